@@ -46,6 +46,8 @@ check_include_file(sys/stat.h HAVE_SYS_STAT_H)
 check_include_file(sys/un.h HAVE_SYS_UN_H)
 check_include_file(sys/poll.h HAVE_SYS_POLL_H)
 check_include_file(sys/select.h HAVE_SYS_SELECT_H)
+check_include_file(sys/eventfd.h HAVE_SYS_EVENTFD_H)
+check_include_file(linux/io_uring.h HAVE_LINUX_IO_URING_H)
 check_include_file(sched.h HAVE_SCHED_H)
 check_include_file(strings.h HAVE_STRINGS_H)
 
@@ -54,6 +56,7 @@ check_function_exists(gethostbyname_r HAVE_GETHOSTBYNAME_R)
 check_function_exists(strerror_r HAVE_STRERROR_R)
 check_function_exists(sched_get_priority_max HAVE_SCHED_GET_PRIORITY_MAX)
 check_function_exists(sched_get_priority_min HAVE_SCHED_GET_PRIORITY_MIN)
+check_function_exists(sched_setaffinity HAVE_SCHED_SETAFFINITY)
 
 include(CheckCSourceCompiles)
 include(CheckCXXSourceCompiles)
@@ -25,6 +25,8 @@
 
 #include <fstream>
 #include <iostream>
+#include <map>
+#include <set>
 #include <sstream>
 #include <string>
 #include <vector>
@@ -42,6 +44,14 @@ using std::vector;
 
 static const string endl = "\n"; // avoid ostream << std::endl flushes
 
+/**
+ * C++03 reads "<::" as "[:", so names starting with "::" need a space in
+ * front of them as the first argument of a template.
+ */
+static string template_arg(const string& name) {
+  return name.compare(0, 2, "::") == 0 ? " " + name : name;
+}
+
 /**
  * C++ code generator. This is legitimacy incarnate.
  *
@@ -64,6 +74,10 @@ public:
     gen_templates_ = false;
     gen_templates_only_ = false;
     gen_moveable_ = false;
+    gen_arena_ = false;
+    gen_tables_ = false;
+    gen_unordered_ = false;
+    gen_hash_ = false;
     for( iter = parsed_options.begin(); iter != parsed_options.end(); ++iter) {
       if( iter->first.compare("pure_enums") == 0) {
         gen_pure_enums_ = true;
@@ -80,6 +94,12 @@ public:
         gen_templates_only_ = (iter->second == "only");
       } else if( iter->first.compare("moveable_types") == 0) {
         gen_moveable_ = true;
+      } else if( iter->first.compare("arena") == 0) {
+        gen_arena_ = true;
+      } else if( iter->first.compare("tables") == 0) {
+        gen_tables_ = true;
+      } else if( iter->first.compare("unordered") == 0) {
+        gen_unordered_ = true;
       } else {
         throw "unknown option cpp:" + iter->first; 
       }
@@ -138,9 +158,19 @@ public:
   void generate_move_assignment_operator(std::ofstream& out, t_struct* tstruct);
   void generate_assignment_helper(std::ofstream& out, t_struct* tstruct, bool is_move);
   void generate_struct_reader(std::ofstream& out, t_struct* tstruct, bool pointers = false);
-  void generate_struct_writer(std::ofstream& out, t_struct* tstruct, bool pointers = false);
-  void generate_struct_result_writer(std::ofstream& out, t_struct* tstruct, bool pointers = false);
+  void generate_struct_writer(std::ofstream& out,
+                              t_struct* tstruct,
+                              bool pointers = false,
+                              bool sizing = false);
+  void generate_struct_result_writer(std::ofstream& out,
+                                     t_struct* tstruct,
+                                     bool pointers = false,
+                                     bool sizing = false);
   void generate_struct_swap(std::ofstream& out, t_struct* tstruct);
+  void generate_struct_hash(std::ofstream& out, t_struct* tstruct);
+  void generate_std_hash_specializations();
+  void generate_struct_spec(std::ofstream& out, t_struct* tstruct);
+  std::string generate_type_spec(std::ofstream& out, t_type* ttype);
   void generate_struct_print_method(std::ofstream& out, t_struct* tstruct);
   void generate_exception_what_method(std::ofstream& out, t_struct* tstruct);
 
@@ -192,20 +222,44 @@ public:
   void generate_serialize_field(std::ofstream& out,
                                 t_field* tfield,
                                 std::string prefix = "",
-                                std::string suffix = "");
+                                std::string suffix = "",
+                                bool sizing = false);
 
   void generate_serialize_struct(std::ofstream& out,
                                  t_struct* tstruct,
                                  std::string prefix = "",
-                                 bool pointer = false);
+                                 bool pointer = false,
+                                 bool sizing = false);
 
-  void generate_serialize_container(std::ofstream& out, t_type* ttype, std::string prefix = "");
+  void generate_serialize_container(std::ofstream& out,
+                                    t_type* ttype,
+                                    std::string prefix = "",
+                                    bool sizing = false);
 
-  void generate_serialize_map_element(std::ofstream& out, t_map* tmap, std::string iter);
+  void generate_serialize_map_element(std::ofstream& out,
+                                      t_map* tmap,
+                                      std::string iter,
+                                      bool sizing = false);
 
-  void generate_serialize_set_element(std::ofstream& out, t_set* tmap, std::string iter);
+  void generate_serialize_set_element(std::ofstream& out,
+                                      t_set* tmap,
+                                      std::string iter,
+                                      bool sizing = false);
 
-  void generate_serialize_list_element(std::ofstream& out, t_list* tlist, std::string iter);
+  void generate_serialize_list_element(std::ofstream& out,
+                                       t_list* tlist,
+                                       std::string iter,
+                                       bool sizing = false);
+
+  /**
+   * Names the protocol method that writes what, or when sizing, the one that
+   * gives the size it would write.
+   */
+  std::string write_method(std::string what, bool sizing) {
+    return (sizing ? "serializedSize" : "write") + what;
+  }
+
+  std::string list_array_type(t_type* ttype);
 
   void generate_function_call(ostream& out,
                               t_function* tfunction,
@@ -250,6 +304,297 @@ public:
 
   bool is_reference(t_field* tfield) { return tfield->get_reference(); }
 
+  /**
+   * Strings and binaries annotated with cpp.view = "true" are held in
+   * TStringViews, which can point into the buffer they were read from.
+   */
+  bool is_view(t_type* ttype) {
+    ttype = get_true_type(ttype);
+    if (!ttype->is_string()) {
+      return false;
+    }
+    std::map<std::string, std::string>::iterator it = ttype->annotations_.find("cpp.view");
+    return it != ttype->annotations_.end() && it->second != "false";
+  }
+
+  /**
+   * With the arena option, strings without a cpp.type or a view are held in
+   * TArenaStrings, and are read and written with the helpers in
+   * TArenaProtocol.h.
+   */
+  bool is_arena_string(t_type* ttype) {
+    ttype = get_true_type(ttype);
+    return gen_arena_ && ttype->is_string() && !is_view(ttype)
+           && ttype->annotations_.find("cpp.type") == ttype->annotations_.end();
+  }
+
+  /**
+   * Struct fields annotated with cpp.lazy = "true" are held in TLazys, which
+   * keep the bytes the struct was read as and decode them when first used.
+   */
+  bool is_lazy(t_field* tfield) {
+    t_type* ttype = get_true_type(tfield->get_type());
+    if (!(ttype->is_struct() || ttype->is_xception()) || is_reference(tfield)) {
+      return false;
+    }
+    std::map<std::string, std::string>::iterator it = tfield->annotations_.find("cpp.lazy");
+    return it != tfield->annotations_.end() && it->second != "false";
+  }
+
+  bool has_lazy_fields(t_program* tprogram) {
+    const vector<t_struct*>& objects = tprogram->get_objects();
+    for (vector<t_struct*>::const_iterator o_iter = objects.begin(); o_iter != objects.end();
+         ++o_iter) {
+      const vector<t_field*>& members = (*o_iter)->get_members();
+      for (vector<t_field*>::const_iterator m_iter = members.begin(); m_iter != members.end();
+           ++m_iter) {
+        if (is_lazy(*m_iter)) {
+          return true;
+        }
+      }
+    }
+    return false;
+  }
+
+  /**
+   * With the tables option, structs whose fields can all be described by a
+   * TStructSpec are read and written by the engine in TStructTable.h.  Views,
+   * arena strings, custom types, references and lazy fields are left to the
+   * generated code, as are structs holding any struct that is.
+   */
+  bool is_table_struct(t_struct* tstruct) { return table_structs_.count(tstruct) != 0; }
+
+  bool is_table_type(t_type* ttype) {
+    ttype = get_true_type(ttype);
+    if (ttype->annotations_.find("cpp.type") != ttype->annotations_.end()) {
+      return false;
+    }
+    if (ttype->is_base_type()) {
+      return ((t_base_type*)ttype)->get_base() != t_base_type::TYPE_VOID && !is_view(ttype)
+             && !is_arena_string(ttype);
+    }
+    if (ttype->is_enum()) {
+      return true;
+    }
+    if (ttype->is_struct() || ttype->is_xception()) {
+      return ttype->get_program() == program_ && is_table_struct((t_struct*)ttype);
+    }
+    if (((t_container*)ttype)->has_cpp_name()) {
+      return false;
+    }
+    if (ttype->is_map()) {
+      return is_table_type(((t_map*)ttype)->get_key_type())
+             && is_table_type(((t_map*)ttype)->get_val_type());
+    }
+    if (ttype->is_set()) {
+      return is_table_type(((t_set*)ttype)->get_elem_type());
+    }
+    return ttype->is_list() && is_table_type(((t_list*)ttype)->get_elem_type());
+  }
+
+  bool is_table_field(t_field* tfield) {
+    return !is_reference(tfield) && !is_lazy(tfield) && is_table_type(tfield->get_type());
+  }
+
+  /**
+   * Starts from every struct in the program and drops those with a field the
+   * tables cannot describe, until no more are dropped.
+   */
+  void find_table_structs() {
+    const vector<t_struct*>& objects = program_->get_objects();
+    table_structs_.insert(objects.begin(), objects.end());
+    bool changed = true;
+    while (changed) {
+      changed = false;
+      for (vector<t_struct*>::const_iterator o_iter = objects.begin(); o_iter != objects.end();
+           ++o_iter) {
+        if (!is_table_struct(*o_iter)) {
+          continue;
+        }
+        const vector<t_field*>& members = (*o_iter)->get_sorted_members();
+        for (size_t i = 0; i < members.size(); ++i) {
+          // required fields are tracked in the bits of a uint64_t
+          if (!is_table_field(members[i])
+              || (members[i]->get_req() == t_field::T_REQUIRED && i >= 64)) {
+            table_structs_.erase(*o_iter);
+            changed = true;
+            break;
+          }
+        }
+      }
+    }
+  }
+
+  /**
+   * Maps and sets are held in boost::unordered_maps and unordered_sets with
+   * the unordered option, or when annotated with cpp.unordered = "true",
+   * as long as their keys can be hashed.  cpp.unordered = "false" keeps a
+   * container ordered under the option, as do keys, which may need ordering.
+   */
+  bool is_unordered(t_type* ttype) {
+    ttype = get_true_type(ttype);
+    if (!(ttype->is_map() || ttype->is_set()) || ((t_container*)ttype)->has_cpp_name()
+        || ordered_keys_.count(ttype) != 0) {
+      return false;
+    }
+    std::map<std::string, std::string>::iterator it = ttype->annotations_.find("cpp.unordered");
+    if (it == ttype->annotations_.end() ? !gen_unordered_ : it->second == "false") {
+      return false;
+    }
+    return is_hashable(ttype->is_map() ? ((t_map*)ttype)->get_key_type()
+                                       : ((t_set*)ttype)->get_elem_type());
+  }
+
+  /**
+   * Values boost::hash can hash: base types, enums, ordered containers of
+   * such values, and structs that are given a hash_value() function.
+   */
+  bool is_hashable(t_type* ttype) {
+    ttype = get_true_type(ttype);
+    if (ttype->annotations_.find("cpp.type") != ttype->annotations_.end()) {
+      return false;
+    }
+    if (ttype->is_base_type()) {
+      return ((t_base_type*)ttype)->get_base() != t_base_type::TYPE_VOID;
+    }
+    if (ttype->is_enum()) {
+      return true;
+    }
+    if (ttype->is_struct() || ttype->is_xception()) {
+      return hashable_structs_.count((t_struct*)ttype) != 0;
+    }
+    if (((t_container*)ttype)->has_cpp_name() || is_unordered(ttype)) {
+      return false;
+    }
+    if (ttype->is_map()) {
+      return is_hashable(((t_map*)ttype)->get_key_type())
+             && is_hashable(((t_map*)ttype)->get_val_type());
+    }
+    if (ttype->is_set()) {
+      return is_hashable(((t_set*)ttype)->get_elem_type());
+    }
+    return is_hashable(((t_list*)ttype)->get_elem_type());
+  }
+
+  void find_ordered_keys(t_type* ttype, bool in_key) {
+    ttype = get_true_type(ttype);
+    if (!ttype->is_container()) {
+      return;
+    }
+    if (in_key) {
+      ordered_keys_.insert(ttype);
+    }
+    if (ttype->is_map()) {
+      find_ordered_keys(((t_map*)ttype)->get_key_type(), true);
+      find_ordered_keys(((t_map*)ttype)->get_val_type(), in_key);
+    } else if (ttype->is_set()) {
+      find_ordered_keys(((t_set*)ttype)->get_elem_type(), true);
+    } else {
+      find_ordered_keys(((t_list*)ttype)->get_elem_type(), in_key);
+    }
+  }
+
+  void find_ordered_keys(t_struct* tstruct) {
+    const vector<t_field*>& members = tstruct->get_members();
+    for (size_t i = 0; i < members.size(); ++i) {
+      find_ordered_keys(members[i]->get_type(), false);
+    }
+  }
+
+  bool has_unordered_annotation(t_type* ttype) {
+    ttype = get_true_type(ttype);
+    if (!ttype->is_container()) {
+      return false;
+    }
+    if (ttype->annotations_.count("cpp.unordered") != 0) {
+      return true;
+    }
+    if (ttype->is_map()) {
+      return has_unordered_annotation(((t_map*)ttype)->get_key_type())
+             || has_unordered_annotation(((t_map*)ttype)->get_val_type());
+    }
+    if (ttype->is_set()) {
+      return has_unordered_annotation(((t_set*)ttype)->get_elem_type());
+    }
+    return has_unordered_annotation(((t_list*)ttype)->get_elem_type());
+  }
+
+  bool has_unordered_annotation(t_struct* tstruct) {
+    const vector<t_field*>& members = tstruct->get_members();
+    for (size_t i = 0; i < members.size(); ++i) {
+      if (has_unordered_annotation(members[i]->get_type())) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /**
+   * Whether hash_value() functions are generated for the program's structs,
+   * which is when it may hold any of them in an unordered container.  Finds
+   * the containers used as keys on the way.
+   */
+  bool find_hash_option() {
+    bool found = gen_unordered_;
+    const vector<t_struct*>& objects = program_->get_objects();
+    for (size_t i = 0; i < objects.size(); ++i) {
+      find_ordered_keys(objects[i]);
+      found = has_unordered_annotation(objects[i]) || found;
+    }
+    const vector<t_typedef*>& typedefs = program_->get_typedefs();
+    for (size_t i = 0; i < typedefs.size(); ++i) {
+      find_ordered_keys(typedefs[i]->get_type(), false);
+      found = has_unordered_annotation(typedefs[i]->get_type()) || found;
+    }
+    const vector<t_const*>& consts = program_->get_consts();
+    for (size_t i = 0; i < consts.size(); ++i) {
+      find_ordered_keys(consts[i]->get_type(), false);
+      found = has_unordered_annotation(consts[i]->get_type()) || found;
+    }
+    const vector<t_service*>& services = program_->get_services();
+    for (size_t i = 0; i < services.size(); ++i) {
+      const vector<t_function*>& functions = services[i]->get_functions();
+      for (size_t j = 0; j < functions.size(); ++j) {
+        find_ordered_keys(functions[j]->get_returntype(), false);
+        find_ordered_keys(functions[j]->get_arglist());
+        found = has_unordered_annotation(functions[j]->get_returntype())
+                || has_unordered_annotation(functions[j]->get_arglist()) || found;
+      }
+    }
+    return found;
+  }
+
+  /**
+   * Structs can be hashed when they have an operator== and all of their
+   * fields can be hashed, references and lazy fields aside.
+   */
+  void find_hashable_structs() {
+    if (gen_no_default_operators_) {
+      return;
+    }
+    const vector<t_struct*>& objects = program_->get_objects();
+    hashable_structs_.insert(objects.begin(), objects.end());
+    bool changed = true;
+    while (changed) {
+      changed = false;
+      for (vector<t_struct*>::const_iterator o_iter = objects.begin(); o_iter != objects.end();
+           ++o_iter) {
+        if (hashable_structs_.count(*o_iter) == 0) {
+          continue;
+        }
+        const vector<t_field*>& members = (*o_iter)->get_members();
+        for (size_t i = 0; i < members.size(); ++i) {
+          if (is_reference(members[i]) || is_lazy(members[i])
+              || !is_hashable(members[i]->get_type())) {
+            hashable_structs_.erase(*o_iter);
+            changed = true;
+            break;
+          }
+        }
+      }
+    }
+  }
+
   bool is_complex_type(t_type* ttype) {
     ttype = get_true_type(ttype);
 
@@ -288,6 +633,40 @@ private:
    */
   bool gen_moveable_;
 
+  /**
+   * True if strings and containers should allocate from the current TArena.
+   */
+  bool gen_arena_;
+
+  /**
+   * True if structs should be read and written from tables of their fields.
+   */
+  bool gen_tables_;
+
+  /**
+   * The structs read and written from tables, and the names of the
+   * TTypeSpecs generated so far, by what they describe.
+   */
+  std::set<t_struct*> table_structs_;
+  std::map<std::string, std::string> type_specs_;
+
+  /**
+   * True if maps and sets should be unordered where their keys can be hashed.
+   */
+  bool gen_unordered_;
+
+  /**
+   * True if the program's structs get hash_value() functions, and the
+   * structs that can be hashed.
+   */
+  bool gen_hash_;
+  std::set<t_struct*> hashable_structs_;
+
+  /**
+   * Containers used as keys of maps and sets, which are kept ordered.
+   */
+  std::set<t_type*> ordered_keys_;
+
   /**
    * True iff we should use a path prefix in our #include statements for other
    * thrift-generated header files.
@@ -379,6 +758,26 @@ void t_cpp_generator::init_generator() {
            << "#include <thrift/protocol/TProtocol.h>" << endl
            << "#include <thrift/transport/TTransport.h>" << endl
            << endl;
+  if (gen_arena_) {
+    f_types_ << "#include <thrift/protocol/TArenaProtocol.h>" << endl << endl;
+  }
+  if (has_lazy_fields(program_)) {
+    f_types_ << "#include <thrift/protocol/TLazy.h>" << endl << endl;
+  }
+  gen_hash_ = find_hash_option();
+  if (gen_hash_) {
+    find_hashable_structs();
+    f_types_ << "#include <boost/functional/hash.hpp>" << endl
+             << "#include <boost/unordered_map.hpp>" << endl
+             << "#include <boost/unordered_set.hpp>" << endl << endl;
+  }
+  if (gen_tables_) {
+    find_table_structs();
+  }
+  if (!table_structs_.empty()) {
+    f_types_ << "#include <thrift/protocol/TStructTable.h>" << endl << endl;
+  }
+
   // Include C++xx compatibility header
   f_types_ << "#include <thrift/cxxfunctional.h>" << endl;
 
@@ -417,6 +816,10 @@ void t_cpp_generator::init_generator() {
   // for operator<<
   f_types_impl_ << "#include <ostream>" << endl << endl;
   f_types_impl_ << "#include <thrift/TToString.h>" << endl << endl;
+  if (!table_structs_.empty()) {
+    // the field tables take offsetof() the generated classes
+    f_types_impl_ << "#include <cstddef>" << endl << endl;
+  }
 
   // Open namespace
   ns_open_ = namespace_open(program_->get_namespace("cpp"));
@@ -438,6 +841,10 @@ void t_cpp_generator::close_generator() {
   f_types_impl_ << ns_close_ << endl;
   f_types_tcc_ << ns_close_ << endl << endl;
 
+  if (gen_hash_) {
+    generate_std_hash_specializations();
+  }
+
   // Include the types.tcc file from the types header file,
   // so clients don't have to explicitly include the tcc file.
   // TODO(simpkins): Make this a separate option.
@@ -738,11 +1145,20 @@ void t_cpp_generator::generate_forward_declaration(t_struct* tstruct) {
 void t_cpp_generator::generate_cpp_struct(t_struct* tstruct, bool is_exception) {
   generate_struct_declaration(f_types_, tstruct, is_exception, false, true, true, true, true);
   generate_struct_definition(f_types_impl_, f_types_impl_, tstruct);
+  if (is_table_struct(tstruct)) {
+    f_types_ << indent() << "extern const ::apache::thrift::protocol::TStructSpec _"
+             << tstruct->get_name() << "__spec;" << endl << endl;
+    generate_struct_spec(f_types_impl_, tstruct);
+  }
 
   std::ofstream& out = (gen_templates_ ? f_types_tcc_ : f_types_impl_);
   generate_struct_reader(out, tstruct);
   generate_struct_writer(out, tstruct);
+  generate_struct_writer(out, tstruct, false, true);
   generate_struct_swap(f_types_impl_, tstruct);
+  if (hashable_structs_.count(tstruct) != 0) {
+    generate_struct_hash(f_types_impl_, tstruct);
+  }
   generate_copy_constructor(f_types_impl_, tstruct, is_exception);
   if (gen_moveable_) {
     generate_move_constructor(f_types_impl_, tstruct, is_exception);
@@ -810,6 +1226,13 @@ void t_cpp_generator::generate_constructor_helper(ofstream& out,
   for (f_iter = members.begin(); f_iter != members.end(); ++f_iter) {
     if ((*f_iter)->get_req() != t_field::T_REQUIRED)
       has_nonrequired_fields = true;
+    if (gen_arena_ && !is_move && is_unordered((*f_iter)->get_type())) {
+      // before C++11 boost's unordered containers copy their elements
+      // along with the arena they were allocated from
+      indent(out) << "::apache::thrift::arenaAssign(" << (*f_iter)->get_name() << ", "
+                  << tmp_name << "." << (*f_iter)->get_name() << ");" << endl;
+      continue;
+    }
     indent(out) << (*f_iter)->get_name() << " = "
                 << maybeMove(tmp_name + "." + (*f_iter)->get_name(), is_move) << ";" << endl;
   }
@@ -855,6 +1278,13 @@ void t_cpp_generator::generate_assignment_helper(ofstream& out, t_struct* tstruc
   for (f_iter = members.begin(); f_iter != members.end(); ++f_iter) {
     if ((*f_iter)->get_req() != t_field::T_REQUIRED)
       has_nonrequired_fields = true;
+    if (gen_arena_ && !is_move && is_unordered((*f_iter)->get_type())) {
+      // before C++11 boost's unordered containers copy their elements
+      // along with the arena they were allocated from
+      indent(out) << "::apache::thrift::arenaAssign(" << (*f_iter)->get_name() << ", "
+                  << tmp_name << "." << (*f_iter)->get_name() << ");" << endl;
+      continue;
+    }
     indent(out) << (*f_iter)->get_name() << " = "
                 << maybeMove(tmp_name + "." + (*f_iter)->get_name(), is_move) << ";" << endl;
   }
@@ -926,9 +1356,11 @@ void t_cpp_generator::generate_struct_declaration(ofstream& out,
     }
     out << " {}" << endl;
 
+    // the field tables need the address of each flag
+    string width = is_table_struct(tstruct) ? ";" : " :1;";
     for (m_iter = members.begin(); m_iter != members.end(); ++m_iter) {
       if ((*m_iter)->get_req() != t_field::T_REQUIRED) {
-        indent(out) << "bool " << (*m_iter)->get_name() << " :1;" << endl;
+        indent(out) << "bool " << (*m_iter)->get_name() << width << endl;
       }
     }
 
@@ -1087,9 +1519,13 @@ void t_cpp_generator::generate_struct_declaration(ofstream& out,
     if (gen_templates_) {
       out << indent() << "template <class Protocol_>" << endl << indent()
           << "uint32_t write(Protocol_* oprot) const;" << endl;
+      out << indent() << "template <class Protocol_>" << endl << indent()
+          << "uint32_t serializedSize(Protocol_* oprot) const;" << endl;
     } else {
       out << indent() << "uint32_t write("
           << "::apache::thrift::protocol::TProtocol* oprot) const;" << endl;
+      out << indent() << "uint32_t serializedSize("
+          << "::apache::thrift::protocol::TProtocol* oprot) const;" << endl;
     }
   }
   out << endl;
@@ -1117,6 +1553,12 @@ void t_cpp_generator::generate_struct_declaration(ofstream& out,
         << " &b);" << endl << endl;
   }
 
+  if (is_user_struct && hashable_structs_.count(tstruct) != 0) {
+    // Generate a namespace-scope hash_value() function for boost::hash
+    out << indent() << "std::size_t hash_value(const " << tstruct->get_name() << "& obj);" << endl
+        << endl;
+  }
+
   if (is_user_struct) {
     generate_struct_ostream_operator(out, tstruct);
   }
@@ -1186,6 +1628,14 @@ void t_cpp_generator::generate_struct_reader(ofstream& out, t_struct* tstruct, b
   }
   indent_up();
 
+  if (!pointers && is_table_struct(tstruct)) {
+    indent(out) << "return ::apache::thrift::protocol::readStruct(*iprot, _" << tstruct->get_name()
+                << "__spec, this);" << endl;
+    indent_down();
+    indent(out) << "}" << endl << endl;
+    return;
+  }
+
   const vector<t_field*>& fields = tstruct->get_members();
   vector<t_field*>::const_iterator f_iter;
 
@@ -1294,29 +1744,43 @@ void t_cpp_generator::generate_struct_reader(ofstream& out, t_struct* tstruct, b
 }
 
 /**
- * Generates the write function.
+ * Generates the write function, or with sizing, the serializedSize function
+ * that adds up what it writes.
  *
  * @param out Stream to write to
  * @param tstruct The struct
  */
-void t_cpp_generator::generate_struct_writer(ofstream& out, t_struct* tstruct, bool pointers) {
+void t_cpp_generator::generate_struct_writer(ofstream& out,
+                                             t_struct* tstruct,
+                                             bool pointers,
+                                             bool sizing) {
   string name = tstruct->get_name();
   const vector<t_field*>& fields = tstruct->get_sorted_members();
   vector<t_field*>::const_iterator f_iter;
+  string method = write_method("", sizing);
 
   if (gen_templates_) {
     out << indent() << "template <class Protocol_>" << endl << indent() << "uint32_t "
-        << tstruct->get_name() << "::write(Protocol_* oprot) const {" << endl;
+        << tstruct->get_name() << "::" << method << "(Protocol_* oprot) const {" << endl;
   } else {
-    indent(out) << "uint32_t " << tstruct->get_name()
-                << "::write(::apache::thrift::protocol::TProtocol* oprot) const {" << endl;
+    indent(out) << "uint32_t " << tstruct->get_name() << "::" << method
+                << "(::apache::thrift::protocol::TProtocol* oprot) const {" << endl;
   }
   indent_up();
 
+  if (!pointers && is_table_struct(tstruct)) {
+    indent(out) << "return ::apache::thrift::protocol::" << write_method("Struct", sizing)
+                << "(*oprot, _" << name << "__spec, this);" << endl;
+    indent_down();
+    indent(out) << "}" << endl << endl;
+    return;
+  }
+
   out << indent() << "uint32_t xfer = 0;" << endl;
 
   indent(out) << "apache::thrift::protocol::TOutputRecursionTracker tracker(*oprot);" << endl;
-  indent(out) << "xfer += oprot->writeStructBegin(\"" << name << "\");" << endl;
+  indent(out) << "xfer += oprot->" << write_method("StructBegin", sizing) << "(\"" << name
+              << "\");" << endl;
 
   for (f_iter = fields.begin(); f_iter != fields.end(); ++f_iter) {
     bool check_if_set = (*f_iter)->get_req() == t_field::T_OPTIONAL
@@ -1329,17 +1793,19 @@ void t_cpp_generator::generate_struct_writer(ofstream& out, t_struct* tstruct, b
     }
 
     // Write field header
-    out << indent() << "xfer += oprot->writeFieldBegin("
+    out << indent() << "xfer += oprot->" << write_method("FieldBegin", sizing) << "("
         << "\"" << (*f_iter)->get_name() << "\", " << type_to_enum((*f_iter)->get_type()) << ", "
         << (*f_iter)->get_key() << ");" << endl;
     // Write field contents
     if (pointers && !(*f_iter)->get_type()->is_xception()) {
-      generate_serialize_field(out, *f_iter, "(*(this->", "))");
+      generate_serialize_field(out, *f_iter, "(*(this->", "))", sizing);
     } else {
-      generate_serialize_field(out, *f_iter, "this->");
+      generate_serialize_field(out, *f_iter, "this->", "", sizing);
     }
     // Write field closer
-    indent(out) << "xfer += oprot->writeFieldEnd();" << endl;
+    if (!sizing) {
+      indent(out) << "xfer += oprot->writeFieldEnd();" << endl;
+    }
     if (check_if_set) {
       indent_down();
       indent(out) << '}';
@@ -1349,9 +1815,9 @@ void t_cpp_generator::generate_struct_writer(ofstream& out, t_struct* tstruct, b
   out << endl;
 
   // Write the struct map
-  out << indent() << "xfer += oprot->writeFieldStop();" << endl << indent()
-      << "xfer += oprot->writeStructEnd();" << endl << indent()
-      << "return xfer;" << endl;
+  out << indent() << "xfer += oprot->" << write_method("FieldStop", sizing) << "();" << endl
+      << indent() << "xfer += oprot->" << write_method("StructEnd", sizing) << "();" << endl
+      << indent() << "return xfer;" << endl;
 
   indent_down();
   indent(out) << "}" << endl << endl;
@@ -1367,23 +1833,26 @@ void t_cpp_generator::generate_struct_writer(ofstream& out, t_struct* tstruct, b
  */
 void t_cpp_generator::generate_struct_result_writer(ofstream& out,
                                                     t_struct* tstruct,
-                                                    bool pointers) {
+                                                    bool pointers,
+                                                    bool sizing) {
   string name = tstruct->get_name();
   const vector<t_field*>& fields = tstruct->get_sorted_members();
   vector<t_field*>::const_iterator f_iter;
+  string method = write_method("", sizing);
 
   if (gen_templates_) {
     out << indent() << "template <class Protocol_>" << endl << indent() << "uint32_t "
-        << tstruct->get_name() << "::write(Protocol_* oprot) const {" << endl;
+        << tstruct->get_name() << "::" << method << "(Protocol_* oprot) const {" << endl;
   } else {
-    indent(out) << "uint32_t " << tstruct->get_name()
-                << "::write(::apache::thrift::protocol::TProtocol* oprot) const {" << endl;
+    indent(out) << "uint32_t " << tstruct->get_name() << "::" << method
+                << "(::apache::thrift::protocol::TProtocol* oprot) const {" << endl;
   }
   indent_up();
 
   out << endl << indent() << "uint32_t xfer = 0;" << endl << endl;
 
-  indent(out) << "xfer += oprot->writeStructBegin(\"" << name << "\");" << endl;
+  indent(out) << "xfer += oprot->" << write_method("StructBegin", sizing) << "(\"" << name
+              << "\");" << endl;
 
   bool first = true;
   for (f_iter = fields.begin(); f_iter != fields.end(); ++f_iter) {
@@ -1399,30 +1868,153 @@ void t_cpp_generator::generate_struct_result_writer(ofstream& out,
     indent_up();
 
     // Write field header
-    out << indent() << "xfer += oprot->writeFieldBegin("
+    out << indent() << "xfer += oprot->" << write_method("FieldBegin", sizing) << "("
         << "\"" << (*f_iter)->get_name() << "\", " << type_to_enum((*f_iter)->get_type()) << ", "
         << (*f_iter)->get_key() << ");" << endl;
     // Write field contents
     if (pointers) {
-      generate_serialize_field(out, *f_iter, "(*(this->", "))");
+      generate_serialize_field(out, *f_iter, "(*(this->", "))", sizing);
     } else {
-      generate_serialize_field(out, *f_iter, "this->");
+      generate_serialize_field(out, *f_iter, "this->", "", sizing);
     }
     // Write field closer
-    indent(out) << "xfer += oprot->writeFieldEnd();" << endl;
+    if (!sizing) {
+      indent(out) << "xfer += oprot->writeFieldEnd();" << endl;
+    }
 
     indent_down();
     indent(out) << "}";
   }
 
   // Write the struct map
-  out << endl << indent() << "xfer += oprot->writeFieldStop();" << endl << indent()
-      << "xfer += oprot->writeStructEnd();" << endl << indent() << "return xfer;" << endl;
+  out << endl << indent() << "xfer += oprot->" << write_method("FieldStop", sizing) << "();"
+      << endl << indent() << "xfer += oprot->" << write_method("StructEnd", sizing) << "();"
+      << endl << indent() << "return xfer;" << endl;
 
   indent_down();
   indent(out) << "}" << endl << endl;
 }
 
+/**
+ * Generates the TStructSpec that the struct is read and written from, after
+ * the TTypeSpecs of its fields.
+ *
+ * @param out Stream to write to
+ * @param tstruct The struct
+ */
+void t_cpp_generator::generate_struct_spec(ofstream& out, t_struct* tstruct) {
+  string name = tstruct->get_name();
+  const vector<t_field*>& fields = tstruct->get_sorted_members();
+
+  vector<string> type_specs;
+  for (size_t i = 0; i < fields.size(); ++i) {
+    type_specs.push_back(generate_type_spec(out, fields[i]->get_type()));
+  }
+
+  uint64_t required_mask = 0;
+  string fields_name = "NULL";
+  if (!fields.empty()) {
+    fields_name = "_" + name + "__fields";
+    // offsetof() is supported for the class's own members despite its
+    // virtual base, so the warning is silenced for the table only
+    out << "#if defined(__GNUC__)" << endl
+        << "#pragma GCC diagnostic push" << endl
+        << "#pragma GCC diagnostic ignored \"-Winvalid-offsetof\"" << endl
+        << "#endif" << endl;
+    indent(out) << "static const ::apache::thrift::protocol::TFieldSpec " << fields_name << "[] = {"
+                << endl;
+    indent_up();
+    for (size_t i = 0; i < fields.size(); ++i) {
+      t_field* tfield = fields[i];
+      string mode = "T_FIELD_DEFAULT";
+      string isset = "::apache::thrift::protocol::TFieldSpec::NO_ISSET";
+      if (tfield->get_req() == t_field::T_REQUIRED) {
+        mode = "T_FIELD_REQUIRED";
+        required_mask |= static_cast<uint64_t>(1) << i;
+      } else {
+        if (tfield->get_req() == t_field::T_OPTIONAL || tfield->get_type()->is_xception()) {
+          mode = "T_FIELD_OPTIONAL";
+        }
+        isset = "offsetof(" + name + ", __isset) + offsetof(_" + name + "__isset, "
+                + tfield->get_name() + ")";
+      }
+      indent(out) << "{" << tfield->get_key() << ", ::apache::thrift::protocol::" << mode << ", \""
+                  << tfield->get_name() << "\", offsetof(" << name << ", " << tfield->get_name()
+                  << "), " << isset << ", &" << type_specs[i] << "}," << endl;
+    }
+    indent_down();
+    indent(out) << "};" << endl;
+    out << "#if defined(__GNUC__)" << endl
+        << "#pragma GCC diagnostic pop" << endl
+        << "#endif" << endl << endl;
+  }
+
+  std::ostringstream mask;
+  mask << "0x" << std::hex << required_mask << "ULL";
+  indent(out) << "const ::apache::thrift::protocol::TStructSpec _" << name << "__spec = {\""
+              << name << "\", " << fields_name << ", " << fields.size() << ", " << mask.str()
+              << "};" << endl << endl;
+}
+
+/**
+ * Generates the TTypeSpec of a type, after those of its elements, unless
+ * one has been generated already.
+ *
+ * @param out Stream to write to
+ * @param ttype The type
+ * @return The name of the TTypeSpec
+ */
+string t_cpp_generator::generate_type_spec(ofstream& out, t_type* ttype) {
+  ttype = get_true_type(ttype);
+
+  string key_spec = "NULL";
+  string value_spec = "NULL";
+  string container = "NULL";
+  string struct_spec = "NULL";
+  string binary = "false";
+  string enum_size = "0";
+  string described;
+  if (ttype->is_map()) {
+    key_spec = "&" + generate_type_spec(out, ((t_map*)ttype)->get_key_type());
+    value_spec = "&" + generate_type_spec(out, ((t_map*)ttype)->get_val_type());
+    container = "&::apache::thrift::protocol::TMapOps<" + template_arg(type_name(ttype)) + ">::ops";
+    described = container + key_spec + value_spec;
+  } else if (ttype->is_set()) {
+    key_spec = "&" + generate_type_spec(out, ((t_set*)ttype)->get_elem_type());
+    container = "&::apache::thrift::protocol::TSetOps<" + template_arg(type_name(ttype)) + ">::ops";
+    described = container + key_spec;
+  } else if (ttype->is_list()) {
+    key_spec = "&" + generate_type_spec(out, ((t_list*)ttype)->get_elem_type());
+    container
+        = "&::apache::thrift::protocol::TListOps<" + template_arg(type_name(ttype)) + ">::ops";
+    described = container + key_spec;
+  } else if (ttype->is_struct() || ttype->is_xception()) {
+    struct_spec = "&_" + ttype->get_name() + "__spec";
+    described = struct_spec;
+  } else if (ttype->is_enum()) {
+    enum_size = "sizeof(" + type_name(ttype) + ")";
+    described = enum_size;
+  } else {
+    if (((t_base_type*)ttype)->is_binary()) {
+      binary = "true";
+    }
+    described = type_to_enum(ttype) + binary;
+  }
+
+  std::map<string, string>::iterator it = type_specs_.find(described);
+  if (it != type_specs_.end()) {
+    return it->second;
+  }
+
+  string spec = tmp("_type_spec");
+  type_specs_[described] = spec;
+  indent(out) << "static const ::apache::thrift::protocol::TTypeSpec " << spec << " = {"
+              << type_to_enum(ttype) << ", " << binary << ", " << enum_size << ", " << key_spec
+              << ", " << value_spec << ", " << container << ", " << struct_spec << "};" << endl
+              << endl;
+  return spec;
+}
+
 /**
  * Generates the swap function.
  *
@@ -1466,6 +2058,65 @@ void t_cpp_generator::generate_struct_swap(ofstream& out, t_struct* tstruct) {
   out << endl;
 }
 
+/**
+ * Generates a hash_value() function that agrees with operator==, which only
+ * compares optional fields that are set.
+ */
+void t_cpp_generator::generate_struct_hash(ofstream& out, t_struct* tstruct) {
+  const vector<t_field*>& fields = tstruct->get_members();
+  out << indent() << "std::size_t hash_value(const " << tstruct->get_name() << "& "
+      << (fields.empty() ? "/* obj */" : "obj") << ") {" << endl;
+  indent_up();
+
+  out << indent() << "std::size_t seed = 0;" << endl;
+  for (vector<t_field*>::const_iterator f_iter = fields.begin(); f_iter != fields.end(); ++f_iter) {
+    string name = (*f_iter)->get_name();
+    if ((*f_iter)->get_req() != t_field::T_OPTIONAL) {
+      out << indent() << "boost::hash_combine(seed, obj." << name << ");" << endl;
+    } else {
+      out << indent() << "boost::hash_combine(seed, static_cast<bool>(obj.__isset." << name
+          << "));" << endl << indent() << "if (obj.__isset." << name << ") {" << endl << indent()
+          << "  boost::hash_combine(seed, obj." << name << ");" << endl << indent() << "}" << endl;
+    }
+  }
+  out << indent() << "return seed;" << endl;
+
+  scope_down(out);
+  out << endl;
+}
+
+/**
+ * Specializes std::hash for the program's enums and hashable structs, for
+ * code built as C++11 that keys std::unordered_maps with them.
+ */
+void t_cpp_generator::generate_std_hash_specializations() {
+  string ns = namespace_prefix(program_->get_namespace("cpp"));
+  f_types_ << "#if __cplusplus >= 201103L" << endl << "namespace std {" << endl << endl;
+
+  const vector<t_enum*>& enums = program_->get_enums();
+  for (vector<t_enum*>::const_iterator e_iter = enums.begin(); e_iter != enums.end(); ++e_iter) {
+    string name = ns + (*e_iter)->get_name() + (gen_pure_enums_ ? "" : "::type");
+    f_types_ << "template <>" << endl << "struct hash<" << name << "> {" << endl
+             << "  size_t operator()(" << name << " value) const {" << endl
+             << "    return static_cast<size_t>(value);" << endl << "  }" << endl << "};" << endl
+             << endl;
+  }
+
+  const vector<t_struct*>& objects = program_->get_objects();
+  for (vector<t_struct*>::const_iterator o_iter = objects.begin(); o_iter != objects.end();
+       ++o_iter) {
+    if (hashable_structs_.count(*o_iter) == 0) {
+      continue;
+    }
+    string name = ns + (*o_iter)->get_name();
+    f_types_ << "template <>" << endl << "struct hash<" << name << "> {" << endl
+             << "  size_t operator()(const " << name << "& value) const {" << endl
+             << "    return hash_value(value);" << endl << "  }" << endl << "};" << endl << endl;
+  }
+
+  f_types_ << "} // namespace std" << endl << "#endif" << endl << endl;
+}
+
 void t_cpp_generator::generate_struct_ostream_operator(std::ofstream& out, t_struct* tstruct) {
   out << "inline std::ostream& operator<<(std::ostream& out, const "
       << tstruct->get_name()
@@ -1734,10 +2385,12 @@ void t_cpp_generator::generate_service_helpers(t_service* tservice) {
     generate_struct_definition(out, f_service_, ts, false);
     generate_struct_reader(out, ts);
     generate_struct_writer(out, ts);
+    generate_struct_writer(out, ts, false, true);
     ts->set_name(tservice->get_name() + "_" + (*f_iter)->get_name() + "_pargs");
     generate_struct_declaration(f_header_, ts, false, true, false, true);
     generate_struct_definition(out, f_service_, ts, false);
     generate_struct_writer(out, ts, true);
+    generate_struct_writer(out, ts, true, true);
     ts->set_name(name_orig);
 
     generate_function_helpers(tservice, *f_iter);
@@ -2688,7 +3341,8 @@ public:
   void run() {
     generate_class_definition();
 
-    // Generate the dispatchCall() function
+    // Generate the findMethod() and dispatchCall() functions
+    generate_find_method();
     generate_dispatch_call(false);
     if (generator_->gen_templates_) {
       generate_dispatch_call(true);
@@ -2701,6 +3355,10 @@ public:
   }
 
   void generate_class_definition();
+  void generate_find_method();
+  void generate_name_switch(const vector<t_function*>& functions,
+                            const vector<size_t>& indexes,
+                            size_t length);
   void generate_dispatch_call(bool template_protocol);
   void generate_process_functions();
   void generate_factory();
@@ -2832,30 +3490,6 @@ void ProcessorGenerator::generate_class_definition() {
   f_header_ << " private:" << endl;
   indent_up();
 
-  // Declare processMap_
-  f_header_ << indent() << "typedef  void (" << class_name_ << "::*"
-            << "ProcessFunction)(" << finish_cob_decl_ << "int32_t, "
-            << "::apache::thrift::protocol::TProtocol*, "
-            << "::apache::thrift::protocol::TProtocol*" << call_context_decl_ << ");" << endl;
-  if (generator_->gen_templates_) {
-    f_header_ << indent() << "typedef void (" << class_name_ << "::*"
-              << "SpecializedProcessFunction)(" << finish_cob_decl_ << "int32_t, "
-              << "Protocol_*, Protocol_*" << call_context_decl_ << ");" << endl << indent()
-              << "struct ProcessFunctions {" << endl << indent() << "  ProcessFunction generic;"
-              << endl << indent() << "  SpecializedProcessFunction specialized;" << endl << indent()
-              << "  ProcessFunctions(ProcessFunction g, "
-              << "SpecializedProcessFunction s) :" << endl << indent() << "    generic(g)," << endl
-              << indent() << "    specialized(s) {}" << endl << indent()
-              << "  ProcessFunctions() : generic(NULL), specialized(NULL) "
-              << "{}" << endl << indent() << "};" << endl << indent()
-              << "typedef std::map<std::string, ProcessFunctions> "
-              << "ProcessMap;" << endl;
-  } else {
-    f_header_ << indent() << "typedef std::map<std::string, ProcessFunction> "
-              << "ProcessMap;" << endl;
-  }
-  f_header_ << indent() << "ProcessMap processMap_;" << endl;
-
   for (f_iter = functions.begin(); f_iter != functions.end(); ++f_iter) {
     indent(f_header_) << "void process_" << (*f_iter)->get_name() << "(" << finish_cob_
                       << "int32_t seqid, ::apache::thrift::protocol::TProtocol* iprot, "
@@ -2899,29 +3533,11 @@ void ProcessorGenerator::generate_class_definition() {
   if (!extends_.empty()) {
     f_header_ << indent() << "  " << extends_ << "(iface)," << endl;
   }
-  f_header_ << indent() << "  iface_(iface) {" << endl;
-  indent_up();
-
-  for (f_iter = functions.begin(); f_iter != functions.end(); ++f_iter) {
-    f_header_ << indent() << "processMap_[\"" << (*f_iter)->get_name() << "\"] = ";
-    if (generator_->gen_templates_) {
-      f_header_ << "ProcessFunctions(" << endl;
-      if (generator_->gen_templates_only_) {
-        indent(f_header_) << "  NULL," << endl;
-      } else {
-        indent(f_header_) << "  &" << class_name_ << "::process_" << (*f_iter)->get_name() << ","
-                          << endl;
-      }
-      indent(f_header_) << "  &" << class_name_ << "::process_" << (*f_iter)->get_name() << ")";
-    } else {
-      f_header_ << "&" << class_name_ << "::process_" << (*f_iter)->get_name();
-    }
-    f_header_ << ";" << endl;
-  }
-
-  indent_down();
-  f_header_ << indent() << "}" << endl << endl << indent() << "virtual ~" << class_name_ << "() {}"
-            << endl;
+  f_header_ << indent() << "  iface_(iface) {}" << endl << endl;
+  f_header_ << indent() << "virtual ~" << class_name_ << "() {}" << endl << endl;
+  f_header_ << indent()
+            << "// Returns the position of the method called fname in the service, or -1" << endl;
+  f_header_ << indent() << "static int32_t findMethod(const std::string& fname);" << endl;
   indent_down();
   f_header_ << "};" << endl << endl;
 
@@ -2940,6 +3556,75 @@ void ProcessorGenerator::generate_class_definition() {
   }
 }
 
+void ProcessorGenerator::generate_find_method() {
+  vector<t_function*> functions = service_->get_functions();
+
+  f_out_ << template_header_ << "int32_t " << class_name_ << template_suffix_
+         << "::findMethod(const std::string& " << (functions.empty() ? "/* fname */" : "fname")
+         << ") {" << endl;
+  indent_up();
+
+  // Names are told apart by their length and then by as few of their
+  // characters as needed, so only the one name that can match is compared.
+  std::map<size_t, vector<size_t> > lengths;
+  for (size_t i = 0; i < functions.size(); ++i) {
+    lengths[functions[i]->get_name().size()].push_back(i);
+  }
+  if (!lengths.empty()) {
+    f_out_ << indent() << "switch (fname.size()) {" << endl;
+    std::map<size_t, vector<size_t> >::const_iterator l_iter;
+    for (l_iter = lengths.begin(); l_iter != lengths.end(); ++l_iter) {
+      f_out_ << indent() << "case " << l_iter->first << ":" << endl;
+      indent_up();
+      generate_name_switch(functions, l_iter->second, l_iter->first);
+      indent_down();
+    }
+    f_out_ << indent() << "}" << endl;
+  }
+  f_out_ << indent() << "return -1;" << endl;
+
+  indent_down();
+  f_out_ << "}" << endl << endl;
+}
+
+void ProcessorGenerator::generate_name_switch(const vector<t_function*>& functions,
+                                              const vector<size_t>& indexes,
+                                              size_t length) {
+  if (indexes.size() == 1) {
+    f_out_ << indent() << "return fname == \"" << functions[indexes[0]]->get_name() << "\" ? "
+           << indexes[0] << " : -1;" << endl;
+    return;
+  }
+
+  // switch on the character that splits the names into the most groups
+  size_t best = 0;
+  size_t bestGroups = 0;
+  for (size_t pos = 0; pos < length; ++pos) {
+    std::set<char> chars;
+    for (size_t i = 0; i < indexes.size(); ++i) {
+      chars.insert(functions[indexes[i]]->get_name()[pos]);
+    }
+    if (chars.size() > bestGroups) {
+      best = pos;
+      bestGroups = chars.size();
+    }
+  }
+
+  std::map<char, vector<size_t> > groups;
+  for (size_t i = 0; i < indexes.size(); ++i) {
+    groups[functions[indexes[i]]->get_name()[best]].push_back(indexes[i]);
+  }
+  f_out_ << indent() << "switch (fname[" << best << "]) {" << endl;
+  std::map<char, vector<size_t> >::const_iterator g_iter;
+  for (g_iter = groups.begin(); g_iter != groups.end(); ++g_iter) {
+    f_out_ << indent() << "case '" << g_iter->first << "':" << endl;
+    indent_up();
+    generate_name_switch(functions, g_iter->second, length);
+    indent_down();
+  }
+  f_out_ << indent() << "}" << endl << indent() << "return -1;" << endl;
+}
+
 void ProcessorGenerator::generate_dispatch_call(bool template_protocol) {
   string protocol = "::apache::thrift::protocol::TProtocol";
   string function_suffix;
@@ -2961,49 +3646,38 @@ void ProcessorGenerator::generate_dispatch_call(bool template_protocol) {
          << "const std::string& fname, int32_t seqid" << call_context_ << ") {" << endl;
   indent_up();
 
-  // HOT: member function pointer map
-  f_out_ << indent() << typename_str_ << "ProcessMap::iterator pfn;" << endl << indent()
-         << "pfn = processMap_.find(fname);" << endl << indent()
-         << "if (pfn == processMap_.end()) {" << endl;
-  if (extends_.empty()) {
-    f_out_ << indent() << "  iprot->skip(::apache::thrift::protocol::T_STRUCT);" << endl << indent()
-           << "  iprot->readMessageEnd();" << endl << indent()
-           << "  iprot->getTransport()->readEnd();" << endl << indent()
-           << "  ::apache::thrift::TApplicationException "
-              "x(::apache::thrift::TApplicationException::UNKNOWN_METHOD, \"Invalid method name: "
-              "'\"+fname+\"'\");" << endl << indent()
-           << "  oprot->writeMessageBegin(fname, ::apache::thrift::protocol::T_EXCEPTION, seqid);"
-           << endl << indent() << "  x.write(oprot);" << endl << indent()
-           << "  oprot->writeMessageEnd();" << endl << indent()
-           << "  oprot->getTransport()->writeEnd();" << endl << indent()
-           << "  oprot->getTransport()->flush();" << endl << indent()
-           << (style_ == "Cob" ? "  return cob(true);" : "  return true;") << endl;
-  } else {
-    f_out_ << indent() << "  return " << extends_ << "::dispatchCall("
-           << (style_ == "Cob" ? "cob, " : "") << "iprot, oprot, fname, seqid" << call_context_arg_
-           << ");" << endl;
-  }
-  f_out_ << indent() << "}" << endl;
-  if (template_protocol) {
-    f_out_ << indent() << "(this->*(pfn->second.specialized))";
-  } else {
-    if (generator_->gen_templates_only_) {
-      // TODO: This is a null pointer, so nothing good will come from calling
-      // it.  Throw an exception instead.
-      f_out_ << indent() << "(this->*(pfn->second.generic))";
-    } else if (generator_->gen_templates_) {
-      f_out_ << indent() << "(this->*(pfn->second.generic))";
-    } else {
-      f_out_ << indent() << "(this->*(pfn->second))";
+  // HOT: the method is found by a switch on its name, with no map lookup
+  vector<t_function*> functions = service_->get_functions();
+  if (!functions.empty()) {
+    f_out_ << indent() << "switch (findMethod(fname)) {" << endl;
+    for (size_t i = 0; i < functions.size(); ++i) {
+      f_out_ << indent() << "case " << i << ":" << endl << indent() << "  process_"
+             << functions[i]->get_name() << "(" << cob_arg_ << "seqid, iprot, oprot"
+             << call_context_arg_ << ");" << endl << indent()
+             << (style_ == "Cob" ? "  return;" : "  return true;") << endl;
     }
+    f_out_ << indent() << "}" << endl;
+  } else if (extends_.empty() && !call_context_.empty()) {
+    f_out_ << indent() << "(void) callContext;" << endl;
   }
-  f_out_ << "(" << cob_arg_ << "seqid, iprot, oprot" << call_context_arg_ << ");" << endl;
 
-  // TODO(dreiss): return pfn ret?
-  if (style_ == "Cob") {
-    f_out_ << indent() << "return;" << endl;
+  if (extends_.empty()) {
+    f_out_ << indent() << "iprot->skip(::apache::thrift::protocol::T_STRUCT);" << endl << indent()
+           << "iprot->readMessageEnd();" << endl << indent()
+           << "iprot->getTransport()->readEnd();" << endl << indent()
+           << "::apache::thrift::TApplicationException "
+              "x(::apache::thrift::TApplicationException::UNKNOWN_METHOD, \"Invalid method name: "
+              "'\"+fname+\"'\");" << endl << indent()
+           << "oprot->writeMessageBegin(fname, ::apache::thrift::protocol::T_EXCEPTION, seqid);"
+           << endl << indent() << "x.write(oprot);" << endl << indent()
+           << "oprot->writeMessageEnd();" << endl << indent()
+           << "oprot->getTransport()->writeEnd();" << endl << indent()
+           << "oprot->getTransport()->flush();" << endl << indent()
+           << (style_ == "Cob" ? "return cob(true);" : "return true;") << endl;
   } else {
-    f_out_ << indent() << "return true;" << endl;
+    f_out_ << indent() << "return " << extends_ << "::dispatchCall("
+           << (style_ == "Cob" ? "cob, " : "") << "iprot, oprot, fname, seqid"
+           << call_context_arg_ << ");" << endl;
   }
 
   indent_down();
@@ -3112,6 +3786,7 @@ void t_cpp_generator::generate_function_helpers(t_service* tservice, t_function*
   generate_struct_definition(out, f_service_, &result, false);
   generate_struct_reader(out, &result);
   generate_struct_result_writer(out, &result);
+  generate_struct_result_writer(out, &result, false, true);
 
   result.set_name(tservice->get_name() + "_" + tfunction->get_name() + "_presult");
   generate_struct_declaration(f_header_, &result, false, true, true, gen_cob_style_);
@@ -3119,6 +3794,7 @@ void t_cpp_generator::generate_function_helpers(t_service* tservice, t_function*
   generate_struct_reader(out, &result, true);
   if (gen_cob_style_) {
     generate_struct_writer(out, &result, true);
+    generate_struct_writer(out, &result, true, true);
   }
 }
 
@@ -3631,6 +4307,10 @@ void t_cpp_generator::generate_deserialize_field(ofstream& out,
     generate_deserialize_struct(out, (t_struct*)type, name, is_reference(tfield));
   } else if (type->is_container()) {
     generate_deserialize_container(out, type, name);
+  } else if (is_arena_string(type)) {
+    indent(out) << "xfer += ::apache::thrift::protocol::"
+                << (((t_base_type*)type)->is_binary() ? "readArenaBinary" : "readArenaString")
+                << "(*iprot, " << name << ");" << endl;
   } else if (type->is_base_type()) {
     indent(out) << "xfer += iprot->";
     t_base_type::t_base tbase = ((t_base_type*)type)->get_base();
@@ -3640,9 +4320,9 @@ void t_cpp_generator::generate_deserialize_field(ofstream& out,
       break;
     case t_base_type::TYPE_STRING:
       if (((t_base_type*)type)->is_binary()) {
-        out << "readBinary(" << name << ");";
+        out << (is_view(type) ? "readBinaryView(" : "readBinary(") << name << ");";
       } else {
-        out << "readString(" << name << ");";
+        out << (is_view(type) ? "readStringView(" : "readString(") << name << ");";
       }
       break;
     case t_base_type::TYPE_BOOL:
@@ -3736,23 +4416,37 @@ void t_cpp_generator::generate_deserialize_container(ofstream& out, t_type* ttyp
       indent(out) << prefix << ".resize(" << size << ");" << endl;
     }
   }
+  if (is_unordered(ttype)) {
+    indent(out) << prefix << ".reserve(" << size << ");" << endl;
+  }
 
-  // For loop iterates over elements
-  string i = tmp("_i");
-  out << indent() << "uint32_t " << i << ";" << endl << indent() << "for (" << i << " = 0; " << i
-      << " < " << size << "; ++" << i << ")" << endl;
+  // Lists of fixed width numbers are read in one go, which lets the
+  // protocol decode runs of elements at once
+  string array_type = list_array_type(ttype);
+  if (!array_type.empty()) {
+    out << indent() << "if (" << size << " > 0)" << endl;
+    scope_up(out);
+    indent(out) << "xfer += iprot->read" << array_type << "Array(&" << prefix << "[0], " << size
+                << ");" << endl;
+    scope_down(out);
+  } else {
+    // For loop iterates over elements
+    string i = tmp("_i");
+    out << indent() << "uint32_t " << i << ";" << endl << indent() << "for (" << i << " = 0; " << i
+        << " < " << size << "; ++" << i << ")" << endl;
 
-  scope_up(out);
+    scope_up(out);
 
-  if (ttype->is_map()) {
-    generate_deserialize_map_element(out, (t_map*)ttype, prefix);
-  } else if (ttype->is_set()) {
-    generate_deserialize_set_element(out, (t_set*)ttype, prefix);
-  } else if (ttype->is_list()) {
-    generate_deserialize_list_element(out, (t_list*)ttype, prefix, use_push, i);
-  }
+    if (ttype->is_map()) {
+      generate_deserialize_map_element(out, (t_map*)ttype, prefix);
+    } else if (ttype->is_set()) {
+      generate_deserialize_set_element(out, (t_set*)ttype, prefix);
+    } else if (ttype->is_list()) {
+      generate_deserialize_list_element(out, (t_list*)ttype, prefix, use_push, i);
+    }
 
-  scope_down(out);
+    scope_down(out);
+  }
 
   // Read container end
   if (ttype->is_map()) {
@@ -3821,7 +4515,8 @@ void t_cpp_generator::generate_deserialize_list_element(ofstream& out,
 void t_cpp_generator::generate_serialize_field(ofstream& out,
                                                t_field* tfield,
                                                string prefix,
-                                               string suffix) {
+                                               string suffix,
+                                               bool sizing) {
   t_type* type = get_true_type(tfield->get_type());
 
   string name = prefix + tfield->get_name() + suffix;
@@ -3832,9 +4527,13 @@ void t_cpp_generator::generate_serialize_field(ofstream& out,
   }
 
   if (type->is_struct() || type->is_xception()) {
-    generate_serialize_struct(out, (t_struct*)type, name, is_reference(tfield));
+    generate_serialize_struct(out, (t_struct*)type, name, is_reference(tfield), sizing);
   } else if (type->is_container()) {
-    generate_serialize_container(out, type, name);
+    generate_serialize_container(out, type, name, sizing);
+  } else if (is_arena_string(type)) {
+    indent(out) << "xfer += ::apache::thrift::protocol::"
+                << write_method(((t_base_type*)type)->is_binary() ? "ArenaBinary" : "ArenaString",
+                                sizing) << "(*oprot, " << name << ");" << endl;
   } else if (type->is_base_type() || type->is_enum()) {
 
     indent(out) << "xfer += oprot->";
@@ -3847,35 +4546,35 @@ void t_cpp_generator::generate_serialize_field(ofstream& out,
         break;
       case t_base_type::TYPE_STRING:
         if (((t_base_type*)type)->is_binary()) {
-          out << "writeBinary(" << name << ");";
+          out << write_method(is_view(type) ? "BinaryView(" : "Binary(", sizing) << name << ");";
         } else {
-          out << "writeString(" << name << ");";
+          out << write_method(is_view(type) ? "StringView(" : "String(", sizing) << name << ");";
         }
         break;
       case t_base_type::TYPE_BOOL:
-        out << "writeBool(" << name << ");";
+        out << write_method("Bool(", sizing) << name << ");";
         break;
       case t_base_type::TYPE_I8:
-        out << "writeByte(" << name << ");";
+        out << write_method("Byte(", sizing) << name << ");";
         break;
       case t_base_type::TYPE_I16:
-        out << "writeI16(" << name << ");";
+        out << write_method("I16(", sizing) << name << ");";
         break;
       case t_base_type::TYPE_I32:
-        out << "writeI32(" << name << ");";
+        out << write_method("I32(", sizing) << name << ");";
         break;
       case t_base_type::TYPE_I64:
-        out << "writeI64(" << name << ");";
+        out << write_method("I64(", sizing) << name << ");";
         break;
       case t_base_type::TYPE_DOUBLE:
-        out << "writeDouble(" << name << ");";
+        out << write_method("Double(", sizing) << name << ");";
         break;
       default:
         throw "compiler error: no C++ writer for base type " + t_base_type::t_base_name(tbase)
             + name;
       }
     } else if (type->is_enum()) {
-      out << "writeI32((int32_t)" << name << ");";
+      out << write_method("I32(", sizing) << "(int32_t)" << name << ");";
     }
     out << endl;
   } else {
@@ -3894,8 +4593,18 @@ void t_cpp_generator::generate_serialize_field(ofstream& out,
 void t_cpp_generator::generate_serialize_struct(ofstream& out,
                                                 t_struct* tstruct,
                                                 string prefix,
-                                                bool pointer) {
-  if (pointer) {
+                                                bool pointer,
+                                                bool sizing) {
+  if (pointer && sizing) {
+    indent(out) << "if (" << prefix << ") {" << endl;
+    indent(out) << "  xfer += " << prefix << "->serializedSize(oprot);" << endl;
+    indent(out) << "} else {" << endl;
+    indent(out) << "  xfer += oprot->serializedSizeStructBegin(\"" << tstruct->get_name()
+                << "\");" << endl;
+    indent(out) << "  xfer += oprot->serializedSizeFieldStop();" << endl;
+    indent(out) << "  xfer += oprot->serializedSizeStructEnd();" << endl;
+    indent(out) << "}" << endl;
+  } else if (pointer) {
     indent(out) << "if (" << prefix << ") {" << endl;
     indent(out) << "  xfer += " << prefix << "->write(oprot); " << endl;
     indent(out) << "} else {"
@@ -3904,42 +4613,58 @@ void t_cpp_generator::generate_serialize_struct(ofstream& out,
     indent(out) << "  oprot->writeFieldStop();" << endl;
     indent(out) << "}" << endl;
   } else {
-    indent(out) << "xfer += " << prefix << ".write(oprot);" << endl;
+    indent(out) << "xfer += " << prefix << "." << write_method("", sizing) << "(oprot);" << endl;
   }
 }
 
-void t_cpp_generator::generate_serialize_container(ofstream& out, t_type* ttype, string prefix) {
+void t_cpp_generator::generate_serialize_container(ofstream& out,
+                                                   t_type* ttype,
+                                                   string prefix,
+                                                   bool sizing) {
   scope_up(out);
 
   if (ttype->is_map()) {
-    indent(out) << "xfer += oprot->writeMapBegin(" << type_to_enum(((t_map*)ttype)->get_key_type())
-                << ", " << type_to_enum(((t_map*)ttype)->get_val_type()) << ", "
+    indent(out) << "xfer += oprot->" << write_method("MapBegin", sizing) << "("
+                << type_to_enum(((t_map*)ttype)->get_key_type()) << ", "
+                << type_to_enum(((t_map*)ttype)->get_val_type()) << ", "
                 << "static_cast<uint32_t>(" << prefix << ".size()));" << endl;
   } else if (ttype->is_set()) {
-    indent(out) << "xfer += oprot->writeSetBegin(" << type_to_enum(((t_set*)ttype)->get_elem_type())
-                << ", "
+    indent(out) << "xfer += oprot->" << write_method("SetBegin", sizing) << "("
+                << type_to_enum(((t_set*)ttype)->get_elem_type()) << ", "
                 << "static_cast<uint32_t>(" << prefix << ".size()));" << endl;
   } else if (ttype->is_list()) {
-    indent(out) << "xfer += oprot->writeListBegin("
+    indent(out) << "xfer += oprot->" << write_method("ListBegin", sizing) << "("
                 << type_to_enum(((t_list*)ttype)->get_elem_type()) << ", "
                 << "static_cast<uint32_t>(" << prefix << ".size()));" << endl;
   }
 
-  string iter = tmp("_iter");
-  out << indent() << type_name(ttype) << "::const_iterator " << iter << ";" << endl << indent()
-      << "for (" << iter << " = " << prefix << ".begin(); " << iter << " != " << prefix
-      << ".end(); ++" << iter << ")" << endl;
-  scope_up(out);
-  if (ttype->is_map()) {
-    generate_serialize_map_element(out, (t_map*)ttype, iter);
-  } else if (ttype->is_set()) {
-    generate_serialize_set_element(out, (t_set*)ttype, iter);
-  } else if (ttype->is_list()) {
-    generate_serialize_list_element(out, (t_list*)ttype, iter);
+  string array_type = list_array_type(ttype);
+  if (!array_type.empty()) {
+    out << indent() << "if (!" << prefix << ".empty())" << endl;
+    scope_up(out);
+    indent(out) << "xfer += oprot->" << write_method(array_type, sizing) << "Array(&" << prefix
+                << "[0], "
+                << "static_cast<uint32_t>(" << prefix << ".size()));" << endl;
+    scope_down(out);
+  } else {
+    string iter = tmp("_iter");
+    out << indent() << type_name(ttype) << "::const_iterator " << iter << ";" << endl << indent()
+        << "for (" << iter << " = " << prefix << ".begin(); " << iter << " != " << prefix
+        << ".end(); ++" << iter << ")" << endl;
+    scope_up(out);
+    if (ttype->is_map()) {
+      generate_serialize_map_element(out, (t_map*)ttype, iter, sizing);
+    } else if (ttype->is_set()) {
+      generate_serialize_set_element(out, (t_set*)ttype, iter, sizing);
+    } else if (ttype->is_list()) {
+      generate_serialize_list_element(out, (t_list*)ttype, iter, sizing);
+    }
+    scope_down(out);
   }
-  scope_down(out);
 
-  if (ttype->is_map()) {
+  if (sizing) {
+    // container ends are not sized
+  } else if (ttype->is_map()) {
     indent(out) << "xfer += oprot->writeMapEnd();" << endl;
   } else if (ttype->is_set()) {
     indent(out) << "xfer += oprot->writeSetEnd();" << endl;
@@ -3954,28 +4679,62 @@ void t_cpp_generator::generate_serialize_container(ofstream& out, t_type* ttype,
  * Serializes the members of a map.
  *
  */
-void t_cpp_generator::generate_serialize_map_element(ofstream& out, t_map* tmap, string iter) {
+void t_cpp_generator::generate_serialize_map_element(ofstream& out,
+                                                     t_map* tmap,
+                                                     string iter,
+                                                     bool sizing) {
   t_field kfield(tmap->get_key_type(), iter + "->first");
-  generate_serialize_field(out, &kfield, "");
+  generate_serialize_field(out, &kfield, "", "", sizing);
 
   t_field vfield(tmap->get_val_type(), iter + "->second");
-  generate_serialize_field(out, &vfield, "");
+  generate_serialize_field(out, &vfield, "", "", sizing);
 }
 
 /**
  * Serializes the members of a set.
  */
-void t_cpp_generator::generate_serialize_set_element(ofstream& out, t_set* tset, string iter) {
+void t_cpp_generator::generate_serialize_set_element(ofstream& out,
+                                                     t_set* tset,
+                                                     string iter,
+                                                     bool sizing) {
   t_field efield(tset->get_elem_type(), "(*" + iter + ")");
-  generate_serialize_field(out, &efield, "");
+  generate_serialize_field(out, &efield, "", "", sizing);
 }
 
 /**
  * Serializes the members of a list.
  */
-void t_cpp_generator::generate_serialize_list_element(ofstream& out, t_list* tlist, string iter) {
+void t_cpp_generator::generate_serialize_list_element(ofstream& out,
+                                                      t_list* tlist,
+                                                      string iter,
+                                                      bool sizing) {
   t_field efield(tlist->get_elem_type(), "(*" + iter + ")");
-  generate_serialize_field(out, &efield, "");
+  generate_serialize_field(out, &efield, "", "", sizing);
+}
+
+/**
+ * Gets the element type name of the protocol array methods that can read
+ * and write a list in one go, or "" if the list needs an element loop.
+ * Only std::vectors of plain i32, i64 and double qualify.
+ */
+string t_cpp_generator::list_array_type(t_type* ttype) {
+  if (!ttype->is_list() || ((t_container*)ttype)->has_cpp_name()) {
+    return "";
+  }
+  t_type* elem_type = get_true_type(((t_list*)ttype)->get_elem_type());
+  if (!elem_type->is_base_type() || elem_type->annotations_.count("cpp.type") > 0) {
+    return "";
+  }
+  switch (((t_base_type*)elem_type)->get_base()) {
+  case t_base_type::TYPE_I32:
+    return "I32";
+  case t_base_type::TYPE_I64:
+    return "I64";
+  case t_base_type::TYPE_DOUBLE:
+    return "Double";
+  default:
+    return "";
+  }
 }
 
 /**
@@ -4067,6 +4826,10 @@ string t_cpp_generator::type_name(t_type* ttype, bool in_typedef, bool arg) {
     std::map<string, string>::iterator it = ttype->annotations_.find("cpp.type");
     if (it != ttype->annotations_.end()) {
       bname = it->second;
+    } else if (is_view(ttype)) {
+      bname = "::apache::thrift::TStringView";
+    } else if (is_arena_string(ttype)) {
+      bname = "::apache::thrift::TArenaString";
     }
 
     if (!arg) {
@@ -4089,14 +4852,44 @@ string t_cpp_generator::type_name(t_type* ttype, bool in_typedef, bool arg) {
       cname = tcontainer->get_cpp_name();
     } else if (ttype->is_map()) {
       t_map* tmap = (t_map*)ttype;
-      cname = "std::map<" + type_name(tmap->get_key_type(), in_typedef) + ", "
-              + type_name(tmap->get_val_type(), in_typedef) + "> ";
+      string key = template_arg(type_name(tmap->get_key_type(), in_typedef));
+      string val = type_name(tmap->get_val_type(), in_typedef);
+      if (is_unordered(ttype) && gen_arena_) {
+        cname = "boost::unordered_map<" + key + ", " + val + ", boost::hash<" + key + " >, "
+                + "std::equal_to<" + key + " >, "
+                + "::apache::thrift::TArenaAllocator<std::pair<const " + key + ", " + val
+                + " > > > ";
+      } else if (is_unordered(ttype)) {
+        cname = "boost::unordered_map<" + key + ", " + val + "> ";
+      } else if (gen_arena_) {
+        cname = "std::map<" + key + ", " + val + ", std::less<" + key + " >, "
+                + "::apache::thrift::TArenaAllocator<std::pair<const " + key + ", " + val
+                + " > > > ";
+      } else {
+        cname = "std::map<" + key + ", " + val + "> ";
+      }
     } else if (ttype->is_set()) {
       t_set* tset = (t_set*)ttype;
-      cname = "std::set<" + type_name(tset->get_elem_type(), in_typedef) + "> ";
+      string elem = template_arg(type_name(tset->get_elem_type(), in_typedef));
+      if (is_unordered(ttype) && gen_arena_) {
+        cname = "boost::unordered_set<" + elem + ", boost::hash<" + elem + " >, std::equal_to<"
+                + elem + " >, ::apache::thrift::TArenaAllocator<" + elem + " > > ";
+      } else if (is_unordered(ttype)) {
+        cname = "boost::unordered_set<" + elem + "> ";
+      } else if (gen_arena_) {
+        cname = "std::set<" + elem + ", std::less<" + elem + " >, "
+                + "::apache::thrift::TArenaAllocator<" + elem + " > > ";
+      } else {
+        cname = "std::set<" + elem + "> ";
+      }
     } else if (ttype->is_list()) {
       t_list* tlist = (t_list*)ttype;
-      cname = "std::vector<" + type_name(tlist->get_elem_type(), in_typedef) + "> ";
+      string elem = template_arg(type_name(tlist->get_elem_type(), in_typedef));
+      if (gen_arena_) {
+        cname = "std::vector<" + elem + ", ::apache::thrift::TArenaAllocator<" + elem + " > > ";
+      } else {
+        cname = "std::vector<" + elem + "> ";
+      }
     }
 
     if (arg) {
@@ -4180,7 +4973,11 @@ string t_cpp_generator::declare_field(t_field* tfield,
   if (constant) {
     result += "const ";
   }
-  result += type_name(tfield->get_type());
+  if (is_lazy(tfield) && !pointer) {
+    result += "::apache::thrift::protocol::TLazy<" + type_name(tfield->get_type()) + ">";
+  } else {
+    result += type_name(tfield->get_type());
+  }
   if (is_reference(tfield)) {
     result = "boost::shared_ptr<" + result + ">";
   }
@@ -4371,4 +5168,7 @@ THRIFT_REGISTER_GENERATOR(
     "    templates:       Generate templatized reader/writer methods.\n"
     "    pure_enums:      Generate pure enums instead of wrapper classes.\n"
     "    include_prefix:  Use full include paths in generated files.\n"
-    "    moveable_types:  Generate move constructors and assignment operators.\n")
+    "    moveable_types:  Generate move constructors and assignment operators.\n"
+    "    arena:           Allocate strings and containers from the current TArena.\n"
+    "    tables:          Read and write structs from tables of their fields.\n"
+    "    unordered:       Hold maps and sets in boost::unordered_maps and unordered_sets.\n")
@@ -0,0 +1,131 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <thrift/TArena.h>
+
+#include <stdlib.h>
+
+#if defined(_MSC_VER)
+#define THRIFT_ARENA_TLS __declspec(thread)
+#else
+#define THRIFT_ARENA_TLS __thread
+#endif
+
+namespace apache {
+namespace thrift {
+
+namespace {
+// a plain pointer, so thread local storage needs no destructor
+THRIFT_ARENA_TLS TArena* currentArena = NULL;
+}
+
+TArena::TArena(size_t blockSize)
+  : blockSize_(blockSize < 1024 ? 1024 : blockSize),
+    blocks_(NULL),
+    pos_(NULL),
+    end_(NULL),
+    allocationCount_(0),
+    bytesReserved_(0) {
+}
+
+TArena::~TArena() {
+  while (blocks_ != NULL) {
+    Block* next = blocks_->next;
+    free(blocks_);
+    blocks_ = next;
+  }
+}
+
+void TArena::release() {
+  // keep one block of the usual size, large blocks are never reused
+  Block* keep = NULL;
+  while (blocks_ != NULL) {
+    Block* next = blocks_->next;
+    if (keep == NULL && blocks_->size == blockSize_) {
+      keep = blocks_;
+    } else {
+      free(blocks_);
+    }
+    blocks_ = next;
+  }
+
+  blocks_ = keep;
+  pos_ = NULL;
+  end_ = NULL;
+  bytesReserved_ = 0;
+  if (keep != NULL) {
+    keep->next = NULL;
+    pos_ = reinterpret_cast<char*>(keep) + ALIGNMENT;
+    end_ = pos_ + keep->size;
+    bytesReserved_ = keep->size;
+  }
+  allocationCount_ = 0;
+}
+
+void* TArena::allocateSlow(size_t size) {
+  if (size > blockSize_ / 4) {
+    // large allocations get a block of their own, behind the current one,
+    // so what is left of the current block is not wasted
+    Block* block = newBlock(size);
+    if (blocks_ != NULL) {
+      block->next = blocks_->next;
+      blocks_->next = block;
+    } else {
+      block->next = NULL;
+      blocks_ = block;
+    }
+    return reinterpret_cast<char*>(block) + ALIGNMENT;
+  }
+
+  Block* block = newBlock(blockSize_);
+  block->next = blocks_;
+  blocks_ = block;
+  pos_ = reinterpret_cast<char*>(block) + ALIGNMENT;
+  end_ = pos_ + blockSize_;
+
+  char* result = pos_;
+  pos_ += size;
+  return result;
+}
+
+TArena::Block* TArena::newBlock(size_t size) {
+  // the header is padded to ALIGNMENT so the data after it stays aligned
+  void* memory = malloc(ALIGNMENT + size);
+  if (memory == NULL) {
+    throw std::bad_alloc();
+  }
+  Block* block = static_cast<Block*>(memory);
+  block->size = size;
+  bytesReserved_ += size;
+  return block;
+}
+
+TArena* TArena::current() {
+  return currentArena;
+}
+
+TArena::Scope::Scope(TArena& arena) : previous_(currentArena) {
+  currentArena = &arena;
+}
+
+TArena::Scope::~Scope() {
+  currentArena = previous_;
+}
+}
+} // apache::thrift
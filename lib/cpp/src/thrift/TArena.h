@@ -0,0 +1,339 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef _THRIFT_TARENA_H_
+#define _THRIFT_TARENA_H_ 1
+
+#include <stddef.h>
+#include <stdint.h>
+#include <limits>
+#include <new>
+#include <string>
+#include <utility>
+
+#if __cplusplus >= 201103L
+#include <type_traits>
+#endif
+
+#include <boost/noncopyable.hpp>
+
+#if __cplusplus < 201103L
+#include <boost/type_traits/remove_const.hpp>
+#include <boost/unordered/unordered_map_fwd.hpp>
+#include <boost/unordered/unordered_set_fwd.hpp>
+#endif
+
+namespace apache {
+namespace thrift {
+
+/**
+ * A monotonic buffer: memory is handed out from large blocks by bumping a
+ * pointer, is never freed piece by piece, and is released all at once when
+ * the arena is released or destroyed.
+ *
+ * Structs generated with the cpp:arena option keep their strings and
+ * containers in TArenaAllocators, which allocate from the arena that is
+ * current on the thread when they are constructed:
+ *
+ *   TArena arena;
+ *   {
+ *     TArena::Scope scope(arena);
+ *     Response response;
+ *     response.read(protocol);
+ *     ...
+ *   }
+ *   arena.release();
+ *
+ * Objects allocated from an arena must be destroyed before it is released;
+ * their destructors then run without freeing anything.  An arena is not
+ * thread safe, so it must only be current on one thread at a time.
+ */
+class TArena : boost::noncopyable {
+public:
+  static const size_t DEFAULT_BLOCK_SIZE = 64 * 1024;
+
+  explicit TArena(size_t blockSize = DEFAULT_BLOCK_SIZE);
+
+  ~TArena();
+
+  /// Allocates size bytes, aligned for any type.
+  void* allocate(size_t size) {
+    size = (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+    ++allocationCount_;
+    if (size <= static_cast<size_t>(end_ - pos_)) {
+      char* result = pos_;
+      pos_ += size;
+      return result;
+    }
+    return allocateSlow(size);
+  }
+
+  /**
+   * Frees everything allocated so far.  The first block is kept for the
+   * allocations that follow.
+   */
+  void release();
+
+  /// Returns the number of allocations since construction or release().
+  uint64_t getAllocationCount() const { return allocationCount_; }
+
+  /// Returns the bytes held in blocks.
+  size_t getBytesReserved() const { return bytesReserved_; }
+
+  /// A buffer for reading strings before they are copied into the arena.
+  std::string& getScratch() { return scratch_; }
+
+  /// Returns the arena current on this thread, or NULL.
+  static TArena* current();
+
+  /// Makes an arena current on this thread for the lifetime of the scope.
+  class Scope : boost::noncopyable {
+  public:
+    explicit Scope(TArena& arena);
+    ~Scope();
+
+  private:
+    TArena* previous_;
+  };
+
+private:
+  static const size_t ALIGNMENT = 16;
+
+  struct Block {
+    Block* next;
+    size_t size;
+  };
+
+  void* allocateSlow(size_t size);
+  Block* newBlock(size_t size);
+
+  size_t blockSize_;
+  Block* blocks_;
+  char* pos_;
+  char* end_;
+  uint64_t allocationCount_;
+  size_t bytesReserved_;
+  std::string scratch_;
+};
+
+#if __cplusplus < 201103L
+template <typename T, typename Enable = void>
+struct TArenaCopy;
+#endif
+
+/**
+ * A standard allocator that allocates from a TArena, or from the heap if it
+ * has none.  A default constructed allocator uses the arena current on the
+ * thread.
+ *
+ * Containers copy constructed from arena containers allocate from the
+ * arena current at the time, so copies taken outside a scope go to the
+ * heap; assignment keeps the allocator of the container assigned to, while
+ * moves and swaps take the allocator along with the memory.
+ *
+ * Before C++11 a container copy constructor takes the allocator of the
+ * container it copies.  The rules still hold there for the members of
+ * generated structs, which are copied by assignment, and for strings and
+ * containers held in other containers, which construct() copies through
+ * TArenaCopy, but a container copy constructed directly keeps its source's
+ * arena.
+ */
+template <typename T>
+class TArenaAllocator {
+public:
+  typedef T value_type;
+  typedef T* pointer;
+  typedef const T* const_pointer;
+  typedef T& reference;
+  typedef const T& const_reference;
+  typedef size_t size_type;
+  typedef ptrdiff_t difference_type;
+
+  template <typename U>
+  struct rebind {
+    typedef TArenaAllocator<U> other;
+  };
+
+#if __cplusplus >= 201103L
+  typedef std::false_type propagate_on_container_copy_assignment;
+  typedef std::true_type propagate_on_container_move_assignment;
+  typedef std::true_type propagate_on_container_swap;
+
+  TArenaAllocator select_on_container_copy_construction() const { return TArenaAllocator(); }
+#endif
+
+  TArenaAllocator() : arena_(TArena::current()) {}
+
+  explicit TArenaAllocator(TArena* arena) : arena_(arena) {}
+
+  template <typename U>
+  TArenaAllocator(const TArenaAllocator<U>& other)
+    : arena_(other.getArena()) {}
+
+  TArena* getArena() const { return arena_; }
+
+  pointer allocate(size_type n, const void* hint = 0) {
+    (void)hint;
+    if (n > max_size()) {
+      throw std::bad_alloc();
+    }
+    if (arena_ != NULL) {
+      return static_cast<pointer>(arena_->allocate(n * sizeof(T)));
+    }
+    return static_cast<pointer>(::operator new(n * sizeof(T)));
+  }
+
+  void deallocate(pointer p, size_type n) {
+    (void)n;
+    if (arena_ == NULL) {
+      ::operator delete(p);
+    }
+  }
+
+  size_type max_size() const { return (std::numeric_limits<size_type>::max)() / sizeof(T); }
+
+  pointer address(reference x) const { return &x; }
+
+  const_pointer address(const_reference x) const { return &x; }
+
+#if __cplusplus >= 201103L
+  void construct(pointer p, const T& value) { new (p) T(value); }
+#else
+  void construct(pointer p, const T& value) { TArenaCopy<T>::construct(p, value); }
+#endif
+
+  void destroy(pointer p) {
+    (void)p;
+    p->~T();
+  }
+
+private:
+  TArena* arena_;
+};
+
+template <typename T, typename U>
+bool operator==(const TArenaAllocator<T>& a, const TArenaAllocator<U>& b) {
+  return a.getArena() == b.getArena();
+}
+
+template <typename T, typename U>
+bool operator!=(const TArenaAllocator<T>& a, const TArenaAllocator<U>& b) {
+  return a.getArena() != b.getArena();
+}
+
+#if __cplusplus < 201103L
+template <typename Allocator>
+struct TArenaAllocated {};
+
+template <typename T>
+struct TArenaAllocated<TArenaAllocator<T> > {
+  typedef void type;
+};
+
+/**
+ * Assigns arena strings and containers.  The boost unordered containers
+ * copy their elements without the allocator, so they are refilled with
+ * copies made by TArenaCopy instead.
+ */
+template <typename T>
+struct TArenaAssign {
+  static void assign(T& to, const T& from) { to = from; }
+};
+
+template <typename T>
+struct TArenaUnorderedAssign {
+  static void assign(T& to, const T& from) {
+    if (&to == &from) {
+      return;
+    }
+    to.clear();
+    for (typename T::const_iterator it = from.begin(); it != from.end(); ++it) {
+      to.insert(TArenaCopy<typename T::value_type>::copy(*it));
+    }
+  }
+};
+
+template <typename K, typename V, typename H, typename P, typename U>
+struct TArenaAssign<boost::unordered_map<K, V, H, P, TArenaAllocator<U> > >
+  : TArenaUnorderedAssign<boost::unordered_map<K, V, H, P, TArenaAllocator<U> > > {};
+
+template <typename T, typename H, typename P, typename U>
+struct TArenaAssign<boost::unordered_set<T, H, P, TArenaAllocator<U> > >
+  : TArenaUnorderedAssign<boost::unordered_set<T, H, P, TArenaAllocator<U> > > {};
+
+/**
+ * Copies values into the arena current at the time, the way
+ * select_on_container_copy_construction() does in C++11.  Values that are
+ * not arena strings or containers are copy constructed.
+ */
+template <typename T, typename Enable>
+struct TArenaCopy {
+  static void construct(T* p, const T& value) { new (p) T(value); }
+
+  static const T& copy(const T& value) { return value; }
+};
+
+/// Arena strings and containers are default constructed and assigned to.
+template <typename T>
+struct TArenaCopy<T, typename TArenaAllocated<typename T::allocator_type>::type> {
+  static void construct(T* p, const T& value) {
+    new (p) T();
+    TArenaAssign<T>::assign(*p, value);
+  }
+
+  static T copy(const T& value) {
+    T result;
+    TArenaAssign<T>::assign(result, value);
+    return result;
+  }
+};
+
+/// The entries of maps, whose const keys cannot be assigned to.
+template <typename K, typename V>
+struct TArenaCopy<std::pair<K, V>, void> {
+  static void construct(std::pair<K, V>* p, const std::pair<K, V>& value) {
+    new (p) std::pair<K, V>(copy(value));
+  }
+
+  static std::pair<K, V> copy(const std::pair<K, V>& value) {
+    return std::pair<K, V>(TArenaCopy<typename boost::remove_const<K>::type>::copy(value.first),
+                           TArenaCopy<V>::copy(value.second));
+  }
+};
+#endif
+
+/**
+ * Assigns to a member of a struct generated with the cpp:arena option, so
+ * that the copy allocates from the arena current at the time.
+ */
+template <typename T>
+void arenaAssign(T& to, const T& from) {
+#if __cplusplus >= 201103L
+  to = from;
+#else
+  TArenaAssign<T>::assign(to, from);
+#endif
+}
+
+/// The string type of structs generated with the cpp:arena option.
+typedef std::basic_string<char, std::char_traits<char>, TArenaAllocator<char> > TArenaString;
+}
+} // apache::thrift
+
+#endif // #ifndef _THRIFT_TARENA_H_
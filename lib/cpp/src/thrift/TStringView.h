@@ -0,0 +1,123 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef _THRIFT_TSTRINGVIEW_H_
+#define _THRIFT_TSTRINGVIEW_H_ 1
+
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <ostream>
+#include <string>
+
+#include <boost/functional/hash.hpp>
+#include <boost/shared_ptr.hpp>
+
+namespace apache {
+namespace thrift {
+
+/**
+ * An immutable string or binary value that may point into a buffer it does
+ * not own, such as the frame a message was read from.  The view holds a
+ * reference to whatever owns the bytes, so copies of it can be passed
+ * around freely; that only keeps the owner alive though, the owner must
+ * also leave the bytes alone for as long as views of them exist.
+ *
+ * Views made from a std::string or a C string own a copy of it.
+ *
+ * Generated code uses views for string and binary types annotated with
+ * cpp.view = "true", and reads them with TProtocol::readStringView() or
+ * readBinaryView().
+ */
+class TStringView {
+public:
+  TStringView() : data_(NULL), size_(0) {}
+
+  TStringView(const std::string& str) {
+    assign(boost::shared_ptr<const std::string>(new std::string(str)));
+  }
+
+  TStringView(const char* str) {
+    assign(boost::shared_ptr<const std::string>(new std::string(str)));
+  }
+
+  /// A view of a string shared with others.
+  explicit TStringView(const boost::shared_ptr<const std::string>& str) { assign(str); }
+
+  /// A view of size bytes at data, which owner keeps valid.
+  TStringView(const char* data, uint32_t size, const boost::shared_ptr<const void>& owner)
+    : data_(data), size_(size), owner_(owner) {}
+
+  const char* data() const { return data_; }
+
+  uint32_t size() const { return size_; }
+
+  bool empty() const { return size_ == 0; }
+
+  const char* begin() const { return data_; }
+
+  const char* end() const { return data_ + size_; }
+
+  /// Returns whatever keeps the bytes valid, if anything.
+  const boost::shared_ptr<const void>& getOwner() const { return owner_; }
+
+  /// Copies the bytes out into a std::string.
+  std::string str() const { return size_ == 0 ? std::string() : std::string(data_, size_); }
+
+  int compare(const TStringView& other) const {
+    uint32_t common = (std::min)(size_, other.size_);
+    int result = common == 0 ? 0 : memcmp(data_, other.data_, common);
+    if (result == 0 && size_ != other.size_) {
+      result = size_ < other.size_ ? -1 : 1;
+    }
+    return result;
+  }
+
+  bool operator==(const TStringView& other) const {
+    return size_ == other.size_ && (size_ == 0 || memcmp(data_, other.data_, size_) == 0);
+  }
+
+  bool operator!=(const TStringView& other) const { return !(*this == other); }
+
+  bool operator<(const TStringView& other) const { return compare(other) < 0; }
+
+private:
+  void assign(const boost::shared_ptr<const std::string>& str) {
+    data_ = str->data();
+    size_ = static_cast<uint32_t>(str->size());
+    owner_ = str;
+  }
+
+  const char* data_;
+  uint32_t size_;
+  boost::shared_ptr<const void> owner_;
+};
+
+inline std::ostream& operator<<(std::ostream& out, const TStringView& view) {
+  return out.write(view.data(), view.size());
+}
+
+/// Hashes the bytes, so views can be kept in boost::unordered containers.
+inline std::size_t hash_value(const TStringView& view) {
+  return boost::hash_range(view.begin(), view.end());
+}
+}
+} // apache::thrift
+
+#endif // #ifndef _THRIFT_TSTRINGVIEW_H_
@@ -21,6 +21,8 @@
 #define _THRIFT_TOSTRING_H_ 1
 
 #include <boost/lexical_cast.hpp>
+#include <boost/unordered/unordered_map_fwd.hpp>
+#include <boost/unordered/unordered_set_fwd.hpp>
 
 #include <vector>
 #include <map>
@@ -36,14 +38,20 @@ std::string to_string(const T& t) {
   return boost::lexical_cast<std::string>(t);
 }
 
-template <typename K, typename V>
-std::string to_string(const std::map<K, V>& m);
+template <typename K, typename V, typename C, typename A>
+std::string to_string(const std::map<K, V, C, A>& m);
 
-template <typename T>
-std::string to_string(const std::set<T>& s);
+template <typename T, typename C, typename A>
+std::string to_string(const std::set<T, C, A>& s);
 
-template <typename T>
-std::string to_string(const std::vector<T>& t);
+template <typename T, typename A>
+std::string to_string(const std::vector<T, A>& t);
+
+template <typename K, typename V, typename H, typename P, typename A>
+std::string to_string(const boost::unordered_map<K, V, H, P, A>& m);
+
+template <typename T, typename H, typename P, typename A>
+std::string to_string(const boost::unordered_set<T, H, P, A>& s);
 
 template <typename K, typename V>
 std::string to_string(const typename std::pair<K, V>& v) {
@@ -63,22 +71,36 @@ std::string to_string(const T& beg, const T& end) {
   return o.str();
 }
 
-template <typename T>
-std::string to_string(const std::vector<T>& t) {
+template <typename T, typename A>
+std::string to_string(const std::vector<T, A>& t) {
   std::ostringstream o;
   o << "[" << to_string(t.begin(), t.end()) << "]";
   return o.str();
 }
 
-template <typename K, typename V>
-std::string to_string(const std::map<K, V>& m) {
+template <typename K, typename V, typename C, typename A>
+std::string to_string(const std::map<K, V, C, A>& m) {
   std::ostringstream o;
   o << "{" << to_string(m.begin(), m.end()) << "}";
   return o.str();
 }
 
-template <typename T>
-std::string to_string(const std::set<T>& s) {
+template <typename T, typename C, typename A>
+std::string to_string(const std::set<T, C, A>& s) {
+  std::ostringstream o;
+  o << "{" << to_string(s.begin(), s.end()) << "}";
+  return o.str();
+}
+
+template <typename K, typename V, typename H, typename P, typename A>
+std::string to_string(const boost::unordered_map<K, V, H, P, A>& m) {
+  std::ostringstream o;
+  o << "{" << to_string(m.begin(), m.end()) << "}";
+  return o.str();
+}
+
+template <typename T, typename H, typename P, typename A>
+std::string to_string(const boost::unordered_set<T, H, P, A>& s) {
   std::ostringstream o;
   o << "{" << to_string(s.begin(), s.end()) << "}";
   return o.str();
@@ -26,6 +26,7 @@
 
 #include <cassert>
 
+#include <boost/atomic.hpp>
 #include <boost/weak_ptr.hpp>
 #include <boost/thread.hpp>
 
@@ -52,10 +53,11 @@ private:
   STATE state_;
   weak_ptr<BoostThread> self_;
   bool detached_;
+  std::vector<int> cpus_;
 
 public:
-  BoostThread(bool detached, shared_ptr<Runnable> runnable)
-    : state_(uninitialized), detached_(detached) {
+  BoostThread(bool detached, const std::vector<int>& cpus, shared_ptr<Runnable> runnable)
+    : state_(uninitialized), detached_(detached), cpus_(cpus) {
     this->Thread::runnable(runnable);
   }
 
@@ -117,6 +119,10 @@ void* BoostThread::threadMain(void* arg) {
     return (void*)0;
   }
 
+  if (!thread->cpus_.empty() && !ThreadAffinity::setCurrentThreadCpus(thread->cpus_)) {
+    GlobalOutput.printf("BoostThread::threadMain(): could not set CPU affinity");
+  }
+
   thread->state_ = started;
   thread->runnable()->run();
 
@@ -133,9 +139,11 @@ class BoostThreadFactory::Impl {
 
 private:
   bool detached_;
+  ThreadAffinity affinity_;
+  mutable boost::atomic<size_t> threadCount_;
 
 public:
-  Impl(bool detached) : detached_(detached) {}
+  Impl(bool detached) : detached_(detached), threadCount_(0) {}
 
   /**
    * Creates a new POSIX thread to run the runnable object
@@ -143,7 +151,8 @@ public:
    * @param runnable A runnable object
    */
   shared_ptr<Thread> newThread(shared_ptr<Runnable> runnable) const {
-    shared_ptr<BoostThread> result = shared_ptr<BoostThread>(new BoostThread(detached_, runnable));
+    shared_ptr<BoostThread> result = shared_ptr<BoostThread>(
+        new BoostThread(detached_, affinity_.cpusFor(threadCount_++), runnable));
     result->weakRef(result);
     runnable->thread(result);
     return result;
@@ -153,6 +162,13 @@ public:
 
   void setDetached(bool value) { detached_ = value; }
 
+  ThreadAffinity getAffinity() const { return affinity_; }
+
+  void setAffinity(const ThreadAffinity& value) {
+    affinity_ = value;
+    threadCount_ = 0;
+  }
+
   Thread::id_t getCurrentThreadId() const { return boost::this_thread::get_id(); }
 };
 
@@ -172,6 +188,14 @@ void BoostThreadFactory::setDetached(bool value) {
   impl_->setDetached(value);
 }
 
+ThreadAffinity BoostThreadFactory::getAffinity() const {
+  return impl_->getAffinity();
+}
+
+void BoostThreadFactory::setAffinity(const ThreadAffinity& value) {
+  impl_->setAffinity(value);
+}
+
 Thread::id_t BoostThreadFactory::getCurrentThreadId() const {
   return impl_->getCurrentThreadId();
 }
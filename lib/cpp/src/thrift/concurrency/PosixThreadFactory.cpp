@@ -31,6 +31,7 @@
 
 #include <iostream>
 
+#include <boost/atomic.hpp>
 #include <boost/weak_ptr.hpp>
 
 namespace apache {
@@ -61,12 +62,14 @@ private:
   int stackSize_;
   weak_ptr<PthreadThread> self_;
   bool detached_;
+  std::vector<int> cpus_;
 
 public:
   PthreadThread(int policy,
                 int priority,
                 int stackSize,
                 bool detached,
+                const std::vector<int>& cpus,
                 shared_ptr<Runnable> runnable)
     :
 
@@ -78,7 +81,8 @@ public:
       policy_(policy),
       priority_(priority),
       stackSize_(stackSize),
-      detached_(detached) {
+      detached_(detached),
+      cpus_(cpus) {
 
     this->Thread::runnable(runnable);
   }
@@ -204,6 +208,10 @@ void* PthreadThread::threadMain(void* arg) {
   ProfilerRegisterThread();
 #endif
 
+  if (!thread->cpus_.empty() && !ThreadAffinity::setCurrentThreadCpus(thread->cpus_)) {
+    GlobalOutput.printf("PthreadThread::threadMain(): could not set CPU affinity");
+  }
+
   thread->state_ = started;
   thread->runnable()->run();
   if (thread->state_ != stopping && thread->state_ != stopped) {
@@ -223,6 +231,8 @@ private:
   PRIORITY priority_;
   int stackSize_;
   bool detached_;
+  ThreadAffinity affinity_;
+  mutable boost::atomic<size_t> threadCount_;
 
   /**
    * Converts generic posix thread schedule policy enums into pthread
@@ -272,7 +282,11 @@ private:
 
 public:
   Impl(POLICY policy, PRIORITY priority, int stackSize, bool detached)
-    : policy_(policy), priority_(priority), stackSize_(stackSize), detached_(detached) {}
+    : policy_(policy),
+      priority_(priority),
+      stackSize_(stackSize),
+      detached_(detached),
+      threadCount_(0) {}
 
   /**
    * Creates a new POSIX thread to run the runnable object
@@ -285,6 +299,7 @@ public:
                                                       toPthreadPriority(policy_, priority_),
                                                       stackSize_,
                                                       detached_,
+                                                      affinity_.cpusFor(threadCount_++),
                                                       runnable));
     result->weakRef(result);
     runnable->thread(result);
@@ -309,6 +324,13 @@ public:
 
   void setDetached(bool value) { detached_ = value; }
 
+  ThreadAffinity getAffinity() const { return affinity_; }
+
+  void setAffinity(const ThreadAffinity& value) {
+    affinity_ = value;
+    threadCount_ = 0;
+  }
+
   Thread::id_t getCurrentThreadId() const {
 
 #ifndef _WIN32
@@ -354,6 +376,14 @@ void PosixThreadFactory::setDetached(bool value) {
   impl_->setDetached(value);
 }
 
+ThreadAffinity PosixThreadFactory::getAffinity() const {
+  return impl_->getAffinity();
+}
+
+void PosixThreadFactory::setAffinity(const ThreadAffinity& value) {
+  impl_->setAffinity(value);
+}
+
 Thread::id_t PosixThreadFactory::getCurrentThreadId() const {
   return impl_->getCurrentThreadId();
 }
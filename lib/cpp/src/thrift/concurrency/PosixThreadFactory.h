@@ -21,6 +21,7 @@
 #define _THRIFT_CONCURRENCY_POSIXTHREADFACTORY_H_ 1
 
 #include <thrift/concurrency/Thread.h>
+#include <thrift/concurrency/ThreadAffinity.h>
 
 #include <boost/shared_ptr.hpp>
 
@@ -120,6 +121,17 @@ public:
    */
   virtual bool isDetached() const;
 
+  /**
+   * Gets the CPUs created threads run on
+   */
+  virtual ThreadAffinity getAffinity() const;
+
+  /**
+   * Sets the CPUs created threads run on.  Threads are numbered in the order
+   * they are created from here on, for a round robin affinity.
+   */
+  virtual void setAffinity(const ThreadAffinity& affinity);
+
 private:
   class Impl;
   boost::shared_ptr<Impl> impl_;
@@ -26,6 +26,7 @@
 
 #include <cassert>
 
+#include <boost/atomic.hpp>
 #include <boost/enable_shared_from_this.hpp>
 #include <boost/weak_ptr.hpp>
 #include <thread>
@@ -53,10 +54,11 @@ private:
   std::unique_ptr<std::thread> thread_;
   STATE state_;
   bool detached_;
+  std::vector<int> cpus_;
 
 public:
-  StdThread(bool detached, boost::shared_ptr<Runnable> runnable)
-    : state_(uninitialized), detached_(detached) {
+  StdThread(bool detached, const std::vector<int>& cpus, boost::shared_ptr<Runnable> runnable)
+    : state_(uninitialized), detached_(detached), cpus_(cpus) {
     this->Thread::runnable(runnable);
   }
 
@@ -106,6 +108,10 @@ void StdThread::threadMain(boost::shared_ptr<StdThread> thread) {
     return;
   }
 
+  if (!thread->cpus_.empty() && !ThreadAffinity::setCurrentThreadCpus(thread->cpus_)) {
+    GlobalOutput.printf("StdThread::threadMain(): could not set CPU affinity");
+  }
+
   thread->state_ = started;
   thread->runnable()->run();
 
@@ -123,9 +129,11 @@ class StdThreadFactory::Impl {
 
 private:
   bool detached_;
+  ThreadAffinity affinity_;
+  mutable boost::atomic<size_t> threadCount_;
 
 public:
-  Impl(bool detached) : detached_(detached) {}
+  Impl(bool detached) : detached_(detached), threadCount_(0) {}
 
   /**
    * Creates a new std::thread to run the runnable object
@@ -134,7 +142,7 @@ public:
    */
   boost::shared_ptr<Thread> newThread(boost::shared_ptr<Runnable> runnable) const {
     boost::shared_ptr<StdThread> result
-        = boost::shared_ptr<StdThread>(new StdThread(detached_, runnable));
+        = boost::shared_ptr<StdThread>(new StdThread(detached_, affinity_.cpusFor(threadCount_++), runnable));
     runnable->thread(result);
     return result;
   }
@@ -143,6 +151,13 @@ public:
 
   void setDetached(bool value) { detached_ = value; }
 
+  ThreadAffinity getAffinity() const { return affinity_; }
+
+  void setAffinity(const ThreadAffinity& value) {
+    affinity_ = value;
+    threadCount_ = 0;
+  }
+
   Thread::id_t getCurrentThreadId() const { return std::this_thread::get_id(); }
 };
 
@@ -161,6 +176,14 @@ void StdThreadFactory::setDetached(bool value) {
   impl_->setDetached(value);
 }
 
+ThreadAffinity StdThreadFactory::getAffinity() const {
+  return impl_->getAffinity();
+}
+
+void StdThreadFactory::setAffinity(const ThreadAffinity& value) {
+  impl_->setAffinity(value);
+}
+
 Thread::id_t StdThreadFactory::getCurrentThreadId() const {
   return impl_->getCurrentThreadId();
 }
@@ -0,0 +1,143 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <thrift/thrift-config.h>
+
+#include <thrift/concurrency/ThreadAffinity.h>
+#include <thrift/concurrency/Exception.h>
+
+#ifdef HAVE_SCHED_H
+#include <sched.h>
+#endif
+
+#include <stdlib.h>
+#include <fstream>
+#include <sstream>
+
+namespace apache {
+namespace thrift {
+namespace concurrency {
+
+ThreadAffinity ThreadAffinity::cpuSet(const std::vector<int>& cpus) {
+  if (cpus.empty()) {
+    throw InvalidArgumentException();
+  }
+  return ThreadAffinity(CPU_SET, cpus);
+}
+
+ThreadAffinity ThreadAffinity::roundRobin(const std::vector<int>& cpus) {
+  if (cpus.empty()) {
+    throw InvalidArgumentException();
+  }
+  return ThreadAffinity(ROUND_ROBIN, cpus);
+}
+
+ThreadAffinity ThreadAffinity::numaNode(int node) {
+  std::vector<int> cpus = getNumaNodeCpus(node);
+  if (cpus.empty()) {
+    throw InvalidArgumentException();
+  }
+  return ThreadAffinity(CPU_SET, cpus);
+}
+
+std::vector<int> ThreadAffinity::cpusFor(size_t thread) const {
+  switch (mode_) {
+  case CPU_SET:
+    return cpus_;
+  case ROUND_ROBIN:
+    return std::vector<int>(1, cpus_[thread % cpus_.size()]);
+  default:
+    return std::vector<int>();
+  }
+}
+
+bool ThreadAffinity::setCurrentThreadCpus(const std::vector<int>& cpus) {
+#ifdef HAVE_SCHED_SETAFFINITY
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (size_t ix = 0; ix < cpus.size(); ix++) {
+    if (cpus[ix] < 0 || cpus[ix] >= CPU_SETSIZE) {
+      return false;
+    }
+    CPU_SET(cpus[ix], &set);
+  }
+  // a pid of 0 is the calling thread, not the whole process
+  return sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+  (void)cpus;
+  return false;
+#endif
+}
+
+std::vector<int> ThreadAffinity::getCurrentThreadCpus() {
+  std::vector<int> result;
+#ifdef HAVE_SCHED_SETAFFINITY
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+      if (CPU_ISSET(cpu, &set)) {
+        result.push_back(cpu);
+      }
+    }
+  }
+#endif
+  return result;
+}
+
+std::vector<int> ThreadAffinity::getNumaNodeCpus(int node) {
+  if (node < 0) {
+    return std::vector<int>();
+  }
+  std::ostringstream path;
+  path << "/sys/devices/system/node/node" << node << "/cpulist";
+  std::ifstream file(path.str().c_str());
+  std::string list;
+  std::getline(file, list);
+  return parseCpuList(list);
+}
+
+std::vector<int> ThreadAffinity::parseCpuList(const std::string& list) {
+  std::vector<int> result;
+  std::istringstream in(list);
+  std::string range;
+  while (std::getline(in, range, ',')) {
+    const char* begin = range.c_str();
+    char* end;
+    long first = strtol(begin, &end, 10);
+    if (end == begin) {
+      continue;
+    }
+    long last = first;
+    if (*end == '-') {
+      begin = end + 1;
+      last = strtol(begin, &end, 10);
+      if (end == begin) {
+        last = first;
+      }
+    }
+    for (long cpu = first; cpu <= last; cpu++) {
+      result.push_back(static_cast<int>(cpu));
+    }
+  }
+  return result;
+}
+}
+}
+} // apache::thrift::concurrency
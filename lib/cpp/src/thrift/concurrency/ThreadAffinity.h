@@ -0,0 +1,97 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef _THRIFT_CONCURRENCY_THREADAFFINITY_H_
+#define _THRIFT_CONCURRENCY_THREADAFFINITY_H_ 1
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+namespace apache {
+namespace thrift {
+namespace concurrency {
+
+/**
+ * The CPUs a group of threads may run on, such as the threads of a thread
+ * factory or the IO threads of a server.  Threads are numbered in the order
+ * they are created or configured, which lets a round robin placement pin
+ * each one to a CPU of its own.
+ *
+ * Affinity is only supported where sched_setaffinity() is (Linux); elsewhere
+ * threads run wherever the operating system schedules them.  Memory is
+ * placed on the NUMA node of the thread that first touches it, so pinning
+ * threads to a node also keeps most of their allocations local.
+ */
+class ThreadAffinity {
+public:
+  enum MODE { ANY, CPU_SET, ROUND_ROBIN };
+
+  /// Threads run wherever the operating system schedules them.
+  ThreadAffinity() : mode_(ANY) {}
+
+  /// Every thread may run on any of cpus.
+  static ThreadAffinity cpuSet(const std::vector<int>& cpus);
+
+  /// Thread n runs on cpus[n % cpus.size()] only.
+  static ThreadAffinity roundRobin(const std::vector<int>& cpus);
+
+  /**
+   * Every thread may run on any CPU of a NUMA node.
+   *
+   * @throws InvalidArgumentException There is no such node.
+   */
+  static ThreadAffinity numaNode(int node);
+
+  MODE getMode() const { return mode_; }
+
+  const std::vector<int>& getCpus() const { return cpus_; }
+
+  bool isSet() const { return mode_ != ANY; }
+
+  /// Gets the CPUs thread n may run on, or none if it may run anywhere.
+  std::vector<int> cpusFor(size_t thread) const;
+
+  /**
+   * Restricts the calling thread to cpus.
+   *
+   * @return false if affinity is not supported or the CPUs were refused.
+   */
+  static bool setCurrentThreadCpus(const std::vector<int>& cpus);
+
+  /// Gets the CPUs the calling thread may run on, or none if unknown.
+  static std::vector<int> getCurrentThreadCpus();
+
+  /// Gets the CPUs of a NUMA node, or none if there is no such node.
+  static std::vector<int> getNumaNodeCpus(int node);
+
+  /// Parses a Linux CPU list such as "0-3,8,10-11".
+  static std::vector<int> parseCpuList(const std::string& list);
+
+private:
+  ThreadAffinity(MODE mode, const std::vector<int>& cpus) : mode_(mode), cpus_(cpus) {}
+
+  MODE mode_;
+  std::vector<int> cpus_;
+};
+}
+}
+} // apache::thrift::concurrency
+
+#endif // #ifndef _THRIFT_CONCURRENCY_THREADAFFINITY_H_
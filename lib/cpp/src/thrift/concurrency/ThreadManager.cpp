@@ -24,11 +24,16 @@
 #include <thrift/concurrency/Monitor.h>
 #include <thrift/concurrency/Util.h>
 
+#include <boost/atomic.hpp>
 #include <boost/shared_ptr.hpp>
 
+#include <algorithm>
 #include <assert.h>
+#include <deque>
+#include <limits>
 #include <queue>
 #include <set>
+#include <vector>
 
 #if defined(DEBUG)
 #include <iostream>
@@ -41,6 +46,103 @@ namespace concurrency {
 using boost::shared_ptr;
 using boost::dynamic_pointer_cast;
 
+ThreadManager::Histogram::Histogram() : count_(0), total_(0), maximum_(0) {
+  std::fill(buckets_, buckets_ + BUCKET_COUNT, 0);
+}
+
+void ThreadManager::Histogram::record(int64_t usec) {
+  if (usec < 0) {
+    usec = 0; // the clock stepped back
+  }
+  size_t index = 0;
+  while (index < BUCKET_COUNT - 1 && (usec >> index) != 0) {
+    index++;
+  }
+  buckets_[index]++;
+  count_++;
+  total_ += usec;
+  maximum_ = std::max(maximum_, usec);
+}
+
+void ThreadManager::Histogram::merge(const Histogram& other) {
+  for (size_t ix = 0; ix < BUCKET_COUNT; ix++) {
+    buckets_[ix] += other.buckets_[ix];
+  }
+  count_ += other.count_;
+  total_ += other.total_;
+  maximum_ = std::max(maximum_, other.maximum_);
+}
+
+int64_t ThreadManager::Histogram::percentile(double percent) const {
+  if (count_ == 0) {
+    return 0;
+  }
+  uint64_t rank = static_cast<uint64_t>(percent / 100.0 * static_cast<double>(count_) + 0.5);
+  rank = std::max<uint64_t>(std::min<uint64_t>(rank, count_), 1);
+  uint64_t seen = 0;
+  for (size_t ix = 0; ix < BUCKET_COUNT - 1; ix++) {
+    seen += buckets_[ix];
+    if (seen >= rank) {
+      return std::min((static_cast<int64_t>(1) << ix) - 1, maximum_);
+    }
+  }
+  return maximum_;
+}
+
+/**
+ * Task timings of one worker.  Only the worker records into them, so the
+ * lock is contended only while a snapshot is taken.
+ */
+struct WorkerTaskStats {
+  void record(int64_t queued, int64_t started, int64_t finished) {
+    Guard g(mutex);
+    stats.queueWait.record(started - queued);
+    stats.runTime.record(finished - started);
+  }
+
+  Mutex mutex;
+  ThreadManager::TaskStats stats;
+};
+
+/**
+ * Task timings of all the workers of a thread manager, keeping those of
+ * workers that have exited.
+ */
+class TaskStatsRegistry {
+
+public:
+  shared_ptr<WorkerTaskStats> add() {
+    shared_ptr<WorkerTaskStats> stats(new WorkerTaskStats());
+    Guard g(mutex_);
+    workers_.push_back(stats);
+    return stats;
+  }
+
+  void remove(shared_ptr<WorkerTaskStats> stats) {
+    Guard g(mutex_);
+    workers_.erase(std::remove(workers_.begin(), workers_.end(), stats), workers_.end());
+    Guard g2(stats->mutex);
+    retired_.queueWait.merge(stats->stats.queueWait);
+    retired_.runTime.merge(stats->stats.runTime);
+  }
+
+  ThreadManager::TaskStats snapshot() const {
+    Guard g(mutex_);
+    ThreadManager::TaskStats result = retired_;
+    for (size_t ix = 0; ix < workers_.size(); ix++) {
+      Guard g2(workers_[ix]->mutex);
+      result.queueWait.merge(workers_[ix]->stats.queueWait);
+      result.runTime.merge(workers_[ix]->stats.runTime);
+    }
+    return result;
+  }
+
+private:
+  Mutex mutex_;
+  std::vector<shared_ptr<WorkerTaskStats> > workers_;
+  ThreadManager::TaskStats retired_;
+};
+
 /**
  * ThreadManager class
  *
@@ -57,12 +159,18 @@ public:
   Impl()
     : workerCount_(0),
       workerMaxCount_(0),
+      exitingCount_(0),
       idleCount_(0),
       pendingTaskCountMax_(0),
       expiredCount_(0),
       state_(ThreadManager::UNINITIALIZED),
+      lanes_(1),
+      pendingCount_(0),
+      weighted_(false),
       monitor_(&mutex_),
-      maxMonitor_(&mutex_) {}
+      maxMonitor_(&mutex_),
+      batchWaiters_(0),
+      controllerRunning_(false) {}
 
   ~Impl() { stop(); }
 
@@ -97,12 +205,12 @@ public:
 
   size_t pendingTaskCount() const {
     Synchronized s(monitor_);
-    return tasks_.size();
+    return pendingCount_;
   }
 
   size_t totalTaskCount() const {
     Synchronized s(monitor_);
-    return tasks_.size() + workerCount_ - idleCount_;
+    return pendingCount_ + workerCount_ - idleCount_;
   }
 
   size_t pendingTaskCountMax() const {
@@ -122,9 +230,23 @@ public:
     pendingTaskCountMax_ = value;
   }
 
+  size_t priorityCount() const { return lanes_.size(); }
+
+  /**
+   * Sets up one queue per weight, before any task is added.  Unless weighted,
+   * the highest priority queue holding a task is always served first.
+   */
+  void priorities(const std::vector<size_t>& weights, bool weighted);
+
   bool canSleep();
 
-  void add(shared_ptr<Runnable> value, int64_t timeout, int64_t expiration);
+  void add(shared_ptr<Runnable> value, int64_t timeout, int64_t expiration) {
+    add(value, timeout, expiration, 0);
+  }
+
+  void add(shared_ptr<Runnable> value, int64_t timeout, int64_t expiration, size_t priority);
+
+  void add(const std::vector<shared_ptr<Runnable> >& values, int64_t timeout, int64_t expiration);
 
   void remove(shared_ptr<Runnable> task);
 
@@ -134,11 +256,33 @@ public:
 
   void setExpireCallback(ExpireCallback expireCallback);
 
+  TaskStats taskStats() const { return taskStats_.snapshot(); }
+
+  void setPoolSizePolicy(const PoolSizePolicy& policy, PoolResizeCallback resizeCallback);
+
+  /**
+   * Resizes the pool by the pool size policy every interval until resizing
+   * is turned off or the thread manager stops.  Run by the controller thread.
+   */
+  void controlPoolSize();
+
 private:
   void stopImpl(bool join);
 
+  /// Starts the controller thread if needed; call with controlMonitor_ held.
+  void startController();
+
+  /// Stops the controller thread and waits for it to finish.
+  void stopController();
+
+  shared_ptr<Task> popTask();
+
   size_t workerCount_;
   size_t workerMaxCount_;
+
+  /// Workers that chose to leave the pool but have not left it yet
+  size_t exitingCount_;
+
   size_t idleCount_;
   size_t pendingTaskCountMax_;
   size_t expiredCount_;
@@ -148,16 +292,44 @@ private:
   shared_ptr<ThreadFactory> threadFactory_;
 
   friend class ThreadManager::Task;
-  std::queue<shared_ptr<Task> > tasks_;
+
+  /**
+   * Pending tasks of one priority.  Weighted lanes take turns by smooth
+   * weighted round robin: each round every lane with tasks earns its weight
+   * in credit, and the richest one is served and pays for the whole round.
+   */
+  struct Lane {
+    Lane() : weight(1), credit(0) {}
+
+    std::queue<shared_ptr<Task> > tasks;
+    int64_t weight;
+    int64_t credit;
+  };
+
+  std::vector<Lane> lanes_;
+  size_t pendingCount_;
+  bool weighted_;
   Mutex mutex_;
   Monitor monitor_;
   Monitor maxMonitor_;
+
+  /// Batch add()s waiting on maxMonitor_, which one freed slot may not fit
+  size_t batchWaiters_;
+
   Monitor workerMonitor_;
 
   friend class ThreadManager::Worker;
   std::set<shared_ptr<Thread> > workers_;
   std::set<shared_ptr<Thread> > deadWorkers_;
   std::map<const Thread::id_t, shared_ptr<Thread> > idMap_;
+
+  TaskStatsRegistry taskStats_;
+
+  PoolSizePolicy poolSizePolicy_;
+  PoolResizeCallback poolResizeCallback_;
+  shared_ptr<Thread> controller_;
+  bool controllerRunning_;
+  Monitor controlMonitor_;
 };
 
 class ThreadManager::Task : public Runnable {
@@ -168,7 +340,10 @@ public:
   Task(shared_ptr<Runnable> runnable, int64_t expiration = 0LL)
     : runnable_(runnable),
       state_(WAITING),
-      expireTime_(expiration != 0LL ? Util::currentTime() + expiration : 0LL) {}
+      expireTime_(expiration != 0LL ? Util::currentTime() + expiration : 0LL),
+      queueTime_(Util::currentTimeUsec()),
+      startTime_(0LL),
+      finishTime_(0LL) {}
 
   ~Task() {}
 
@@ -183,11 +358,23 @@ public:
 
   int64_t getExpireTime() const { return expireTime_; }
 
+  /// Microseconds when the task was added
+  int64_t getQueueTime() const { return queueTime_; }
+
+  /// Microseconds when a worker took the task, or 0
+  int64_t getStartTime() const { return startTime_; }
+
+  /// Microseconds when the task finished running, or 0
+  int64_t getFinishTime() const { return finishTime_; }
+
 private:
   shared_ptr<Runnable> runnable_;
   friend class ThreadManager::Worker;
   STATE state_;
   int64_t expireTime_;
+  int64_t queueTime_;
+  int64_t startTime_;
+  int64_t finishTime_;
 };
 
 class ThreadManager::Worker : public Runnable {
@@ -200,8 +387,8 @@ public:
 
 private:
   bool isActive() const {
-    return (manager_->workerCount_ <= manager_->workerMaxCount_)
-           || (manager_->state_ == JOINING && !manager_->tasks_.empty());
+    return (manager_->workerCount_ - manager_->exitingCount_ <= manager_->workerMaxCount_)
+           || (manager_->state_ == JOINING && manager_->pendingCount_ != 0);
   }
 
 public:
@@ -213,6 +400,7 @@ public:
    */
   void run() {
     bool active = false;
+    bool counted = false;
     /**
      * Increment worker semaphore and notify manager if worker count reached
      * desired max
@@ -225,6 +413,7 @@ public:
       {
         Synchronized s(manager_->monitor_);
         active = manager_->workerCount_ < manager_->workerMaxCount_;
+        counted = active;
         if (active) {
           manager_->workerCount_++;
           notifyManager = manager_->workerCount_ == manager_->workerMaxCount_;
@@ -237,6 +426,8 @@ public:
       }
     }
 
+    shared_ptr<WorkerTaskStats> stats = manager_->taskStats_.add();
+
     while (active) {
       shared_ptr<ThreadManager::Task> task;
 
@@ -245,15 +436,14 @@ public:
        * check that the thread hasn't been requested to stop). Once the queue
        * is non-empty, dequeue a task, release monitor, and execute. If the
        * worker max count has been decremented such that we exceed it, mark
-       * ourself inactive, decrement the worker count and notify the manager
-       * (technically we're notifying the next blocked thread but eventually
-       * the manager will see it.
+       * ourself inactive and count ourself out right away, so that no more
+       * workers than asked for leave the pool.
        */
       {
         Guard g(manager_->mutex_);
         active = isActive();
 
-        while (active && manager_->tasks_.empty()) {
+        while (active && manager_->pendingCount_ == 0) {
           manager_->idleCount_++;
           idle_ = true;
           manager_->monitor_.wait();
@@ -262,28 +452,36 @@ public:
           manager_->idleCount_--;
         }
 
-        if (active) {
+        if (!active) {
+          manager_->exitingCount_++;
+        } else {
           manager_->removeExpiredTasks();
 
-          if (!manager_->tasks_.empty()) {
-            task = manager_->tasks_.front();
-            manager_->tasks_.pop();
+          if (manager_->pendingCount_ != 0) {
+            task = manager_->popTask();
             if (task->state_ == ThreadManager::Task::WAITING) {
               task->state_ = ThreadManager::Task::EXECUTING;
             }
           }
 
           /* If we have a pending task max and we just dropped below it, wakeup any
-             thread that might be blocked on add. */
+             thread that might be blocked on add.  A batch add may not fit in the
+             slot that freed, so with one waiting wake them all, or an add that
+             would fit can be left asleep. */
           if (manager_->pendingTaskCountMax_ != 0
-              && manager_->tasks_.size() <= manager_->pendingTaskCountMax_ - 1) {
-            manager_->maxMonitor_.notify();
+              && manager_->pendingCount_ <= manager_->pendingTaskCountMax_ - 1) {
+            if (manager_->batchWaiters_ > 0) {
+              manager_->maxMonitor_.notifyAll();
+            } else {
+              manager_->maxMonitor_.notify();
+            }
           }
         }
       }
 
       if (task) {
         if (task->state_ == ThreadManager::Task::EXECUTING) {
+          task->startTime_ = Util::currentTimeUsec();
           try {
             task->run();
           } catch (const std::exception& e) {
@@ -291,16 +489,28 @@ public:
           } catch (...) {
             GlobalOutput.printf("[ERROR] task->run() raised an unknown exception");
           }
+          task->finishTime_ = Util::currentTimeUsec();
+          stats->record(task->queueTime_, task->startTime_, task->finishTime_);
         }
       }
     }
 
+    manager_->taskStats_.remove(stats);
+
     {
       Synchronized s(manager_->workerMonitor_);
-      manager_->deadWorkers_.insert(this->thread());
-      idle_ = true;
-      manager_->workerCount_--;
-      bool notifyManager = (manager_->workerCount_ == manager_->workerMaxCount_);
+      bool notifyManager = false;
+      {
+        Synchronized s2(manager_->monitor_);
+        manager_->deadWorkers_.insert(this->thread());
+        idle_ = true;
+        // a worker that found the pool full on start was never counted in
+        if (counted) {
+          manager_->workerCount_--;
+          manager_->exitingCount_--;
+          notifyManager = (manager_->workerCount_ == manager_->workerMaxCount_);
+        }
+      }
       if (notifyManager) {
         manager_->workerMonitor_.notify();
       }
@@ -316,6 +526,19 @@ private:
   bool idle_;
 };
 
+/**
+ * Runnable of the thread that resizes the pool of a thread manager.
+ */
+class PoolSizeController : public Runnable {
+public:
+  PoolSizeController(ThreadManager::Impl* manager) : manager_(manager) {}
+
+  void run() { manager_->controlPoolSize(); }
+
+private:
+  ThreadManager::Impl* manager_;
+};
+
 void ThreadManager::Impl::addWorker(size_t value) {
   std::set<shared_ptr<Thread> > newThreads;
   for (size_t ix = 0; ix < value; ix++) {
@@ -336,6 +559,7 @@ void ThreadManager::Impl::addWorker(size_t value) {
         = dynamic_pointer_cast<ThreadManager::Worker, Runnable>((*ix)->runnable());
     worker->state_ = ThreadManager::Worker::STARTING;
     (*ix)->start();
+    Synchronized s(monitor_);
     idMap_.insert(std::pair<const Thread::id_t, shared_ptr<Thread> >((*ix)->getId(), *ix));
   }
 
@@ -367,6 +591,9 @@ void ThreadManager::Impl::start() {
       monitor_.wait();
     }
   }
+
+  Synchronized s(controlMonitor_);
+  startController();
 }
 
 void ThreadManager::Impl::stopImpl(bool join) {
@@ -385,6 +612,7 @@ void ThreadManager::Impl::stopImpl(bool join) {
   }
 
   if (doStop) {
+    stopController();
     removeWorker(workerCount_);
   }
 
@@ -424,6 +652,7 @@ void ThreadManager::Impl::removeWorker(size_t value) {
       workerMonitor_.wait();
     }
 
+    Synchronized s2(monitor_);
     for (std::set<shared_ptr<Thread> >::iterator ix = deadWorkers_.begin();
          ix != deadWorkers_.end();
          ++ix) {
@@ -440,7 +669,49 @@ bool ThreadManager::Impl::canSleep() {
   return idMap_.find(id) == idMap_.end();
 }
 
-void ThreadManager::Impl::add(shared_ptr<Runnable> value, int64_t timeout, int64_t expiration) {
+void ThreadManager::Impl::priorities(const std::vector<size_t>& weights, bool weighted) {
+  Synchronized s(monitor_);
+  if (pendingCount_ != 0) {
+    throw IllegalStateException("ThreadManager::Impl::priorities tasks pending");
+  }
+  lanes_.assign(std::max<size_t>(weights.size(), 1), Lane());
+  for (size_t ix = 0; ix < weights.size(); ++ix) {
+    lanes_[ix].weight = static_cast<int64_t>(std::max<size_t>(weights[ix], 1));
+  }
+  weighted_ = weighted && lanes_.size() > 1;
+}
+
+shared_ptr<ThreadManager::Task> ThreadManager::Impl::popTask() {
+  size_t next = lanes_.size();
+  if (!weighted_) {
+    for (next = 0; lanes_[next].tasks.empty(); ++next) {
+    }
+  } else {
+    int64_t round = 0;
+    for (size_t ix = 0; ix < lanes_.size(); ++ix) {
+      Lane& lane = lanes_[ix];
+      if (lane.tasks.empty()) {
+        continue;
+      }
+      lane.credit += lane.weight;
+      round += lane.weight;
+      if (next == lanes_.size() || lane.credit > lanes_[next].credit) {
+        next = ix;
+      }
+    }
+    lanes_[next].credit -= round;
+  }
+
+  shared_ptr<ThreadManager::Task> task = lanes_[next].tasks.front();
+  lanes_[next].tasks.pop();
+  pendingCount_--;
+  return task;
+}
+
+void ThreadManager::Impl::add(shared_ptr<Runnable> value,
+                              int64_t timeout,
+                              int64_t expiration,
+                              size_t priority) {
   Guard g(mutex_, timeout);
 
   if (!g) {
@@ -454,9 +725,9 @@ void ThreadManager::Impl::add(shared_ptr<Runnable> value, int64_t timeout, int64
   }
 
   removeExpiredTasks();
-  if (pendingTaskCountMax_ > 0 && (tasks_.size() >= pendingTaskCountMax_)) {
+  if (pendingTaskCountMax_ > 0 && (pendingCount_ >= pendingTaskCountMax_)) {
     if (canSleep() && timeout >= 0) {
-      while (pendingTaskCountMax_ > 0 && tasks_.size() >= pendingTaskCountMax_) {
+      while (pendingTaskCountMax_ > 0 && pendingCount_ >= pendingTaskCountMax_) {
         // This is thread safe because the mutex is shared between monitors.
         maxMonitor_.wait(timeout);
       }
@@ -465,7 +736,9 @@ void ThreadManager::Impl::add(shared_ptr<Runnable> value, int64_t timeout, int64
     }
   }
 
-  tasks_.push(shared_ptr<ThreadManager::Task>(new ThreadManager::Task(value, expiration)));
+  Lane& lane = lanes_[std::min(priority, lanes_.size() - 1)];
+  lane.tasks.push(shared_ptr<ThreadManager::Task>(new ThreadManager::Task(value, expiration)));
+  pendingCount_++;
 
   // If idle thread is available notify it, otherwise all worker threads are
   // running and will get around to this task in time.
@@ -474,6 +747,61 @@ void ThreadManager::Impl::add(shared_ptr<Runnable> value, int64_t timeout, int64
   }
 }
 
+void ThreadManager::Impl::add(const std::vector<shared_ptr<Runnable> >& values,
+                              int64_t timeout,
+                              int64_t expiration) {
+  if (values.empty()) {
+    return;
+  }
+  std::vector<shared_ptr<ThreadManager::Task> > batch;
+  batch.reserve(values.size());
+  for (size_t ix = 0; ix < values.size(); ix++) {
+    batch.push_back(shared_ptr<ThreadManager::Task>(new ThreadManager::Task(values[ix], expiration)));
+  }
+
+  Guard g(mutex_, timeout);
+
+  if (!g) {
+    throw TimedOutException();
+  }
+
+  if (state_ != ThreadManager::STARTED) {
+    throw IllegalStateException(
+        "ThreadManager::Impl::add ThreadManager "
+        "not started");
+  }
+
+  removeExpiredTasks();
+  if (pendingTaskCountMax_ > 0 && (pendingCount_ + batch.size() > pendingTaskCountMax_)) {
+    if (canSleep() && timeout >= 0 && batch.size() <= pendingTaskCountMax_) {
+      batchWaiters_++;
+      try {
+        while (pendingTaskCountMax_ > 0 && pendingCount_ + batch.size() > pendingTaskCountMax_) {
+          // This is thread safe because the mutex is shared between monitors.
+          maxMonitor_.wait(timeout);
+        }
+      } catch (...) {
+        batchWaiters_--;
+        throw;
+      }
+      batchWaiters_--;
+    } else {
+      throw TooManyPendingTasksException();
+    }
+  }
+
+  Lane& lane = lanes_[0];
+  for (size_t ix = 0; ix < batch.size(); ix++) {
+    lane.tasks.push(batch[ix]);
+  }
+  pendingCount_ += batch.size();
+
+  // Wake up an idle thread per task at most; busy ones get to the rest in time.
+  for (size_t ix = std::min(idleCount_, batch.size()); ix > 0; ix--) {
+    monitor_.notify();
+  }
+}
+
 void ThreadManager::Impl::remove(shared_ptr<Runnable> task) {
   (void)task;
   Synchronized s(monitor_);
@@ -492,36 +820,37 @@ boost::shared_ptr<Runnable> ThreadManager::Impl::removeNextPending() {
         "ThreadManager not started");
   }
 
-  if (tasks_.empty()) {
+  if (pendingCount_ == 0) {
     return boost::shared_ptr<Runnable>();
   }
 
-  shared_ptr<ThreadManager::Task> task = tasks_.front();
-  tasks_.pop();
-
-  return task->getRunnable();
+  return popTask()->getRunnable();
 }
 
 void ThreadManager::Impl::removeExpiredTasks() {
   int64_t now = 0LL; // we won't ask for the time untile we need it
 
-  // note that this loop breaks at the first non-expiring task
-  while (!tasks_.empty()) {
-    shared_ptr<ThreadManager::Task> task = tasks_.front();
-    if (task->getExpireTime() == 0LL) {
-      break;
-    }
-    if (now == 0LL) {
-      now = Util::currentTime();
-    }
-    if (task->getExpireTime() > now) {
-      break;
-    }
-    if (expireCallback_) {
-      expireCallback_(task->getRunnable());
+  // note that this loop breaks at the first non-expiring task of each lane
+  for (size_t ix = 0; ix < lanes_.size() && pendingCount_ != 0; ++ix) {
+    std::queue<shared_ptr<Task> >& tasks = lanes_[ix].tasks;
+    while (!tasks.empty()) {
+      shared_ptr<ThreadManager::Task> task = tasks.front();
+      if (task->getExpireTime() == 0LL) {
+        break;
+      }
+      if (now == 0LL) {
+        now = Util::currentTime();
+      }
+      if (task->getExpireTime() > now) {
+        break;
+      }
+      if (expireCallback_) {
+        expireCallback_(task->getRunnable());
+      }
+      tasks.pop();
+      pendingCount_--;
+      expiredCount_++;
     }
-    tasks_.pop();
-    expiredCount_++;
   }
 }
 
@@ -529,12 +858,151 @@ void ThreadManager::Impl::setExpireCallback(ExpireCallback expireCallback) {
   expireCallback_ = expireCallback;
 }
 
+void ThreadManager::Impl::setPoolSizePolicy(const PoolSizePolicy& policy,
+                                            PoolResizeCallback resizeCallback) {
+  if ((policy.maxWorkers != 0 && policy.minWorkers > policy.maxWorkers) || policy.interval <= 0) {
+    throw InvalidArgumentException();
+  }
+
+  Synchronized s(controlMonitor_);
+  poolSizePolicy_ = policy;
+  poolResizeCallback_ = resizeCallback;
+  controlMonitor_.notifyAll();
+  startController();
+}
+
+void ThreadManager::Impl::startController() {
+  if (controllerRunning_ || poolSizePolicy_.maxWorkers == 0 || state_ != ThreadManager::STARTED) {
+    return;
+  }
+  controller_ = threadFactory_->newThread(shared_ptr<Runnable>(new PoolSizeController(this)));
+  controllerRunning_ = true;
+  controller_->start();
+}
+
+void ThreadManager::Impl::stopController() {
+  shared_ptr<Thread> controller;
+  {
+    Synchronized s(controlMonitor_);
+    poolSizePolicy_.maxWorkers = 0;
+    controlMonitor_.notifyAll();
+    while (controllerRunning_) {
+      controlMonitor_.wait();
+    }
+    controller.swap(controller_);
+  }
+}
+
+void ThreadManager::Impl::controlPoolSize() {
+  // the window over which idle workers are counted, restarted whenever none is
+  int64_t idleSince = Util::currentTime();
+  size_t idleMin = std::numeric_limits<size_t>::max();
+
+  while (true) {
+    PoolSizePolicy policy;
+    PoolResizeCallback resizeCallback;
+    {
+      Synchronized s(controlMonitor_);
+      if (poolSizePolicy_.maxWorkers != 0) {
+        try {
+          controlMonitor_.wait(poolSizePolicy_.interval);
+        } catch (TimedOutException&) {
+          // time for the next look at the pool
+        }
+      }
+      if (poolSizePolicy_.maxWorkers == 0) {
+        controllerRunning_ = false;
+        controlMonitor_.notifyAll();
+        return;
+      }
+      policy = poolSizePolicy_;
+      resizeCallback = poolResizeCallback_;
+    }
+
+    PoolResize resize;
+    size_t idle;
+    {
+      Guard g(mutex_);
+      resize.oldWorkerCount = workerMaxCount_;
+      resize.pendingTaskCount = pendingCount_;
+      resize.queueWait = 0LL;
+      int64_t now = Util::currentTimeUsec();
+      for (size_t ix = 0; ix < lanes_.size(); ix++) {
+        if (!lanes_[ix].tasks.empty()) {
+          resize.queueWait
+              = std::max(resize.queueWait, now - lanes_[ix].tasks.front()->getQueueTime());
+        }
+      }
+      idle = idleCount_;
+    }
+
+    int64_t now = Util::currentTime();
+    if (idle == 0) {
+      idleSince = now;
+      idleMin = std::numeric_limits<size_t>::max();
+    } else {
+      idleMin = std::min(idleMin, idle);
+    }
+    resize.idleWorkerCount = idle == 0 ? 0 : idleMin;
+
+    size_t count = resize.oldWorkerCount;
+    size_t target = count;
+    if (count < policy.minWorkers) {
+      target = policy.minWorkers;
+    } else if (count > policy.maxWorkers) {
+      target = policy.maxWorkers;
+    } else if (idle == 0 && resize.queueWait >= policy.queueWaitThreshold * 1000
+               && count < policy.maxWorkers) {
+      size_t step = std::max<size_t>(std::min(resize.pendingTaskCount, count), 1);
+      target = count + std::min(step, policy.maxWorkers - count);
+    } else if (idle != 0 && now - idleSince >= policy.idleTimeout && count > policy.minWorkers) {
+      target = count - std::min(idleMin, count - policy.minWorkers);
+    }
+
+    if (target == count) {
+      continue;
+    }
+
+    try {
+      if (target > count) {
+        addWorker(target - count);
+      } else {
+        removeWorker(count - target);
+      }
+    } catch (const TException& e) {
+      GlobalOutput.printf("[ERROR] resizing the worker pool failed: %s", e.what());
+      continue;
+    }
+    resize.newWorkerCount = target;
+    idleSince = Util::currentTime();
+    idleMin = std::numeric_limits<size_t>::max();
+
+    if (resizeCallback) {
+      try {
+        resizeCallback(resize);
+      } catch (const std::exception& e) {
+        GlobalOutput.printf("[ERROR] resize callback raised an exception: %s", e.what());
+      } catch (...) {
+        GlobalOutput.printf("[ERROR] resize callback raised an unknown exception");
+      }
+    }
+  }
+}
+
 class SimpleThreadManager : public ThreadManager::Impl {
 
 public:
   SimpleThreadManager(size_t workerCount = 4, size_t pendingTaskCountMax = 0)
     : workerCount_(workerCount), pendingTaskCountMax_(pendingTaskCountMax) {}
 
+  SimpleThreadManager(size_t workerCount,
+                      size_t pendingTaskCountMax,
+                      const std::vector<size_t>& weights,
+                      bool weighted)
+    : workerCount_(workerCount), pendingTaskCountMax_(pendingTaskCountMax) {
+    priorities(weights, weighted);
+  }
+
   void start() {
     ThreadManager::Impl::pendingTaskCountMax(pendingTaskCountMax_);
     ThreadManager::Impl::start();
@@ -547,13 +1015,857 @@ private:
   Monitor monitor_;
 };
 
-shared_ptr<ThreadManager> ThreadManager::newThreadManager() {
-  return shared_ptr<ThreadManager>(new ThreadManager::Impl());
-}
+/**
+ * Thread manager that gives every worker a deque of tasks of its own.
+ *
+ * Tasks are added to a global injection queue.  A worker whose deque runs
+ * dry moves its share of the injection queue into it, or failing that
+ * steals half of the deque of another worker, so that under load the
+ * workers mostly take locks of their own rather than one shared by the
+ * whole pool.  Idle workers sleep until there is work.
+ *
+ * Pending tasks are counted across all queues, so pendingTaskCountMax,
+ * expiration and the expire callback work as for the simple thread
+ * manager, except that tasks may start slightly out of order.
+ */
+class WorkStealingThreadManager : public ThreadManager {
 
-shared_ptr<ThreadManager> ThreadManager::newSimpleThreadManager(size_t count,
-                                                                size_t pendingTaskCountMax) {
-  return shared_ptr<ThreadManager>(new SimpleThreadManager(count, pendingTaskCountMax));
+public:
+  using ThreadManager::add;
+
+  WorkStealingThreadManager(size_t workerCount, size_t pendingTaskCountMax)
+    : initialWorkerCount_(workerCount),
+      pendingTaskCountMax_(pendingTaskCountMax),
+      state_(ThreadManager::UNINITIALIZED),
+      workerCount_(0),
+      workerMaxCount_(0),
+      queues_(new QueueList()),
+      numQueues_(0),
+      pendingCount_(0),
+      queuedCount_(0),
+      totalCount_(0),
+      expiredCount_(0),
+      idleCount_(0),
+      addWaiters_(0),
+      batchWaiters_(0),
+      exitRequests_(0) {}
+
+  ~WorkStealingThreadManager() { stop(); }
+
+  void start();
+
+  void stop() { stopImpl(false); }
+
+  void join() { stopImpl(true); }
+
+  ThreadManager::STATE state() const { return state_; }
+
+  shared_ptr<ThreadFactory> threadFactory() const {
+    Synchronized s(monitor_);
+    return threadFactory_;
+  }
+
+  void threadFactory(shared_ptr<ThreadFactory> value) {
+    Synchronized s(monitor_);
+    threadFactory_ = value;
+  }
+
+  void addWorker(size_t value);
+
+  void removeWorker(size_t value);
+
+  size_t idleWorkerCount() const { return idleCount_; }
+
+  size_t workerCount() const {
+    Synchronized s(monitor_);
+    return workerCount_;
+  }
+
+  size_t pendingTaskCount() const { return pendingCount_; }
+
+  size_t totalTaskCount() const { return totalCount_; }
+
+  size_t pendingTaskCountMax() const { return pendingTaskCountMax_; }
+
+  size_t expiredTaskCount() { return expiredCount_.exchange(0); }
+
+  void add(shared_ptr<Runnable> value, int64_t timeout, int64_t expiration);
+
+  void add(const std::vector<shared_ptr<Runnable> >& values, int64_t timeout, int64_t expiration);
+
+  void remove(shared_ptr<Runnable> task);
+
+  shared_ptr<Runnable> removeNextPending();
+
+  void removeExpiredTasks();
+
+  void setExpireCallback(ExpireCallback expireCallback) { expireCallback_ = expireCallback; }
+
+  TaskStats taskStats() const { return taskStats_.snapshot(); }
+
+private:
+  /// Most tasks a worker moves from the injection queue at once
+  static const size_t MAX_BATCH = 16;
+
+  struct Task {
+    /// Moves the task held by other here, leaving other empty
+    void take(Task& other) {
+      runnable.swap(other.runnable);
+      other.runnable.reset();
+      expireTime = other.expireTime;
+      queueTime = other.queueTime;
+    }
+
+    shared_ptr<Runnable> runnable;
+    int64_t expireTime;
+
+    /// Microseconds when the task was added
+    int64_t queueTime;
+  };
+
+  /// A deque of tasks with a lock of its own
+  struct TaskQueue {
+    TaskQueue() : size(0) {}
+
+    Mutex mutex;
+    std::deque<Task> tasks;
+
+    /// tasks.size(), for a look without the lock
+    boost::atomic<size_t> size;
+  };
+
+  typedef std::vector<shared_ptr<TaskQueue> > QueueList;
+
+  class Worker;
+  friend class Worker;
+
+  void stopImpl(bool join);
+
+  bool canSleep() const;
+
+  /// Returns the queues of the running workers.
+  shared_ptr<const QueueList> getQueues() const {
+    Guard g(queuesMutex_);
+    return queues_;
+  }
+
+  /// Blocks until the worker has a task to run; false when it should exit.
+  bool nextTask(Worker& worker, Task& task);
+
+  /// Takes a task from the worker's own deque.
+  bool takeLocal(Worker& worker, Task& task, std::vector<Task>& expired);
+
+  /// Takes a task, and the worker's share of the rest, from the injection queue.
+  bool takeInjected(Worker& worker, Task& task, std::vector<Task>& expired);
+
+  /// Takes a task, and half of the rest, from another worker's deque.
+  bool steal(Worker& worker, Task& task, std::vector<Task>& expired);
+
+  /**
+   * Pops the first task of queue that is still in time into task, moving
+   * expired ones to expired.  Called with the queue's lock held.
+   */
+  bool popTask(TaskQueue& queue, Task& task, std::vector<Task>& expired, int64_t& now);
+
+  /// Accounts for a task taken off the queues.
+  void taskTaken();
+
+  /// Runs the expire callback for expired tasks and accounts for them.
+  void expire(std::vector<Task>& expired);
+
+  /// Wakes up to count sleeping workers.
+  void wakeWorker(size_t count = 1);
+
+  /**
+   * Claims count places among the pending tasks, waiting for room as add()
+   * does.  Tasks added in one call get room together or not at all.
+   */
+  void reservePending(size_t count, int64_t timeout);
+
+  /// Claims one of the pending worker exits, if any may be taken.
+  bool claimExit();
+
+  void registerWorker(Worker& worker);
+
+  void unregisterWorker(Worker& worker);
+
+  const size_t initialWorkerCount_;
+  const size_t pendingTaskCountMax_;
+  ExpireCallback expireCallback_;
+
+  ThreadManager::STATE state_;
+  shared_ptr<ThreadFactory> threadFactory_;
+
+  /// Guards the worker bookkeeping below, like the simple manager's monitor
+  Monitor monitor_;
+  Monitor workerMonitor_;
+  size_t workerCount_;
+  size_t workerMaxCount_;
+  std::set<shared_ptr<Thread> > workers_;
+  std::set<shared_ptr<Thread> > deadWorkers_;
+  std::set<Thread::id_t> workerIds_;
+
+  /// Where add() puts tasks
+  TaskQueue injection_;
+
+  /// Deques of the running workers, replaced whenever a worker comes or goes
+  Mutex queuesMutex_;
+  shared_ptr<const QueueList> queues_;
+  boost::atomic<size_t> numQueues_;
+
+  /// Tasks added and not taken yet, counting those being added
+  boost::atomic<size_t> pendingCount_;
+
+  /// Tasks sitting in one of the queues; workers sleep only when it is zero
+  boost::atomic<size_t> queuedCount_;
+
+  /// Tasks added and not finished yet
+  boost::atomic<size_t> totalCount_;
+
+  boost::atomic<size_t> expiredCount_;
+
+  /// Workers sleeping on sleepMonitor_
+  boost::atomic<size_t> idleCount_;
+  Monitor sleepMonitor_;
+
+  /// Callers of add() waiting on maxMonitor_ for the pending count to drop
+  boost::atomic<size_t> addWaiters_;
+
+  /// Those of them adding more than one task, which one freed slot may not fit
+  boost::atomic<size_t> batchWaiters_;
+  Monitor maxMonitor_;
+
+  /// Workers asked to exit by removeWorker() that have not done so yet
+  boost::atomic<size_t> exitRequests_;
+
+  TaskStatsRegistry taskStats_;
+};
+
+const size_t WorkStealingThreadManager::MAX_BATCH;
+
+class WorkStealingThreadManager::Worker : public Runnable {
+
+public:
+  Worker(WorkStealingThreadManager* manager, uint32_t seed)
+    : manager_(manager), queue_(new TaskQueue()), random_(seed ? seed : 1) {}
+
+  void run() {
+    manager_->registerWorker(*this);
+    shared_ptr<WorkerTaskStats> stats = manager_->taskStats_.add();
+
+    Task task;
+    while (manager_->nextTask(*this, task)) {
+      int64_t startTime = Util::currentTimeUsec();
+      try {
+        task.runnable->run();
+      } catch (const std::exception& e) {
+        GlobalOutput.printf("[ERROR] task->run() raised an exception: %s", e.what());
+      } catch (...) {
+        GlobalOutput.printf("[ERROR] task->run() raised an unknown exception");
+      }
+      stats->record(task.queueTime, startTime, Util::currentTimeUsec());
+      task.runnable.reset();
+      --manager_->totalCount_;
+    }
+
+    manager_->taskStats_.remove(stats);
+    manager_->unregisterWorker(*this);
+  }
+
+private:
+  friend class WorkStealingThreadManager;
+
+  /// xorshift32, to spread the victims of stealing
+  uint32_t nextRandom() {
+    random_ ^= random_ << 13;
+    random_ ^= random_ >> 17;
+    random_ ^= random_ << 5;
+    return random_;
+  }
+
+  WorkStealingThreadManager* manager_;
+  shared_ptr<TaskQueue> queue_;
+  uint32_t random_;
+
+  /// Scratch space for tasks moved between queues
+  std::vector<Task> moving_;
+  std::vector<Task> expired_;
+};
+
+void WorkStealingThreadManager::start() {
+  if (state_ == ThreadManager::STOPPED) {
+    return;
+  }
+
+  {
+    Synchronized s(monitor_);
+    if (state_ != ThreadManager::UNINITIALIZED) {
+      return;
+    }
+    if (!threadFactory_) {
+      throw InvalidArgumentException();
+    }
+    state_ = ThreadManager::STARTED;
+  }
+  addWorker(initialWorkerCount_);
+}
+
+void WorkStealingThreadManager::stopImpl(bool join) {
+  bool doStop = false;
+  if (state_ == ThreadManager::STOPPED) {
+    return;
+  }
+
+  {
+    Synchronized s(monitor_);
+    if (state_ != ThreadManager::STOPPING && state_ != ThreadManager::JOINING
+        && state_ != ThreadManager::STOPPED) {
+      doStop = true;
+      state_ = join ? ThreadManager::JOINING : ThreadManager::STOPPING;
+    }
+  }
+
+  if (doStop) {
+    removeWorker(workerCount());
+  }
+
+  {
+    Synchronized s(monitor_);
+    state_ = ThreadManager::STOPPED;
+  }
+}
+
+void WorkStealingThreadManager::addWorker(size_t value) {
+  std::set<shared_ptr<Thread> > newThreads;
+  {
+    Synchronized s(monitor_);
+    for (size_t ix = 0; ix < value; ix++) {
+      uint32_t seed = static_cast<uint32_t>(workerMaxCount_ + ix + 1) * 0x9E3779B9u;
+      newThreads.insert(threadFactory_->newThread(shared_ptr<Worker>(new Worker(this, seed))));
+    }
+    workerMaxCount_ += value;
+    workers_.insert(newThreads.begin(), newThreads.end());
+  }
+
+  for (std::set<shared_ptr<Thread> >::iterator ix = newThreads.begin(); ix != newThreads.end();
+       ++ix) {
+    (*ix)->start();
+  }
+
+  {
+    Synchronized s(workerMonitor_);
+    while (workerCount() != workerMaxCount_) {
+      workerMonitor_.wait();
+    }
+  }
+}
+
+void WorkStealingThreadManager::removeWorker(size_t value) {
+  {
+    Synchronized s(monitor_);
+    if (value > workerMaxCount_) {
+      throw InvalidArgumentException();
+    }
+    workerMaxCount_ -= value;
+  }
+
+  exitRequests_ += value;
+  {
+    Synchronized s(sleepMonitor_);
+    sleepMonitor_.notifyAll();
+  }
+
+  {
+    Synchronized s(workerMonitor_);
+    while (workerCount() != workerMaxCount_) {
+      workerMonitor_.wait();
+    }
+  }
+
+  Synchronized s(monitor_);
+  for (std::set<shared_ptr<Thread> >::iterator ix = deadWorkers_.begin();
+       ix != deadWorkers_.end();
+       ++ix) {
+    workers_.erase(*ix);
+  }
+  deadWorkers_.clear();
+}
+
+void WorkStealingThreadManager::registerWorker(Worker& worker) {
+  {
+    Guard g(queuesMutex_);
+    shared_ptr<QueueList> queues(new QueueList(*queues_));
+    queues->push_back(worker.queue_);
+    queues_ = queues;
+    numQueues_ = queues->size();
+  }
+
+  bool notifyManager;
+  {
+    Synchronized s(monitor_);
+    workerIds_.insert(threadFactory_->getCurrentThreadId());
+    ++workerCount_;
+    notifyManager = workerCount_ == workerMaxCount_;
+  }
+  if (notifyManager) {
+    Synchronized s(workerMonitor_);
+    workerMonitor_.notify();
+  }
+}
+
+void WorkStealingThreadManager::unregisterWorker(Worker& worker) {
+  {
+    Guard g(queuesMutex_);
+    shared_ptr<QueueList> queues(new QueueList());
+    for (size_t ix = 0; ix < queues_->size(); ++ix) {
+      if ((*queues_)[ix] != worker.queue_) {
+        queues->push_back((*queues_)[ix]);
+      }
+    }
+    queues_ = queues;
+    numQueues_ = queues->size();
+  }
+
+  // hand what we still hold to the remaining workers
+  worker.moving_.clear();
+  {
+    Guard g(worker.queue_->mutex);
+    worker.moving_.assign(worker.queue_->tasks.begin(), worker.queue_->tasks.end());
+    worker.queue_->tasks.clear();
+    worker.queue_->size = 0;
+  }
+  if (!worker.moving_.empty()) {
+    Guard g(injection_.mutex);
+    injection_.tasks.insert(injection_.tasks.end(), worker.moving_.begin(), worker.moving_.end());
+    injection_.size = injection_.tasks.size();
+  }
+  worker.moving_.clear();
+  wakeWorker();
+
+  Synchronized s(workerMonitor_);
+  {
+    Synchronized s2(monitor_);
+    workerIds_.erase(threadFactory_->getCurrentThreadId());
+    deadWorkers_.insert(worker.thread());
+    --workerCount_;
+    if (workerCount_ != workerMaxCount_) {
+      return;
+    }
+  }
+  workerMonitor_.notify();
+}
+
+bool WorkStealingThreadManager::canSleep() const {
+  Synchronized s(monitor_);
+  return workerIds_.find(threadFactory_->getCurrentThreadId()) == workerIds_.end();
+}
+
+bool WorkStealingThreadManager::claimExit() {
+  size_t requests = exitRequests_;
+  while (requests > 0) {
+    // joining workers finish the queued tasks first
+    if (state_ == ThreadManager::JOINING && queuedCount_ > 0) {
+      return false;
+    }
+    if (exitRequests_.compare_exchange_weak(requests, requests - 1)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool WorkStealingThreadManager::nextTask(Worker& worker, Task& task) {
+  while (true) {
+    if (claimExit()) {
+      return false;
+    }
+
+    worker.expired_.clear();
+    bool found = takeLocal(worker, task, worker.expired_)
+                 || takeInjected(worker, task, worker.expired_)
+                 || steal(worker, task, worker.expired_);
+    if (!worker.expired_.empty()) {
+      expire(worker.expired_);
+    }
+    if (found) {
+      // what we keep for later is there for an idle worker to steal
+      if (worker.queue_->size > 0 && idleCount_ > 0) {
+        wakeWorker();
+      }
+      return true;
+    }
+
+    // tasks may be on their way between queues; only sleep if there are none
+    Synchronized s(sleepMonitor_);
+    ++idleCount_;
+    if (queuedCount_ == 0 && exitRequests_ == 0) {
+      sleepMonitor_.wait();
+    }
+    --idleCount_;
+  }
+}
+
+bool WorkStealingThreadManager::popTask(TaskQueue& queue,
+                                        Task& task,
+                                        std::vector<Task>& expired,
+                                        int64_t& now) {
+  while (!queue.tasks.empty()) {
+    Task& front = queue.tasks.front();
+    if (front.expireTime != 0LL) {
+      if (now == 0LL) {
+        now = Util::currentTime();
+      }
+      if (front.expireTime <= now) {
+        expired.push_back(front);
+        queue.tasks.pop_front();
+        continue;
+      }
+    }
+    task.take(front);
+    queue.tasks.pop_front();
+    queue.size = queue.tasks.size();
+    taskTaken();
+    return true;
+  }
+  queue.size = 0;
+  return false;
+}
+
+bool WorkStealingThreadManager::takeLocal(Worker& worker, Task& task, std::vector<Task>& expired) {
+  TaskQueue& queue = *worker.queue_;
+  if (queue.size == 0) {
+    return false;
+  }
+  int64_t now = 0LL;
+  Guard g(queue.mutex);
+  return popTask(queue, task, expired, now);
+}
+
+bool WorkStealingThreadManager::takeInjected(Worker& worker,
+                                             Task& task,
+                                             std::vector<Task>& expired) {
+  if (injection_.size == 0) {
+    return false;
+  }
+
+  int64_t now = 0LL;
+  worker.moving_.clear();
+  {
+    Guard g(injection_.mutex);
+    if (!popTask(injection_, task, expired, now)) {
+      return false;
+    }
+    // a backlog is shared out among the workers
+    size_t workers = std::max<size_t>(numQueues_, 1);
+    size_t share = std::min(injection_.tasks.size() / workers, MAX_BATCH);
+    for (size_t ix = 0; ix < share; ++ix) {
+      worker.moving_.push_back(Task());
+      worker.moving_.back().take(injection_.tasks.front());
+      injection_.tasks.pop_front();
+    }
+    injection_.size = injection_.tasks.size();
+  }
+
+  if (!worker.moving_.empty()) {
+    TaskQueue& queue = *worker.queue_;
+    Guard g(queue.mutex);
+    queue.tasks.insert(queue.tasks.end(), worker.moving_.begin(), worker.moving_.end());
+    queue.size = queue.tasks.size();
+    worker.moving_.clear();
+  }
+  return true;
+}
+
+bool WorkStealingThreadManager::steal(Worker& worker, Task& task, std::vector<Task>& expired) {
+  if (queuedCount_ == 0) {
+    return false;
+  }
+
+  shared_ptr<const QueueList> queues = getQueues();
+  size_t count = queues->size();
+  if (count < 2) {
+    return false;
+  }
+
+  int64_t now = 0LL;
+  size_t start = worker.nextRandom() % count;
+  for (size_t ix = 0; ix < count; ++ix) {
+    TaskQueue& victim = *(*queues)[(start + ix) % count];
+    if (&victim == worker.queue_.get() || victim.size == 0) {
+      continue;
+    }
+
+    worker.moving_.clear();
+    {
+      Guard g(victim.mutex);
+      if (!popTask(victim, task, expired, now)) {
+        continue;
+      }
+      size_t half = victim.tasks.size() / 2;
+      for (size_t jx = 0; jx < half; ++jx) {
+        worker.moving_.push_back(Task());
+        worker.moving_.back().take(victim.tasks.front());
+        victim.tasks.pop_front();
+      }
+      victim.size = victim.tasks.size();
+    }
+
+    if (!worker.moving_.empty()) {
+      TaskQueue& queue = *worker.queue_;
+      Guard g(queue.mutex);
+      queue.tasks.insert(queue.tasks.end(), worker.moving_.begin(), worker.moving_.end());
+      queue.size = queue.tasks.size();
+      worker.moving_.clear();
+    }
+    return true;
+  }
+  return false;
+}
+
+void WorkStealingThreadManager::taskTaken() {
+  --queuedCount_;
+  --pendingCount_;
+  if (addWaiters_ > 0) {
+    Synchronized s(maxMonitor_);
+    if (batchWaiters_ > 0) {
+      maxMonitor_.notifyAll();
+    } else {
+      maxMonitor_.notify();
+    }
+  }
+}
+
+void WorkStealingThreadManager::expire(std::vector<Task>& expired) {
+  for (size_t ix = 0; ix < expired.size(); ++ix) {
+    --queuedCount_;
+    --pendingCount_;
+    if (expireCallback_) {
+      expireCallback_(expired[ix].runnable);
+    }
+    ++expiredCount_;
+    --totalCount_;
+  }
+  expired.clear();
+  if (addWaiters_ > 0) {
+    Synchronized s(maxMonitor_);
+    maxMonitor_.notifyAll();
+  }
+}
+
+void WorkStealingThreadManager::wakeWorker(size_t count) {
+  Synchronized s(sleepMonitor_);
+  for (size_t ix = 0; ix < count; ++ix) {
+    sleepMonitor_.notify();
+  }
+}
+
+void WorkStealingThreadManager::reservePending(size_t count, int64_t timeout) {
+  if (pendingTaskCountMax_ > 0 && count > pendingTaskCountMax_) {
+    throw TooManyPendingTasksException();
+  }
+
+  size_t pending = pendingCount_;
+  while (true) {
+    if (pendingTaskCountMax_ > 0 && pending + count > pendingTaskCountMax_) {
+      removeExpiredTasks();
+      if (!canSleep() || timeout < 0) {
+        if (pendingCount_ + count > pendingTaskCountMax_) {
+          throw TooManyPendingTasksException();
+        }
+      } else {
+        Synchronized s(maxMonitor_);
+        size_t batch = count > 1 ? 1 : 0;
+        ++addWaiters_;
+        batchWaiters_ += batch;
+        try {
+          while (pendingCount_ + count > pendingTaskCountMax_) {
+            maxMonitor_.wait(timeout);
+          }
+        } catch (...) {
+          --addWaiters_;
+          batchWaiters_ -= batch;
+          throw;
+        }
+        --addWaiters_;
+        batchWaiters_ -= batch;
+      }
+      pending = pendingCount_;
+      continue;
+    }
+    if (pendingCount_.compare_exchange_weak(pending, pending + count)) {
+      return;
+    }
+  }
+}
+
+void WorkStealingThreadManager::add(shared_ptr<Runnable> value,
+                                    int64_t timeout,
+                                    int64_t expiration) {
+  if (state_ != ThreadManager::STARTED) {
+    throw IllegalStateException(
+        "WorkStealingThreadManager::add ThreadManager "
+        "not started");
+  }
+
+  // claim a place among the pending tasks before queueing
+  reservePending(1, timeout);
+  ++totalCount_;
+
+  Task task;
+  task.runnable = value;
+  task.expireTime = expiration != 0LL ? Util::currentTime() + expiration : 0LL;
+  task.queueTime = Util::currentTimeUsec();
+  {
+    Guard g(injection_.mutex);
+    injection_.tasks.push_back(Task());
+    injection_.tasks.back().take(task);
+    injection_.size = injection_.tasks.size();
+    ++queuedCount_;
+  }
+
+  // a busy worker gets to the task in time otherwise
+  if (idleCount_ > 0) {
+    wakeWorker();
+  }
+}
+
+void WorkStealingThreadManager::add(const std::vector<shared_ptr<Runnable> >& values,
+                                    int64_t timeout,
+                                    int64_t expiration) {
+  if (state_ != ThreadManager::STARTED) {
+    throw IllegalStateException(
+        "WorkStealingThreadManager::add ThreadManager "
+        "not started");
+  }
+  if (values.empty()) {
+    return;
+  }
+
+  reservePending(values.size(), timeout);
+  totalCount_ += values.size();
+
+  int64_t expireTime = expiration != 0LL ? Util::currentTime() + expiration : 0LL;
+  int64_t queueTime = Util::currentTimeUsec();
+  {
+    Guard g(injection_.mutex);
+    for (size_t ix = 0; ix < values.size(); ix++) {
+      injection_.tasks.push_back(Task());
+      Task& task = injection_.tasks.back();
+      task.runnable = values[ix];
+      task.expireTime = expireTime;
+      task.queueTime = queueTime;
+    }
+    injection_.size = injection_.tasks.size();
+    queuedCount_ += values.size();
+  }
+
+  size_t idle = idleCount_;
+  if (idle > 0) {
+    wakeWorker(std::min(idle, values.size()));
+  }
+}
+
+void WorkStealingThreadManager::remove(shared_ptr<Runnable> task) {
+  (void)task;
+  Synchronized s(monitor_);
+  if (state_ != ThreadManager::STARTED) {
+    throw IllegalStateException(
+        "WorkStealingThreadManager::remove ThreadManager not "
+        "started");
+  }
+}
+
+shared_ptr<Runnable> WorkStealingThreadManager::removeNextPending() {
+  if (state_ != ThreadManager::STARTED) {
+    throw IllegalStateException(
+        "WorkStealingThreadManager::removeNextPending "
+        "ThreadManager not started");
+  }
+
+  // the injection queue holds the oldest tasks nobody has taken yet
+  shared_ptr<const QueueList> queues = getQueues();
+  for (size_t ix = 0; ix <= queues->size(); ++ix) {
+    TaskQueue& queue = ix == 0 ? injection_ : *(*queues)[ix - 1];
+    if (queue.size == 0) {
+      continue;
+    }
+    shared_ptr<Runnable> runnable;
+    {
+      Guard g(queue.mutex);
+      if (queue.tasks.empty()) {
+        continue;
+      }
+      runnable.swap(queue.tasks.front().runnable);
+      queue.tasks.pop_front();
+      queue.size = queue.tasks.size();
+    }
+    taskTaken();
+    --totalCount_;
+    return runnable;
+  }
+  return shared_ptr<Runnable>();
+}
+
+void WorkStealingThreadManager::removeExpiredTasks() {
+  std::vector<Task> expired;
+  int64_t now = Util::currentTime();
+
+  shared_ptr<const QueueList> queues = getQueues();
+  for (size_t ix = 0; ix <= queues->size(); ++ix) {
+    TaskQueue& queue = ix == 0 ? injection_ : *(*queues)[ix - 1];
+    if (queue.size == 0) {
+      continue;
+    }
+    Guard g(queue.mutex);
+    // as with the simple manager, stop at the first task that is in time
+    while (!queue.tasks.empty() && queue.tasks.front().expireTime != 0LL
+           && queue.tasks.front().expireTime <= now) {
+      expired.push_back(queue.tasks.front());
+      queue.tasks.pop_front();
+    }
+    queue.size = queue.tasks.size();
+  }
+
+  if (!expired.empty()) {
+    expire(expired);
+  }
+}
+
+void ThreadManager::setPoolSizePolicy(const PoolSizePolicy& policy,
+                                      PoolResizeCallback resizeCallback) {
+  (void)policy;
+  (void)resizeCallback;
+  throw IllegalStateException("ThreadManager::setPoolSizePolicy pool size is fixed");
+}
+
+shared_ptr<ThreadManager> ThreadManager::newThreadManager() {
+  return shared_ptr<ThreadManager>(new ThreadManager::Impl());
+}
+
+shared_ptr<ThreadManager> ThreadManager::newSimpleThreadManager(size_t count,
+                                                                size_t pendingTaskCountMax) {
+  return shared_ptr<ThreadManager>(new SimpleThreadManager(count, pendingTaskCountMax));
+}
+
+shared_ptr<ThreadManager> ThreadManager::newWorkStealingThreadManager(size_t count,
+                                                                     size_t pendingTaskCountMax) {
+  return shared_ptr<ThreadManager>(new WorkStealingThreadManager(count, pendingTaskCountMax));
+}
+
+shared_ptr<ThreadManager> ThreadManager::newPriorityThreadManager(size_t count,
+                                                                  size_t priorityCount,
+                                                                  size_t pendingTaskCountMax) {
+  std::vector<size_t> weights(priorityCount, 1);
+  return shared_ptr<ThreadManager>(
+      new SimpleThreadManager(count, pendingTaskCountMax, weights, false));
+}
+
+shared_ptr<ThreadManager> ThreadManager::newWeightedPriorityThreadManager(
+    size_t count,
+    const std::vector<size_t>& weights,
+    size_t pendingTaskCountMax) {
+  return shared_ptr<ThreadManager>(
+      new SimpleThreadManager(count, pendingTaskCountMax, weights, true));
 }
 }
 }
@@ -25,6 +25,8 @@
 #include <sys/types.h>
 #include <thrift/concurrency/Thread.h>
 
+#include <vector>
+
 namespace apache {
 namespace thrift {
 namespace concurrency {
@@ -61,6 +63,113 @@ protected:
 public:
   typedef apache::thrift::stdcxx::function<void(boost::shared_ptr<Runnable>)> ExpireCallback;
 
+  /**
+   * Counts of durations in microseconds, in buckets of powers of two.  Bucket
+   * 0 counts durations of 0, bucket i > 0 those from 2^(i-1) to 2^i - 1, and
+   * the last bucket everything longer.
+   */
+  class Histogram {
+  public:
+    enum { BUCKET_COUNT = 40 };
+
+    Histogram();
+
+    /// Counts a duration.
+    void record(int64_t usec);
+
+    /// Adds the counts of other to this histogram.
+    void merge(const Histogram& other);
+
+    /// Number of durations counted
+    uint64_t count() const { return count_; }
+
+    /// Sum of the durations counted
+    int64_t total() const { return total_; }
+
+    /// Longest duration counted
+    int64_t maximum() const { return maximum_; }
+
+    /// Average duration, or 0 if none was counted
+    int64_t mean() const { return count_ == 0 ? 0 : total_ / static_cast<int64_t>(count_); }
+
+    /// Number of durations counted in a bucket
+    uint64_t bucket(size_t index) const { return buckets_[index]; }
+
+    /**
+     * Gets an upper bound on a percentile of the durations counted: the
+     * end of the bucket it falls into, or the longest duration if smaller.
+     *
+     * @param percent the percentile, 0 to 100.
+     */
+    int64_t percentile(double percent) const;
+
+  private:
+    uint64_t buckets_[BUCKET_COUNT];
+    uint64_t count_;
+    int64_t total_;
+    int64_t maximum_;
+  };
+
+  /**
+   * Timing of the tasks run so far.
+   */
+  struct TaskStats {
+    /// Time from add() until a worker took the task
+    Histogram queueWait;
+
+    /// Time the task took to run
+    Histogram runTime;
+  };
+
+  /**
+   * Bounds and thresholds within which a thread manager resizes its pool of
+   * workers on its own.  Every interval milliseconds it looks at the oldest
+   * pending task and at the idle workers: once the oldest task has waited
+   * queueWaitThreshold milliseconds with no worker idle, the pool grows, by
+   * at most one worker per pending task and at most doubling; once some
+   * workers have stayed idle through idleTimeout milliseconds, the pool
+   * shrinks by that many.  The pool never leaves minWorkers to maxWorkers.
+   */
+  struct PoolSizePolicy {
+    PoolSizePolicy(size_t minWorkers = 1,
+                   size_t maxWorkers = 0,
+                   int64_t queueWaitThreshold = 10LL,
+                   int64_t idleTimeout = 60000LL,
+                   int64_t interval = 100LL)
+      : minWorkers(minWorkers),
+        maxWorkers(maxWorkers),
+        queueWaitThreshold(queueWaitThreshold),
+        idleTimeout(idleTimeout),
+        interval(interval) {}
+
+    size_t minWorkers;
+
+    /// Largest pool size; 0 leaves the pool size alone
+    size_t maxWorkers;
+
+    int64_t queueWaitThreshold;
+    int64_t idleTimeout;
+    int64_t interval;
+  };
+
+  /**
+   * A resize of the worker pool, and what it was decided on.
+   */
+  struct PoolResize {
+    size_t oldWorkerCount;
+    size_t newWorkerCount;
+
+    /// Microseconds the oldest pending task had waited
+    int64_t queueWait;
+
+    /// Fewest workers idle since the last resize
+    size_t idleWorkerCount;
+
+    size_t pendingTaskCount;
+  };
+
+  typedef apache::thrift::stdcxx::function<void(const PoolResize&)> PoolResizeCallback;
+
   virtual ~ThreadManager() {}
 
   /**
@@ -127,6 +236,14 @@ public:
    */
   virtual size_t expiredTaskCount() = 0;
 
+  /**
+   * Gets the queue wait and run time of the tasks run so far, including by
+   * workers that have since been removed.  Each worker keeps its own counts,
+   * which this sums up while the workers carry on.  Thread managers that do
+   * not keep timings return empty histograms.
+   */
+  virtual TaskStats taskStats() const { return TaskStats(); }
+
   /**
    * Adds a task to be executed at some time in the future by a worker thread.
    *
@@ -150,6 +267,45 @@ public:
                    int64_t timeout = 0LL,
                    int64_t expiration = 0LL) = 0;
 
+  /**
+   * Adds a task like add() above, to the queue of the given priority.  0 is
+   * the highest priority; priorities past priorityCount() - 1 are taken as
+   * the lowest one.  Thread managers with a single priority ignore it.
+   *
+   * @param priority the priority of the task.
+   */
+  virtual void add(boost::shared_ptr<Runnable> task,
+                   int64_t timeout,
+                   int64_t expiration,
+                   size_t priority) {
+    (void)priority;
+    add(task, timeout, expiration);
+  }
+
+  /**
+   * Adds several tasks like add() above, as one batch: the batch is only
+   * queued once there is room below pendingTaskCountMax() for all of it, and
+   * then wakes up as many idle workers as it has tasks.  Thread managers that
+   * do not queue batches add the tasks one by one.
+   *
+   * @param tasks the tasks to queue for execution, in order.
+   *
+   * @throws TooManyPendingTasksException The batch does not fit below the max
+   * pending task count, or never can.
+   */
+  virtual void add(const std::vector<boost::shared_ptr<Runnable> >& tasks,
+                   int64_t timeout = 0LL,
+                   int64_t expiration = 0LL) {
+    for (size_t ix = 0; ix < tasks.size(); ++ix) {
+      add(tasks[ix], timeout, expiration);
+    }
+  }
+
+  /**
+   * Gets the number of priorities tasks can be added with.
+   */
+  virtual size_t priorityCount() const { return 1; }
+
   /**
    * Removes a pending task
    */
@@ -175,6 +331,23 @@ public:
    */
   virtual void setExpireCallback(ExpireCallback expireCallback) = 0;
 
+  /**
+   * Lets the thread manager add and remove workers on its own, within the
+   * bounds of policy, from a thread of its thread factory.  Workers may
+   * still be added and removed by hand.  A policy with maxWorkers of 0 stops
+   * resizing.
+   *
+   * @param policy the bounds and thresholds to resize by.
+   * @param resizeCallback a function called after each resize, from the
+   * thread that resized.  It must not stop the thread manager.
+   *
+   * @throws InvalidArgumentException minWorkers exceeds maxWorkers, or the
+   * interval is not positive.
+   * @throws IllegalStateException The thread manager does not resize.
+   */
+  virtual void setPoolSizePolicy(const PoolSizePolicy& policy,
+                                 PoolResizeCallback resizeCallback = PoolResizeCallback());
+
   static boost::shared_ptr<ThreadManager> newThreadManager();
 
   /**
@@ -185,6 +358,39 @@ public:
   static boost::shared_ptr<ThreadManager> newSimpleThreadManager(size_t count = 4,
                                                                  size_t pendingTaskCountMax = 0);
 
+  /**
+   * Creates a thread manager like newSimpleThreadManager(), except that each
+   * worker thread keeps a deque of tasks of its own.  Workers take their
+   * share of newly added tasks in batches and steal from each other when
+   * they run out, so they rarely contend on a lock shared by the whole pool.
+   * Tasks may start slightly out of the order in which they were added.
+   */
+  static boost::shared_ptr<ThreadManager> newWorkStealingThreadManager(
+      size_t count = 4,
+      size_t pendingTaskCountMax = 0);
+
+  /**
+   * Creates a thread manager like newSimpleThreadManager() with priorityCount
+   * queues of pending tasks.  Workers always run the oldest task of the
+   * highest priority pending, so lower priorities wait as long as higher ones
+   * keep the workers busy.  Tasks added without a priority get priority 0.
+   */
+  static boost::shared_ptr<ThreadManager> newPriorityThreadManager(size_t count,
+                                                                   size_t priorityCount,
+                                                                   size_t pendingTaskCountMax = 0);
+
+  /**
+   * Creates a thread manager like newPriorityThreadManager() with one priority
+   * per entry of weights.  Rather than always running the highest priority
+   * first, workers share out the tasks they start among the priorities that
+   * have tasks pending, in proportion to their weights, so no priority
+   * starves.  Weights of 0 count as 1.
+   */
+  static boost::shared_ptr<ThreadManager> newWeightedPriorityThreadManager(
+      size_t count,
+      const std::vector<size_t>& weights,
+      size_t pendingTaskCountMax = 0);
+
   class Task;
 
   class Worker;
@@ -21,9 +21,10 @@
 #include <thrift/concurrency/Exception.h>
 #include <thrift/concurrency/Util.h>
 
+#include <algorithm>
 #include <assert.h>
 #include <iostream>
-#include <set>
+#include <vector>
 
 namespace apache {
 namespace thrift {
@@ -41,7 +42,13 @@ class TimerManager::Task : public Runnable {
 public:
   enum STATE { WAITING, EXECUTING, CANCELLED, COMPLETE };
 
-  Task(shared_ptr<Runnable> runnable) : runnable_(runnable), state_(WAITING) {}
+  Task(shared_ptr<Runnable> runnable, int64_t expiration)
+    : runnable_(runnable),
+      state_(WAITING),
+      expiration_(expiration),
+      slot_(NULL),
+      prev_(NULL),
+      next_(NULL) {}
 
   ~Task() {}
 
@@ -54,8 +61,168 @@ public:
 
 private:
   shared_ptr<Runnable> runnable_;
+  friend class TimerManager;
   friend class TimerManager::Dispatcher;
+  friend class TimerManager::Wheel;
   STATE state_;
+  int64_t expiration_;
+
+  /// Head of the wheel slot listing the task, NULL when not in the wheel
+  Task** slot_;
+  Task* prev_;
+  Task* next_;
+
+  /// Keeps the task alive while the wheel lists it
+  shared_ptr<Task> self_;
+};
+
+/**
+ * Hierarchical timing wheel after Varghese and Lauck, with millisecond
+ * ticks.  Level 0 has a slot for each of the next 256 ticks, and each level
+ * above a slot for each span covered by a whole level below.  Whenever a
+ * level comes round, the tasks of the next slot of the level above move
+ * down to where they now belong.  Slots are intrusive lists, so listing and
+ * unlisting a task take constant time.  Guarded by the manager's monitor.
+ */
+class TimerManager::Wheel {
+
+public:
+  Wheel() : now_(0), count_(0) {
+    std::fill(&slots_[0][0], &slots_[0][0] + LEVELS * SLOTS, static_cast<Task*>(NULL));
+  }
+
+  ~Wheel() { clear(); }
+
+  size_t size() const { return count_; }
+
+  /// Moves an empty wheel to the current time.
+  void reset(int64_t now) {
+    assert(count_ == 0);
+    now_ = now;
+  }
+
+  void insert(shared_ptr<Task> task) {
+    task->self_ = task;
+    link(task.get());
+    count_++;
+  }
+
+  void erase(Task* task) {
+    unlink(task);
+    count_--;
+    // the caller holds a reference, so the task does not go away here
+    task->self_.reset();
+  }
+
+  /// Takes out the tasks due by now, in order.
+  void advance(int64_t now, std::vector<shared_ptr<Task> >& expired) {
+    if (count_ == 0) {
+      now_ = std::max(now_, now + 1);
+      return;
+    }
+    for (; now_ <= now; now_++) {
+      // move the next slot of each level that came round down
+      for (int level = 1; level < LEVELS && (now_ & mask(level - 1)) == 0; level++) {
+        cascade(level);
+      }
+      Task*& head = slots_[0][now_ & SLOT_MASK];
+      while (head != NULL) {
+        Task* task = head;
+        unlink(task);
+        count_--;
+        expired.push_back(shared_ptr<Task>());
+        expired.back().swap(task->self_);
+      }
+    }
+  }
+
+  /**
+   * Returns the time of the next tick that has tasks due or needs tasks
+   * moved down, or 0 if the wheel is empty.
+   */
+  int64_t nextTime() const {
+    if (count_ == 0) {
+      return 0;
+    }
+    int64_t end = (now_ | SLOT_MASK) + 1;
+    for (int64_t tick = now_; tick < end; tick++) {
+      if (slots_[0][tick & SLOT_MASK] != NULL) {
+        return tick;
+      }
+    }
+    return end;
+  }
+
+  void clear() {
+    for (int level = 0; level < LEVELS; level++) {
+      for (int slot = 0; slot < SLOTS; slot++) {
+        while (slots_[level][slot] != NULL) {
+          shared_ptr<Task> task = slots_[level][slot]->self_;
+          erase(task.get());
+        }
+      }
+    }
+  }
+
+private:
+  enum { LEVELS = 4, SLOT_BITS = 8, SLOTS = 1 << SLOT_BITS, SLOT_MASK = SLOTS - 1 };
+
+  /// Mask of the ticks within one slot of level
+  static int64_t mask(int level) {
+    return (static_cast<int64_t>(1) << (SLOT_BITS * (level + 1))) - 1;
+  }
+
+  void link(Task* task) {
+    int64_t when = std::max(task->expiration_, now_);
+    int64_t delta = when - now_;
+    int level = 0;
+    while (level < LEVELS - 1 && delta > mask(level)) {
+      level++;
+    }
+    if (delta > mask(LEVELS - 1)) {
+      // beyond the top level; moved down again once it comes round
+      when = now_ + mask(LEVELS - 1);
+    }
+    Task*& head = slots_[level][(when >> (SLOT_BITS * level)) & SLOT_MASK];
+    task->slot_ = &head;
+    task->prev_ = NULL;
+    task->next_ = head;
+    if (head != NULL) {
+      head->prev_ = task;
+    }
+    head = task;
+  }
+
+  void unlink(Task* task) {
+    if (task->prev_ != NULL) {
+      task->prev_->next_ = task->next_;
+    } else {
+      *task->slot_ = task->next_;
+    }
+    if (task->next_ != NULL) {
+      task->next_->prev_ = task->prev_;
+    }
+    task->slot_ = NULL;
+    task->prev_ = NULL;
+    task->next_ = NULL;
+  }
+
+  void cascade(int level) {
+    Task*& head = slots_[level][(now_ >> (SLOT_BITS * level)) & SLOT_MASK];
+    Task* task = head;
+    head = NULL;
+    while (task != NULL) {
+      Task* next = task->next_;
+      link(task);
+      task = next;
+    }
+  }
+
+  Task* slots_[LEVELS][SLOTS];
+
+  /// The next tick to take tasks out for
+  int64_t now_;
+  size_t count_;
 };
 
 class TimerManager::Dispatcher : public Runnable {
@@ -68,7 +235,7 @@ public:
   /**
    * Dispatcher entry point
    *
-   * As long as dispatcher thread is running, pull tasks off the task taskMap_
+   * As long as dispatcher thread is running, pull tasks off the timing wheel
    * and execute.
    */
   void run() {
@@ -80,46 +247,40 @@ public:
       }
     }
 
+    std::vector<shared_ptr<TimerManager::Task> > expiredTasks;
     do {
-      std::set<shared_ptr<TimerManager::Task> > expiredTasks;
       {
         Synchronized s(manager_->monitor_);
-        task_iterator expiredTaskEnd;
-        int64_t now = Util::currentTime();
-        while (manager_->state_ == TimerManager::STARTED
-               && (expiredTaskEnd = manager_->taskMap_.upper_bound(now))
-                  == manager_->taskMap_.begin()) {
-          int64_t timeout = 0LL;
-          if (!manager_->taskMap_.empty()) {
-            timeout = manager_->taskMap_.begin()->first - now;
+        while (manager_->state_ == TimerManager::STARTED) {
+          int64_t now = Util::currentTime();
+          manager_->wheel_->advance(now, expiredTasks);
+          if (!expiredTasks.empty()) {
+            break;
           }
-          assert((timeout != 0 && manager_->taskCount_ > 0)
-                 || (timeout == 0 && manager_->taskCount_ == 0));
+          int64_t wakeTime = manager_->wheel_->nextTime();
+          assert(wakeTime == 0 || wakeTime > now);
+          assert((wakeTime != 0 && manager_->taskCount_ > 0)
+                 || (wakeTime == 0 && manager_->taskCount_ == 0));
+          manager_->wakeTime_ = wakeTime;
           try {
-            manager_->monitor_.wait(timeout);
+            manager_->monitor_.wait(wakeTime == 0 ? 0LL : wakeTime - now);
           } catch (TimedOutException&) {
           }
-          now = Util::currentTime();
         }
+        manager_->wakeTime_ = 0;
 
-        if (manager_->state_ == TimerManager::STARTED) {
-          for (task_iterator ix = manager_->taskMap_.begin(); ix != expiredTaskEnd; ix++) {
-            shared_ptr<TimerManager::Task> task = ix->second;
-            expiredTasks.insert(task);
-            if (task->state_ == TimerManager::Task::WAITING) {
-              task->state_ = TimerManager::Task::EXECUTING;
-            }
-            manager_->taskCount_--;
+        for (size_t ix = 0; ix < expiredTasks.size(); ix++) {
+          if (expiredTasks[ix]->state_ == TimerManager::Task::WAITING) {
+            expiredTasks[ix]->state_ = TimerManager::Task::EXECUTING;
           }
-          manager_->taskMap_.erase(manager_->taskMap_.begin(), expiredTaskEnd);
+          manager_->taskCount_--;
         }
       }
 
-      for (std::set<shared_ptr<Task> >::iterator ix = expiredTasks.begin();
-           ix != expiredTasks.end();
-           ++ix) {
-        (*ix)->run();
+      for (size_t ix = 0; ix < expiredTasks.size(); ix++) {
+        expiredTasks[ix]->run();
       }
+      expiredTasks.clear();
 
     } while (manager_->state_ == TimerManager::STARTED);
 
@@ -144,8 +305,10 @@ private:
 #endif
 
 TimerManager::TimerManager()
-  : taskCount_(0),
+  : wheel_(new Wheel()),
+    taskCount_(0),
     state_(TimerManager::UNINITIALIZED),
+    wakeTime_(0),
     dispatcher_(shared_ptr<Dispatcher>(new Dispatcher(this))) {
 }
 
@@ -212,7 +375,8 @@ void TimerManager::stop() {
 
   if (doStop) {
     // Clean up any outstanding tasks
-    taskMap_.clear();
+    wheel_->clear();
+    taskCount_ = 0;
 
     // Remove dispatcher's reference to us.
     dispatcher_->manager_ = NULL;
@@ -233,35 +397,37 @@ size_t TimerManager::taskCount() const {
   return taskCount_;
 }
 
-void TimerManager::add(shared_ptr<Runnable> task, int64_t timeout) {
+TimerManager::Timer TimerManager::addTimer(shared_ptr<Runnable> task, int64_t timeout) {
   int64_t now = Util::currentTime();
   timeout += now;
 
+  shared_ptr<Task> timer(new Task(task, timeout));
   {
     Synchronized s(monitor_);
     if (state_ != TimerManager::STARTED) {
       throw IllegalStateException();
     }
 
-    // If the task map is empty, we will kick the dispatcher for sure. Otherwise, we kick him
-    // if the expiration time is shorter than the current value. Need to test before we insert,
-    // because the new task might insert at the front.
-    bool notifyRequired = (taskCount_ == 0) ? true : timeout < taskMap_.begin()->first;
+    if (wheel_->size() == 0) {
+      wheel_->reset(now);
+    }
+
+    // Kick the dispatcher if it sleeps for good or past the new expiration,
+    // so it can update its timeout.
+    bool notifyRequired = wakeTime_ == 0 || timeout < wakeTime_;
 
     taskCount_++;
-    taskMap_.insert(
-        std::pair<int64_t, shared_ptr<Task> >(timeout, shared_ptr<Task>(new Task(task))));
+    wheel_->insert(timer);
 
-    // If the task map was empty, or if we have an expiration that is earlier
-    // than any previously seen, kick the dispatcher so it can update its
-    // timeout
     if (notifyRequired) {
       monitor_.notify();
     }
   }
+  return timer;
 }
 
-void TimerManager::add(shared_ptr<Runnable> task, const struct THRIFT_TIMESPEC& value) {
+TimerManager::Timer TimerManager::addTimer(shared_ptr<Runnable> task,
+                                           const struct THRIFT_TIMESPEC& value) {
 
   int64_t expiration;
   Util::toMilliseconds(expiration, value);
@@ -272,10 +438,11 @@ void TimerManager::add(shared_ptr<Runnable> task, const struct THRIFT_TIMESPEC&
     throw InvalidArgumentException();
   }
 
-  add(task, expiration - now);
+  return addTimer(task, expiration - now);
 }
 
-void TimerManager::add(shared_ptr<Runnable> task, const struct timeval& value) {
+TimerManager::Timer TimerManager::addTimer(shared_ptr<Runnable> task,
+                                           const struct timeval& value) {
 
   int64_t expiration;
   Util::toMilliseconds(expiration, value);
@@ -286,7 +453,19 @@ void TimerManager::add(shared_ptr<Runnable> task, const struct timeval& value) {
     throw InvalidArgumentException();
   }
 
-  add(task, expiration - now);
+  return addTimer(task, expiration - now);
+}
+
+void TimerManager::add(shared_ptr<Runnable> task, int64_t timeout) {
+  addTimer(task, timeout);
+}
+
+void TimerManager::add(shared_ptr<Runnable> task, const struct THRIFT_TIMESPEC& timeout) {
+  addTimer(task, timeout);
+}
+
+void TimerManager::add(shared_ptr<Runnable> task, const struct timeval& timeout) {
+  addTimer(task, timeout);
 }
 
 void TimerManager::remove(shared_ptr<Runnable> task) {
@@ -297,6 +476,24 @@ void TimerManager::remove(shared_ptr<Runnable> task) {
   }
 }
 
+void TimerManager::removeTimer(Timer timer) {
+  shared_ptr<Task> task = timer.lock();
+  Synchronized s(monitor_);
+  if (state_ != TimerManager::STARTED) {
+    throw IllegalStateException();
+  }
+  if (!task || task->state_ == Task::CANCELLED) {
+    throw NoSuchTaskException();
+  }
+  if (task->slot_ == NULL) {
+    // taken out of the wheel for execution
+    throw UncancellableTaskException();
+  }
+  wheel_->erase(task.get());
+  task->state_ = Task::CANCELLED;
+  taskCount_--;
+}
+
 TimerManager::STATE TimerManager::state() const {
   return state_;
 }
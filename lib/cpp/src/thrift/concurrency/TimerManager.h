@@ -24,8 +24,9 @@
 #include <thrift/concurrency/Monitor.h>
 #include <thrift/concurrency/Thread.h>
 
+#include <boost/scoped_ptr.hpp>
 #include <boost/shared_ptr.hpp>
-#include <map>
+#include <boost/weak_ptr.hpp>
 #include <time.h>
 
 namespace apache {
@@ -35,13 +36,22 @@ namespace concurrency {
 /**
  * Timer Manager
  *
- * This class dispatches timer tasks when they fall due.
+ * This class dispatches timer tasks when they fall due.  Pending tasks are
+ * kept in a hierarchical timing wheel with millisecond ticks, so adding and
+ * removing a task take constant time however many are pending.
  *
  * @version $Id:$
  */
 class TimerManager {
 
 public:
+  class Task;
+
+  /**
+   * Handle of an added task, for removeTimer().  Does not keep the task alive.
+   */
+  typedef boost::weak_ptr<Task> Timer;
+
   TimerManager();
 
   virtual ~TimerManager();
@@ -88,6 +98,33 @@ public:
    */
   virtual void add(boost::shared_ptr<Runnable> task, const struct timeval& timeout);
 
+  /**
+   * Adds a task like add(), returning a handle to cancel it with.
+   *
+   * @param task The task to execute
+   * @param timeout Time in milliseconds to delay before executing task
+   * @return a handle for removeTimer().
+   */
+  Timer addTimer(boost::shared_ptr<Runnable> task, int64_t timeout);
+
+  /**
+   * Adds a task like add(), returning a handle to cancel it with.
+   *
+   * @param task The task to execute
+   * @param timeout Absolute time in the future to execute task.
+   * @return a handle for removeTimer().
+   */
+  Timer addTimer(boost::shared_ptr<Runnable> task, const struct THRIFT_TIMESPEC& timeout);
+
+  /**
+   * Adds a task like add(), returning a handle to cancel it with.
+   *
+   * @param task The task to execute
+   * @param timeout Absolute time in the future to execute task.
+   * @return a handle for removeTimer().
+   */
+  Timer addTimer(boost::shared_ptr<Runnable> task, const struct timeval& timeout);
+
   /**
    * Removes a pending task
    *
@@ -100,24 +137,36 @@ public:
    */
   virtual void remove(boost::shared_ptr<Runnable> task);
 
+  /**
+   * Removes a pending task, in constant time.
+   *
+   * @param timer The handle addTimer() returned for the task
+   *
+   * @throws NoSuchTaskException The task has run and is gone, or was removed
+   *                             already.
+   *
+   * @throws UncancellableTaskException The task is being executed.
+   */
+  void removeTimer(Timer timer);
+
   enum STATE { UNINITIALIZED, STARTING, STARTED, STOPPING, STOPPED };
 
   virtual STATE state() const;
 
 private:
   boost::shared_ptr<const ThreadFactory> threadFactory_;
-  class Task;
   friend class Task;
-  std::multimap<int64_t, boost::shared_ptr<Task> > taskMap_;
+  class Wheel;
+  boost::scoped_ptr<Wheel> wheel_;
   size_t taskCount_;
   Monitor monitor_;
   STATE state_;
+  /// When the dispatcher means to wake up next, 0 if only when notified
+  int64_t wakeTime_;
   class Dispatcher;
   friend class Dispatcher;
   boost::shared_ptr<Dispatcher> dispatcher_;
   boost::shared_ptr<Thread> dispatcherThread_;
-  typedef std::multimap<int64_t, boost::shared_ptr<TimerManager::Task> >::iterator task_iterator;
-  typedef std::pair<task_iterator, task_iterator> task_range;
 };
 }
 }
@@ -20,10 +20,14 @@
 #ifndef THRIFT_TMULTIPLEXEDPROCESSOR_H_
 #define THRIFT_TMULTIPLEXEDPROCESSOR_H_ 1
 
+#include <map>
+#include <vector>
 #include <thrift/protocol/TProtocolDecorator.h>
+#include <thrift/concurrency/Mutex.h>
 #include <thrift/TApplicationException.h>
 #include <thrift/TProcessor.h>
-#include <boost/tokenizer.hpp>
+#include <thrift/TStringView.h>
+#include <boost/unordered_map.hpp>
 
 namespace apache {
 namespace thrift {
@@ -53,6 +57,12 @@ public:
     return 0; // (Normal TProtocol read functions return number of bytes read)
   }
 
+  /**
+   * Forwards to _protocol from now on, so one instance can serve one call
+   * after another.  An empty _protocol lets go of the last one.
+   */
+  void reset(shared_ptr<protocol::TProtocol> _protocol) { setProtocol(_protocol); }
+
   std::string name;
   TMessageType type;
   int32_t seqid;
@@ -101,7 +111,12 @@ public:
     *                         implementing WeatherReportIf interface.
     */
   void registerProcessor(const std::string& serviceName, shared_ptr<TProcessor> processor) {
-    services[serviceName] = processor;
+    services_t::iterator it = services.insert(std::make_pair(serviceName, processor)).first;
+    it->second = processor;
+    // the map's key outlives the view, its node never moves
+    servicesByView[TStringView(it->first.data(),
+                               static_cast<uint32_t>(it->first.size()),
+                               boost::shared_ptr<const void>())] = processor;
   }
 
   /**
@@ -115,6 +130,10 @@ public:
    *         that allows readMessageBegin() to return the original TMessage.</li>
    * </ol>
    *
+   * The decorated protocols are kept and reused, and the service is looked
+   * up without copying its name, so once warmed up a call allocates nothing
+   * here.
+   *
    * \throws TException If the message type is not T_CALL or T_ONEWAY, if
    * the service name was not found in the message, or if the service
    * name was not found in the service map.
@@ -122,7 +141,10 @@ public:
   bool process(shared_ptr<protocol::TProtocol> in,
                shared_ptr<protocol::TProtocol> out,
                void* connectionContext) {
-    std::string name;
+    // The message is read into the name of the decorator that will pass it
+    // on, which already has room for it after the first few calls.
+    StoredProtocol stored(*this, in);
+    std::string& name = stored->name;
     protocol::TMessageType type;
     int32_t seqid;
 
@@ -147,53 +169,105 @@ public:
       throw TException(msg);
     }
 
-    // Extract the service name
+    // A valid message name consists of the service name and the name of
+    // the method to call, separated by the first ':'.
+    std::string::size_type separator = name.find(':');
+    if (separator == std::string::npos || separator == 0 || separator + 1 == name.size()) {
+      return false;
+    }
 
-    boost::tokenizer<boost::char_separator<char> > tok(name, boost::char_separator<char>(":"));
+    // Search for a processor associated with this service name.
+    services_by_view_t::iterator it = servicesByView.find(
+        TStringView(name.data(), static_cast<uint32_t>(separator), boost::shared_ptr<const void>()));
 
-    std::vector<std::string> tokens;
-    std::copy(tok.begin(), tok.end(), std::back_inserter(tokens));
+    if (it == servicesByView.end()) {
+      // Unknown service.
+      in->skip(::apache::thrift::protocol::T_STRUCT);
+      in->readMessageEnd();
+      in->getTransport()->readEnd();
 
-    // A valid message should consist of two tokens: the service
-    // name and the name of the method to call.
-    if (tokens.size() == 2) {
-      // Search for a processor associated with this service name.
-      services_t::iterator it = services.find(tokens[0]);
+      std::string msg("TMultiplexedProcessor: Unknown service: ");
+      msg.append(name, 0, separator);
+      ::apache::thrift::TApplicationException
+          x(::apache::thrift::TApplicationException::PROTOCOL_ERROR, msg);
+      out->writeMessageBegin(name, ::apache::thrift::protocol::T_EXCEPTION, seqid);
+      x.write(out.get());
+      out->writeMessageEnd();
+      out->getTransport()->writeEnd();
+      out->getTransport()->flush();
+      msg += ". Did you forget to call registerProcessor()?";
+      throw TException(msg);
+    }
+
+    // Let the processor registered for this service name process the
+    // message, which it reads without the service name.
+    name.erase(0, separator + 1);
+    stored->type = type;
+    stored->seqid = seqid;
+    return it->second->process(stored.get(), out, connectionContext);
+  }
 
-      if (it != services.end()) {
-        shared_ptr<TProcessor> processor = it->second;
-        // Let the processor registered for this service name
-        // process the message.
-        return processor
-            ->process(shared_ptr<protocol::TProtocol>(
-                          new protocol::StoredMessageProtocol(in, tokens[1], type, seqid)),
-                      out,
-                      connectionContext);
+private:
+  typedef boost::unordered_map<TStringView, shared_ptr<TProcessor> > services_by_view_t;
+
+  /**
+   * Takes a decorator from the pool and points it at a protocol, then puts
+   * it back once the call is done.  A decorator some processor kept a
+   * reference to is left to it rather than reused.
+   */
+  class StoredProtocol {
+  public:
+    StoredProtocol(TMultiplexedProcessor& owner, const shared_ptr<protocol::TProtocol>& in)
+      : owner_(owner) {
+      {
+        concurrency::Guard g(owner_.storedMutex);
+        if (!owner_.stored.empty()) {
+          protocol_.swap(owner_.stored.back());
+          owner_.stored.pop_back();
+        }
+      }
+      if (protocol_) {
+        protocol_->reset(in);
       } else {
-        // Unknown service.
-        in->skip(::apache::thrift::protocol::T_STRUCT);
-        in->readMessageEnd();
-        in->getTransport()->readEnd();
-
-        std::string msg("TMultiplexedProcessor: Unknown service: ");
-        msg += tokens[0];
-        ::apache::thrift::TApplicationException
-            x(::apache::thrift::TApplicationException::PROTOCOL_ERROR, msg);
-        out->writeMessageBegin(name, ::apache::thrift::protocol::T_EXCEPTION, seqid);
-        x.write(out.get());
-        out->writeMessageEnd();
-        out->getTransport()->writeEnd();
-        out->getTransport()->flush();
-        msg += ". Did you forget to call registerProcessor()?";
-        throw TException(msg);
+        protocol_.reset(new protocol::StoredMessageProtocol(in, "", protocol::T_CALL, 0));
       }
     }
-    return false;
-  }
 
-private:
+    ~StoredProtocol() {
+      if (!protocol_.unique()) {
+        return;
+      }
+      protocol_->reset(shared_ptr<protocol::TProtocol>());
+      try {
+        concurrency::Guard g(owner_.storedMutex);
+        owner_.stored.push_back(shared_ptr<protocol::StoredMessageProtocol>());
+        owner_.stored.back().swap(protocol_);
+      } catch (...) {
+        // without room in the pool, the decorator is simply freed
+      }
+    }
+
+    const shared_ptr<protocol::StoredMessageProtocol>& get() const { return protocol_; }
+
+    protocol::StoredMessageProtocol* operator->() const { return protocol_.get(); }
+
+  private:
+    TMultiplexedProcessor& owner_;
+    shared_ptr<protocol::StoredMessageProtocol> protocol_;
+  };
+
   /** Map of service processor objects, indexed by service names. */
   services_t services;
+
+  /**
+   * The same processors, indexed by views of the names in services, so a
+   * service can be looked up by a part of the message name without copying it.
+   */
+  services_by_view_t servicesByView;
+
+  /** Decorators no call is using, kept to be reused. */
+  std::vector<shared_ptr<protocol::StoredMessageProtocol> > stored;
+  concurrency::Mutex storedMutex;
 };
 }
 }
@@ -0,0 +1,92 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef _THRIFT_PROTOCOL_TARENAPROTOCOL_H_
+#define _THRIFT_PROTOCOL_TARENAPROTOCOL_H_ 1
+
+#include <string>
+
+#include <boost/shared_ptr.hpp>
+
+#include <thrift/TArena.h>
+#include <thrift/TStringView.h>
+#include <thrift/protocol/TProtocol.h>
+
+namespace apache {
+namespace thrift {
+namespace protocol {
+
+/**
+ * Helper templates for reading and writing the strings of structs generated
+ * with the cpp:arena option.  Reads go through a std::string kept by the
+ * arena, so protocols need no arena specific methods, and the only arena
+ * allocation is the final copy.
+ */
+template <class Protocol_>
+uint32_t readArenaString(Protocol_& prot, TArenaString& str) {
+  TArena* arena = str.get_allocator().getArena();
+  std::string local;
+  std::string& buf = arena != NULL ? arena->getScratch() : local;
+  uint32_t result = prot.readString(buf);
+  str.assign(buf.data(), buf.size());
+  return result;
+}
+
+template <class Protocol_>
+uint32_t readArenaBinary(Protocol_& prot, TArenaString& str) {
+  TArena* arena = str.get_allocator().getArena();
+  std::string local;
+  std::string& buf = arena != NULL ? arena->getScratch() : local;
+  uint32_t result = prot.readBinary(buf);
+  str.assign(buf.data(), buf.size());
+  return result;
+}
+
+template <class Protocol_>
+uint32_t writeArenaString(Protocol_& prot, const TArenaString& str) {
+  return prot.writeStringView(TStringView(str.data(),
+                                          static_cast<uint32_t>(str.size()),
+                                          boost::shared_ptr<const void>()));
+}
+
+template <class Protocol_>
+uint32_t writeArenaBinary(Protocol_& prot, const TArenaString& str) {
+  return prot.writeBinaryView(TStringView(str.data(),
+                                          static_cast<uint32_t>(str.size()),
+                                          boost::shared_ptr<const void>()));
+}
+
+template <class Protocol_>
+uint32_t serializedSizeArenaString(Protocol_& prot, const TArenaString& str) {
+  return prot.serializedSizeStringView(TStringView(str.data(),
+                                                   static_cast<uint32_t>(str.size()),
+                                                   boost::shared_ptr<const void>()));
+}
+
+template <class Protocol_>
+uint32_t serializedSizeArenaBinary(Protocol_& prot, const TArenaString& str) {
+  return prot.serializedSizeBinaryView(TStringView(str.data(),
+                                                   static_cast<uint32_t>(str.size()),
+                                                   boost::shared_ptr<const void>()));
+}
+}
+}
+} // apache::thrift::protocol
+
+#endif // #ifndef _THRIFT_PROTOCOL_TARENAPROTOCOL_H_
@@ -24,6 +24,7 @@
 #include <thrift/protocol/TVirtualProtocol.h>
 
 #include <boost/shared_ptr.hpp>
+#include <limits>
 
 namespace apache {
 namespace thrift {
@@ -47,7 +48,8 @@ public:
       string_limit_(0),
       container_limit_(0),
       strict_read_(false),
-      strict_write_(true) {}
+      strict_write_(true),
+      borrow_views_(false) {}
 
   TBinaryProtocolT(boost::shared_ptr<Transport_> trans,
                    int32_t string_limit,
@@ -59,7 +61,8 @@ public:
       string_limit_(string_limit),
       container_limit_(container_limit),
       strict_read_(strict_read),
-      strict_write_(strict_write) {}
+      strict_write_(strict_write),
+      borrow_views_(false) {}
 
   void setStringSizeLimit(int32_t string_limit) { string_limit_ = string_limit; }
 
@@ -70,6 +73,14 @@ public:
     strict_write_ = strict_write;
   }
 
+  /**
+   * Lets readStringView() and readBinaryView() return views into the
+   * transport's buffer rather than copies.  Only for transports whose buffer
+   * holds the whole message and stays put while the views are in use, such
+   * as a TMemoryBuffer wrapping a frame.
+   */
+  void setBorrowViews(bool borrow_views) { borrow_views_ = borrow_views; }
+
   /**
    * Writing functions.
    */
@@ -119,6 +130,123 @@ public:
 
   inline uint32_t writeBinary(const std::string& str);
 
+  uint32_t writeStringView(const TStringView& str) { return writeString(str); }
+
+  uint32_t writeBinaryView(const TStringView& str) { return writeString(str); }
+
+  /**
+   * Write a whole list of fixed width values, byte swapping them a vector
+   * at a time where the byte order calls for it.
+   */
+  uint32_t writeI32Array(const int32_t* values, uint32_t count);
+
+  uint32_t writeI64Array(const int64_t* values, uint32_t count);
+
+  uint32_t writeDoubleArray(const double* values, uint32_t count);
+
+  /**
+   * Write a value read by readRaw() straight to the transport.
+   */
+  uint32_t writeRaw(const std::string& raw);
+
+  /**
+   * Sizing functions, which give the sizes the writing functions write.
+   */
+
+  uint32_t serializedSizeStructBegin(const char* name) {
+    (void)name;
+    return 0;
+  }
+
+  uint32_t serializedSizeStructEnd() { return 0; }
+
+  uint32_t serializedSizeFieldBegin(const char* name,
+                                    const TType fieldType,
+                                    const int16_t fieldId) {
+    (void)name;
+    (void)fieldType;
+    (void)fieldId;
+    return 3;
+  }
+
+  uint32_t serializedSizeFieldStop() { return 1; }
+
+  uint32_t serializedSizeMapBegin(const TType keyType, const TType valType, const uint32_t size) {
+    (void)keyType;
+    (void)valType;
+    (void)size;
+    return 6;
+  }
+
+  uint32_t serializedSizeListBegin(const TType elemType, const uint32_t size) {
+    (void)elemType;
+    (void)size;
+    return 5;
+  }
+
+  uint32_t serializedSizeSetBegin(const TType elemType, const uint32_t size) {
+    (void)elemType;
+    (void)size;
+    return 5;
+  }
+
+  uint32_t serializedSizeBool(const bool value) {
+    (void)value;
+    return 1;
+  }
+
+  uint32_t serializedSizeByte(const int8_t byte) {
+    (void)byte;
+    return 1;
+  }
+
+  uint32_t serializedSizeI16(const int16_t i16) {
+    (void)i16;
+    return 2;
+  }
+
+  uint32_t serializedSizeI32(const int32_t i32) {
+    (void)i32;
+    return 4;
+  }
+
+  uint32_t serializedSizeI64(const int64_t i64) {
+    (void)i64;
+    return 8;
+  }
+
+  uint32_t serializedSizeDouble(const double dub) {
+    (void)dub;
+    return 8;
+  }
+
+  uint32_t serializedSizeString(const std::string& str) { return serializedSizeBytes(str.size()); }
+
+  uint32_t serializedSizeBinary(const std::string& str) { return serializedSizeBytes(str.size()); }
+
+  uint32_t serializedSizeStringView(const TStringView& str) {
+    return serializedSizeBytes(str.size());
+  }
+
+  uint32_t serializedSizeBinaryView(const TStringView& str) {
+    return serializedSizeBytes(str.size());
+  }
+
+  uint32_t serializedSizeI32Array(const int32_t* values, uint32_t count) {
+    (void)values;
+    return 4 * count;
+  }
+
+  uint32_t serializedSizeI64Array(const int64_t* values, uint32_t count) {
+    (void)values;
+    return 8 * count;
+  }
+
+  uint32_t serializedSizeDoubleArray(const double* values, uint32_t count) {
+    (void)values;
+    return 8 * count;
+  }
+
   /**
    * Reading functions
    */
@@ -166,7 +294,52 @@ public:
 
   inline uint32_t readBinary(std::string& str);
 
+  uint32_t readStringView(TStringView& str);
+
+  uint32_t readBinaryView(TStringView& str) { return readStringView(str); }
+
+  /**
+   * Read a whole list of fixed width values with a single transport read,
+   * then byte swap them in place.
+   */
+  uint32_t readI32Array(int32_t* values, uint32_t count);
+
+  uint32_t readI64Array(int64_t* values, uint32_t count);
+
+  uint32_t readDoubleArray(double* values, uint32_t count);
+
+  /**
+   * Skip a value by walking its encoding in the transport's buffer, which
+   * jumps over strings and runs of fixed width values, or the usual way
+   * where the buffer does not hold all of it.
+   */
+  uint32_t skip(TType type);
+
+  /**
+   * Copy a whole value out of the transport's buffer without decoding it,
+   * where the buffer holds all of it.
+   */
+  uint32_t readRaw(TType type, std::string& raw);
+
+  const char* getRawFormat() const;
+
+  boost::shared_ptr<TProtocolFactory> getRawFactory();
+
+  bool hasSerializedSize() const { return true; }
+
 protected:
+  uint32_t serializedSizeBytes(size_t size) {
+    if (size > static_cast<size_t>((std::numeric_limits<int32_t>::max)()))
+      throw TProtocolException(TProtocolException::SIZE_LIMIT);
+    return 4 + static_cast<uint32_t>(size);
+  }
+
+  template <typename Word_>
+  uint32_t writeWords(const uint8_t* data, uint32_t count);
+
+  template <typename Word_>
+  uint32_t readWords(uint8_t* data, uint32_t count);
+
   template <typename StrType>
   uint32_t readStringBody(StrType& str, int32_t sz);
 
@@ -178,6 +351,8 @@ protected:
   // Enforce presence of version identifier
   bool strict_read_;
   bool strict_write_;
+
+  bool borrow_views_;
 };
 
 typedef TBinaryProtocolT<TTransport> TBinaryProtocol;
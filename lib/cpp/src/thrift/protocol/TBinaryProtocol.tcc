@@ -21,13 +21,259 @@
 #define _THRIFT_PROTOCOL_TBINARYPROTOCOL_TCC_ 1
 
 #include <thrift/protocol/TBinaryProtocol.h>
+#include <thrift/transport/TBufferTransports.h>
 
+#include <algorithm>
+#include <cstring>
 #include <limits>
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
 namespace apache {
 namespace thrift {
 namespace protocol {
 
+namespace detail {
+namespace binary {
+
+template <class ByteOrder_>
+inline uint32_t fromWire(uint32_t word) {
+  return ByteOrder_::fromWire32(word);
+}
+
+template <class ByteOrder_>
+inline uint64_t fromWire(uint64_t word) {
+  return ByteOrder_::fromWire64(word);
+}
+
+#if defined(__AVX2__)
+const uint32_t SWAP_CHUNK = 32;
+
+inline void swapChunk(uint8_t* data, uint32_t*) {
+  const __m256i mask = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+                                        3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+  __m256i* chunk = reinterpret_cast<__m256i*>(data);
+  _mm256_storeu_si256(chunk, _mm256_shuffle_epi8(_mm256_loadu_si256(chunk), mask));
+}
+
+inline void swapChunk(uint8_t* data, uint64_t*) {
+  const __m256i mask = _mm256_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8,
+                                        7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+  __m256i* chunk = reinterpret_cast<__m256i*>(data);
+  _mm256_storeu_si256(chunk, _mm256_shuffle_epi8(_mm256_loadu_si256(chunk), mask));
+}
+#elif defined(__SSE2__) || defined(_M_X64)
+const uint32_t SWAP_CHUNK = 16;
+
+// SSE2 has no byte shuffle: swap the bytes of each 16 bit lane, then the lanes
+inline __m128i swapLaneBytes(__m128i lanes) {
+  return _mm_or_si128(_mm_slli_epi16(lanes, 8), _mm_srli_epi16(lanes, 8));
+}
+
+inline void swapChunk(uint8_t* data, uint32_t*) {
+  __m128i* chunk = reinterpret_cast<__m128i*>(data);
+  __m128i lanes = swapLaneBytes(_mm_loadu_si128(chunk));
+  lanes = _mm_shufflelo_epi16(lanes, _MM_SHUFFLE(2, 3, 0, 1));
+  _mm_storeu_si128(chunk, _mm_shufflehi_epi16(lanes, _MM_SHUFFLE(2, 3, 0, 1)));
+}
+
+inline void swapChunk(uint8_t* data, uint64_t*) {
+  __m128i* chunk = reinterpret_cast<__m128i*>(data);
+  __m128i lanes = swapLaneBytes(_mm_loadu_si128(chunk));
+  lanes = _mm_shufflelo_epi16(lanes, _MM_SHUFFLE(0, 1, 2, 3));
+  _mm_storeu_si128(chunk, _mm_shufflehi_epi16(lanes, _MM_SHUFFLE(0, 1, 2, 3)));
+}
+#else
+const uint32_t SWAP_CHUNK = 0;
+#endif
+
+/**
+ * Converts count words between host and wire byte order in place, a vector
+ * at a time where the build targets SSE2 or AVX2.  Nothing is done when the
+ * wire order is the host order.
+ */
+template <class ByteOrder_, typename Word_>
+void swapWords(uint8_t* data, uint32_t count) {
+  if (ByteOrder_::toWire32(1) == 1) {
+    return;
+  }
+  uint32_t pos = 0;
+  uint32_t len = count * static_cast<uint32_t>(sizeof(Word_));
+#if defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64)
+  for (; len - pos >= SWAP_CHUNK; pos += SWAP_CHUNK) {
+    swapChunk(data + pos, static_cast<Word_*>(NULL));
+  }
+#endif
+  for (; pos < len; pos += static_cast<uint32_t>(sizeof(Word_))) {
+    Word_ word;
+    std::memcpy(&word, data + pos, sizeof(word));
+    word = fromWire<ByteOrder_>(word);
+    std::memcpy(data + pos, &word, sizeof(word));
+  }
+}
+
+/**
+ * The encoded width of a value of the given type, or 0 if it varies.
+ */
+inline uint32_t fixedWidth(TType type) {
+  switch (type) {
+  case T_BOOL:
+  case T_BYTE:
+    return 1;
+  case T_I16:
+    return 2;
+  case T_I32:
+    return 4;
+  case T_I64:
+  case T_DOUBLE:
+    return 8;
+  default:
+    return 0;
+  }
+}
+
+/**
+ * Finds the end of an encoded value in a buffer without decoding it, jumping
+ * over runs of fixed width values and over strings in one step.
+ *
+ * skip() returns NULL when the value does not end within the buffer, or holds
+ * a type the walk does not know, and the caller then skips it the usual way.
+ * Sizes are checked against the protocol's limits, and nesting against its
+ * recursion limit, as they are when the value is read.
+ */
+template <class ByteOrder_>
+class ValueSkipper {
+public:
+  ValueSkipper(TProtocol& prot,
+               const uint8_t* end,
+               int32_t string_limit,
+               int32_t container_limit)
+    : prot_(prot), end_(end), string_limit_(string_limit), container_limit_(container_limit) {}
+
+  const uint8_t* skip(const uint8_t* pos, TType type) {
+    uint32_t width = fixedWidth(type);
+    if (width != 0) {
+      return remaining(pos) < width ? NULL : pos + width;
+    }
+
+    switch (type) {
+    case T_STRING: {
+      int32_t size;
+      if (!readSize(pos, size)) {
+        return NULL;
+      }
+      checkSize(size, string_limit_);
+      return remaining(pos) < static_cast<uint32_t>(size) ? NULL : pos + size;
+    }
+    case T_STRUCT: {
+      TInputRecursionTracker tracker(prot_);
+      while (pos != NULL && pos < end_) {
+        TType fieldType = static_cast<TType>(*pos++);
+        if (fieldType == T_STOP) {
+          return pos;
+        }
+        // the field id
+        pos = remaining(pos) < 2 ? NULL : skip(pos + 2, fieldType);
+      }
+      return NULL;
+    }
+    case T_MAP: {
+      TInputRecursionTracker tracker(prot_);
+      if (remaining(pos) < 2) {
+        return NULL;
+      }
+      TType types[2] = {static_cast<TType>(pos[0]), static_cast<TType>(pos[1])};
+      pos += 2;
+      int32_t size;
+      if (!readSize(pos, size)) {
+        return NULL;
+      }
+      checkSize(size, container_limit_);
+      return skipRun(pos, types, 2, static_cast<uint32_t>(size));
+    }
+    case T_SET:
+    case T_LIST: {
+      TInputRecursionTracker tracker(prot_);
+      if (remaining(pos) < 1) {
+        return NULL;
+      }
+      TType types[1] = {static_cast<TType>(*pos++)};
+      int32_t size;
+      if (!readSize(pos, size)) {
+        return NULL;
+      }
+      checkSize(size, container_limit_);
+      return skipRun(pos, types, 1, static_cast<uint32_t>(size));
+    }
+    default:
+      return NULL;
+    }
+  }
+
+private:
+  uint32_t remaining(const uint8_t* pos) const { return static_cast<uint32_t>(end_ - pos); }
+
+  bool readSize(const uint8_t*& pos, int32_t& size) const {
+    if (remaining(pos) < 4) {
+      return false;
+    }
+    uint32_t word;
+    std::memcpy(&word, pos, sizeof(word));
+    size = static_cast<int32_t>(ByteOrder_::fromWire32(word));
+    pos += 4;
+    return true;
+  }
+
+  static void checkSize(int32_t size, int32_t limit) {
+    if (size < 0) {
+      throw TProtocolException(TProtocolException::NEGATIVE_SIZE);
+    }
+    if (limit > 0 && size > limit) {
+      throw TProtocolException(TProtocolException::SIZE_LIMIT);
+    }
+  }
+
+  // count groups of values of the given types, such as the keys and values
+  // of a map
+  const uint8_t* skipRun(const uint8_t* pos, const TType* types, uint32_t ntypes, uint32_t count) {
+    uint64_t width = 0;
+    for (uint32_t ix = 0; ix < ntypes; ++ix) {
+      uint32_t typeWidth = fixedWidth(types[ix]);
+      if (typeWidth == 0) {
+        width = 0;
+        break;
+      }
+      width += typeWidth;
+    }
+    if (width != 0) {
+      uint64_t size = width * count;
+      return remaining(pos) < size ? NULL : pos + size;
+    }
+
+    for (uint32_t n = 0; n < count && pos != NULL; ++n) {
+      for (uint32_t ix = 0; ix < ntypes && pos != NULL; ++ix) {
+        pos = skip(pos, types[ix]);
+      }
+    }
+    return pos;
+  }
+
+  TProtocol& prot_;
+  const uint8_t* end_;
+  int32_t string_limit_;
+  int32_t container_limit_;
+};
+
+// Arrays go to and from the transport in slices of this many bytes, which
+// keeps the swapped words in cache and the byte counts from overflowing
+const uint32_t ARRAY_SLICE = 16384;
+}
+} // detail::binary
+
 template <class Transport_, class ByteOrder_>
 uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::writeMessageBegin(const std::string& name,
                                                                      const TMessageType messageType,
@@ -174,6 +420,49 @@ uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::writeDouble(const double dub)
   return 8;
 }
 
+template <class Transport_, class ByteOrder_>
+uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::writeI32Array(const int32_t* values,
+                                                                 uint32_t count) {
+  return writeWords<uint32_t>(reinterpret_cast<const uint8_t*>(values), count);
+}
+
+template <class Transport_, class ByteOrder_>
+uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::writeI64Array(const int64_t* values,
+                                                                 uint32_t count) {
+  return writeWords<uint64_t>(reinterpret_cast<const uint8_t*>(values), count);
+}
+
+template <class Transport_, class ByteOrder_>
+uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::writeDoubleArray(const double* values,
+                                                                    uint32_t count) {
+  BOOST_STATIC_ASSERT(sizeof(double) == sizeof(uint64_t));
+  BOOST_STATIC_ASSERT(std::numeric_limits<double>::is_iec559);
+
+  return writeWords<uint64_t>(reinterpret_cast<const uint8_t*>(values), count);
+}
+
+template <class Transport_, class ByteOrder_>
+template <typename Word_>
+uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::writeWords(const uint8_t* data,
+                                                              uint32_t count) {
+  const uint32_t width = static_cast<uint32_t>(sizeof(Word_));
+  const uint32_t slice = detail::binary::ARRAY_SLICE / width;
+  uint8_t swapped[detail::binary::ARRAY_SLICE];
+
+  for (uint32_t done = 0; done < count; ) {
+    uint32_t n = (std::min)(count - done, slice);
+    const uint8_t* wire = data + static_cast<size_t>(done) * width;
+    if (ByteOrder_::toWire32(1) != 1) {
+      std::memcpy(swapped, wire, n * width);
+      detail::binary::swapWords<ByteOrder_, Word_>(swapped, n);
+      wire = swapped;
+    }
+    this->trans_->write(wire, n * width);
+    done += n;
+  }
+  return count * width;
+}
+
 template <class Transport_, class ByteOrder_>
 template <typename StrType>
 uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::writeString(const StrType& str) {
@@ -401,6 +690,41 @@ uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::readDouble(double& dub) {
   return 8;
 }
 
+template <class Transport_, class ByteOrder_>
+uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::readI32Array(int32_t* values, uint32_t count) {
+  return readWords<uint32_t>(reinterpret_cast<uint8_t*>(values), count);
+}
+
+template <class Transport_, class ByteOrder_>
+uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::readI64Array(int64_t* values, uint32_t count) {
+  return readWords<uint64_t>(reinterpret_cast<uint8_t*>(values), count);
+}
+
+template <class Transport_, class ByteOrder_>
+uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::readDoubleArray(double* values,
+                                                                   uint32_t count) {
+  BOOST_STATIC_ASSERT(sizeof(double) == sizeof(uint64_t));
+  BOOST_STATIC_ASSERT(std::numeric_limits<double>::is_iec559);
+
+  return readWords<uint64_t>(reinterpret_cast<uint8_t*>(values), count);
+}
+
+template <class Transport_, class ByteOrder_>
+template <typename Word_>
+uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::readWords(uint8_t* data, uint32_t count) {
+  const uint32_t width = static_cast<uint32_t>(sizeof(Word_));
+  const uint32_t slice = detail::binary::ARRAY_SLICE / width;
+
+  for (uint32_t done = 0; done < count; ) {
+    uint32_t n = (std::min)(count - done, slice);
+    uint8_t* host = data + static_cast<size_t>(done) * width;
+    this->trans_->readAll(host, n * width);
+    detail::binary::swapWords<ByteOrder_, Word_>(host, n);
+    done += n;
+  }
+  return count * width;
+}
+
 template <class Transport_, class ByteOrder_>
 template <typename StrType>
 uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::readString(StrType& str) {
@@ -415,6 +739,105 @@ uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::readBinary(std::string& str)
   return TBinaryProtocolT<Transport_, ByteOrder_>::readString(str);
 }
 
+/**
+ * Reads a string or binary into a view, which borrows the transport's
+ * buffer if that is allowed and the buffer holds the whole value.
+ */
+template <class Transport_, class ByteOrder_>
+uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::readStringView(TStringView& str) {
+  int32_t size;
+  uint32_t result = readI32(size);
+
+  if (this->borrow_views_ && size > 0 && (this->string_limit_ <= 0 || size <= this->string_limit_)) {
+    uint32_t got = size;
+    const uint8_t* borrow_buf = this->trans_->borrow(NULL, &got);
+    if (borrow_buf != NULL) {
+      str = TStringView((const char*)borrow_buf, (uint32_t)size, this->getTransport());
+      this->trans_->consume(size);
+      return result + (uint32_t)size;
+    }
+  }
+
+  boost::shared_ptr<std::string> copy(new std::string());
+  result += readStringBody(*copy, size);
+  str = TStringView(copy);
+  return result;
+}
+
+/**
+ * Finds where the value ends by skipping it in a window on the transport's
+ * buffer, which consumes nothing, so a value running past the end of the
+ * buffer can still be read the usual way.
+ */
+template <class Transport_, class ByteOrder_>
+uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::readRaw(TType type, std::string& raw) {
+  uint32_t avail = 0;
+  const uint8_t* data = this->trans_->borrow(NULL, &avail);
+  if (data == NULL || avail == 0) {
+    return 0;
+  }
+
+  detail::binary::ValueSkipper<ByteOrder_> skipper(*this,
+                                                   data + avail,
+                                                   this->string_limit_,
+                                                   this->container_limit_);
+  const uint8_t* end = skipper.skip(data, type);
+  if (end == NULL) {
+    return 0;
+  }
+
+  uint32_t size = static_cast<uint32_t>(end - data);
+  raw.assign((const char*)data, size);
+  this->trans_->consume(size);
+  return size;
+}
+
+/**
+ * Skips the value in the transport's buffer the way readRaw() finds its
+ * end, and falls back to reading it field by field when it runs past it.
+ */
+template <class Transport_, class ByteOrder_>
+uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::skip(TType type) {
+  uint32_t avail = 0;
+  const uint8_t* data = this->trans_->borrow(NULL, &avail);
+  if (data != NULL && avail > 0) {
+    detail::binary::ValueSkipper<ByteOrder_> skipper(*this,
+                                                     data + avail,
+                                                     this->string_limit_,
+                                                     this->container_limit_);
+    const uint8_t* end = skipper.skip(data, type);
+    if (end != NULL) {
+      uint32_t size = static_cast<uint32_t>(end - data);
+      this->trans_->consume(size);
+      return size;
+    }
+  }
+  return ::apache::thrift::protocol::skip(*this, type);
+}
+
+template <class Transport_, class ByteOrder_>
+uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::writeRaw(const std::string& raw) {
+  uint32_t size = static_cast<uint32_t>(raw.size());
+  this->trans_->write((const uint8_t*)raw.data(), size);
+  return size;
+}
+
+template <class Transport_, class ByteOrder_>
+const char* TBinaryProtocolT<Transport_, ByteOrder_>::getRawFormat() const {
+  // the byte order is the only setting that changes how values are encoded
+  const uint16_t probe = ByteOrder_::toWire16(1);
+  return *(const uint8_t*)&probe == 0 ? "binary" : "binary-le";
+}
+
+template <class Transport_, class ByteOrder_>
+boost::shared_ptr<TProtocolFactory> TBinaryProtocolT<Transport_, ByteOrder_>::getRawFactory() {
+  return boost::shared_ptr<TProtocolFactory>(
+      new TBinaryProtocolFactoryT<transport::TMemoryBuffer, ByteOrder_>(this->string_limit_,
+                                                                        this->container_limit_,
+                                                                        this->strict_read_,
+                                                                        this->strict_write_));
+}
+
 template <class Transport_, class ByteOrder_>
 template <typename StrType>
 uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::readStringBody(StrType& str, int32_t size) {
@@ -73,15 +73,25 @@ protected:
   std::stack<int16_t> lastField_;
   int16_t lastFieldId_;
 
+  /**
+   * (Sizing) The same, for the structs being sized, and whether the last
+   * field sized was a boolean, whose value is in its header.  Kept apart from
+   * the writing state so that sizing never disturbs a write.
+   */
+  std::stack<int16_t> sizeLastField_;
+  int16_t sizeLastFieldId_;
+  bool sizeBooleanField_;
+
 public:
   TCompactProtocolT(boost::shared_ptr<Transport_> trans)
     : TVirtualProtocol<TCompactProtocolT<Transport_> >(trans),
       trans_(trans.get()),
       lastFieldId_(0),
+      sizeLastFieldId_(0),
+      sizeBooleanField_(false),
       string_limit_(0),
-      string_buf_(NULL),
-      string_buf_size_(0),
-      container_limit_(0) {
+      container_limit_(0),
+      borrow_views_(false) {
     booleanField_.name = NULL;
     boolValue_.hasBoolValue = false;
   }
@@ -92,15 +102,22 @@ public:
     : TVirtualProtocol<TCompactProtocolT<Transport_> >(trans),
       trans_(trans.get()),
       lastFieldId_(0),
+      sizeLastFieldId_(0),
+      sizeBooleanField_(false),
       string_limit_(string_limit),
-      string_buf_(NULL),
-      string_buf_size_(0),
-      container_limit_(container_limit) {
+      container_limit_(container_limit),
+      borrow_views_(false) {
     booleanField_.name = NULL;
     boolValue_.hasBoolValue = false;
   }
 
-  ~TCompactProtocolT() { free(string_buf_); }
+  /**
+   * Lets readStringView() and readBinaryView() return views into the
+   * transport's buffer rather than copies.  Only for transports whose buffer
+   * holds the whole message and stays put while the views are in use, such
+   * as a TMemoryBuffer wrapping a frame.
+   */
+  void setBorrowViews(bool borrow_views) { borrow_views_ = borrow_views; }
 
   /**
    * Writing functions
@@ -140,6 +157,74 @@ public:
 
   uint32_t writeBinary(const std::string& str);
 
+  uint32_t writeStringView(const TStringView& str) { return writeBinaryView(str); }
+
+  uint32_t writeBinaryView(const TStringView& str);
+
+  /**
+   * Write a value read by readRaw() straight to the transport.
+   */
+  uint32_t writeRaw(const std::string& raw);
+
+  /**
+   * Sizing functions, which give the sizes the writing functions write.
+   */
+
+  uint32_t serializedSizeStructBegin(const char* name);
+
+  uint32_t serializedSizeStructEnd();
+
+  uint32_t serializedSizeFieldBegin(const char* name,
+                                    const TType fieldType,
+                                    const int16_t fieldId);
+
+  uint32_t serializedSizeFieldStop() { return 1; }
+
+  uint32_t serializedSizeMapBegin(const TType keyType, const TType valType, const uint32_t size);
+
+  uint32_t serializedSizeListBegin(const TType elemType, const uint32_t size);
+
+  uint32_t serializedSizeSetBegin(const TType elemType, const uint32_t size);
+
+  uint32_t serializedSizeBool(const bool value);
+
+  uint32_t serializedSizeByte(const int8_t byte) {
+    (void)byte;
+    return 1;
+  }
+
+  uint32_t serializedSizeI16(const int16_t i16);
+
+  uint32_t serializedSizeI32(const int32_t i32);
+
+  uint32_t serializedSizeI64(const int64_t i64);
+
+  uint32_t serializedSizeDouble(const double dub) {
+    (void)dub;
+    return 8;
+  }
+
+  uint32_t serializedSizeString(const std::string& str) { return serializedSizeBinary(str); }
+
+  uint32_t serializedSizeBinary(const std::string& str);
+
+  uint32_t serializedSizeStringView(const TStringView& str) {
+    return serializedSizeBinaryView(str);
+  }
+
+  uint32_t serializedSizeBinaryView(const TStringView& str);
+
+  uint32_t serializedSizeI32Array(const int32_t* values, uint32_t count);
+
+  uint32_t serializedSizeI64Array(const int64_t* values, uint32_t count);
+
+  uint32_t serializedSizeDoubleArray(const double* values, uint32_t count) {
+    (void)values;
+    return 8 * count;
+  }
+
+  bool hasSerializedSize() const { return true; }
+
   /**
   * These methods are called by structs, but don't actually have any wired
   * output or purpose
@@ -156,6 +241,8 @@ protected:
                                   const int16_t fieldId,
                                   int8_t typeOverride);
   uint32_t writeCollectionBegin(const TType elemType, int32_t size);
+  uint32_t serializedSizeCollectionBegin(int32_t size);
+  uint32_t serializedSizeBytes(size_t size);
   uint32_t writeVarint32(uint32_t n);
   uint32_t writeVarint64(uint64_t n);
   uint64_t i64ToZigzag(const int64_t l);
@@ -195,6 +282,36 @@ public:
 
   uint32_t readBinary(std::string& str);
 
+  uint32_t readStringView(TStringView& str) { return readBinaryView(str); }
+
+  uint32_t readBinaryView(TStringView& str);
+
+  /**
+   * Read count i32s or i64s, as a run of readI32() or readI64() calls
+   * would.  Varints the transport can lend are decoded a run at a time.
+   */
+  uint32_t readI32Array(int32_t* values, uint32_t count);
+
+  uint32_t readI64Array(int64_t* values, uint32_t count);
+
+  /**
+   * Skip a value by walking its encoding in the transport's buffer, which
+   * jumps over strings and runs of bytes and doubles, and counts runs of
+   * varints a chunk at a time, or the usual way where the buffer does not
+   * hold all of it.
+   */
+  uint32_t skip(TType type);
+
+  /**
+   * Copy a whole value out of the transport's buffer without decoding it,
+   * where the buffer holds all of it.
+   */
+  uint32_t readRaw(TType type, std::string& raw);
+
+  const char* getRawFormat() const { return "compact"; }
+
+  boost::shared_ptr<TProtocolFactory> getRawFactory();
+
   /*
    *These methods are here for the struct to call, but don't have any wire
    * encoding.
@@ -208,16 +325,19 @@ public:
 protected:
   uint32_t readVarint32(int32_t& i32);
   uint32_t readVarint64(int64_t& i64);
+  uint32_t readBinaryBody(std::string& str, int32_t size);
+  uint32_t writeBinaryBytes(const char* data, uint32_t size);
+  template <typename Int_>
+  uint32_t readZigzagArray(Int_* values, uint32_t count);
+  uint32_t readZigzag(int32_t& i32) { return readI32(i32); }
+  uint32_t readZigzag(int64_t& i64) { return readI64(i64); }
   int32_t zigzagToI32(uint32_t n);
   int64_t zigzagToI64(uint64_t n);
   TType getTType(int8_t type);
 
-  // Buffer for reading strings, save for the lifetime of the protocol to
-  // avoid memory churn allocating memory on every string read
   int32_t string_limit_;
-  uint8_t* string_buf_;
-  int32_t string_buf_size_;
   int32_t container_limit_;
+  bool borrow_views_;
 };
 
 typedef TCompactProtocolT<TTransport> TCompactProtocol;
@@ -19,9 +19,17 @@
 #ifndef _THRIFT_PROTOCOL_TCOMPACTPROTOCOL_TCC_
 #define _THRIFT_PROTOCOL_TCOMPACTPROTOCOL_TCC_ 1
 
+#include <cstring>
 #include <limits>
 
 #include "thrift/config.h"
+#include <thrift/transport/TBufferTransports.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
 
 /*
  * TCompactProtocol::i*ToZigzag depend on the fact that the right shift
@@ -82,6 +90,389 @@ const int8_t TTypeToCType[16] = {
   CT_LIST, // T_LIST
 };
 
+/**
+ * Varint runs are decoded a chunk at a time: the high bits of a chunk of
+ * bytes give a mask of the bytes that continue a varint, so the varints
+ * ending in the chunk are found without testing byte by byte.  Chunks are
+ * as wide as the vector instructions the build targets, or 8 bytes without
+ * them.
+ */
+#if defined(__AVX2__)
+const uint32_t VARINT_CHUNK = 32;
+const uint32_t VARINT_CHUNK_MASK = 0xffffffff;
+
+inline uint32_t continuationMask(const uint8_t* buf) {
+  return static_cast<uint32_t>(
+      _mm256_movemask_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(buf))));
+}
+#elif defined(__SSE2__) || defined(_M_X64)
+const uint32_t VARINT_CHUNK = 16;
+const uint32_t VARINT_CHUNK_MASK = 0xffff;
+
+inline uint32_t continuationMask(const uint8_t* buf) {
+  return static_cast<uint32_t>(
+      _mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(buf))));
+}
+#else
+const uint32_t VARINT_CHUNK = 8;
+const uint32_t VARINT_CHUNK_MASK = 0xff;
+
+inline uint32_t continuationMask(const uint8_t* buf) {
+  uint64_t word;
+  std::memcpy(&word, buf, sizeof(word));
+  word = THRIFT_letohll(word);
+  // gathers the high bit of every byte into the top byte, lowest byte first
+  return static_cast<uint32_t>(
+      (((word & 0x8080808080808080ULL) >> 7) * 0x0102040810204080ULL) >> 56);
+}
+#endif
+
+inline uint32_t countTrailingZeros(uint32_t mask) {
+#ifdef __GNUC__
+  return static_cast<uint32_t>(__builtin_ctz(mask));
+#else
+  uint32_t count = 0;
+  while (!(mask & 1)) {
+    mask >>= 1;
+    ++count;
+  }
+  return count;
+#endif
+}
+
+inline void zigzagDecode(uint64_t n, int32_t& value) {
+  uint32_t n32 = static_cast<uint32_t>(n);
+  value = static_cast<int32_t>((n32 >> 1) ^ static_cast<uint32_t>(-static_cast<int32_t>(n32 & 1)));
+}
+
+inline void zigzagDecode(uint64_t n, int64_t& value) {
+  value = static_cast<int64_t>((n >> 1) ^ static_cast<uint64_t>(-static_cast<int64_t>(n & 1)));
+}
+
+/**
+ * Decodes the varint at buf a byte at a time.
+ *
+ * @return its size, or 0 if it does not end within the len bytes at buf.
+ * @throws TProtocolException the varint is over 10 bytes.
+ */
+inline uint32_t decodeVarint(const uint8_t* buf, uint32_t len, uint64_t& value) {
+  uint64_t val = 0;
+  for (uint32_t size = 0; size < len; ) {
+    uint8_t byte = buf[size];
+    val |= static_cast<uint64_t>(byte & 0x7f) << (7 * size);
+    ++size;
+    if (!(byte & 0x80)) {
+      value = val;
+      return size;
+    }
+    if (UNLIKELY(size == 10)) {
+      throw TProtocolException(TProtocolException::INVALID_DATA,
+                               "Variable-length int over 10 bytes.");
+    }
+  }
+  return 0;
+}
+
+/**
+ * Decodes up to count zigzag varints from the len bytes at buf into values,
+ * stopping before a varint that does not end within them.
+ *
+ * @param count the number of values wanted; set to the number decoded.
+ * @return the number of bytes decoded.
+ * @throws TProtocolException a varint is over 10 bytes.
+ */
+template <typename Int_>
+uint32_t decodeZigzagVarints(const uint8_t* buf, uint32_t len, Int_* values, uint32_t& count) {
+  uint32_t pos = 0;
+  uint32_t n = 0;
+
+  while (n < count && len - pos >= VARINT_CHUNK) {
+    const uint8_t* chunk = buf + pos;
+    uint32_t more = continuationMask(chunk);
+    uint32_t ends = ~more & VARINT_CHUNK_MASK;
+
+    uint32_t start = 0;
+    if (more == 0 && count - n >= VARINT_CHUNK) {
+      // a run of single byte varints, the common case for small numbers
+      for (uint32_t ix = 0; ix < VARINT_CHUNK; ++ix) {
+        zigzagDecode(chunk[ix], values[n + ix]);
+      }
+      n += VARINT_CHUNK;
+      start = VARINT_CHUNK;
+    } else if (ends == 0) {
+      // longer than a chunk; only valid for chunks under 10 bytes
+      uint64_t val;
+      start = decodeVarint(chunk, len - pos, val);
+      if (start == 0) {
+        break;
+      }
+      zigzagDecode(val, values[n++]);
+    } else {
+      while (ends != 0 && n < count) {
+        uint32_t stop = countTrailingZeros(ends);
+        uint32_t size = stop - start + 1;
+        if (UNLIKELY(size > 10)) {
+          throw TProtocolException(TProtocolException::INVALID_DATA,
+                                   "Variable-length int over 10 bytes.");
+        }
+        uint64_t val = 0;
+        for (uint32_t ix = 0; ix < size; ++ix) {
+          val |= static_cast<uint64_t>(chunk[start + ix] & 0x7f) << (7 * ix);
+        }
+        zigzagDecode(val, values[n++]);
+        ends &= ends - 1;
+        start = stop + 1;
+      }
+    }
+    pos += start;
+  }
+
+  // the tail, a byte at a time
+  while (n < count && pos < len) {
+    uint64_t val;
+    uint32_t size = decodeVarint(buf + pos, len - pos, val);
+    if (size == 0) {
+      break;
+    }
+    zigzagDecode(val, values[n++]);
+    pos += size;
+  }
+
+  count = n;
+  return pos;
+}
+
+inline uint32_t countBits(uint32_t mask) {
+#ifdef __GNUC__
+  return static_cast<uint32_t>(__builtin_popcount(mask));
+#else
+  uint32_t count = 0;
+  for (; mask != 0; mask &= mask - 1) {
+    ++count;
+  }
+  return count;
+#endif
+}
+
+/**
+ * The encoded width of a collection element of the given compact type, or
+ * 0 if it varies.
+ */
+inline uint32_t fixedWidth(int8_t type) {
+  switch (type) {
+  case CT_BOOLEAN_TRUE:
+  case CT_BOOLEAN_FALSE:
+  case CT_BYTE:
+    return 1;
+  case CT_DOUBLE:
+    return 8;
+  default:
+    return 0;
+  }
+}
+
+inline bool isVarint(int8_t type) {
+  return type == CT_I16 || type == CT_I32 || type == CT_I64;
+}
+
+/**
+ * Finds the end of an encoded value in a buffer without decoding it.  Runs
+ * of bytes and doubles and strings are jumped over in one step, and runs of
+ * varints counted a chunk at a time.
+ *
+ * skip() returns NULL when the value does not end within the buffer, or holds
+ * a type the walk does not know, and the caller then skips it the usual way.
+ * Sizes are checked against the protocol's limits, and nesting against its
+ * recursion limit, as they are when the value is read.
+ */
+class ValueSkipper {
+public:
+  ValueSkipper(TProtocol& prot,
+               const uint8_t* end,
+               int32_t string_limit,
+               int32_t container_limit)
+    : prot_(prot), end_(end), string_limit_(string_limit), container_limit_(container_limit) {}
+
+  /// Skips a value of the given compact type, where bools take a byte.
+  const uint8_t* skip(const uint8_t* pos, int8_t type) {
+    uint32_t width = fixedWidth(type);
+    if (width != 0) {
+      return remaining(pos) < width ? NULL : pos + width;
+    }
+
+    switch (type) {
+    case CT_I16:
+    case CT_I32:
+    case CT_I64:
+      return skipVarints(pos, 1);
+    case CT_BINARY: {
+      int32_t size;
+      pos = readSize(pos, size);
+      if (pos == NULL) {
+        return NULL;
+      }
+      checkSize(size, string_limit_);
+      return remaining(pos) < static_cast<uint32_t>(size) ? NULL : pos + size;
+    }
+    case CT_STRUCT: {
+      TInputRecursionTracker tracker(prot_);
+      while (pos != NULL && pos < end_) {
+        uint8_t header = *pos++;
+        int8_t fieldType = static_cast<int8_t>(header & 0x0f);
+        if (fieldType == CT_STOP) {
+          return pos;
+        }
+        // without a delta, the field id follows as a varint
+        if ((header & 0xf0) == 0) {
+          pos = skipVarints(pos, 1);
+        }
+        // a bool field's value is its type
+        if (pos != NULL && fieldType != CT_BOOLEAN_TRUE && fieldType != CT_BOOLEAN_FALSE) {
+          pos = skip(pos, fieldType);
+        }
+      }
+      return NULL;
+    }
+    case CT_MAP: {
+      TInputRecursionTracker tracker(prot_);
+      int32_t size;
+      pos = readSize(pos, size);
+      if (pos == NULL) {
+        return NULL;
+      }
+      checkSize(size, container_limit_);
+      if (size == 0) {
+        return pos;
+      }
+      if (remaining(pos) < 1) {
+        return NULL;
+      }
+      int8_t types[2] = {static_cast<int8_t>(*pos >> 4), static_cast<int8_t>(*pos & 0x0f)};
+      return skipRun(pos + 1, types, 2, static_cast<uint32_t>(size));
+    }
+    case CT_SET:
+    case CT_LIST: {
+      TInputRecursionTracker tracker(prot_);
+      if (remaining(pos) < 1) {
+        return NULL;
+      }
+      int8_t types[1] = {static_cast<int8_t>(*pos & 0x0f)};
+      int32_t size = (*pos++ >> 4) & 0x0f;
+      if (size == 15) {
+        pos = readSize(pos, size);
+        if (pos == NULL) {
+          return NULL;
+        }
+      }
+      checkSize(size, container_limit_);
+      return skipRun(pos, types, 1, static_cast<uint32_t>(size));
+    }
+    default:
+      return NULL;
+    }
+  }
+
+private:
+  uint32_t remaining(const uint8_t* pos) const { return static_cast<uint32_t>(end_ - pos); }
+
+  const uint8_t* readSize(const uint8_t* pos, int32_t& size) const {
+    uint64_t value;
+    uint32_t len = decodeVarint(pos, remaining(pos), value);
+    if (len == 0) {
+      return NULL;
+    }
+    size = static_cast<int32_t>(value);
+    return pos + len;
+  }
+
+  static void checkSize(int32_t size, int32_t limit) {
+    if (size < 0) {
+      throw TProtocolException(TProtocolException::NEGATIVE_SIZE);
+    }
+    if (limit > 0 && size > limit) {
+      throw TProtocolException(TProtocolException::SIZE_LIMIT);
+    }
+  }
+
+  // counts the ends of count varints, a chunk at a time
+  const uint8_t* skipVarints(const uint8_t* pos, uint64_t count) const {
+    while (count > 0 && remaining(pos) >= VARINT_CHUNK) {
+      uint32_t ends = ~continuationMask(pos) & VARINT_CHUNK_MASK;
+      uint32_t found = countBits(ends);
+      if (found == 0) {
+        // longer than a chunk; only valid for chunks under 10 bytes
+        uint64_t value;
+        uint32_t len = decodeVarint(pos, remaining(pos), value);
+        if (len == 0) {
+          return NULL;
+        }
+        pos += len;
+        --count;
+      } else if (found <= count) {
+        pos += VARINT_CHUNK;
+        count -= found;
+      } else {
+        for (uint64_t n = 1; n < count; ++n) {
+          ends &= ends - 1;
+        }
+        return pos + countTrailingZeros(ends) + 1;
+      }
+    }
+
+    // the tail, a byte at a time
+    for (; count > 0 && pos < end_; ++pos) {
+      if (!(*pos & 0x80)) {
+        --count;
+      }
+    }
+    return count > 0 ? NULL : pos;
+  }
+
+  // count groups of values of the given types, such as the keys and values
+  // of a map
+  const uint8_t* skipRun(const uint8_t* pos, const int8_t* types, uint32_t ntypes, uint32_t count) {
+    uint64_t width = 0;
+    bool fixed = true;
+    bool varints = true;
+    for (uint32_t ix = 0; ix < ntypes; ++ix) {
+      uint32_t typeWidth = fixedWidth(types[ix]);
+      width += typeWidth;
+      fixed = fixed && typeWidth != 0;
+      varints = varints && isVarint(types[ix]);
+    }
+    if (fixed) {
+      uint64_t size = width * count;
+      return remaining(pos) < size ? NULL : pos + size;
+    }
+    if (varints) {
+      return skipVarints(pos, static_cast<uint64_t>(ntypes) * count);
+    }
+
+    for (uint32_t n = 0; n < count && pos != NULL; ++n) {
+      for (uint32_t ix = 0; ix < ntypes && pos != NULL; ++ix) {
+        pos = skip(pos, types[ix]);
+      }
+    }
+    return pos;
+  }
+
+  TProtocol& prot_;
+  const uint8_t* end_;
+  int32_t string_limit_;
+  int32_t container_limit_;
+};
+/**
+ * The number of bytes n takes as a varint.
+ */
+inline uint32_t varintSize(uint64_t n) {
+  uint32_t size = 1;
+  while (n >= 0x80) {
+    n >>= 7;
+    ++size;
+  }
+  return size;
+}
+
 }} // end detail::compact namespace
 
 
@@ -274,14 +665,23 @@ template <class Transport_>
 uint32_t TCompactProtocolT<Transport_>::writeBinary(const std::string& str) {
   if(str.size() > (std::numeric_limits<uint32_t>::max)())
     throw TProtocolException(TProtocolException::SIZE_LIMIT);
-  uint32_t ssize = static_cast<uint32_t>(str.size());
+  return writeBinaryBytes(str.data(), static_cast<uint32_t>(str.size()));
+}
+
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::writeBinaryView(const TStringView& str) {
+  return writeBinaryBytes(str.data(), str.size());
+}
+
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::writeBinaryBytes(const char* data, uint32_t ssize) {
   uint32_t wsize = writeVarint32(ssize) ;
   // checking ssize + wsize > uint_max, but we don't want to overflow while checking for overflows.
   // transforming the check to ssize > uint_max - wsize
   if(ssize > (std::numeric_limits<uint32_t>::max)() - wsize)
     throw TProtocolException(TProtocolException::SIZE_LIMIT);
   wsize += ssize;
-  trans_->write((uint8_t*)str.data(), ssize);
+  trans_->write((const uint8_t*)data, ssize);
   return wsize;
 }
 
@@ -407,6 +807,136 @@ int8_t TCompactProtocolT<Transport_>::getCompactType(const TType ttype) {
   return detail::compact::TTypeToCType[ttype];
 }
 
+//
+// Sizing Methods
+//
+
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::serializedSizeStructBegin(const char* name) {
+  (void) name;
+  sizeLastField_.push(sizeLastFieldId_);
+  sizeLastFieldId_ = 0;
+  return 0;
+}
+
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::serializedSizeStructEnd() {
+  sizeLastFieldId_ = sizeLastField_.top();
+  sizeLastField_.pop();
+  return 0;
+}
+
+/**
+ * A boolean field's header is counted here, and its value then counts for
+ * nothing, as writeBool() puts the value in the header.
+ */
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::serializedSizeFieldBegin(const char* name,
+                                                                 const TType fieldType,
+                                                                 const int16_t fieldId) {
+  (void) name;
+  uint32_t size = 1;
+  if (!(fieldId > sizeLastFieldId_ && fieldId - sizeLastFieldId_ <= 15)) {
+    size += detail::compact::varintSize(i32ToZigzag(fieldId));
+  }
+  sizeLastFieldId_ = fieldId;
+  sizeBooleanField_ = fieldType == T_BOOL;
+  return size;
+}
+
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::serializedSizeMapBegin(const TType keyType,
+                                                               const TType valType,
+                                                               const uint32_t size) {
+  (void) keyType;
+  (void) valType;
+  return size == 0 ? 1 : detail::compact::varintSize(size) + 1;
+}
+
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::serializedSizeListBegin(const TType elemType,
+                                                                const uint32_t size) {
+  (void) elemType;
+  return serializedSizeCollectionBegin(size);
+}
+
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::serializedSizeSetBegin(const TType elemType,
+                                                               const uint32_t size) {
+  (void) elemType;
+  return serializedSizeCollectionBegin(size);
+}
+
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::serializedSizeBool(const bool value) {
+  (void) value;
+  if (sizeBooleanField_) {
+    sizeBooleanField_ = false;
+    return 0;
+  }
+  return 1;
+}
+
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::serializedSizeI16(const int16_t i16) {
+  return detail::compact::varintSize(i32ToZigzag(i16));
+}
+
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::serializedSizeI32(const int32_t i32) {
+  return detail::compact::varintSize(i32ToZigzag(i32));
+}
+
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::serializedSizeI64(const int64_t i64) {
+  return detail::compact::varintSize(i64ToZigzag(i64));
+}
+
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::serializedSizeBinary(const std::string& str) {
+  return serializedSizeBytes(str.size());
+}
+
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::serializedSizeBinaryView(const TStringView& str) {
+  return serializedSizeBytes(str.size());
+}
+
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::serializedSizeI32Array(const int32_t* values,
+                                                               uint32_t count) {
+  uint32_t size = 0;
+  for (uint32_t ix = 0; ix < count; ++ix) {
+    size += detail::compact::varintSize(i32ToZigzag(values[ix]));
+  }
+  return size;
+}
+
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::serializedSizeI64Array(const int64_t* values,
+                                                               uint32_t count) {
+  uint32_t size = 0;
+  for (uint32_t ix = 0; ix < count; ++ix) {
+    size += detail::compact::varintSize(i64ToZigzag(values[ix]));
+  }
+  return size;
+}
+
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::serializedSizeCollectionBegin(int32_t size) {
+  return size <= 14 ? 1 : 1 + detail::compact::varintSize(static_cast<uint32_t>(size));
+}
+
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::serializedSizeBytes(size_t ssize) {
+  if (ssize > (std::numeric_limits<uint32_t>::max)())
+    throw TProtocolException(TProtocolException::SIZE_LIMIT);
+  uint32_t size = detail::compact::varintSize(ssize);
+  if (ssize > (std::numeric_limits<uint32_t>::max)() - size)
+    throw TProtocolException(TProtocolException::SIZE_LIMIT);
+  return size + static_cast<uint32_t>(ssize);
+}
+
 //
 // Reading Methods
 //
@@ -676,14 +1206,98 @@ uint32_t TCompactProtocolT<Transport_>::readString(std::string& str) {
  */
 template <class Transport_>
 uint32_t TCompactProtocolT<Transport_>::readBinary(std::string& str) {
-  int32_t rsize = 0;
   int32_t size;
+  uint32_t rsize = readVarint32(size);
+  return rsize + readBinaryBody(str, size);
+}
+
+/**
+ * Read a string or binary into a view, which borrows the transport's
+ * buffer if that is allowed and the buffer holds the whole value.
+ */
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::readBinaryView(TStringView& str) {
+  int32_t size;
+  uint32_t rsize = readVarint32(size);
+
+  if (borrow_views_ && size > 0 && (string_limit_ <= 0 || size <= string_limit_)) {
+    uint32_t got = (uint32_t)size;
+    const uint8_t* borrowed = trans_->borrow(NULL, &got);
+    if (borrowed != NULL) {
+      str = TStringView((const char*)borrowed, (uint32_t)size, this->getTransport());
+      trans_->consume(size);
+      return rsize + (uint32_t)size;
+    }
+  }
+
+  boost::shared_ptr<std::string> copy(new std::string());
+  rsize += readBinaryBody(*copy, size);
+  str = TStringView(copy);
+  return rsize;
+}
+
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::skip(TType type) {
+  // a bool field's value was read with its header
+  if (type != T_BOOL && static_cast<uint32_t>(type) < 16) {
+    uint32_t avail = 0;
+    const uint8_t* data = trans_->borrow(NULL, &avail);
+    if (data != NULL && avail > 0) {
+      detail::compact::ValueSkipper skipper(*this, data + avail, string_limit_, container_limit_);
+      const uint8_t* end = skipper.skip(data, detail::compact::TTypeToCType[type]);
+      if (end != NULL) {
+        uint32_t size = static_cast<uint32_t>(end - data);
+        trans_->consume(size);
+        return size;
+      }
+    }
+  }
+  return ::apache::thrift::protocol::skip(*this, type);
+}
+
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::readRaw(TType type, std::string& raw) {
+  uint32_t avail = 0;
+  const uint8_t* data = trans_->borrow(NULL, &avail);
+  if (data == NULL || avail == 0 || static_cast<uint32_t>(type) >= 16) {
+    return 0;
+  }
+
+  detail::compact::ValueSkipper skipper(*this, data + avail, string_limit_, container_limit_);
+  const uint8_t* end = skipper.skip(data, detail::compact::TTypeToCType[type]);
+  if (end == NULL) {
+    return 0;
+  }
+
+  uint32_t size = static_cast<uint32_t>(end - data);
+  raw.assign((const char*)data, size);
+  trans_->consume(size);
+  return size;
+}
 
-  rsize += readVarint32(size);
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::writeRaw(const std::string& raw) {
+  uint32_t size = static_cast<uint32_t>(raw.size());
+  trans_->write((const uint8_t*)raw.data(), size);
+  return size;
+}
+
+template <class Transport_>
+boost::shared_ptr<TProtocolFactory> TCompactProtocolT<Transport_>::getRawFactory() {
+  return boost::shared_ptr<TProtocolFactory>(
+      new TCompactProtocolFactoryT<transport::TMemoryBuffer>(string_limit_, container_limit_));
+}
+
+/**
+ * Read the size bytes of a string or binary, straight out of the
+ * transport's buffer if it has them all.
+ */
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::readBinaryBody(std::string& str, int32_t size) {
   // Catch empty string case
   if (size == 0) {
-    str = "";
-    return rsize;
+    str.clear();
+    return 0;
   }
 
   // Catch error cases
@@ -694,19 +1308,56 @@ uint32_t TCompactProtocolT<Transport_>::readBinary(std::string& str) {
     throw TProtocolException(TProtocolException::SIZE_LIMIT);
   }
 
-  // Use the heap here to prevent stack overflow for v. large strings
-  if (size > string_buf_size_ || string_buf_ == NULL) {
-    void* new_string_buf = std::realloc(string_buf_, (uint32_t)size);
-    if (new_string_buf == NULL) {
-      throw std::bad_alloc();
-    }
-    string_buf_ = (uint8_t*)new_string_buf;
-    string_buf_size_ = size;
+  uint32_t got = (uint32_t)size;
+  const uint8_t* borrowed = trans_->borrow(NULL, &got);
+  if (borrowed != NULL) {
+    str.assign((const char*)borrowed, size);
+    trans_->consume(size);
+  } else {
+    str.resize(size);
+    trans_->readAll(reinterpret_cast<uint8_t*>(&str[0]), size);
   }
-  trans_->readAll(string_buf_, size);
-  str.assign((char*)string_buf_, size);
+  return (uint32_t)size;
+}
 
-  return rsize + (uint32_t)size;
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::readI32Array(int32_t* values, uint32_t count) {
+  return readZigzagArray(values, count);
+}
+
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::readI64Array(int64_t* values, uint32_t count) {
+  return readZigzagArray(values, count);
+}
+
+/**
+ * Read a run of zigzag varints straight out of the transport buffer, as far
+ * as it goes.  A varint the buffer only holds part of, or a transport that
+ * cannot lend its buffer, falls back to reading one value at a time.
+ */
+template <class Transport_>
+template <typename Int_>
+uint32_t TCompactProtocolT<Transport_>::readZigzagArray(Int_* values, uint32_t count) {
+  uint32_t rsize = 0;
+  while (count > 0) {
+    uint32_t len = 1;
+    const uint8_t* borrowed = trans_->borrow(NULL, &len);
+    uint32_t decoded = count;
+    uint32_t size = 0;
+    if (borrowed != NULL) {
+      size = detail::compact::decodeZigzagVarints(borrowed, len, values, decoded);
+    }
+    if (borrowed == NULL || decoded == 0) {
+      rsize += readZigzag(*values);
+      decoded = 1;
+    } else {
+      trans_->consume(size);
+      rsize += size;
+    }
+    values += decoded;
+    count -= decoded;
+  }
+  return rsize;
 }
 
 /**
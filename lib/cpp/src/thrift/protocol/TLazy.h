@@ -0,0 +1,173 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef _THRIFT_PROTOCOL_TLAZY_H_
+#define _THRIFT_PROTOCOL_TLAZY_H_ 1
+
+#include <string.h>
+#include <algorithm>
+#include <ostream>
+#include <string>
+
+#include <boost/shared_ptr.hpp>
+
+#include <thrift/protocol/TProtocol.h>
+#include <thrift/transport/TBufferTransports.h>
+
+namespace apache {
+namespace thrift {
+namespace protocol {
+
+/**
+ * Holds a struct field annotated with cpp.lazy = "true".  Where the protocol
+ * can, read() keeps the bytes the struct was serialized as instead of
+ * decoding it.  The struct is decoded the first time get() is called, and
+ * as long as getMutable() is not called or the value assigned, write()
+ * copies the bytes back out unchanged when the protocol has the same raw
+ * format, and serializedSize() counts them without decoding.
+ *
+ * Like the struct it holds, a TLazy is not safe to use from several threads
+ * at once, not even through const methods, as get() decodes in place.
+ */
+template <typename T>
+class TLazy {
+public:
+  TLazy() : decoded_(true), format_(NULL) {}
+
+  TLazy(const T& value) : value_(value), decoded_(true), format_(NULL) {}
+
+  TLazy& operator=(const T& value) {
+    value_ = value;
+    setDecoded();
+    return *this;
+  }
+
+  /// Returns the value, decoding it first if needed.
+  const T& get() const {
+    if (!decoded_) {
+      decode();
+    }
+    return value_;
+  }
+
+  /// Returns the value to be changed, after which write() encodes it.
+  T& getMutable() {
+    get();
+    setDecoded();
+    return value_;
+  }
+
+  operator const T&() const { return get(); }
+
+  const T* operator->() const { return &get(); }
+
+  /// True if the value was read as raw bytes that have not been decoded.
+  bool isRaw() const { return !decoded_; }
+
+  template <class Protocol_>
+  uint32_t read(Protocol_* iprot) {
+    raw_.clear();
+    uint32_t xfer = iprot->readRaw(T_STRUCT, raw_);
+    if (xfer > 0) {
+      value_ = T();
+      decoded_ = false;
+      format_ = iprot->getRawFormat();
+      factory_ = iprot->getRawFactory();
+      return xfer;
+    }
+
+    setDecoded();
+    return value_.read(iprot);
+  }
+
+  template <class Protocol_>
+  uint32_t write(Protocol_* oprot) const {
+    if (format_ != NULL) {
+      const char* format = oprot->getRawFormat();
+      if (format != NULL && strcmp(format, format_) == 0) {
+        return oprot->writeRaw(raw_);
+      }
+    }
+    return get().write(oprot);
+  }
+
+  template <class Protocol_>
+  uint32_t serializedSize(Protocol_* oprot) const {
+    if (format_ != NULL) {
+      const char* format = oprot->getRawFormat();
+      if (format != NULL && strcmp(format, format_) == 0) {
+        return static_cast<uint32_t>(raw_.size());
+      }
+    }
+    return get().serializedSize(oprot);
+  }
+
+  void swap(TLazy& other) {
+    using ::std::swap;
+    swap(value_, other.value_);
+    swap(decoded_, other.decoded_);
+    raw_.swap(other.raw_);
+    swap(format_, other.format_);
+    factory_.swap(other.factory_);
+  }
+
+  bool operator==(const TLazy& rhs) const { return get() == rhs.get(); }
+
+  bool operator!=(const TLazy& rhs) const { return !(*this == rhs); }
+
+  bool operator<(const TLazy& rhs) const { return get() < rhs.get(); }
+
+private:
+  void decode() const {
+    boost::shared_ptr<transport::TMemoryBuffer> buffer(
+        new transport::TMemoryBuffer((uint8_t*)raw_.data(), static_cast<uint32_t>(raw_.size())));
+    boost::shared_ptr<TProtocol> iprot = factory_->getProtocol(buffer);
+    value_.read(iprot.get());
+    decoded_ = true;
+  }
+
+  // forgets the raw bytes, once the value may no longer match them
+  void setDecoded() {
+    decoded_ = true;
+    raw_.clear();
+    format_ = NULL;
+    factory_.reset();
+  }
+
+  mutable T value_;
+  mutable bool decoded_;
+  std::string raw_;
+  const char* format_;
+  boost::shared_ptr<TProtocolFactory> factory_;
+};
+
+template <typename T>
+void swap(TLazy<T>& a, TLazy<T>& b) {
+  a.swap(b);
+}
+
+template <typename T>
+std::ostream& operator<<(std::ostream& out, const TLazy<T>& lazy) {
+  return out << lazy.get();
+}
+}
+}
+} // apache::thrift::protocol
+
+#endif // #ifndef _THRIFT_PROTOCOL_TLAZY_H_
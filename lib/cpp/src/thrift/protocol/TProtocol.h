@@ -21,6 +21,7 @@
 #define _THRIFT_PROTOCOL_TPROTOCOL_H_ 1
 
 #include <thrift/transport/TTransport.h>
+#include <thrift/TStringView.h>
 #include <thrift/protocol/TProtocolException.h>
 
 #include <boost/shared_ptr.hpp>
@@ -216,6 +217,8 @@ static const uint32_t DEFAULT_RECURSION_LIMIT = 64;
  * looking ahead character by character for a close tag).
  *
  */
+class TProtocolFactory;
+
 class TProtocol {
 public:
   virtual ~TProtocol();
@@ -271,6 +274,52 @@ public:
 
   virtual uint32_t writeBinary_virt(const std::string& str) = 0;
 
+  virtual uint32_t writeStringView_virt(const TStringView& str) {
+    return writeString_virt(str.str());
+  }
+
+  virtual uint32_t writeBinaryView_virt(const TStringView& str) {
+    return writeBinary_virt(str.str());
+  }
+
+  /**
+   * Writes count elements of a list at once.  Protocols that can encode runs
+   * of elements faster than one at a time override these.
+   */
+  virtual uint32_t writeI32Array_virt(const int32_t* values, uint32_t count) {
+    uint32_t xfer = 0;
+    for (uint32_t ix = 0; ix < count; ++ix) {
+      xfer += writeI32_virt(values[ix]);
+    }
+    return xfer;
+  }
+
+  virtual uint32_t writeI64Array_virt(const int64_t* values, uint32_t count) {
+    uint32_t xfer = 0;
+    for (uint32_t ix = 0; ix < count; ++ix) {
+      xfer += writeI64_virt(values[ix]);
+    }
+    return xfer;
+  }
+
+  virtual uint32_t writeDoubleArray_virt(const double* values, uint32_t count) {
+    uint32_t xfer = 0;
+    for (uint32_t ix = 0; ix < count; ++ix) {
+      xfer += writeDouble_virt(values[ix]);
+    }
+    return xfer;
+  }
+
+  /**
+   * Writes a value read by readRaw() as it is.  Only protocols with a raw
+   * format support this, and only for values read in that same format.
+   */
+  virtual uint32_t writeRaw_virt(const std::string& raw) {
+    (void)raw;
+    throw TProtocolException(TProtocolException::NOT_IMPLEMENTED,
+                             "Raw values are not supported by this protocol.");
+  }
+
   uint32_t writeMessageBegin(const std::string& name,
                              const TMessageType messageType,
                              const int32_t seqid) {
@@ -378,6 +427,258 @@ public:
     return writeBinary_virt(str);
   }
 
+  uint32_t writeStringView(const TStringView& str) {
+    T_VIRTUAL_CALL();
+    return writeStringView_virt(str);
+  }
+
+  uint32_t writeBinaryView(const TStringView& str) {
+    T_VIRTUAL_CALL();
+    return writeBinaryView_virt(str);
+  }
+
+  uint32_t writeI32Array(const int32_t* values, uint32_t count) {
+    T_VIRTUAL_CALL();
+    return writeI32Array_virt(values, count);
+  }
+
+  uint32_t writeI64Array(const int64_t* values, uint32_t count) {
+    T_VIRTUAL_CALL();
+    return writeI64Array_virt(values, count);
+  }
+
+  uint32_t writeDoubleArray(const double* values, uint32_t count) {
+    T_VIRTUAL_CALL();
+    return writeDoubleArray_virt(values, count);
+  }
+
+  uint32_t writeRaw(const std::string& raw) {
+    T_VIRTUAL_CALL();
+    return writeRaw_virt(raw);
+  }
+
+  /**
+   * Sizing functions
+   *
+   * Each returns the number of bytes the matching write function would put
+   * on the wire, without writing anything, so that a struct's
+   * serializedSize() can be added up before it is written.  Field, list, set
+   * and map ends are not sized, as the protocols that size encode nothing
+   * for them.  Only protocols whose hasSerializedSize() is true support
+   * these; the defaults throw.
+   */
+
+  virtual uint32_t serializedSizeStructBegin_virt(const char* name) {
+    (void)name;
+    return noSerializedSize();
+  }
+
+  virtual uint32_t serializedSizeStructEnd_virt() { return noSerializedSize(); }
+
+  virtual uint32_t serializedSizeFieldBegin_virt(const char* name,
+                                                 const TType fieldType,
+                                                 const int16_t fieldId) {
+    (void)name;
+    (void)fieldType;
+    (void)fieldId;
+    return noSerializedSize();
+  }
+
+  virtual uint32_t serializedSizeFieldStop_virt() { return noSerializedSize(); }
+
+  virtual uint32_t serializedSizeMapBegin_virt(const TType keyType,
+                                               const TType valType,
+                                               const uint32_t size) {
+    (void)keyType;
+    (void)valType;
+    (void)size;
+    return noSerializedSize();
+  }
+
+  virtual uint32_t serializedSizeListBegin_virt(const TType elemType, const uint32_t size) {
+    (void)elemType;
+    (void)size;
+    return noSerializedSize();
+  }
+
+  virtual uint32_t serializedSizeSetBegin_virt(const TType elemType, const uint32_t size) {
+    (void)elemType;
+    (void)size;
+    return noSerializedSize();
+  }
+
+  virtual uint32_t serializedSizeBool_virt(const bool value) {
+    (void)value;
+    return noSerializedSize();
+  }
+
+  virtual uint32_t serializedSizeByte_virt(const int8_t byte) {
+    (void)byte;
+    return noSerializedSize();
+  }
+
+  virtual uint32_t serializedSizeI16_virt(const int16_t i16) {
+    (void)i16;
+    return noSerializedSize();
+  }
+
+  virtual uint32_t serializedSizeI32_virt(const int32_t i32) {
+    (void)i32;
+    return noSerializedSize();
+  }
+
+  virtual uint32_t serializedSizeI64_virt(const int64_t i64) {
+    (void)i64;
+    return noSerializedSize();
+  }
+
+  virtual uint32_t serializedSizeDouble_virt(const double dub) {
+    (void)dub;
+    return noSerializedSize();
+  }
+
+  virtual uint32_t serializedSizeString_virt(const std::string& str) {
+    (void)str;
+    return noSerializedSize();
+  }
+
+  virtual uint32_t serializedSizeBinary_virt(const std::string& str) {
+    (void)str;
+    return noSerializedSize();
+  }
+
+  virtual uint32_t serializedSizeStringView_virt(const TStringView& str) {
+    return serializedSizeString_virt(str.str());
+  }
+
+  virtual uint32_t serializedSizeBinaryView_virt(const TStringView& str) {
+    return serializedSizeBinary_virt(str.str());
+  }
+
+  virtual uint32_t serializedSizeI32Array_virt(const int32_t* values, uint32_t count) {
+    uint32_t xfer = 0;
+    for (uint32_t ix = 0; ix < count; ++ix) {
+      xfer += serializedSizeI32_virt(values[ix]);
+    }
+    return xfer;
+  }
+
+  virtual uint32_t serializedSizeI64Array_virt(const int64_t* values, uint32_t count) {
+    uint32_t xfer = 0;
+    for (uint32_t ix = 0; ix < count; ++ix) {
+      xfer += serializedSizeI64_virt(values[ix]);
+    }
+    return xfer;
+  }
+
+  virtual uint32_t serializedSizeDoubleArray_virt(const double* values, uint32_t count) {
+    uint32_t xfer = 0;
+    for (uint32_t ix = 0; ix < count; ++ix) {
+      xfer += serializedSizeDouble_virt(values[ix]);
+    }
+    return xfer;
+  }
+
+  uint32_t serializedSizeStructBegin(const char* name) {
+    T_VIRTUAL_CALL();
+    return serializedSizeStructBegin_virt(name);
+  }
+
+  uint32_t serializedSizeStructEnd() {
+    T_VIRTUAL_CALL();
+    return serializedSizeStructEnd_virt();
+  }
+
+  uint32_t serializedSizeFieldBegin(const char* name, const TType fieldType, const int16_t fieldId) {
+    T_VIRTUAL_CALL();
+    return serializedSizeFieldBegin_virt(name, fieldType, fieldId);
+  }
+
+  uint32_t serializedSizeFieldStop() {
+    T_VIRTUAL_CALL();
+    return serializedSizeFieldStop_virt();
+  }
+
+  uint32_t serializedSizeMapBegin(const TType keyType, const TType valType, const uint32_t size) {
+    T_VIRTUAL_CALL();
+    return serializedSizeMapBegin_virt(keyType, valType, size);
+  }
+
+  uint32_t serializedSizeListBegin(const TType elemType, const uint32_t size) {
+    T_VIRTUAL_CALL();
+    return serializedSizeListBegin_virt(elemType, size);
+  }
+
+  uint32_t serializedSizeSetBegin(const TType elemType, const uint32_t size) {
+    T_VIRTUAL_CALL();
+    return serializedSizeSetBegin_virt(elemType, size);
+  }
+
+  uint32_t serializedSizeBool(const bool value) {
+    T_VIRTUAL_CALL();
+    return serializedSizeBool_virt(value);
+  }
+
+  uint32_t serializedSizeByte(const int8_t byte) {
+    T_VIRTUAL_CALL();
+    return serializedSizeByte_virt(byte);
+  }
+
+  uint32_t serializedSizeI16(const int16_t i16) {
+    T_VIRTUAL_CALL();
+    return serializedSizeI16_virt(i16);
+  }
+
+  uint32_t serializedSizeI32(const int32_t i32) {
+    T_VIRTUAL_CALL();
+    return serializedSizeI32_virt(i32);
+  }
+
+  uint32_t serializedSizeI64(const int64_t i64) {
+    T_VIRTUAL_CALL();
+    return serializedSizeI64_virt(i64);
+  }
+
+  uint32_t serializedSizeDouble(const double dub) {
+    T_VIRTUAL_CALL();
+    return serializedSizeDouble_virt(dub);
+  }
+
+  uint32_t serializedSizeString(const std::string& str) {
+    T_VIRTUAL_CALL();
+    return serializedSizeString_virt(str);
+  }
+
+  uint32_t serializedSizeBinary(const std::string& str) {
+    T_VIRTUAL_CALL();
+    return serializedSizeBinary_virt(str);
+  }
+
+  uint32_t serializedSizeStringView(const TStringView& str) {
+    T_VIRTUAL_CALL();
+    return serializedSizeStringView_virt(str);
+  }
+
+  uint32_t serializedSizeBinaryView(const TStringView& str) {
+    T_VIRTUAL_CALL();
+    return serializedSizeBinaryView_virt(str);
+  }
+
+  uint32_t serializedSizeI32Array(const int32_t* values, uint32_t count) {
+    T_VIRTUAL_CALL();
+    return serializedSizeI32Array_virt(values, count);
+  }
+
+  uint32_t serializedSizeI64Array(const int64_t* values, uint32_t count) {
+    T_VIRTUAL_CALL();
+    return serializedSizeI64Array_virt(values, count);
+  }
+
+  uint32_t serializedSizeDoubleArray(const double* values, uint32_t count) {
+    T_VIRTUAL_CALL();
+    return serializedSizeDoubleArray_virt(values, count);
+  }
+
   /**
    * Reading functions
    */
@@ -426,6 +727,63 @@ public:
 
   virtual uint32_t readBinary_virt(std::string& str) = 0;
 
+  /**
+   * Reads a string or binary into a view.  By default the view owns a copy;
+   * protocols that can lend out their transport's buffer override these.
+   */
+  virtual uint32_t readStringView_virt(TStringView& str) {
+    boost::shared_ptr<std::string> copy(new std::string());
+    uint32_t xfer = readString_virt(*copy);
+    str = TStringView(copy);
+    return xfer;
+  }
+
+  virtual uint32_t readBinaryView_virt(TStringView& str) {
+    boost::shared_ptr<std::string> copy(new std::string());
+    uint32_t xfer = readBinary_virt(*copy);
+    str = TStringView(copy);
+    return xfer;
+  }
+
+  /**
+   * Reads count elements of a list at once.  Protocols that can decode runs
+   * of elements faster than one at a time override these.
+   */
+  virtual uint32_t readI32Array_virt(int32_t* values, uint32_t count) {
+    uint32_t xfer = 0;
+    for (uint32_t ix = 0; ix < count; ++ix) {
+      xfer += readI32_virt(values[ix]);
+    }
+    return xfer;
+  }
+
+  virtual uint32_t readI64Array_virt(int64_t* values, uint32_t count) {
+    uint32_t xfer = 0;
+    for (uint32_t ix = 0; ix < count; ++ix) {
+      xfer += readI64_virt(values[ix]);
+    }
+    return xfer;
+  }
+
+  virtual uint32_t readDoubleArray_virt(double* values, uint32_t count) {
+    uint32_t xfer = 0;
+    for (uint32_t ix = 0; ix < count; ++ix) {
+      xfer += readDouble_virt(values[ix]);
+    }
+    return xfer;
+  }
+
+  /**
+   * Reads a value of the given type without decoding it, as the bytes it was
+   * serialized as.  Returns 0, having read nothing, if the protocol or its
+   * transport cannot do that; no value is shorter than a byte.
+   */
+  virtual uint32_t readRaw_virt(TType type, std::string& raw) {
+    (void)type;
+    (void)raw;
+    return 0;
+  }
+
   uint32_t readMessageBegin(std::string& name, TMessageType& messageType, int32_t& seqid) {
     T_VIRTUAL_CALL();
     return readMessageBegin_virt(name, messageType, seqid);
@@ -526,6 +884,36 @@ public:
     return readBinary_virt(str);
   }
 
+  uint32_t readStringView(TStringView& str) {
+    T_VIRTUAL_CALL();
+    return readStringView_virt(str);
+  }
+
+  uint32_t readBinaryView(TStringView& str) {
+    T_VIRTUAL_CALL();
+    return readBinaryView_virt(str);
+  }
+
+  uint32_t readI32Array(int32_t* values, uint32_t count) {
+    T_VIRTUAL_CALL();
+    return readI32Array_virt(values, count);
+  }
+
+  uint32_t readI64Array(int64_t* values, uint32_t count) {
+    T_VIRTUAL_CALL();
+    return readI64Array_virt(values, count);
+  }
+
+  uint32_t readDoubleArray(double* values, uint32_t count) {
+    T_VIRTUAL_CALL();
+    return readDoubleArray_virt(values, count);
+  }
+
+  uint32_t readRaw(TType type, std::string& raw) {
+    T_VIRTUAL_CALL();
+    return readRaw_virt(type, raw);
+  }
+
   /*
    * std::vector is specialized for bool, and its elements are individual bits
    * rather than bools.   We need to define a different version of readBool()
@@ -547,6 +935,26 @@ public:
 
   inline boost::shared_ptr<TTransport> getTransport() { return ptrans_; }
 
+  /**
+   * Names the encoding of the values readRaw() returns and writeRaw()
+   * accepts, or returns NULL if the protocol has none.  Raw values can be
+   * copied between protocols whose formats compare equal with strcmp().
+   */
+  virtual const char* getRawFormat() const { return NULL; }
+
+  /**
+   * Returns a factory for protocols that decode the raw values this one
+   * reads, or an empty pointer if it has no raw format.
+   */
+  virtual boost::shared_ptr<TProtocolFactory> getRawFactory() {
+    return boost::shared_ptr<TProtocolFactory>();
+  }
+
+  /**
+   * Whether the sizing functions give the exact sizes this protocol writes.
+   */
+  virtual bool hasSerializedSize() const { return false; }
+
   // TODO: remove these two calls, they are for backwards
   // compatibility
   inline boost::shared_ptr<TTransport> getInputTransport() { return ptrans_; }
@@ -572,6 +980,11 @@ public:
   void setRecurisionLimit(uint32_t depth) {recursion_limit_ = depth;}
 
 protected:
+  static uint32_t noSerializedSize() {
+    throw TProtocolException(TProtocolException::NOT_IMPLEMENTED,
+                             "Serialized sizes are not supported by this protocol.");
+  }
+
   TProtocol(boost::shared_ptr<TTransport> ptrans)
     : ptrans_(ptrans), input_recursion_depth_(0), output_recursion_depth_(0), recursion_limit_(DEFAULT_RECURSION_LIMIT)
   {}
@@ -752,6 +1165,20 @@ uint32_t skip(Protocol_& prot, TType type) {
   return 0;
 }
 
+/**
+ * Writes a generated struct after reserving room for all of it in the
+ * protocol's transport, so that a buffering transport grows its buffer at
+ * most once however large the struct is.  Where the protocol cannot size
+ * the struct, it is just written.
+ */
+template <class Protocol_, class Struct_>
+uint32_t writeReserved(Protocol_& prot, const Struct_& value) {
+  if (prot.hasSerializedSize()) {
+    prot.getTransport()->reserveWrite(value.serializedSize(&prot));
+  }
+  return value.write(&prot);
+}
+
 }}} // apache::thrift::protocol
 
 #endif // #define _THRIFT_PROTOCOL_TPROTOCOL_H_ 1
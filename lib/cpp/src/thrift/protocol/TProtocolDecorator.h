@@ -93,6 +93,84 @@ public:
   virtual uint32_t writeString_virt(const std::string& str) { return protocol->writeString(str); }
   virtual uint32_t writeBinary_virt(const std::string& str) { return protocol->writeBinary(str); }
 
+  virtual uint32_t writeStringView_virt(const TStringView& str) {
+    return protocol->writeStringView(str);
+  }
+  virtual uint32_t writeBinaryView_virt(const TStringView& str) {
+    return protocol->writeBinaryView(str);
+  }
+  virtual uint32_t writeI32Array_virt(const int32_t* values, uint32_t count) {
+    return protocol->writeI32Array(values, count);
+  }
+  virtual uint32_t writeI64Array_virt(const int64_t* values, uint32_t count) {
+    return protocol->writeI64Array(values, count);
+  }
+  virtual uint32_t writeDoubleArray_virt(const double* values, uint32_t count) {
+    return protocol->writeDoubleArray(values, count);
+  }
+  virtual uint32_t writeRaw_virt(const std::string& raw) { return protocol->writeRaw(raw); }
+
+  virtual uint32_t serializedSizeStructBegin_virt(const char* name) {
+    return protocol->serializedSizeStructBegin(name);
+  }
+  virtual uint32_t serializedSizeStructEnd_virt() { return protocol->serializedSizeStructEnd(); }
+  virtual uint32_t serializedSizeFieldBegin_virt(const char* name,
+                                                 const TType fieldType,
+                                                 const int16_t fieldId) {
+    return protocol->serializedSizeFieldBegin(name, fieldType, fieldId);
+  }
+  virtual uint32_t serializedSizeFieldStop_virt() { return protocol->serializedSizeFieldStop(); }
+  virtual uint32_t serializedSizeMapBegin_virt(const TType keyType,
+                                               const TType valType,
+                                               const uint32_t size) {
+    return protocol->serializedSizeMapBegin(keyType, valType, size);
+  }
+  virtual uint32_t serializedSizeListBegin_virt(const TType elemType, const uint32_t size) {
+    return protocol->serializedSizeListBegin(elemType, size);
+  }
+  virtual uint32_t serializedSizeSetBegin_virt(const TType elemType, const uint32_t size) {
+    return protocol->serializedSizeSetBegin(elemType, size);
+  }
+  virtual uint32_t serializedSizeBool_virt(const bool value) {
+    return protocol->serializedSizeBool(value);
+  }
+  virtual uint32_t serializedSizeByte_virt(const int8_t byte) {
+    return protocol->serializedSizeByte(byte);
+  }
+  virtual uint32_t serializedSizeI16_virt(const int16_t i16) {
+    return protocol->serializedSizeI16(i16);
+  }
+  virtual uint32_t serializedSizeI32_virt(const int32_t i32) {
+    return protocol->serializedSizeI32(i32);
+  }
+  virtual uint32_t serializedSizeI64_virt(const int64_t i64) {
+    return protocol->serializedSizeI64(i64);
+  }
+  virtual uint32_t serializedSizeDouble_virt(const double dub) {
+    return protocol->serializedSizeDouble(dub);
+  }
+  virtual uint32_t serializedSizeString_virt(const std::string& str) {
+    return protocol->serializedSizeString(str);
+  }
+  virtual uint32_t serializedSizeBinary_virt(const std::string& str) {
+    return protocol->serializedSizeBinary(str);
+  }
+  virtual uint32_t serializedSizeStringView_virt(const TStringView& str) {
+    return protocol->serializedSizeStringView(str);
+  }
+  virtual uint32_t serializedSizeBinaryView_virt(const TStringView& str) {
+    return protocol->serializedSizeBinaryView(str);
+  }
+  virtual uint32_t serializedSizeI32Array_virt(const int32_t* values, uint32_t count) {
+    return protocol->serializedSizeI32Array(values, count);
+  }
+  virtual uint32_t serializedSizeI64Array_virt(const int64_t* values, uint32_t count) {
+    return protocol->serializedSizeI64Array(values, count);
+  }
+  virtual uint32_t serializedSizeDoubleArray_virt(const double* values, uint32_t count) {
+    return protocol->serializedSizeDoubleArray(values, count);
+  }
+
   virtual uint32_t readMessageBegin_virt(std::string& name,
                                          TMessageType& messageType,
                                          int32_t& seqid) {
@@ -141,6 +219,33 @@ public:
   virtual uint32_t readString_virt(std::string& str) { return protocol->readString(str); }
   virtual uint32_t readBinary_virt(std::string& str) { return protocol->readBinary(str); }
 
+  virtual uint32_t readStringView_virt(TStringView& str) { return protocol->readStringView(str); }
+  virtual uint32_t readBinaryView_virt(TStringView& str) { return protocol->readBinaryView(str); }
+
+  virtual uint32_t readI32Array_virt(int32_t* values, uint32_t count) {
+    return protocol->readI32Array(values, count);
+  }
+  virtual uint32_t readI64Array_virt(int64_t* values, uint32_t count) {
+    return protocol->readI64Array(values, count);
+  }
+  virtual uint32_t readDoubleArray_virt(double* values, uint32_t count) {
+    return protocol->readDoubleArray(values, count);
+  }
+  virtual uint32_t readRaw_virt(TType type, std::string& raw) {
+    return protocol->readRaw(type, raw);
+  }
+
+  virtual const char* getRawFormat() const { return protocol->getRawFormat(); }
+  virtual shared_ptr<TProtocolFactory> getRawFactory() { return protocol->getRawFactory(); }
+  virtual bool hasSerializedSize() const { return protocol->hasSerializedSize(); }
+
+protected:
+  // Desc: Forwards to another protocol from now on, or to none if it is empty.
+  void setProtocol(shared_ptr<TProtocol> proto) {
+    protocol = proto;
+    ptrans_ = proto ? proto->getTransport() : shared_ptr<TTransport>();
+  }
+
 private:
   shared_ptr<TProtocol> protocol;
 };
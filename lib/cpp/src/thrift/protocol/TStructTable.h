@@ -0,0 +1,639 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef _THRIFT_PROTOCOL_TSTRUCTTABLE_H_
+#define _THRIFT_PROTOCOL_TSTRUCTTABLE_H_ 1
+
+#include <stddef.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <boost/unordered/unordered_map_fwd.hpp>
+#include <boost/unordered/unordered_set_fwd.hpp>
+
+#include <thrift/protocol/TProtocol.h>
+
+/**
+ * Structs generated with the cpp:tables option describe their fields in
+ * tables of the types below, and their read(), write() and serializedSize()
+ * hand the tables to readStruct(), writeStruct() and serializedSizeStruct()
+ * instead of expanding the code for every field.  The tables are plain
+ * aggregates of constants, so they are laid out by the compiler and need no
+ * initialization at run time.
+ */
+
+namespace apache {
+namespace thrift {
+namespace protocol {
+
+struct TStructSpec;
+
+/// Called by a container for each element it reads, or each key and value.
+typedef void (*TElementReader)(void* context, void* element, bool isValue);
+
+/// Called by a container for each element it writes, or each key and value.
+typedef void (*TElementWriter)(void* context, const void* element, bool isValue);
+
+/**
+ * What the engine needs of a list, set or map, given as functions so a
+ * table can describe any container type.  TListOps, TSetOps and TMapOps
+ * provide them for the standard containers.
+ */
+struct TContainerOps {
+  uint32_t (*size)(const void* container);
+
+  /// Clears the container, then reads size elements into it.
+  void (*read)(void* container, uint32_t size, TElementReader reader, void* context);
+
+  void (*write)(const void* container, TElementWriter writer, void* context);
+};
+
+/**
+ * Describes how a value of a type is held and encoded.
+ */
+struct TTypeSpec {
+  TType type;
+
+  /// For strings, whether they are read and written as binaries.
+  bool binary;
+
+  /// For enums, which are encoded as i32s, the size of the enum type.
+  uint8_t enumSize;
+
+  /// The elements of a list or set, or the keys of a map.
+  const TTypeSpec* key;
+
+  /// The values of a map.
+  const TTypeSpec* value;
+
+  const TContainerOps* container;
+
+  const TStructSpec* structSpec;
+};
+
+enum TFieldMode {
+  T_FIELD_DEFAULT,
+  T_FIELD_REQUIRED,
+
+  /// Only written when its __isset flag is set.
+  T_FIELD_OPTIONAL
+};
+
+struct TFieldSpec {
+  /// The issetOffset of a field without an __isset flag.
+  static const size_t NO_ISSET = static_cast<size_t>(-1);
+
+  int16_t id;
+  TFieldMode mode;
+  const char* name;
+
+  /// Where the field is in the struct.
+  size_t offset;
+
+  /// Where the field's __isset flag is in the struct, or NO_ISSET.
+  size_t issetOffset;
+
+  const TTypeSpec* type;
+};
+
+struct TStructSpec {
+  const char* name;
+
+  /// In field id order.
+  const TFieldSpec* fields;
+  uint32_t fieldCount;
+
+  /// A bit for each required field, by its index in fields.
+  uint64_t requiredMask;
+};
+
+template <class Protocol_>
+uint32_t readStruct(Protocol_& prot, const TStructSpec& spec, void* object);
+
+template <class Protocol_>
+uint32_t writeStruct(Protocol_& prot, const TStructSpec& spec, const void* object);
+
+template <class Protocol_>
+uint32_t serializedSizeStruct(Protocol_& prot, const TStructSpec& spec, const void* object);
+
+namespace detail {
+namespace table {
+
+template <class Protocol_>
+struct ElementContext {
+  Protocol_* prot;
+  const TTypeSpec* spec;
+  uint32_t xfer;
+};
+
+inline void storeEnum(void* value, uint8_t size, int32_t ecast) {
+  switch (size) {
+  case 1: {
+    int8_t narrow = static_cast<int8_t>(ecast);
+    memcpy(value, &narrow, sizeof(narrow));
+    break;
+  }
+  case 2: {
+    int16_t narrow = static_cast<int16_t>(ecast);
+    memcpy(value, &narrow, sizeof(narrow));
+    break;
+  }
+  case 8: {
+    int64_t wide = ecast;
+    memcpy(value, &wide, sizeof(wide));
+    break;
+  }
+  default:
+    memcpy(value, &ecast, sizeof(ecast));
+    break;
+  }
+}
+
+inline int32_t loadEnum(const void* value, uint8_t size) {
+  switch (size) {
+  case 1: {
+    int8_t narrow;
+    memcpy(&narrow, value, sizeof(narrow));
+    return narrow;
+  }
+  case 2: {
+    int16_t narrow;
+    memcpy(&narrow, value, sizeof(narrow));
+    return narrow;
+  }
+  case 8: {
+    int64_t wide;
+    memcpy(&wide, value, sizeof(wide));
+    return static_cast<int32_t>(wide);
+  }
+  default: {
+    int32_t ecast;
+    memcpy(&ecast, value, sizeof(ecast));
+    return ecast;
+  }
+  }
+}
+
+template <class Protocol_>
+uint32_t readValue(Protocol_& prot, const TTypeSpec& spec, void* value);
+
+template <class Protocol_>
+uint32_t writeValue(Protocol_& prot, const TTypeSpec& spec, const void* value);
+
+template <class Protocol_>
+uint32_t sizeValue(Protocol_& prot, const TTypeSpec& spec, const void* value);
+
+template <class Protocol_>
+void readElement(void* context, void* element, bool isValue) {
+  ElementContext<Protocol_>* ctx = static_cast<ElementContext<Protocol_>*>(context);
+  ctx->xfer += readValue(*ctx->prot, isValue ? *ctx->spec->value : *ctx->spec->key, element);
+}
+
+template <class Protocol_>
+void writeElement(void* context, const void* element, bool isValue) {
+  ElementContext<Protocol_>* ctx = static_cast<ElementContext<Protocol_>*>(context);
+  ctx->xfer += writeValue(*ctx->prot, isValue ? *ctx->spec->value : *ctx->spec->key, element);
+}
+
+template <class Protocol_>
+void sizeElement(void* context, const void* element, bool isValue) {
+  ElementContext<Protocol_>* ctx = static_cast<ElementContext<Protocol_>*>(context);
+  ctx->xfer += sizeValue(*ctx->prot, isValue ? *ctx->spec->value : *ctx->spec->key, element);
+}
+
+template <class Protocol_>
+uint32_t readValue(Protocol_& prot, const TTypeSpec& spec, void* value) {
+  switch (spec.type) {
+  case T_BOOL:
+    return prot.readBool(*static_cast<bool*>(value));
+  case T_BYTE:
+    return prot.readByte(*static_cast<int8_t*>(value));
+  case T_I16:
+    return prot.readI16(*static_cast<int16_t*>(value));
+  case T_I32: {
+    if (spec.enumSize == 0) {
+      return prot.readI32(*static_cast<int32_t*>(value));
+    }
+    int32_t ecast;
+    uint32_t xfer = prot.readI32(ecast);
+    storeEnum(value, spec.enumSize, ecast);
+    return xfer;
+  }
+  case T_I64:
+    return prot.readI64(*static_cast<int64_t*>(value));
+  case T_DOUBLE:
+    return prot.readDouble(*static_cast<double*>(value));
+  case T_STRING:
+    if (spec.binary) {
+      return prot.readBinary(*static_cast<std::string*>(value));
+    }
+    return prot.readString(*static_cast<std::string*>(value));
+  case T_STRUCT:
+    return readStruct(prot, *spec.structSpec, value);
+  case T_MAP: {
+    TType keyType;
+    TType valType;
+    uint32_t size;
+    ElementContext<Protocol_> ctx = {&prot, &spec, 0};
+    ctx.xfer += prot.readMapBegin(keyType, valType, size);
+    spec.container->read(value, size, &readElement<Protocol_>, &ctx);
+    ctx.xfer += prot.readMapEnd();
+    return ctx.xfer;
+  }
+  case T_SET: {
+    TType elemType;
+    uint32_t size;
+    ElementContext<Protocol_> ctx = {&prot, &spec, 0};
+    ctx.xfer += prot.readSetBegin(elemType, size);
+    spec.container->read(value, size, &readElement<Protocol_>, &ctx);
+    ctx.xfer += prot.readSetEnd();
+    return ctx.xfer;
+  }
+  case T_LIST: {
+    TType elemType;
+    uint32_t size;
+    ElementContext<Protocol_> ctx = {&prot, &spec, 0};
+    ctx.xfer += prot.readListBegin(elemType, size);
+    spec.container->read(value, size, &readElement<Protocol_>, &ctx);
+    ctx.xfer += prot.readListEnd();
+    return ctx.xfer;
+  }
+  default:
+    throw TProtocolException(TProtocolException::INVALID_DATA);
+  }
+}
+
+template <class Protocol_>
+uint32_t writeValue(Protocol_& prot, const TTypeSpec& spec, const void* value) {
+  switch (spec.type) {
+  case T_BOOL:
+    return prot.writeBool(*static_cast<const bool*>(value));
+  case T_BYTE:
+    return prot.writeByte(*static_cast<const int8_t*>(value));
+  case T_I16:
+    return prot.writeI16(*static_cast<const int16_t*>(value));
+  case T_I32:
+    if (spec.enumSize == 0) {
+      return prot.writeI32(*static_cast<const int32_t*>(value));
+    }
+    return prot.writeI32(loadEnum(value, spec.enumSize));
+  case T_I64:
+    return prot.writeI64(*static_cast<const int64_t*>(value));
+  case T_DOUBLE:
+    return prot.writeDouble(*static_cast<const double*>(value));
+  case T_STRING:
+    if (spec.binary) {
+      return prot.writeBinary(*static_cast<const std::string*>(value));
+    }
+    return prot.writeString(*static_cast<const std::string*>(value));
+  case T_STRUCT:
+    return writeStruct(prot, *spec.structSpec, value);
+  case T_MAP: {
+    ElementContext<Protocol_> ctx = {&prot, &spec, 0};
+    ctx.xfer += prot.writeMapBegin(spec.key->type, spec.value->type, spec.container->size(value));
+    spec.container->write(value, &writeElement<Protocol_>, &ctx);
+    ctx.xfer += prot.writeMapEnd();
+    return ctx.xfer;
+  }
+  case T_SET: {
+    ElementContext<Protocol_> ctx = {&prot, &spec, 0};
+    ctx.xfer += prot.writeSetBegin(spec.key->type, spec.container->size(value));
+    spec.container->write(value, &writeElement<Protocol_>, &ctx);
+    ctx.xfer += prot.writeSetEnd();
+    return ctx.xfer;
+  }
+  case T_LIST: {
+    ElementContext<Protocol_> ctx = {&prot, &spec, 0};
+    ctx.xfer += prot.writeListBegin(spec.key->type, spec.container->size(value));
+    spec.container->write(value, &writeElement<Protocol_>, &ctx);
+    ctx.xfer += prot.writeListEnd();
+    return ctx.xfer;
+  }
+  default:
+    throw TProtocolException(TProtocolException::INVALID_DATA);
+  }
+}
+
+template <class Protocol_>
+uint32_t sizeValue(Protocol_& prot, const TTypeSpec& spec, const void* value) {
+  switch (spec.type) {
+  case T_BOOL:
+    return prot.serializedSizeBool(*static_cast<const bool*>(value));
+  case T_BYTE:
+    return prot.serializedSizeByte(*static_cast<const int8_t*>(value));
+  case T_I16:
+    return prot.serializedSizeI16(*static_cast<const int16_t*>(value));
+  case T_I32:
+    if (spec.enumSize == 0) {
+      return prot.serializedSizeI32(*static_cast<const int32_t*>(value));
+    }
+    return prot.serializedSizeI32(loadEnum(value, spec.enumSize));
+  case T_I64:
+    return prot.serializedSizeI64(*static_cast<const int64_t*>(value));
+  case T_DOUBLE:
+    return prot.serializedSizeDouble(*static_cast<const double*>(value));
+  case T_STRING:
+    if (spec.binary) {
+      return prot.serializedSizeBinary(*static_cast<const std::string*>(value));
+    }
+    return prot.serializedSizeString(*static_cast<const std::string*>(value));
+  case T_STRUCT:
+    return serializedSizeStruct(prot, *spec.structSpec, value);
+  case T_MAP: {
+    ElementContext<Protocol_> ctx = {&prot, &spec, 0};
+    ctx.xfer += prot.serializedSizeMapBegin(spec.key->type,
+                                            spec.value->type,
+                                            spec.container->size(value));
+    spec.container->write(value, &sizeElement<Protocol_>, &ctx);
+    return ctx.xfer;
+  }
+  case T_SET: {
+    ElementContext<Protocol_> ctx = {&prot, &spec, 0};
+    ctx.xfer += prot.serializedSizeSetBegin(spec.key->type, spec.container->size(value));
+    spec.container->write(value, &sizeElement<Protocol_>, &ctx);
+    return ctx.xfer;
+  }
+  case T_LIST: {
+    ElementContext<Protocol_> ctx = {&prot, &spec, 0};
+    ctx.xfer += prot.serializedSizeListBegin(spec.key->type, spec.container->size(value));
+    spec.container->write(value, &sizeElement<Protocol_>, &ctx);
+    return ctx.xfer;
+  }
+  default:
+    throw TProtocolException(TProtocolException::INVALID_DATA);
+  }
+}
+
+inline bool fieldIdLess(const TFieldSpec& field, int16_t id) {
+  return field.id < id;
+}
+
+/**
+ * Finds the field with the given id.  Fields usually arrive in id order, so
+ * the one after the last found is tried before searching.
+ */
+inline const TFieldSpec* findField(const TStructSpec& spec, int16_t id, uint32_t& hint) {
+  const TFieldSpec* end = spec.fields + spec.fieldCount;
+  const TFieldSpec* field = spec.fields + hint;
+  if (field == end || field->id != id) {
+    field = std::lower_bound(spec.fields, end, id, &fieldIdLess);
+    if (field == end || field->id != id) {
+      return NULL;
+    }
+  }
+  hint = static_cast<uint32_t>(field - spec.fields) + 1;
+  return field;
+}
+
+template <class Container_>
+uint32_t containerSize(const void* container) {
+  return static_cast<uint32_t>(static_cast<const Container_*>(container)->size());
+}
+
+// only hashed containers make room for their elements ahead of time
+template <class Container_>
+void reserve(Container_&, uint32_t) {}
+
+template <class Key_, class Hash_, class Pred_, class Alloc_>
+void reserve(boost::unordered_set<Key_, Hash_, Pred_, Alloc_>& set, uint32_t size) {
+  set.reserve(size);
+}
+
+template <class Key_, class Value_, class Hash_, class Pred_, class Alloc_>
+void reserve(boost::unordered_map<Key_, Value_, Hash_, Pred_, Alloc_>& map, uint32_t size) {
+  map.reserve(size);
+}
+}
+} // detail::table
+
+template <class Protocol_>
+uint32_t readStruct(Protocol_& prot, const TStructSpec& spec, void* object) {
+  TInputRecursionTracker tracker(prot);
+  char* base = static_cast<char*>(object);
+  uint32_t xfer = 0;
+  std::string fname;
+  TType ftype;
+  int16_t fid;
+  uint64_t required = 0;
+  uint32_t hint = 0;
+
+  xfer += prot.readStructBegin(fname);
+  while (true) {
+    xfer += prot.readFieldBegin(fname, ftype, fid);
+    if (ftype == T_STOP) {
+      break;
+    }
+    const TFieldSpec* field = detail::table::findField(spec, fid, hint);
+    if (field != NULL && ftype == field->type->type) {
+      xfer += detail::table::readValue(prot, *field->type, base + field->offset);
+      if (field->issetOffset != TFieldSpec::NO_ISSET) {
+        *reinterpret_cast<bool*>(base + field->issetOffset) = true;
+      } else {
+        required |= static_cast<uint64_t>(1) << (field - spec.fields);
+      }
+    } else {
+      xfer += prot.skip(ftype);
+    }
+    xfer += prot.readFieldEnd();
+  }
+  xfer += prot.readStructEnd();
+
+  // Throw if any required fields are missing, after reading the struct end
+  // so there might be a chance of continuing.
+  if ((required & spec.requiredMask) != spec.requiredMask) {
+    throw TProtocolException(TProtocolException::INVALID_DATA);
+  }
+  return xfer;
+}
+
+template <class Protocol_>
+uint32_t writeStruct(Protocol_& prot, const TStructSpec& spec, const void* object) {
+  TOutputRecursionTracker tracker(prot);
+  const char* base = static_cast<const char*>(object);
+  uint32_t xfer = 0;
+
+  xfer += prot.writeStructBegin(spec.name);
+  for (const TFieldSpec* field = spec.fields; field != spec.fields + spec.fieldCount; ++field) {
+    if (field->mode == T_FIELD_OPTIONAL
+        && !*reinterpret_cast<const bool*>(base + field->issetOffset)) {
+      continue;
+    }
+    xfer += prot.writeFieldBegin(field->name, field->type->type, field->id);
+    xfer += detail::table::writeValue(prot, *field->type, base + field->offset);
+    xfer += prot.writeFieldEnd();
+  }
+  xfer += prot.writeFieldStop();
+  xfer += prot.writeStructEnd();
+  return xfer;
+}
+
+template <class Protocol_>
+uint32_t serializedSizeStruct(Protocol_& prot, const TStructSpec& spec, const void* object) {
+  TOutputRecursionTracker tracker(prot);
+  const char* base = static_cast<const char*>(object);
+  uint32_t xfer = 0;
+
+  xfer += prot.serializedSizeStructBegin(spec.name);
+  for (const TFieldSpec* field = spec.fields; field != spec.fields + spec.fieldCount; ++field) {
+    if (field->mode == T_FIELD_OPTIONAL
+        && !*reinterpret_cast<const bool*>(base + field->issetOffset)) {
+      continue;
+    }
+    xfer += prot.serializedSizeFieldBegin(field->name, field->type->type, field->id);
+    xfer += detail::table::sizeValue(prot, *field->type, base + field->offset);
+  }
+  xfer += prot.serializedSizeFieldStop();
+  xfer += prot.serializedSizeStructEnd();
+  return xfer;
+}
+
+/**
+ * The TContainerOps of a std::vector or a container like it.
+ */
+template <class List_>
+struct TListOps {
+  static const TContainerOps ops;
+
+  static void read(void* container, uint32_t size, TElementReader reader, void* context) {
+    List_& list = *static_cast<List_*>(container);
+    list.clear();
+    list.resize(size);
+    for (typename List_::iterator it = list.begin(); it != list.end(); ++it) {
+      reader(context, &*it, false);
+    }
+  }
+
+  static void write(const void* container, TElementWriter writer, void* context) {
+    const List_& list = *static_cast<const List_*>(container);
+    for (typename List_::const_iterator it = list.begin(); it != list.end(); ++it) {
+      writer(context, &*it, false);
+    }
+  }
+};
+
+template <class List_>
+const TContainerOps TListOps<List_>::ops = {&detail::table::containerSize<List_>,
+                                            &TListOps<List_>::read,
+                                            &TListOps<List_>::write};
+
+/**
+ * std::vector<bool> packs its elements, so they go through a bool.
+ */
+template <class Alloc_>
+struct TListOps<std::vector<bool, Alloc_> > {
+  typedef std::vector<bool, Alloc_> List_;
+
+  static const TContainerOps ops;
+
+  static void read(void* container, uint32_t size, TElementReader reader, void* context) {
+    List_& list = *static_cast<List_*>(container);
+    list.clear();
+    list.resize(size);
+    for (uint32_t ix = 0; ix < size; ++ix) {
+      bool elem;
+      reader(context, &elem, false);
+      list[ix] = elem;
+    }
+  }
+
+  static void write(const void* container, TElementWriter writer, void* context) {
+    const List_& list = *static_cast<const List_*>(container);
+    for (typename List_::const_iterator it = list.begin(); it != list.end(); ++it) {
+      bool elem = *it;
+      writer(context, &elem, false);
+    }
+  }
+};
+
+template <class Alloc_>
+const TContainerOps TListOps<std::vector<bool, Alloc_> >::ops
+    = {&detail::table::containerSize<std::vector<bool, Alloc_> >,
+       &TListOps<std::vector<bool, Alloc_> >::read,
+       &TListOps<std::vector<bool, Alloc_> >::write};
+
+/**
+ * The TContainerOps of a std::set or a container like it.
+ */
+template <class Set_>
+struct TSetOps {
+  static const TContainerOps ops;
+
+  static void read(void* container, uint32_t size, TElementReader reader, void* context) {
+    Set_& set = *static_cast<Set_*>(container);
+    set.clear();
+    detail::table::reserve(set, size);
+    typename Set_::iterator hint = set.end();
+    for (uint32_t ix = 0; ix < size; ++ix) {
+      typename Set_::value_type elem;
+      reader(context, &elem, false);
+      hint = set.insert(hint, elem);
+    }
+  }
+
+  static void write(const void* container, TElementWriter writer, void* context) {
+    const Set_& set = *static_cast<const Set_*>(container);
+    for (typename Set_::const_iterator it = set.begin(); it != set.end(); ++it) {
+      writer(context, &*it, false);
+    }
+  }
+};
+
+template <class Set_>
+const TContainerOps TSetOps<Set_>::ops = {&detail::table::containerSize<Set_>,
+                                          &TSetOps<Set_>::read,
+                                          &TSetOps<Set_>::write};
+
+/**
+ * The TContainerOps of a std::map or a container like it.
+ */
+template <class Map_>
+struct TMapOps {
+  static const TContainerOps ops;
+
+  static void read(void* container, uint32_t size, TElementReader reader, void* context) {
+    Map_& map = *static_cast<Map_*>(container);
+    map.clear();
+    detail::table::reserve(map, size);
+    for (uint32_t ix = 0; ix < size; ++ix) {
+      typename Map_::key_type key;
+      reader(context, &key, false);
+      reader(context, &map[key], true);
+    }
+  }
+
+  static void write(const void* container, TElementWriter writer, void* context) {
+    const Map_& map = *static_cast<const Map_*>(container);
+    for (typename Map_::const_iterator it = map.begin(); it != map.end(); ++it) {
+      writer(context, &it->first, false);
+      writer(context, &it->second, true);
+    }
+  }
+};
+
+template <class Map_>
+const TContainerOps TMapOps<Map_>::ops = {&detail::table::containerSize<Map_>,
+                                          &TMapOps<Map_>::read,
+                                          &TMapOps<Map_>::write};
+}
+}
+} // apache::thrift::protocol
+
+#endif // #ifndef _THRIFT_PROTOCOL_TSTRUCTTABLE_H_
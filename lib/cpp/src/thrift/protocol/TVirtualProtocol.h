@@ -169,6 +169,24 @@ public:
                              "this protocol does not support reading (yet).");
   }
 
+  uint32_t readStringView(TStringView& str) { return TProtocol::readStringView_virt(str); }
+
+  uint32_t readBinaryView(TStringView& str) { return TProtocol::readBinaryView_virt(str); }
+
+  uint32_t readI32Array(int32_t* values, uint32_t count) {
+    return TProtocol::readI32Array_virt(values, count);
+  }
+
+  uint32_t readI64Array(int64_t* values, uint32_t count) {
+    return TProtocol::readI64Array_virt(values, count);
+  }
+
+  uint32_t readDoubleArray(double* values, uint32_t count) {
+    return TProtocol::readDoubleArray_virt(values, count);
+  }
+
+  uint32_t readRaw(TType type, std::string& raw) { return TProtocol::readRaw_virt(type, raw); }
+
   uint32_t writeMessageBegin(const std::string& name,
                              const TMessageType messageType,
                              const int32_t seqid) {
@@ -298,6 +316,96 @@ public:
                              "this protocol does not support writing (yet).");
   }
 
+  uint32_t writeStringView(const TStringView& str) { return TProtocol::writeStringView_virt(str); }
+
+  uint32_t writeBinaryView(const TStringView& str) { return TProtocol::writeBinaryView_virt(str); }
+
+  uint32_t writeI32Array(const int32_t* values, uint32_t count) {
+    return TProtocol::writeI32Array_virt(values, count);
+  }
+
+  uint32_t writeI64Array(const int64_t* values, uint32_t count) {
+    return TProtocol::writeI64Array_virt(values, count);
+  }
+
+  uint32_t writeDoubleArray(const double* values, uint32_t count) {
+    return TProtocol::writeDoubleArray_virt(values, count);
+  }
+
+  uint32_t writeRaw(const std::string& raw) { return TProtocol::writeRaw_virt(raw); }
+
+  uint32_t serializedSizeStructBegin(const char* name) {
+    return TProtocol::serializedSizeStructBegin_virt(name);
+  }
+
+  uint32_t serializedSizeStructEnd() { return TProtocol::serializedSizeStructEnd_virt(); }
+
+  uint32_t serializedSizeFieldBegin(const char* name,
+                                    const TType fieldType,
+                                    const int16_t fieldId) {
+    return TProtocol::serializedSizeFieldBegin_virt(name, fieldType, fieldId);
+  }
+
+  uint32_t serializedSizeFieldStop() { return TProtocol::serializedSizeFieldStop_virt(); }
+
+  uint32_t serializedSizeMapBegin(const TType keyType, const TType valType, const uint32_t size) {
+    return TProtocol::serializedSizeMapBegin_virt(keyType, valType, size);
+  }
+
+  uint32_t serializedSizeListBegin(const TType elemType, const uint32_t size) {
+    return TProtocol::serializedSizeListBegin_virt(elemType, size);
+  }
+
+  uint32_t serializedSizeSetBegin(const TType elemType, const uint32_t size) {
+    return TProtocol::serializedSizeSetBegin_virt(elemType, size);
+  }
+
+  uint32_t serializedSizeBool(const bool value) {
+    return TProtocol::serializedSizeBool_virt(value);
+  }
+
+  uint32_t serializedSizeByte(const int8_t byte) {
+    return TProtocol::serializedSizeByte_virt(byte);
+  }
+
+  uint32_t serializedSizeI16(const int16_t i16) { return TProtocol::serializedSizeI16_virt(i16); }
+
+  uint32_t serializedSizeI32(const int32_t i32) { return TProtocol::serializedSizeI32_virt(i32); }
+
+  uint32_t serializedSizeI64(const int64_t i64) { return TProtocol::serializedSizeI64_virt(i64); }
+
+  uint32_t serializedSizeDouble(const double dub) {
+    return TProtocol::serializedSizeDouble_virt(dub);
+  }
+
+  uint32_t serializedSizeString(const std::string& str) {
+    return TProtocol::serializedSizeString_virt(str);
+  }
+
+  uint32_t serializedSizeBinary(const std::string& str) {
+    return TProtocol::serializedSizeBinary_virt(str);
+  }
+
+  uint32_t serializedSizeStringView(const TStringView& str) {
+    return TProtocol::serializedSizeStringView_virt(str);
+  }
+
+  uint32_t serializedSizeBinaryView(const TStringView& str) {
+    return TProtocol::serializedSizeBinaryView_virt(str);
+  }
+
+  uint32_t serializedSizeI32Array(const int32_t* values, uint32_t count) {
+    return TProtocol::serializedSizeI32Array_virt(values, count);
+  }
+
+  uint32_t serializedSizeI64Array(const int64_t* values, uint32_t count) {
+    return TProtocol::serializedSizeI64Array_virt(values, count);
+  }
+
+  uint32_t serializedSizeDoubleArray(const double* values, uint32_t count) {
+    return TProtocol::serializedSizeDoubleArray_virt(values, count);
+  }
+
   uint32_t skip(TType type) { return ::apache::thrift::protocol::skip(*this, type); }
 
 protected:
@@ -393,6 +501,114 @@ public:
     return static_cast<Protocol_*>(this)->writeBinary(str);
   }
 
+  virtual uint32_t writeStringView_virt(const TStringView& str) {
+    return static_cast<Protocol_*>(this)->writeStringView(str);
+  }
+
+  virtual uint32_t writeBinaryView_virt(const TStringView& str) {
+    return static_cast<Protocol_*>(this)->writeBinaryView(str);
+  }
+
+  virtual uint32_t writeI32Array_virt(const int32_t* values, uint32_t count) {
+    return static_cast<Protocol_*>(this)->writeI32Array(values, count);
+  }
+
+  virtual uint32_t writeI64Array_virt(const int64_t* values, uint32_t count) {
+    return static_cast<Protocol_*>(this)->writeI64Array(values, count);
+  }
+
+  virtual uint32_t writeDoubleArray_virt(const double* values, uint32_t count) {
+    return static_cast<Protocol_*>(this)->writeDoubleArray(values, count);
+  }
+
+  virtual uint32_t writeRaw_virt(const std::string& raw) {
+    return static_cast<Protocol_*>(this)->writeRaw(raw);
+  }
+
+  virtual uint32_t serializedSizeStructBegin_virt(const char* name) {
+    return static_cast<Protocol_*>(this)->serializedSizeStructBegin(name);
+  }
+
+  virtual uint32_t serializedSizeStructEnd_virt() {
+    return static_cast<Protocol_*>(this)->serializedSizeStructEnd();
+  }
+
+  virtual uint32_t serializedSizeFieldBegin_virt(const char* name,
+                                                 const TType fieldType,
+                                                 const int16_t fieldId) {
+    return static_cast<Protocol_*>(this)->serializedSizeFieldBegin(name, fieldType, fieldId);
+  }
+
+  virtual uint32_t serializedSizeFieldStop_virt() {
+    return static_cast<Protocol_*>(this)->serializedSizeFieldStop();
+  }
+
+  virtual uint32_t serializedSizeMapBegin_virt(const TType keyType,
+                                               const TType valType,
+                                               const uint32_t size) {
+    return static_cast<Protocol_*>(this)->serializedSizeMapBegin(keyType, valType, size);
+  }
+
+  virtual uint32_t serializedSizeListBegin_virt(const TType elemType, const uint32_t size) {
+    return static_cast<Protocol_*>(this)->serializedSizeListBegin(elemType, size);
+  }
+
+  virtual uint32_t serializedSizeSetBegin_virt(const TType elemType, const uint32_t size) {
+    return static_cast<Protocol_*>(this)->serializedSizeSetBegin(elemType, size);
+  }
+
+  virtual uint32_t serializedSizeBool_virt(const bool value) {
+    return static_cast<Protocol_*>(this)->serializedSizeBool(value);
+  }
+
+  virtual uint32_t serializedSizeByte_virt(const int8_t byte) {
+    return static_cast<Protocol_*>(this)->serializedSizeByte(byte);
+  }
+
+  virtual uint32_t serializedSizeI16_virt(const int16_t i16) {
+    return static_cast<Protocol_*>(this)->serializedSizeI16(i16);
+  }
+
+  virtual uint32_t serializedSizeI32_virt(const int32_t i32) {
+    return static_cast<Protocol_*>(this)->serializedSizeI32(i32);
+  }
+
+  virtual uint32_t serializedSizeI64_virt(const int64_t i64) {
+    return static_cast<Protocol_*>(this)->serializedSizeI64(i64);
+  }
+
+  virtual uint32_t serializedSizeDouble_virt(const double dub) {
+    return static_cast<Protocol_*>(this)->serializedSizeDouble(dub);
+  }
+
+  virtual uint32_t serializedSizeString_virt(const std::string& str) {
+    return static_cast<Protocol_*>(this)->serializedSizeString(str);
+  }
+
+  virtual uint32_t serializedSizeBinary_virt(const std::string& str) {
+    return static_cast<Protocol_*>(this)->serializedSizeBinary(str);
+  }
+
+  virtual uint32_t serializedSizeStringView_virt(const TStringView& str) {
+    return static_cast<Protocol_*>(this)->serializedSizeStringView(str);
+  }
+
+  virtual uint32_t serializedSizeBinaryView_virt(const TStringView& str) {
+    return static_cast<Protocol_*>(this)->serializedSizeBinaryView(str);
+  }
+
+  virtual uint32_t serializedSizeI32Array_virt(const int32_t* values, uint32_t count) {
+    return static_cast<Protocol_*>(this)->serializedSizeI32Array(values, count);
+  }
+
+  virtual uint32_t serializedSizeI64Array_virt(const int64_t* values, uint32_t count) {
+    return static_cast<Protocol_*>(this)->serializedSizeI64Array(values, count);
+  }
+
+  virtual uint32_t serializedSizeDoubleArray_virt(const double* values, uint32_t count) {
+    return static_cast<Protocol_*>(this)->serializedSizeDoubleArray(values, count);
+  }
+
   /**
    * Reading functions
    */
@@ -471,6 +687,30 @@ public:
     return static_cast<Protocol_*>(this)->readBinary(str);
   }
 
+  virtual uint32_t readStringView_virt(TStringView& str) {
+    return static_cast<Protocol_*>(this)->readStringView(str);
+  }
+
+  virtual uint32_t readBinaryView_virt(TStringView& str) {
+    return static_cast<Protocol_*>(this)->readBinaryView(str);
+  }
+
+  virtual uint32_t readI32Array_virt(int32_t* values, uint32_t count) {
+    return static_cast<Protocol_*>(this)->readI32Array(values, count);
+  }
+
+  virtual uint32_t readI64Array_virt(int64_t* values, uint32_t count) {
+    return static_cast<Protocol_*>(this)->readI64Array(values, count);
+  }
+
+  virtual uint32_t readDoubleArray_virt(double* values, uint32_t count) {
+    return static_cast<Protocol_*>(this)->readDoubleArray(values, count);
+  }
+
+  virtual uint32_t readRaw_virt(TType type, std::string& raw) {
+    return static_cast<Protocol_*>(this)->readRaw(type, raw);
+  }
+
   virtual uint32_t skip_virt(TType type) { return static_cast<Protocol_*>(this)->skip(type); }
 
   /*
@@ -0,0 +1,126 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <thrift/server/TBufferPool.h>
+
+#include <cstdlib>
+#include <new>
+
+namespace apache {
+namespace thrift {
+namespace server {
+
+TBufferPool::TBufferPool(size_t maxPooledBytes)
+  : maxPooledBytes_(maxPooledBytes),
+    freeLists_(classFor(MAX_BUFFER_SIZE) + 1),
+    numHits_(0),
+    numMisses_(0),
+    numPooledBytes_(0),
+    numBorrowed_(0) {
+}
+
+TBufferPool::~TBufferPool() {
+  clear();
+}
+
+int TBufferPool::classFor(uint32_t size) {
+  if (size > MAX_BUFFER_SIZE) {
+    return -1;
+  }
+  int sizeClass = 0;
+  while (classSize(sizeClass) < size) {
+    ++sizeClass;
+  }
+  return sizeClass;
+}
+
+uint8_t* TBufferPool::allocate(uint32_t size, uint32_t* capacity) {
+  int sizeClass = classFor(size);
+  if (sizeClass >= 0 && !freeLists_[sizeClass].empty()) {
+    uint8_t* buffer = freeLists_[sizeClass].back();
+    freeLists_[sizeClass].pop_back();
+    *capacity = classSize(sizeClass);
+    numPooledBytes_ -= *capacity;
+    ++numBorrowed_;
+    ++numHits_;
+    return buffer;
+  }
+
+  uint32_t allocSize = sizeClass >= 0 ? classSize(sizeClass) : size;
+  uint8_t* buffer = static_cast<uint8_t*>(std::malloc(allocSize));
+  if (buffer == NULL) {
+    throw std::bad_alloc();
+  }
+  *capacity = allocSize;
+  ++numBorrowed_;
+  ++numMisses_;
+  return buffer;
+}
+
+void TBufferPool::release(uint8_t* buffer, uint32_t capacity) {
+  if (buffer == NULL) {
+    return;
+  }
+  --numBorrowed_;
+
+  // file it under the largest class it can serve
+  int sizeClass = -1;
+  if (capacity >= MIN_BUFFER_SIZE && capacity <= MAX_BUFFER_SIZE) {
+    sizeClass = classFor(capacity);
+    if (classSize(sizeClass) > capacity) {
+      --sizeClass;
+    }
+  }
+  if (sizeClass < 0
+      || numPooledBytes_ + classSize(sizeClass) > static_cast<int64_t>(maxPooledBytes_)) {
+    std::free(buffer);
+    return;
+  }
+
+  freeLists_[sizeClass].push_back(buffer);
+  numPooledBytes_ += classSize(sizeClass);
+}
+
+void TBufferPool::clear() {
+  for (size_t i = 0; i < freeLists_.size(); ++i) {
+    for (size_t j = 0; j < freeLists_[i].size(); ++j) {
+      std::free(freeLists_[i][j]);
+    }
+    freeLists_[i].clear();
+  }
+  numPooledBytes_ = 0;
+}
+
+void TBufferPool::setMaxPooledBytes(size_t maxPooledBytes) {
+  maxPooledBytes_ = maxPooledBytes;
+
+  // drop the largest buffers first
+  int64_t limit = static_cast<int64_t>(maxPooledBytes_);
+  for (size_t i = freeLists_.size(); i > 0 && numPooledBytes_ > limit; --i) {
+    std::vector<uint8_t*>& freeList = freeLists_[i - 1];
+    while (!freeList.empty() && numPooledBytes_ > limit) {
+      std::free(freeList.back());
+      freeList.pop_back();
+      numPooledBytes_ -= classSize(static_cast<int>(i - 1));
+    }
+  }
+}
+}
+}
+} // apache::thrift::server
@@ -0,0 +1,122 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef _THRIFT_SERVER_TBUFFERPOOL_H_
+#define _THRIFT_SERVER_TBUFFERPOOL_H_ 1
+
+#include <thrift/Thrift.h>
+
+#include <boost/atomic.hpp>
+#include <boost/noncopyable.hpp>
+
+#include <vector>
+
+namespace apache {
+namespace thrift {
+namespace server {
+
+/**
+ * Pool of malloc()ed buffers in power-of-two size classes.
+ *
+ * Connections borrow a buffer while a frame is in flight and give it back
+ * when they go idle, so that many idle connections hold no buffer memory
+ * and busy ones reuse the same few allocations.  Returned buffers are kept
+ * for reuse until the pool holds getMaxPooledBytes(), after which they are
+ * freed.  Sizes above the largest class bypass the pool.
+ *
+ * Buffers come from malloc(), so they can be handed to a TMemoryBuffer
+ * with TAKE_OWNERSHIP and may be realloc()ed before they are returned.
+ *
+ * Not thread safe: each pool belongs to a single IO thread.  The counters
+ * may be read from any thread.
+ */
+class TBufferPool : boost::noncopyable {
+public:
+  /// Smallest size class
+  static const uint32_t MIN_BUFFER_SIZE = 256;
+
+  /// Largest size class
+  static const uint32_t MAX_BUFFER_SIZE = 1024 * 1024;
+
+  /**
+   * @param maxPooledBytes limit on the bytes kept for reuse; 0 keeps none.
+   */
+  explicit TBufferPool(size_t maxPooledBytes = 0);
+
+  ~TBufferPool();
+
+  /**
+   * Borrow a buffer of at least size bytes.
+   *
+   * @param size the number of bytes needed.
+   * @param capacity set to the usable size of the returned buffer.
+   * @throw std::bad_alloc if no memory is available.
+   */
+  uint8_t* allocate(uint32_t size, uint32_t* capacity);
+
+  /**
+   * Give back a borrowed buffer.  It may have been realloc()ed since, so
+   * its capacity need not match what allocate() returned.
+   *
+   * @param buffer the buffer, may be NULL.
+   * @param capacity the allocated size of the buffer.
+   */
+  void release(uint8_t* buffer, uint32_t capacity);
+
+  /// Free every buffer kept for reuse.
+  void clear();
+
+  size_t getMaxPooledBytes() const { return maxPooledBytes_; }
+
+  /// Change the limit on bytes kept for reuse, trimming the pool if needed.
+  void setMaxPooledBytes(size_t maxPooledBytes);
+
+  /// Number of allocations served from the pool.
+  uint64_t getNumHits() const { return numHits_; }
+
+  /// Number of allocations that had to go to malloc().
+  uint64_t getNumMisses() const { return numMisses_; }
+
+  /// Bytes currently kept for reuse.
+  int64_t getNumPooledBytes() const { return numPooledBytes_; }
+
+  /// Buffers currently borrowed and not given back.
+  int64_t getNumBorrowed() const { return numBorrowed_; }
+
+private:
+  /// Index of the smallest class holding size bytes, or -1 if none does.
+  static int classFor(uint32_t size);
+
+  static uint32_t classSize(int sizeClass) { return MIN_BUFFER_SIZE << sizeClass; }
+
+  size_t maxPooledBytes_;
+
+  /// Free buffers, one list per size class
+  std::vector<std::vector<uint8_t*> > freeLists_;
+
+  boost::atomic<uint64_t> numHits_;
+  boost::atomic<uint64_t> numMisses_;
+  boost::atomic<int64_t> numPooledBytes_;
+  boost::atomic<int64_t> numBorrowed_;
+};
+}
+}
+} // apache::thrift::server
+
+#endif // #ifndef _THRIFT_SERVER_TBUFFERPOOL_H_
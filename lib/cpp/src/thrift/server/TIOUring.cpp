@@ -0,0 +1,501 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <thrift/thrift-config.h>
+
+#include <thrift/server/TIOUring.h>
+
+#ifdef HAVE_LINUX_IO_URING_H
+#include <linux/io_uring.h>
+#endif
+
+// Older kernel headers have io_uring but not the provided buffer rings,
+// multishot accepts and receives, or cancelling by fd that the ring is
+// driven with, and multishot receives came last, in Linux 6.0.  Without
+// them the engine is left out, and isSupported() says so.
+#if defined(HAVE_LINUX_IO_URING_H) && defined(IORING_RECV_MULTISHOT)
+#define THRIFT_IO_URING 1
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#endif
+
+namespace apache {
+namespace thrift {
+namespace server {
+
+TIOUring::TIOUring()
+  : ringFD_(-1),
+    eventFD_(THRIFT_INVALID_SOCKET),
+    numInFlight_(0),
+    numQueued_(0),
+    sqRing_(NULL),
+    sqRingSize_(0),
+    sqHead_(NULL),
+    sqTail_(NULL),
+    sqFlags_(NULL),
+    sqMask_(0),
+    sqArray_(NULL),
+    sqes_(NULL),
+    sqesSize_(0),
+    sqeTail_(0),
+    cqRing_(NULL),
+    cqRingSize_(0),
+    cqHead_(NULL),
+    cqTail_(NULL),
+    cqMask_(0),
+    cqes_(NULL),
+    buffers_(NULL),
+    bufferSize_(0),
+    bufferRing_(NULL),
+    bufferRingSize_(0),
+    bufferMask_(0),
+    bufferTail_(0) {
+}
+
+TIOUring::~TIOUring() {
+  close();
+}
+
+#ifdef THRIFT_IO_URING
+
+namespace {
+
+int ioUringSetup(uint32_t entries, io_uring_params* params) {
+  return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+int ioUringEnter(int fd, uint32_t toSubmit, uint32_t minComplete, uint32_t flags) {
+  return static_cast<int>(syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, NULL, 0));
+}
+
+int ioUringRegister(int fd, uint32_t opcode, void* arg, uint32_t nrArgs) {
+  return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, nrArgs));
+}
+
+template <typename T>
+T* atOffset(void* base, uint32_t offset) {
+  return reinterpret_cast<T*>(static_cast<char*>(base) + offset);
+}
+
+// the rings are shared with the kernel, which reads what we publish with
+// release semantics and publishes its side the same way
+uint32_t loadAcquire(const uint32_t* p) {
+  return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+void storeRelease(uint32_t* p, uint32_t value) {
+  __atomic_store_n(p, value, __ATOMIC_RELEASE);
+}
+}
+
+bool TIOUring::isSupported() {
+  // multishot receive is the newest feature we rely on, so try it out
+  // rather than going by the kernel version
+  int pair[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, pair) != 0) {
+    return false;
+  }
+
+  bool supported = false;
+  try {
+    TIOUring ring;
+    ring.open(4, 2, 64);
+    ring.recv(pair[0], 1);
+    if (ring.submit() == 1 && ::write(pair[1], "x", 1) == 1 && ring.waitForCompletion()) {
+      Completion completion;
+      supported = ring.nextCompletion(completion) && completion.result == 1 && completion.more
+                  && completion.data != NULL;
+    }
+    ::shutdown(pair[0], SHUT_RDWR);
+    ring.close();
+  } catch (const TException&) {
+    supported = false;
+  }
+
+  ::close(pair[0]);
+  ::close(pair[1]);
+  return supported;
+}
+
+void TIOUring::open(uint32_t entries, uint32_t bufferCount, uint32_t bufferSize) {
+  if (isOpen()) {
+    return;
+  }
+
+  io_uring_params params;
+  std::memset(&params, 0, sizeof(params));
+  // multishot requests can complete many times, so leave room for them
+  params.flags = IORING_SETUP_CQSIZE;
+  params.cq_entries = entries * 4;
+  ringFD_ = ioUringSetup(entries, &params);
+  if (ringFD_ < 0) {
+    GlobalOutput.perror("TIOUring::open() io_uring_setup ", errno);
+    throw TException("TIOUring::open() io_uring_setup");
+  }
+
+  sqRingSize_ = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+  cqRingSize_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+  bool singleMap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+  if (singleMap) {
+    sqRingSize_ = cqRingSize_ = sqRingSize_ > cqRingSize_ ? sqRingSize_ : cqRingSize_;
+  }
+
+  sqRing_ = mmap(NULL,
+                 sqRingSize_,
+                 PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_POPULATE,
+                 ringFD_,
+                 IORING_OFF_SQ_RING);
+  if (sqRing_ == MAP_FAILED) {
+    sqRing_ = NULL;
+    int err = errno;
+    close();
+    GlobalOutput.perror("TIOUring::open() mmap ", err);
+    throw TException("TIOUring::open() mmap");
+  }
+  if (singleMap) {
+    cqRing_ = sqRing_;
+  } else {
+    cqRing_ = mmap(NULL,
+                   cqRingSize_,
+                   PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE,
+                   ringFD_,
+                   IORING_OFF_CQ_RING);
+    if (cqRing_ == MAP_FAILED) {
+      cqRing_ = NULL;
+      int err = errno;
+      close();
+      GlobalOutput.perror("TIOUring::open() mmap ", err);
+      throw TException("TIOUring::open() mmap");
+    }
+  }
+  sqesSize_ = params.sq_entries * sizeof(io_uring_sqe);
+  sqes_ = mmap(NULL,
+               sqesSize_,
+               PROT_READ | PROT_WRITE,
+               MAP_SHARED | MAP_POPULATE,
+               ringFD_,
+               IORING_OFF_SQES);
+  if (sqes_ == MAP_FAILED) {
+    sqes_ = NULL;
+    int err = errno;
+    close();
+    GlobalOutput.perror("TIOUring::open() mmap ", err);
+    throw TException("TIOUring::open() mmap");
+  }
+
+  sqHead_ = atOffset<uint32_t>(sqRing_, params.sq_off.head);
+  sqTail_ = atOffset<uint32_t>(sqRing_, params.sq_off.tail);
+  sqFlags_ = atOffset<uint32_t>(sqRing_, params.sq_off.flags);
+  sqMask_ = *atOffset<uint32_t>(sqRing_, params.sq_off.ring_mask);
+  sqArray_ = atOffset<uint32_t>(sqRing_, params.sq_off.array);
+  sqeTail_ = *sqTail_;
+  cqHead_ = atOffset<uint32_t>(cqRing_, params.cq_off.head);
+  cqTail_ = atOffset<uint32_t>(cqRing_, params.cq_off.tail);
+  cqMask_ = *atOffset<uint32_t>(cqRing_, params.cq_off.ring_mask);
+  cqes_ = atOffset<void>(cqRing_, params.cq_off.cqes);
+
+  int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (fd < 0 || ioUringRegister(ringFD_, IORING_REGISTER_EVENTFD, &fd, 1) < 0) {
+    int err = errno;
+    if (fd >= 0) {
+      ::close(fd);
+    }
+    close();
+    GlobalOutput.perror("TIOUring::open() eventfd ", err);
+    throw TException("TIOUring::open() eventfd");
+  }
+  eventFD_ = fd;
+
+  bufferRingSize_ = bufferCount * sizeof(io_uring_buf);
+  bufferRing_
+      = mmap(NULL, bufferRingSize_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  buffers_ = static_cast<uint8_t*>(std::malloc(static_cast<size_t>(bufferCount) * bufferSize));
+  if (bufferRing_ == MAP_FAILED || buffers_ == NULL) {
+    if (bufferRing_ == MAP_FAILED) {
+      bufferRing_ = NULL;
+    }
+    close();
+    throw TException("TIOUring::open() cannot allocate receive buffers");
+  }
+  io_uring_buf_reg reg;
+  std::memset(&reg, 0, sizeof(reg));
+  reg.ring_addr = reinterpret_cast<uintptr_t>(bufferRing_);
+  reg.ring_entries = bufferCount;
+  reg.bgid = 0;
+  if (ioUringRegister(ringFD_, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+    int err = errno;
+    close();
+    GlobalOutput.perror("TIOUring::open() register buffers ", err);
+    throw TException("TIOUring::open() register buffers");
+  }
+  bufferSize_ = bufferSize;
+  bufferMask_ = bufferCount - 1;
+  bufferTail_ = 0;
+  for (uint32_t i = 0; i < bufferCount; ++i) {
+    releaseBuffer(static_cast<uint16_t>(i));
+  }
+}
+
+void TIOUring::close() {
+  if (ringFD_ >= 0 && sqes_ != NULL && numInFlight_ > 0) {
+    // the kernel may write into our buffers until every request has ended
+    try {
+      cancelAll(0);
+    } catch (const TException&) {
+      // the queue is full, so the requests there get submitted below
+    }
+    Completion completion;
+    while (numInFlight_ > 0 && submit() >= 0) {
+      while (nextCompletion(completion)) {
+      }
+      if (numInFlight_ > 0 && !waitForCompletion()) {
+        break;
+      }
+    }
+  }
+
+  if (sqes_ != NULL) {
+    munmap(sqes_, sqesSize_);
+    sqes_ = NULL;
+  }
+  if (cqRing_ != NULL && cqRing_ != sqRing_) {
+    munmap(cqRing_, cqRingSize_);
+  }
+  cqRing_ = NULL;
+  if (sqRing_ != NULL) {
+    munmap(sqRing_, sqRingSize_);
+    sqRing_ = NULL;
+  }
+  if (ringFD_ >= 0) {
+    ::close(ringFD_);
+    ringFD_ = -1;
+  }
+  if (eventFD_ != THRIFT_INVALID_SOCKET) {
+    ::close(eventFD_);
+    eventFD_ = THRIFT_INVALID_SOCKET;
+  }
+  if (bufferRing_ != NULL) {
+    munmap(bufferRing_, bufferRingSize_);
+    bufferRing_ = NULL;
+  }
+  std::free(buffers_);
+  buffers_ = NULL;
+  numInFlight_ = 0;
+  numQueued_ = 0;
+}
+
+void TIOUring::clearSignal() {
+  uint64_t count;
+  while (::read(eventFD_, &count, sizeof(count)) < 0 && errno == EINTR) {
+  }
+}
+
+void* TIOUring::getSqe() {
+  if (sqeTail_ - loadAcquire(sqHead_) > sqMask_) {
+    submit();
+    if (sqeTail_ - loadAcquire(sqHead_) > sqMask_) {
+      throw TException("TIOUring: submission queue full");
+    }
+  }
+  uint32_t index = sqeTail_ & sqMask_;
+  io_uring_sqe* sqe = static_cast<io_uring_sqe*>(sqes_) + index;
+  std::memset(sqe, 0, sizeof(*sqe));
+  sqArray_[index] = index;
+  ++sqeTail_;
+  ++numQueued_;
+  ++numInFlight_;
+  return sqe;
+}
+
+void TIOUring::accept(THRIFT_SOCKET fd, uint64_t userData) {
+  io_uring_sqe* sqe = static_cast<io_uring_sqe*>(getSqe());
+  sqe->opcode = IORING_OP_ACCEPT;
+  sqe->fd = fd;
+  sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+  sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+  sqe->user_data = userData;
+}
+
+void TIOUring::recv(THRIFT_SOCKET fd, uint64_t userData) {
+  io_uring_sqe* sqe = static_cast<io_uring_sqe*>(getSqe());
+  sqe->opcode = IORING_OP_RECV;
+  sqe->fd = fd;
+  sqe->ioprio = IORING_RECV_MULTISHOT;
+  sqe->flags = IOSQE_BUFFER_SELECT;
+  sqe->buf_group = 0;
+  sqe->user_data = userData;
+}
+
+void TIOUring::send(THRIFT_SOCKET fd, const uint8_t* buf, uint32_t len, uint64_t userData) {
+  io_uring_sqe* sqe = static_cast<io_uring_sqe*>(getSqe());
+  sqe->opcode = IORING_OP_SEND;
+  sqe->fd = fd;
+  sqe->addr = reinterpret_cast<uintptr_t>(buf);
+  sqe->len = len;
+  sqe->msg_flags = MSG_NOSIGNAL;
+  sqe->user_data = userData;
+}
+
+void TIOUring::cancel(uint64_t userData, uint64_t cancelUserData) {
+  io_uring_sqe* sqe = static_cast<io_uring_sqe*>(getSqe());
+  sqe->opcode = IORING_OP_ASYNC_CANCEL;
+  sqe->fd = -1;
+  sqe->addr = userData;
+  sqe->user_data = cancelUserData;
+}
+
+void TIOUring::cancelAll(uint64_t cancelUserData) {
+  io_uring_sqe* sqe = static_cast<io_uring_sqe*>(getSqe());
+  sqe->opcode = IORING_OP_ASYNC_CANCEL;
+  sqe->fd = -1;
+  sqe->cancel_flags = IORING_ASYNC_CANCEL_ALL | IORING_ASYNC_CANCEL_ANY;
+  sqe->user_data = cancelUserData;
+}
+
+int TIOUring::submit() {
+  if (numQueued_ == 0) {
+    return 0;
+  }
+  storeRelease(sqTail_, sqeTail_);
+  while (true) {
+    int ret = ioUringEnter(ringFD_, numQueued_, 0, 0);
+    if (ret >= 0) {
+      numQueued_ -= ret;
+      return ret;
+    }
+    if (errno != EINTR) {
+      return -errno;
+    }
+  }
+}
+
+bool TIOUring::nextCompletion(Completion& completion) {
+  uint32_t head = *cqHead_;
+  if (head == loadAcquire(cqTail_)) {
+    // completions that did not fit the ring wait in the kernel until asked for
+    if ((loadAcquire(sqFlags_) & IORING_SQ_CQ_OVERFLOW) == 0) {
+      return false;
+    }
+    ioUringEnter(ringFD_, 0, 0, IORING_ENTER_GETEVENTS);
+    if (head == loadAcquire(cqTail_)) {
+      return false;
+    }
+  }
+
+  const io_uring_cqe* cqe = static_cast<const io_uring_cqe*>(cqes_) + (head & cqMask_);
+  completion.userData = cqe->user_data;
+  completion.result = cqe->res;
+  completion.more = (cqe->flags & IORING_CQE_F_MORE) != 0;
+  if (cqe->flags & IORING_CQE_F_BUFFER) {
+    completion.bufferId = static_cast<uint16_t>(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+    completion.data = buffers_ + static_cast<size_t>(completion.bufferId) * bufferSize_;
+  } else {
+    completion.bufferId = 0;
+    completion.data = NULL;
+  }
+  storeRelease(cqHead_, head + 1);
+
+  if (!completion.more) {
+    --numInFlight_;
+  }
+  return true;
+}
+
+void TIOUring::releaseBuffer(uint16_t bufferId) {
+  io_uring_buf* buf = static_cast<io_uring_buf*>(bufferRing_) + (bufferTail_ & bufferMask_);
+  buf->addr = reinterpret_cast<uintptr_t>(buffers_ + static_cast<size_t>(bufferId) * bufferSize_);
+  buf->len = bufferSize_;
+  buf->bid = bufferId;
+  ++bufferTail_;
+
+  // the tail overlays the unused last field of the first entry
+  __atomic_store_n(atOffset<uint16_t>(bufferRing_, offsetof(io_uring_buf, resv)),
+                   bufferTail_,
+                   __ATOMIC_RELEASE);
+}
+
+bool TIOUring::waitForCompletion() {
+  while (ioUringEnter(ringFD_, 0, 1, IORING_ENTER_GETEVENTS) < 0) {
+    if (errno != EINTR) {
+      return false;
+    }
+  }
+  return true;
+}
+
+#else // !THRIFT_IO_URING
+
+bool TIOUring::isSupported() {
+  return false;
+}
+
+void TIOUring::open(uint32_t, uint32_t, uint32_t) {
+  throw TException("TIOUring::open() io_uring is not available on this platform");
+}
+
+void TIOUring::close() {
+}
+
+void TIOUring::clearSignal() {
+}
+
+void TIOUring::accept(THRIFT_SOCKET, uint64_t) {
+}
+
+void TIOUring::recv(THRIFT_SOCKET, uint64_t) {
+}
+
+void TIOUring::send(THRIFT_SOCKET, const uint8_t*, uint32_t, uint64_t) {
+}
+
+void TIOUring::cancel(uint64_t, uint64_t) {
+}
+
+void TIOUring::cancelAll(uint64_t) {
+}
+
+int TIOUring::submit() {
+  return 0;
+}
+
+bool TIOUring::nextCompletion(Completion&) {
+  return false;
+}
+
+void TIOUring::releaseBuffer(uint16_t) {
+}
+
+bool TIOUring::waitForCompletion() {
+  return false;
+}
+
+#endif // THRIFT_IO_URING
+}
+}
+} // apache::thrift::server
@@ -0,0 +1,184 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef _THRIFT_SERVER_TIOURING_H_
+#define _THRIFT_SERVER_TIOURING_H_ 1
+
+#include <thrift/Thrift.h>
+#include <thrift/transport/PlatformSocket.h>
+
+#include <boost/noncopyable.hpp>
+
+namespace apache {
+namespace thrift {
+namespace server {
+
+/**
+ * Minimal Linux io_uring for the socket operations of a TNonblockingIOThread.
+ *
+ * Requests are only queued by accept(), recv(), send() and cancel(), and go
+ * to the kernel together on the next submit(), so one system call covers
+ * all connections of a loop iteration.  Accepts and receives are multishot:
+ * they stay armed and complete once per connection or chunk of data.
+ * Received data lands in buffers the ring provides to the kernel, which the
+ * consumer hands back with releaseBuffer() once it has copied them out.
+ *
+ * Completions are announced on an eventfd, so the ring can be driven from
+ * an existing event loop.
+ *
+ * Talks to the kernel directly, without liburing.  Needs Linux 6.0 or
+ * later, and headers from it to be compiled in; isSupported() tells
+ * whether both hold.  Not thread safe: each ring belongs to a single IO
+ * thread.
+ */
+class TIOUring : boost::noncopyable {
+public:
+  /// The outcome of a request.
+  struct Completion {
+    /// The value given when the request was queued
+    uint64_t userData;
+
+    /// Bytes transferred or the accepted descriptor, or -errno
+    int32_t result;
+
+    /// Set if a multishot request stays armed after this completion
+    bool more;
+
+    /// Received data, result bytes long, or NULL
+    const uint8_t* data;
+
+    /// The provided buffer holding data, for releaseBuffer()
+    uint16_t bufferId;
+  };
+
+  TIOUring();
+
+  ~TIOUring();
+
+  /// Returns true if io_uring was compiled in and the kernel supports it.
+  static bool isSupported();
+
+  /**
+   * Sets up the ring and its provided buffers.
+   *
+   * @param entries the number of requests that can be queued at once.
+   * @param bufferCount the number of receive buffers, a power of two.
+   * @param bufferSize the size of each receive buffer.
+   * @throw TException if the ring cannot be set up.
+   */
+  void open(uint32_t entries, uint32_t bufferCount, uint32_t bufferSize);
+
+  /// Tears the ring down, cancelling the requests still in flight.
+  void close();
+
+  bool isOpen() const { return ringFD_ >= 0; }
+
+  /// Returns the descriptor that becomes readable when completions arrive.
+  THRIFT_SOCKET getEventFD() const { return eventFD_; }
+
+  /// Consumes the readiness of getEventFD().
+  void clearSignal();
+
+  /// Queues a multishot accept on a listen socket.
+  void accept(THRIFT_SOCKET fd, uint64_t userData);
+
+  /// Queues a multishot receive into provided buffers.
+  void recv(THRIFT_SOCKET fd, uint64_t userData);
+
+  /// Queues a send of len bytes from buf, which must stay valid until it completes.
+  void send(THRIFT_SOCKET fd, const uint8_t* buf, uint32_t len, uint64_t userData);
+
+  /**
+   * Queues the cancellation of the request queued with userData.  The
+   * cancellation completes as well, with cancelUserData.
+   */
+  void cancel(uint64_t userData, uint64_t cancelUserData);
+
+  /// Queues the cancellation of every request in flight.
+  void cancelAll(uint64_t cancelUserData);
+
+  /**
+   * Hands the queued requests to the kernel.
+   *
+   * @return the number submitted, or -errno.
+   */
+  int submit();
+
+  /**
+   * Takes the next completion off the ring.
+   *
+   * @return false if there is none.
+   */
+  bool nextCompletion(Completion& completion);
+
+  /// Hands a provided buffer back to the kernel.
+  void releaseBuffer(uint16_t bufferId);
+
+  /**
+   * Blocks until at least one completion is available.
+   *
+   * @return false if waiting failed.
+   */
+  bool waitForCompletion();
+
+  /// Returns the number of requests that have not completed for good yet.
+  uint32_t getNumInFlight() const { return numInFlight_; }
+
+private:
+  void* getSqe();
+
+  int ringFD_;
+  THRIFT_SOCKET eventFD_;
+
+  uint32_t numInFlight_;
+  uint32_t numQueued_;
+
+  /// Submission queue, shared with the kernel
+  void* sqRing_;
+  size_t sqRingSize_;
+  uint32_t* sqHead_;
+  uint32_t* sqTail_;
+  uint32_t* sqFlags_;
+  uint32_t sqMask_;
+  uint32_t* sqArray_;
+  void* sqes_;
+  size_t sqesSize_;
+  uint32_t sqeTail_;
+
+  /// Completion queue, shared with the kernel; may be the same mapping
+  void* cqRing_;
+  size_t cqRingSize_;
+  uint32_t* cqHead_;
+  uint32_t* cqTail_;
+  uint32_t cqMask_;
+  void* cqes_;
+
+  /// Provided buffers and the ring that lends them to the kernel
+  uint8_t* buffers_;
+  uint32_t bufferSize_;
+  void* bufferRing_;
+  size_t bufferRingSize_;
+  uint32_t bufferMask_;
+  uint16_t bufferTail_;
+};
+}
+}
+} // apache::thrift::server
+
+#endif // #ifndef _THRIFT_SERVER_TIOURING_H_
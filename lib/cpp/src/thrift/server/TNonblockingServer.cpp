@@ -22,12 +22,18 @@
 #include <thrift/thrift-config.h>
 
 #include <thrift/server/TNonblockingServer.h>
+#include <thrift/TApplicationException.h>
 #include <thrift/concurrency/Exception.h>
+#include <thrift/concurrency/Util.h>
 #include <thrift/transport/TSocket.h>
 #include <thrift/concurrency/PlatformThreadFactory.h>
 #include <thrift/transport/PlatformSocket.h>
 
+#include <algorithm>
+#include <cerrno>
+#include <deque>
 #include <iostream>
+#include <map>
 
 #ifdef HAVE_SYS_SELECT_H
 #include <sys/select.h>
@@ -110,6 +116,9 @@ enum TAppState {
  * essentially encapsulates a socket that has some associated libevent state.
  */
 class TNonblockingServer::TConnection {
+public:
+  struct Request;
+
 private:
   /// Server IO Thread handling this connection
   TNonblockingIOThread* ioThread_;
@@ -162,6 +171,12 @@ private:
   /// Count of the number of calls for use with getResizeBufferEveryN().
   int32_t callsForResize_;
 
+  /// Bytes this connection currently adds to its IO thread's pending bytes
+  int64_t pendingBytes_;
+
+  /// Whether this connection currently counts as an active task of its IO thread
+  bool taskActive_;
+
   /// Transport to read from
   boost::shared_ptr<TMemoryBuffer> inputTransport_;
 
@@ -178,12 +193,89 @@ private:
   /// Protocol encoder
   boost::shared_ptr<TProtocol> outputProtocol_;
 
+  /// View of the request being queued and decoder reading its method name,
+  /// only set up while the server has method priorities
+  boost::shared_ptr<TMemoryBuffer> priorityTransport_;
+  boost::shared_ptr<TProtocol> priorityProtocol_;
+
+  /// Method name of the request being queued, reused to spare allocations
+  std::string priorityName_;
+
   /// Server event handler, if any
   boost::shared_ptr<TServerEventHandler> serverEventHandler_;
 
   /// Thrift call context, if any
   void* connectionContext_;
 
+  /// Whether buffers are borrowed from the IO thread's pool
+  bool useBufferPool_;
+
+  /// Limit for requests in flight at once, 1 when not pipelining
+  size_t maxPipelinedRequests_;
+
+  /// Whether responses go out as soon as they are ready
+  bool outOfOrderResponses_;
+
+  /// Pipelined requests handed to the thread manager and not collected yet
+  size_t pipelineInFlight_;
+
+  /// Arrival number of the next request and of the next in-order response
+  uint64_t nextRequestSeq_;
+  uint64_t nextResponseSeq_;
+
+  /// Set when close() was called with pipelined requests still in flight
+  bool closePending_;
+
+  /// Guards completed_, which worker threads append to
+  Mutex pipelineMutex_;
+
+  /// Pipelined requests finished by a worker but not collected yet
+  std::vector<Request*> completed_;
+
+  /// Scratch space for collecting completed_ without holding the lock
+  std::vector<Request*> collected_;
+
+  /// Finished requests waiting for an earlier response (in order only)
+  std::map<uint64_t, Request*> reorder_;
+
+  /// Responses ready to send; the front one is being written
+  std::deque<Request*> sendQueue_;
+
+  /// Request objects kept for reuse
+  std::vector<Request*> freeRequests_;
+
+  /// Whether socket IO goes through the IO thread's io_uring
+  bool useRing_;
+
+  /// Ring requests that refer to us, counting a queued ready pass; close() waits for them
+  uint32_t ringOps_;
+
+  /// Whether a multishot receive is armed
+  bool ringRecvArmed_;
+
+  /// Whether a send is in flight, and the result of one that finished
+  bool ringSendBusy_;
+  bool ringSendDone_;
+  int32_t ringSendResult_;
+
+  /// Whether we are on the IO thread's ready list
+  bool ringReady_;
+
+  /// Set once the peer has closed, or to the errno of a failed receive
+  bool ringEOF_;
+  int ringError_;
+
+  /// Set when close() is waiting for the ring
+  bool ringClosing_;
+
+  /// Received bytes the state machine has not consumed yet
+  std::vector<uint8_t> ringInput_;
+  size_t ringInputPos_;
+
+  /// Rest of the data of the receive being handled
+  const uint8_t* ringData_;
+  uint32_t ringDataLen_;
+
   /// Go into read mode
   void setRead() { setFlags(EV_READ | EV_PERSIST); }
 
@@ -193,6 +285,23 @@ private:
   /// Set socket idle
   void setIdle() { setFlags(0); }
 
+  /// Update this connection's share of the IO thread's pending bytes
+  void setPendingBytes(int64_t bytes) {
+    ioThread_->numPendingBytes_ += bytes - pendingBytes_;
+    pendingBytes_ = bytes;
+  }
+
+  /// Add to this connection's share of the IO thread's pending bytes
+  void addPendingBytes(int64_t bytes) { setPendingBytes(pendingBytes_ + bytes); }
+
+  /// Update whether this connection counts as an active task of the IO thread
+  void setTaskActive(bool active) {
+    if (active != taskActive_) {
+      ioThread_->numActiveTasks_ += active ? 1 : -1;
+      taskActive_ = active;
+    }
+  }
+
   /**
    * Set event flags for this connection.
    *
@@ -208,6 +317,77 @@ private:
    */
   void workSocket();
 
+  /// Whether requests on this connection are pipelined
+  bool isPipelined() const { return maxPipelinedRequests_ > 1; }
+
+  /// Requests dispatched but whose response has not been sent yet
+  size_t pipelineOutstanding() const {
+    return pipelineInFlight_ + reorder_.size() + sendQueue_.size();
+  }
+
+  /// Handle socket events while pipelining, where reads and writes overlap
+  void workPipelinedSocket(short which);
+
+  /// Thread manager priority of the request just read, offset into the read buffer
+  size_t getTaskPriority(uint32_t offset);
+
+  /// Hand the request just read to the thread manager
+  void dispatchPipelinedRequest();
+
+  /// Pick up requests finished by the workers and queue their responses
+  void collectPipelinedResponses();
+
+  /// Frame a finished request's response and queue it for sending
+  void queueResponse(Request* request);
+
+  /// Write as many queued responses as the socket takes; false if closed
+  bool sendPipelinedResponses();
+
+  /// Watch for reads and/or writes depending on the pipeline state
+  void updatePipelineFlags();
+
+  /// Undo the accounting done when a pipelined request was dispatched
+  void finishRequest(Request* request);
+
+  Request* newRequest();
+  void recycleRequest(Request* request);
+
+  /// Replace the buffer of transport with an empty pooled one of size bytes
+  void borrowBuffer(TMemoryBuffer* transport, uint32_t size);
+
+  /// Give the buffer of transport back to the pool
+  void returnBuffer(TMemoryBuffer* transport);
+
+  /// Give the read buffer back to the pool
+  void returnReadBuffer();
+
+  /// Read from the socket, or from what the ring received
+  uint32_t readSocket(uint8_t* buf, uint32_t len);
+
+  /// Write to the socket; through the ring, returns 0 until a send completes
+  uint32_t writeSocket(const uint8_t* buf, uint32_t len);
+
+  /// Ring user data for one of our requests
+  uint64_t ringUserData(int op) const { return reinterpret_cast<uintptr_t>(this) | op; }
+
+  /// Whether received data is waiting to be consumed
+  bool hasRingInput() const { return ringInputPos_ < ringInput_.size() || ringDataLen_ > 0; }
+
+  /// Keep what the state machine left of the receive being handled
+  void saveRingInput();
+
+  /// Queue a multishot receive on the ring
+  void armRingRecv();
+
+  /// Ask the IO thread for a ready pass
+  void queueRingReady();
+
+  /**
+   * Run the state machine for as long as the ring has delivered what it
+   * waits for, like the readiness events of libevent would.
+   */
+  void workRing();
+
 public:
   class Task;
 
@@ -225,17 +405,29 @@ public:
     // Allocate input and output transports these only need to be allocated
     // once per TConnection (they don't need to be reallocated on init() call)
     inputTransport_.reset(new TMemoryBuffer(readBuffer_, readBufferSize_));
-    outputTransport_.reset(
-        new TMemoryBuffer(static_cast<uint32_t>(server_->getWriteBufferDefaultSize())));
+    if (server_->getBufferPoolLimit() > 0) {
+      // borrowed from the pool once there is a response to write
+      outputTransport_.reset(new TMemoryBuffer(NULL, 0));
+    } else {
+      outputTransport_.reset(
+          new TMemoryBuffer(static_cast<uint32_t>(server_->getWriteBufferDefaultSize())));
+    }
     tSocket_.reset(new TSocket());
     init(socket, ioThread, addr, addrLen);
   }
 
   ~TConnection() { std::free(readBuffer_); }
 
-  /// Close this connection and free or reset its resources.
+  /**
+   * Close this connection and free or reset its resources.  With pipelined
+   * requests still being processed, it is only marked as closing, and closed
+   * once the last of them is collected.
+   */
   void close();
 
+  /// Whether close() is waiting for pipelined requests to be collected
+  bool isClosePending() const { return closePending_; }
+
   /**
     * Check buffers against any size limits and shrink it if exceeded.
     *
@@ -265,11 +457,38 @@ public:
    * @param which the flags associated with the event.
    * @param v void* callback arg where we placed TConnection's "this".
    */
-  static void eventHandler(evutil_socket_t fd, short /* which */, void* v) {
+  static void eventHandler(evutil_socket_t fd, short which, void* v) {
     assert(fd == static_cast<evutil_socket_t>(((TConnection*)v)->getTSocket()->getSocketFD()));
-    ((TConnection*)v)->workSocket();
+    if (((TConnection*)v)->isPipelined()) {
+      ((TConnection*)v)->workPipelinedSocket(which);
+    } else {
+      ((TConnection*)v)->workSocket();
+    }
+  }
+
+  /**
+   * Called on the IO thread for every notifyIOThread().  Advances the state
+   * machine, or collects finished requests when pipelining.
+   */
+  void notified() {
+    if (isPipelined() && appState_ != APP_INIT) {
+      collectPipelinedResponses();
+    } else {
+      transition();
+    }
   }
 
+  /**
+   * Called on the IO thread for a completion of one of our ring requests.
+   *
+   * @param op RING_RECV or RING_SEND.
+   * @param completion the completion.
+   */
+  void ringCompleted(int op, const TIOUring::Completion& completion);
+
+  /// Called on the IO thread for the ready pass asked for by queueRingReady().
+  void ringReadyPass();
+
   /**
    * Notification to server that processing has ended on this request.
    * Can be called either when processing is completed or when a waiting
@@ -287,15 +506,33 @@ public:
    */
   int getIOThreadNumber() const { return ioThread_->getThreadNumber(); }
 
-  /// Force connection shutdown for this connection.
-  void forceClose() {
-    appState_ = APP_CLOSE_CONNECTION;
-    if (!notifyIOThread()) {
-      close();
-      throw TException("TConnection::forceClose: failed write on notify pipe");
+  /// Returns this connection's currently assigned IO thread.
+  TNonblockingIOThread* getIOThread() const { return ioThread_; }
+
+  /**
+   * Notification to server that processing has ended on a pipelined
+   * request.  Called from the worker thread that processed it.
+   *
+   * @return true if successful, false if unable to notify.
+   */
+  bool completeRequest(Request* request) {
+    bool wasEmpty;
+    {
+      Guard g(pipelineMutex_);
+      wasEmpty = completed_.empty();
+      completed_.push_back(request);
     }
+    // a single notification covers everything queued until it is collected
+    return !wasEmpty || notifyIOThread();
   }
 
+  /**
+   * Force connection shutdown for this connection.
+   *
+   * @param request the pipelined request whose task was dropped, if any.
+   */
+  void forceClose(Request* request = NULL);
+
   /// return the server this connection was initialized for.
   TNonblockingServer* getServer() const { return server_; }
 
@@ -312,6 +549,33 @@ public:
   void* getConnectionContext() { return connectionContext_; }
 };
 
+/**
+ * A request read from a pipelining connection, with its own buffers and
+ * protocols so that it can be processed alongside the connection's other
+ * requests.
+ */
+struct TNonblockingServer::TConnection::Request {
+  boost::shared_ptr<TMemoryBuffer> inputTransport;
+  boost::shared_ptr<TMemoryBuffer> outputTransport;
+  boost::shared_ptr<TTransport> factoryInputTransport;
+  boost::shared_ptr<TTransport> factoryOutputTransport;
+  boost::shared_ptr<TProtocol> inputProtocol;
+  boost::shared_ptr<TProtocol> outputProtocol;
+
+  /// Arrival order on the connection
+  uint64_t sequence;
+
+  /// Frame bytes counted as pending while processing
+  uint32_t size;
+
+  /// Set when the task was dropped without running
+  bool expired;
+
+  /// Pooled frame the input observes, if buffers are pooled
+  uint8_t* frame;
+  uint32_t frameCapacity;
+};
+
 class TNonblockingServer::TConnection::Task : public Runnable {
 public:
   Task(boost::shared_ptr<TProcessor> processor,
@@ -322,17 +586,43 @@ public:
       input_(input),
       output_(output),
       connection_(connection),
+      request_(NULL),
+      serverEventHandler_(connection_->getServerEventHandler()),
+      connectionContext_(connection_->getConnectionContext()),
+      queuedAt_(queuedAt(connection)) {}
+
+  Task(boost::shared_ptr<TProcessor> processor, TConnection* connection, Request* request)
+    : processor_(processor),
+      input_(request->inputProtocol),
+      output_(request->outputProtocol),
+      connection_(connection),
+      request_(request),
       serverEventHandler_(connection_->getServerEventHandler()),
-      connectionContext_(connection_->getConnectionContext()) {}
+      connectionContext_(connection_->getConnectionContext()),
+      queuedAt_(queuedAt(connection)) {}
 
   void run() {
+    TNonblockingServer* server = connection_->getServer();
+    bool shed = queuedAt_ != 0
+                && connection_->getIOThread()->shedTask(Util::currentTimeUsec() - queuedAt_);
+    if (shed && server->getOverloadAction() == T_OVERLOAD_CLOSE_ON_QUEUE_DELAY) {
+      connection_->forceClose(request_);
+      return;
+    }
+
     try {
       for (;;) {
-        if (serverEventHandler_) {
-          serverEventHandler_->processContext(connectionContext_, connection_->getTSocket());
+        if (shed) {
+          reject();
+        } else {
+          if (serverEventHandler_) {
+            serverEventHandler_->processContext(connectionContext_, connection_->getTSocket());
+          }
+          if (!processor_->process(input_, output_, connectionContext_)) {
+            break;
+          }
         }
-        if (!processor_->process(input_, output_, connectionContext_)
-            || !input_->getTransport()->peek()) {
+        if (!input_->getTransport()->peek()) {
           break;
         }
       }
@@ -349,6 +639,15 @@ public:
       GlobalOutput.printf("TNonblockingServer: unknown exception while processing.");
     }
 
+    if (request_) {
+      // the connection may not be closed from here while it is pipelining
+      if (!connection_->completeRequest(request_)) {
+        GlobalOutput.printf("TNonblockingServer: failed to notifyIOThread.");
+        throw TException("TNonblockingServer::Task::run: failed write on notify pipe");
+      }
+      return;
+    }
+
     // Signal completion back to the libevent thread via a pipe
     if (!connection_->notifyIOThread()) {
       GlobalOutput.printf("TNonblockingServer: failed to notifyIOThread, closing.");
@@ -359,15 +658,65 @@ public:
 
   TConnection* getTConnection() { return connection_; }
 
+  /// The pipelined request this task processes, or NULL.
+  Request* getRequest() { return request_; }
+
 private:
+  /// The time a task is queued at, taken only if it may be shed on it.
+  static int64_t queuedAt(TConnection* connection) {
+    return connection->getServer()->shedsOnQueueDelay() ? Util::currentTimeUsec() : 0;
+  }
+
+  /// Answer the next request with an exception instead of processing it.
+  void reject() {
+    std::string name;
+    TMessageType type;
+    int32_t seqid;
+    input_->readMessageBegin(name, type, seqid);
+    input_->skip(T_STRUCT);
+    input_->readMessageEnd();
+    input_->getTransport()->readEnd();
+    if (type == T_ONEWAY) {
+      return;
+    }
+
+    TApplicationException x(TApplicationException::INTERNAL_ERROR,
+                            "TNonblockingServer: overloaded, request shed");
+    output_->writeMessageBegin(name, T_EXCEPTION, seqid);
+    x.write(output_.get());
+    output_->writeMessageEnd();
+    output_->getTransport()->writeEnd();
+    output_->getTransport()->flush();
+  }
+
   boost::shared_ptr<TProcessor> processor_;
   boost::shared_ptr<TProtocol> input_;
   boost::shared_ptr<TProtocol> output_;
   TConnection* connection_;
+  Request* request_;
   boost::shared_ptr<TServerEventHandler> serverEventHandler_;
   void* connectionContext_;
+
+  /// When the task was handed to the thread manager, in microseconds, or 0
+  int64_t queuedAt_;
 };
 
+void TNonblockingServer::TConnection::forceClose(Request* request) {
+  if (request) {
+    // the IO thread closes the connection once the other requests are back
+    request->expired = true;
+    if (!completeRequest(request)) {
+      throw TException("TConnection::forceClose: failed write on notify pipe");
+    }
+    return;
+  }
+  appState_ = APP_CLOSE_CONNECTION;
+  if (!notifyIOThread()) {
+    close();
+    throw TException("TConnection::forceClose: failed write on notify pipe");
+  }
+}
+
 void TNonblockingServer::TConnection::init(THRIFT_SOCKET socket,
                                            TNonblockingIOThread* ioThread,
                                            const sockaddr* addr,
@@ -391,6 +740,32 @@ void TNonblockingServer::TConnection::init(THRIFT_SOCKET socket,
   socketState_ = SOCKET_RECV_FRAMING;
   callsForResize_ = 0;
 
+  pendingBytes_ = 0;
+  taskActive_ = false;
+  ++ioThread_->numConnections_;
+
+  useBufferPool_ = server_->getBufferPoolLimit() > 0;
+  maxPipelinedRequests_ = server_->isThreadPoolProcessing() ? server_->getMaxPipelinedRequests() : 1;
+  outOfOrderResponses_ = server_->getOutOfOrderResponses();
+  pipelineInFlight_ = 0;
+  nextRequestSeq_ = 0;
+  nextResponseSeq_ = 0;
+  closePending_ = false;
+
+  useRing_ = server_->getIOEngine() == T_IO_ENGINE_IO_URING;
+  ringOps_ = 0;
+  ringRecvArmed_ = false;
+  ringSendBusy_ = false;
+  ringSendDone_ = false;
+  ringSendResult_ = 0;
+  ringReady_ = false;
+  ringEOF_ = false;
+  ringError_ = 0;
+  ringClosing_ = false;
+  ringInputPos_ = 0;
+  ringData_ = NULL;
+  ringDataLen_ = 0;
+
   // get input/transports
   factoryInputTransport_ = server_->getInputTransportFactory()->getTransport(inputTransport_);
   factoryOutputTransport_ = server_->getOutputTransportFactory()->getTransport(outputTransport_);
@@ -405,6 +780,17 @@ void TNonblockingServer::TConnection::init(THRIFT_SOCKET socket,
     outputProtocol_ = server_->getOutputProtocolFactory()->getProtocol(factoryOutputTransport_);
   }
 
+  // The method name is read the way the processor will read it, through a
+  // protocol kept for the connection as the processor's is
+  if (server_->hasMethodPriorities()) {
+    priorityTransport_.reset(new TMemoryBuffer(NULL, 0));
+    priorityProtocol_ = server_->getInputProtocolFactory()->getProtocol(
+        server_->getInputTransportFactory()->getTransport(priorityTransport_));
+  } else {
+    priorityTransport_.reset();
+    priorityProtocol_.reset();
+  }
+
   // Set up for any server event handler
   serverEventHandler_ = server_->getEventHandler();
   if (serverEventHandler_) {
@@ -433,8 +819,8 @@ void TNonblockingServer::TConnection::workSocket() {
     // determine size of this frame
     try {
       // Read from the socket
-      fetch = tSocket_->read(&framing.buf[readBufferPos_],
-                             uint32_t(sizeof(framing.size) - readBufferPos_));
+      fetch = readSocket(&framing.buf[readBufferPos_],
+                         uint32_t(sizeof(framing.size) - readBufferPos_));
       if (fetch == 0) {
         // Whenever we get here it means a remote disconnect
         close();
@@ -480,7 +866,7 @@ void TNonblockingServer::TConnection::workSocket() {
     try {
       // Read from the socket
       fetch = readWant_ - readBufferPos_;
-      got = tSocket_->read(readBuffer_ + readBufferPos_, fetch);
+      got = readSocket(readBuffer_ + readBufferPos_, fetch);
     } catch (TTransportException& te) {
       GlobalOutput.printf("TConnection::workSocket(): %s", te.what());
       close();
@@ -520,7 +906,7 @@ void TNonblockingServer::TConnection::workSocket() {
 
     try {
       left = writeBufferSize_ - writeBufferPos_;
-      sent = tSocket_->write_partial(writeBuffer_ + writeBufferPos_, left);
+      sent = writeSocket(writeBuffer_ + writeBufferPos_, left);
     } catch (TTransportException& te) {
       GlobalOutput.printf("TConnection::workSocket(): %s ", te.what());
       close();
@@ -532,6 +918,8 @@ void TNonblockingServer::TConnection::workSocket() {
     // Did we overdo it?
     assert(writeBufferPos_ <= writeBufferSize_);
 
+    setPendingBytes(writeBufferSize_ - writeBufferPos_);
+
     // We are done!
     if (writeBufferPos_ == writeBufferSize_) {
       transition();
@@ -545,6 +933,276 @@ void TNonblockingServer::TConnection::workSocket() {
   }
 }
 
+void TNonblockingServer::TConnection::workPipelinedSocket(short which) {
+  if (which & EV_WRITE) {
+    if (!sendPipelinedResponses()) {
+      return;
+    }
+  }
+  // sending may have changed whether we want to read
+  if ((which & EV_READ) && (eventFlags_ & EV_READ)) {
+    workSocket();
+  }
+}
+
+size_t TNonblockingServer::TConnection::getTaskPriority(uint32_t offset) {
+  if (!priorityProtocol_) {
+    return server_->getDefaultTaskPriority();
+  }
+  priorityTransport_->resetBuffer(readBuffer_ + offset, readBufferPos_ - offset);
+  size_t priority = server_->getTaskPriority(priorityProtocol_.get(), priorityName_);
+  // don't hold on to the read buffer, it may be handed over with the request
+  priorityTransport_->resetBuffer(NULL, 0);
+  return priority;
+}
+
+void TNonblockingServer::TConnection::dispatchPipelinedRequest() {
+  Request* request = newRequest();
+  // skip the frame size unless the header transport needs it
+  uint32_t offset = server_->getHeaderTransport() ? 0 : 4;
+  size_t priority = getTaskPriority(offset);
+  if (useBufferPool_) {
+    // hand the frame itself over, the next one goes into a fresh buffer
+    request->frame = readBuffer_;
+    request->frameCapacity = readBufferSize_;
+    readBuffer_ = NULL;
+    readBufferSize_ = 0;
+    request->inputTransport->resetBuffer(request->frame + offset, readBufferPos_ - offset);
+    borrowBuffer(request->outputTransport.get(),
+                 static_cast<uint32_t>(server_->getWriteBufferDefaultSize()));
+  } else {
+    request->inputTransport->resetBuffer();
+    request->inputTransport->write(readBuffer_ + offset, readBufferPos_ - offset);
+    request->outputTransport->resetBuffer();
+  }
+  if (offset) {
+    // leave room to write the response's frame size
+    request->outputTransport->getWritePtr(4);
+    request->outputTransport->wroteBytes(4);
+  }
+  request->sequence = nextRequestSeq_++;
+  request->size = readBufferPos_;
+  request->expired = false;
+
+  server_->incrementActiveProcessors();
+  ++ioThread_->numActiveTasks_;
+  addPendingBytes(request->size);
+  ++pipelineInFlight_;
+
+  // the read buffer is free again, so go straight back to the next frame
+  socketState_ = SOCKET_RECV_FRAMING;
+  appState_ = APP_READ_FRAME_SIZE;
+  readBufferPos_ = 0;
+
+  try {
+    server_->addTask(boost::shared_ptr<Runnable>(new Task(processor_, this, request)), priority);
+  } catch (IllegalStateException& ise) {
+    // The ThreadManager is not ready to handle any more tasks (it's probably shutting down).
+    GlobalOutput.printf("IllegalStateException: Server::process() %s", ise.what());
+    finishRequest(request);
+    recycleRequest(request);
+    close();
+    return;
+  } catch (TimedOutException& to) {
+    GlobalOutput.printf("[ERROR] TimedOutException: Server::process() %s", to.what());
+    finishRequest(request);
+    recycleRequest(request);
+    close();
+    return;
+  }
+
+  updatePipelineFlags();
+}
+
+void TNonblockingServer::TConnection::collectPipelinedResponses() {
+  {
+    Guard g(pipelineMutex_);
+    collected_.swap(completed_);
+  }
+
+  bool expired = false;
+  for (size_t i = 0; i < collected_.size(); ++i) {
+    Request* request = collected_[i];
+    finishRequest(request);
+    if (request->expired) {
+      expired = true;
+    }
+    if (outOfOrderResponses_) {
+      queueResponse(request);
+    } else {
+      reorder_[request->sequence] = request;
+    }
+  }
+  collected_.clear();
+
+  // a dropped task closes the connection, as it does without pipelining
+  if (expired || closePending_) {
+    if (pipelineInFlight_ == 0) {
+      close();
+    } else {
+      closePending_ = true;
+      setIdle();
+    }
+    return;
+  }
+
+  // release in-order responses whose predecessors are all done
+  while (!reorder_.empty() && reorder_.begin()->first == nextResponseSeq_) {
+    queueResponse(reorder_.begin()->second);
+    reorder_.erase(reorder_.begin());
+    ++nextResponseSeq_;
+  }
+
+  updatePipelineFlags();
+}
+
+void TNonblockingServer::TConnection::queueResponse(Request* request) {
+  uint8_t* buffer;
+  uint32_t size;
+  request->outputTransport->getBuffer(&buffer, &size);
+
+  // 4 bytes were reserved for frame size; a oneway call leaves nothing else
+  if (size <= 4) {
+    recycleRequest(request);
+    return;
+  }
+
+  int32_t frameSize = (int32_t)htonl(size - 4);
+  memcpy(buffer, &frameSize, 4);
+  addPendingBytes(size);
+  sendQueue_.push_back(request);
+}
+
+bool TNonblockingServer::TConnection::sendPipelinedResponses() {
+  while (!sendQueue_.empty()) {
+    Request* request = sendQueue_.front();
+    uint8_t* buffer;
+    uint32_t size;
+    request->outputTransport->getBuffer(&buffer, &size);
+
+    uint32_t sent;
+    try {
+      sent = writeSocket(buffer + writeBufferPos_, size - writeBufferPos_);
+    } catch (TTransportException& te) {
+      GlobalOutput.printf("TConnection::workPipelinedSocket(): %s ", te.what());
+      close();
+      return false;
+    }
+    writeBufferPos_ += sent;
+    addPendingBytes(-(int64_t)sent);
+    if (writeBufferPos_ < size) {
+      // the socket buffer is full, wait for the next write event
+      break;
+    }
+
+    writeBufferPos_ = 0;
+    sendQueue_.pop_front();
+    recycleRequest(request);
+
+    // the read buffer may only be shrunk between frames
+    if (!useBufferPool_ && server_->getResizeBufferEveryN() > 0
+        && ++callsForResize_ >= server_->getResizeBufferEveryN()
+        && socketState_ == SOCKET_RECV_FRAMING) {
+      checkIdleBufferMemLimit(server_->getIdleReadBufferLimit(), 0);
+      callsForResize_ = 0;
+    }
+  }
+
+  updatePipelineFlags();
+  return true;
+}
+
+void TNonblockingServer::TConnection::updatePipelineFlags() {
+  short flags = 0;
+  if (pipelineOutstanding() < maxPipelinedRequests_) {
+    flags |= EV_READ;
+  }
+  if (!sendQueue_.empty()) {
+    flags |= EV_WRITE;
+  }
+  setFlags(flags ? flags | EV_PERSIST : 0);
+}
+
+void TNonblockingServer::TConnection::finishRequest(Request* request) {
+  server_->decrementActiveProcessors();
+  --ioThread_->numActiveTasks_;
+  addPendingBytes(-(int64_t)request->size);
+  request->size = 0;
+  --pipelineInFlight_;
+}
+
+TNonblockingServer::TConnection::Request* TNonblockingServer::TConnection::newRequest() {
+  if (!freeRequests_.empty()) {
+    Request* request = freeRequests_.back();
+    freeRequests_.pop_back();
+    return request;
+  }
+
+  Request* request = new Request();
+  request->frame = NULL;
+  request->frameCapacity = 0;
+  request->inputTransport.reset(new TMemoryBuffer());
+  if (useBufferPool_) {
+    request->outputTransport.reset(new TMemoryBuffer(NULL, 0));
+  } else {
+    request->outputTransport.reset(
+        new TMemoryBuffer(static_cast<uint32_t>(server_->getWriteBufferDefaultSize())));
+  }
+  request->factoryInputTransport
+      = server_->getInputTransportFactory()->getTransport(request->inputTransport);
+  request->factoryOutputTransport
+      = server_->getOutputTransportFactory()->getTransport(request->outputTransport);
+  if (server_->getHeaderTransport()) {
+    request->inputProtocol
+        = server_->getInputProtocolFactory()->getProtocol(request->factoryInputTransport,
+                                                          request->factoryOutputTransport);
+    request->outputProtocol = request->inputProtocol;
+  } else {
+    request->inputProtocol
+        = server_->getInputProtocolFactory()->getProtocol(request->factoryInputTransport);
+    request->outputProtocol
+        = server_->getOutputProtocolFactory()->getProtocol(request->factoryOutputTransport);
+  }
+  return request;
+}
+
+void TNonblockingServer::TConnection::recycleRequest(Request* request) {
+  if (useBufferPool_) {
+    request->inputTransport->resetBuffer(NULL, 0);
+    ioThread_->bufferPool_.release(request->frame, request->frameCapacity);
+    request->frame = NULL;
+    request->frameCapacity = 0;
+    returnBuffer(request->outputTransport.get());
+  }
+  if (freeRequests_.size() < maxPipelinedRequests_) {
+    freeRequests_.push_back(request);
+  } else {
+    delete request;
+  }
+}
+
+void TNonblockingServer::TConnection::borrowBuffer(TMemoryBuffer* transport, uint32_t size) {
+  returnBuffer(transport);
+  uint32_t capacity;
+  uint8_t* buffer = ioThread_->bufferPool_.allocate(size, &capacity);
+  transport->resetBuffer(buffer, capacity, TMemoryBuffer::TAKE_OWNERSHIP);
+  transport->resetBuffer();
+}
+
+void TNonblockingServer::TConnection::returnBuffer(TMemoryBuffer* transport) {
+  uint32_t capacity;
+  uint8_t* buffer = transport->releaseBuffer(&capacity);
+  ioThread_->bufferPool_.release(buffer, capacity);
+}
+
+void TNonblockingServer::TConnection::returnReadBuffer() {
+  // stop observing it first
+  inputTransport_->resetBuffer(NULL, 0);
+  ioThread_->bufferPool_.release(readBuffer_, readBufferSize_);
+  readBuffer_ = NULL;
+  readBufferSize_ = 0;
+}
+
 bool TNonblockingServer::getHeaderTransport() {
   // Currently if there is no output protocol factory,
   // we assume header transport (without having to create
@@ -566,6 +1224,17 @@ void TNonblockingServer::TConnection::transition() {
   switch (appState_) {
 
   case APP_READ_REQUEST:
+    if (isPipelined()) {
+      // the request gets its own buffers, and we go on reading the next one
+      dispatchPipelinedRequest();
+      return;
+    }
+
+    if (useBufferPool_) {
+      borrowBuffer(outputTransport_.get(),
+                   static_cast<uint32_t>(server_->getWriteBufferDefaultSize()));
+    }
+
     // We are done reading the request, package the read buffer into transport
     // and get back some data from the dispatch function
     if (server_->getHeaderTransport()) {
@@ -584,6 +1253,8 @@ void TNonblockingServer::TConnection::transition() {
     }
 
     server_->incrementActiveProcessors();
+    setTaskActive(true);
+    setPendingBytes(readBufferPos_);
 
     if (server_->isThreadPoolProcessing()) {
       // We are setting up a Task to do this work and we will wait on it
@@ -591,11 +1262,13 @@ void TNonblockingServer::TConnection::transition() {
       // Create task and dispatch to the thread manager
       boost::shared_ptr<Runnable> task = boost::shared_ptr<Runnable>(
           new Task(processor_, inputProtocol_, outputProtocol_, this));
+      uint32_t offset = server_->getHeaderTransport() ? 0 : 4;
+      size_t priority = getTaskPriority(offset);
       // The application is now waiting on the task to finish
       appState_ = APP_WAIT_TASK;
 
       try {
-        server_->addTask(task);
+        server_->addTask(task, priority);
       } catch (IllegalStateException& ise) {
         // The ThreadManager is not ready to handle any more tasks (it's probably shutting down).
         GlobalOutput.printf("IllegalStateException: Server::process() %s", ise.what());
@@ -649,8 +1322,14 @@ void TNonblockingServer::TConnection::transition() {
     // the writeBuffer_ for actual writing by the libevent thread
 
     server_->decrementActiveProcessors();
+    setTaskActive(false);
+    if (useBufferPool_) {
+      // the request has been consumed
+      returnReadBuffer();
+    }
     // Get the result of the operation
     outputTransport_->getBuffer(&writeBuffer_, &writeBufferSize_);
+    setPendingBytes(writeBufferSize_ > 4 ? writeBufferSize_ : 0);
 
     // If the function call generated return data, then move into the send
     // state and get going
@@ -680,15 +1359,18 @@ void TNonblockingServer::TConnection::transition() {
     goto LABEL_APP_INIT;
 
   case APP_SEND_RESULT:
-    // it's now safe to perform buffer size housekeeping.
-    if (writeBufferSize_ > largestWriteBufferSize_) {
-      largestWriteBufferSize_ = writeBufferSize_;
-    }
-    if (server_->getResizeBufferEveryN() > 0
-        && ++callsForResize_ >= server_->getResizeBufferEveryN()) {
-      checkIdleBufferMemLimit(server_->getIdleReadBufferLimit(),
-                              server_->getIdleWriteBufferLimit());
-      callsForResize_ = 0;
+    // it's now safe to perform buffer size housekeeping; pooled buffers
+    // are already given back below.
+    if (!useBufferPool_) {
+      if (writeBufferSize_ > largestWriteBufferSize_) {
+        largestWriteBufferSize_ = writeBufferSize_;
+      }
+      if (server_->getResizeBufferEveryN() > 0
+          && ++callsForResize_ >= server_->getResizeBufferEveryN()) {
+        checkIdleBufferMemLimit(server_->getIdleReadBufferLimit(),
+                                server_->getIdleWriteBufferLimit());
+        callsForResize_ = 0;
+      }
     }
 
   // N.B.: We also intentionally fall through here into the INIT state!
@@ -700,6 +1382,10 @@ void TNonblockingServer::TConnection::transition() {
     writeBuffer_ = NULL;
     writeBufferPos_ = 0;
     writeBufferSize_ = 0;
+    setPendingBytes(0);
+    if (useBufferPool_) {
+      returnBuffer(outputTransport_.get());
+    }
 
     // Into read4 state we go
     socketState_ = SOCKET_RECV_FRAMING;
@@ -720,7 +1406,12 @@ void TNonblockingServer::TConnection::transition() {
 
     // We just read the request length
     // Double the buffer size until it is big enough
-    if (readWant_ > readBufferSize_) {
+    if (readWant_ > readBufferSize_ && useBufferPool_) {
+      ioThread_->bufferPool_.release(readBuffer_, readBufferSize_);
+      readBuffer_ = NULL;
+      readBufferSize_ = 0;
+      readBuffer_ = ioThread_->bufferPool_.allocate(readWant_, &readBufferSize_);
+    } else if (readWant_ > readBufferSize_) {
       if (readBufferSize_ == 0) {
         readBufferSize_ = 1;
       }
@@ -762,6 +1453,24 @@ void TNonblockingServer::TConnection::transition() {
 }
 
 void TNonblockingServer::TConnection::setFlags(short eventFlags) {
+  if (useRing_) {
+    // there are no readiness events; keep a receive armed and make sure
+    // the state machine gets to look at what the ring already delivered
+    eventFlags_ = eventFlags;
+    if (ringClosing_) {
+      return;
+    }
+    bool wantRead = (eventFlags_ & EV_READ) != 0;
+    if (wantRead && !ringRecvArmed_ && !ringEOF_ && ringError_ == 0) {
+      armRingRecv();
+    }
+    if ((wantRead && (hasRingInput() || ringEOF_ || ringError_ != 0))
+        || ((eventFlags_ & EV_WRITE) && !ringSendBusy_)) {
+      queueRingReady();
+    }
+    return;
+  }
+
   // Catch the do nothing case
   if (eventFlags_ == eventFlags) {
     return;
@@ -819,25 +1528,258 @@ void TNonblockingServer::TConnection::setFlags(short eventFlags) {
   }
 }
 
-/**
- * Closes a connection
- */
-void TNonblockingServer::TConnection::close() {
-  // Delete the registered libevent
-  if (event_del(&event_) == -1) {
-    GlobalOutput.perror("TConnection::close() event_del", THRIFT_GET_SOCKET_ERROR);
+uint32_t TNonblockingServer::TConnection::readSocket(uint8_t* buf, uint32_t len) {
+  if (!useRing_) {
+    return tSocket_->read(buf, len);
   }
 
-  if (serverEventHandler_) {
-    serverEventHandler_->deleteContext(connectionContext_, inputProtocol_, outputProtocol_);
+  // bytes left over from earlier receives come first
+  uint32_t got = 0;
+  if (ringInputPos_ < ringInput_.size()) {
+    got = static_cast<uint32_t>(std::min<size_t>(len, ringInput_.size() - ringInputPos_));
+    memcpy(buf, &ringInput_[ringInputPos_], got);
+    ringInputPos_ += got;
+    if (ringInputPos_ == ringInput_.size()) {
+      ringInput_.clear();
+      ringInputPos_ = 0;
+    }
   }
-  ioThread_ = NULL;
+  if (got < len && ringDataLen_ > 0) {
+    uint32_t n = std::min(len - got, ringDataLen_);
+    memcpy(buf + got, ringData_, n);
+    ringData_ += n;
+    ringDataLen_ -= n;
+    got += n;
+  }
+  if (got == 0 && ringError_ != 0) {
+    throw TTransportException(TTransportException::UNKNOWN, "io_uring recv()", ringError_);
+  }
+  // 0 means end of file, as for TSocket::read()
+  return got;
+}
 
-  // Close the socket
-  tSocket_->close();
+uint32_t TNonblockingServer::TConnection::writeSocket(const uint8_t* buf, uint32_t len) {
+  if (!useRing_) {
+    return tSocket_->write_partial(buf, len);
+  }
 
-  // close any factory produced transports
-  factoryInputTransport_->close();
+  if (ringSendDone_) {
+    // the caller asks again for the same bytes, now that they went out
+    ringSendDone_ = false;
+    if (ringSendResult_ < 0) {
+      throw TTransportException(TTransportException::UNKNOWN, "io_uring send()", -ringSendResult_);
+    }
+    return static_cast<uint32_t>(ringSendResult_);
+  }
+  if (!ringSendBusy_) {
+    try {
+      ioThread_->ring_.send(tSocket_->getSocketFD(),
+                            buf,
+                            len,
+                            ringUserData(TNonblockingIOThread::RING_SEND));
+    } catch (const TException& e) {
+      throw TTransportException(TTransportException::UNKNOWN, e.what());
+    }
+    ringSendBusy_ = true;
+    ++ringOps_;
+  }
+  return 0;
+}
+
+void TNonblockingServer::TConnection::saveRingInput() {
+  if (ringDataLen_ > 0) {
+    if (ringInputPos_ > 0) {
+      ringInput_.erase(ringInput_.begin(), ringInput_.begin() + ringInputPos_);
+      ringInputPos_ = 0;
+    }
+    ringInput_.insert(ringInput_.end(), ringData_, ringData_ + ringDataLen_);
+  }
+  ringData_ = NULL;
+  ringDataLen_ = 0;
+}
+
+void TNonblockingServer::TConnection::armRingRecv() {
+  try {
+    ioThread_->ring_.recv(tSocket_->getSocketFD(), ringUserData(TNonblockingIOThread::RING_RECV));
+  } catch (const TException& e) {
+    // the next read fails, which closes the connection
+    GlobalOutput.printf("TConnection::armRingRecv(): %s", e.what());
+    ringError_ = EBUSY;
+    queueRingReady();
+    return;
+  }
+  ringRecvArmed_ = true;
+  ++ringOps_;
+}
+
+void TNonblockingServer::TConnection::queueRingReady() {
+  if (!ringReady_) {
+    ringReady_ = true;
+    ++ringOps_;
+    ioThread_->ringReady_.push_back(this);
+  }
+}
+
+void TNonblockingServer::TConnection::workRing() {
+  // every pass either consumes input, starts a send or changes state, so
+  // this ends once the state machine waits for the ring
+  while (!ringClosing_) {
+    short which = 0;
+    if ((eventFlags_ & EV_READ) && (hasRingInput() || ringEOF_ || ringError_ != 0)) {
+      which |= EV_READ;
+    }
+    if ((eventFlags_ & EV_WRITE) && !ringSendBusy_) {
+      which |= EV_WRITE;
+    }
+    if (!which) {
+      return;
+    }
+    if (isPipelined()) {
+      workPipelinedSocket(which);
+    } else {
+      workSocket();
+    }
+  }
+}
+
+void TNonblockingServer::TConnection::ringCompleted(int op,
+                                                    const TIOUring::Completion& completion) {
+  bool stopping = ioThread_->ringStopping_;
+  if (op == TNonblockingIOThread::RING_SEND) {
+    ringSendBusy_ = false;
+    ringSendDone_ = true;
+    ringSendResult_ = completion.result;
+  } else {
+    if (!completion.more) {
+      ringRecvArmed_ = false;
+    }
+    if (completion.data != NULL) {
+      ringData_ = completion.data;
+      ringDataLen_ = static_cast<uint32_t>(completion.result);
+    } else if (completion.result == 0) {
+      ringEOF_ = true;
+    } else if (completion.result != -ENOBUFS && completion.result != -ECANCELED) {
+      ringError_ = -completion.result;
+    }
+  }
+
+  if (!stopping) {
+    workRing();
+  }
+
+  if (completion.data != NULL) {
+    if (!ringClosing_ && !stopping) {
+      saveRingInput();
+      // a client that keeps sending while we do not read is misbehaving
+      if (ringInput_.size() - ringInputPos_ > server_->getMaxFrameSize()) {
+        GlobalOutput.printf("TConnection::ringCompleted(): too much unread input from client %s",
+                            tSocket_->getSocketInfo().c_str());
+        close();
+      }
+    }
+    ringData_ = NULL;
+    ringDataLen_ = 0;
+    ioThread_->ring_.releaseBuffer(completion.bufferId);
+  }
+
+  // running out of receive buffers ends a multishot receive; rearm it
+  if (op == TNonblockingIOThread::RING_RECV && !ringRecvArmed_ && !ringClosing_ && !stopping
+      && !ringEOF_ && ringError_ == 0) {
+    armRingRecv();
+  }
+
+  if (!completion.more) {
+    --ringOps_;
+  }
+  if (ringClosing_ && ringOps_ == 0) {
+    close();
+  }
+}
+
+void TNonblockingServer::TConnection::ringReadyPass() {
+  ringReady_ = false;
+  if (!ioThread_->ringStopping_) {
+    workRing();
+  }
+  if (--ringOps_ == 0 && ringClosing_) {
+    close();
+  }
+}
+
+/**
+ * Closes a connection
+ */
+void TNonblockingServer::TConnection::close() {
+  // Pipelined requests still being processed point back at us, so the
+  // teardown waits until collectPipelinedResponses() has them all back.
+  if (pipelineInFlight_ > 0) {
+    closePending_ = true;
+    setIdle();
+    return;
+  }
+
+  if (useRing_) {
+    // the ring may still write to our buffers, so finish once it lets go
+    if (ringOps_ > 0) {
+      if (!ringClosing_) {
+        ringClosing_ = true;
+        eventFlags_ = 0;
+        try {
+          if (ringRecvArmed_) {
+            ioThread_->ring_.cancel(ringUserData(TNonblockingIOThread::RING_RECV),
+                                    TNonblockingIOThread::RING_CANCEL);
+          }
+          if (ringSendBusy_) {
+            ioThread_->ring_.cancel(ringUserData(TNonblockingIOThread::RING_SEND),
+                                    TNonblockingIOThread::RING_CANCEL);
+          }
+        } catch (const TException&) {
+          // ending the stream ends the requests as well
+          ::shutdown(tSocket_->getSocketFD(), THRIFT_SHUT_RDWR);
+        }
+      }
+      return;
+    }
+    std::vector<uint8_t>().swap(ringInput_);
+  } else if (event_del(&event_) == -1) {
+    // Delete the registered libevent
+    GlobalOutput.perror("TConnection::close() event_del", THRIFT_GET_SOCKET_ERROR);
+  }
+
+  if (serverEventHandler_) {
+    serverEventHandler_->deleteContext(connectionContext_, inputProtocol_, outputProtocol_);
+  }
+
+  // drop responses nobody will read, along with the reusable requests
+  for (std::map<uint64_t, Request*>::iterator it = reorder_.begin(); it != reorder_.end(); ++it) {
+    recycleRequest(it->second);
+  }
+  reorder_.clear();
+  while (!sendQueue_.empty()) {
+    recycleRequest(sendQueue_.front());
+    sendQueue_.pop_front();
+  }
+  for (size_t i = 0; i < freeRequests_.size(); ++i) {
+    delete freeRequests_[i];
+  }
+  freeRequests_.clear();
+
+  if (useBufferPool_) {
+    returnReadBuffer();
+    returnBuffer(outputTransport_.get());
+  }
+
+  // Drop our share of the IO thread's load
+  setTaskActive(false);
+  setPendingBytes(0);
+  --ioThread_->numConnections_;
+  ioThread_ = NULL;
+
+  // Close the socket
+  tSocket_->close();
+
+  // close any factory produced transports
+  factoryInputTransport_->close();
   factoryOutputTransport_->close();
 
   // release processor and handler
@@ -864,7 +1806,14 @@ void TNonblockingServer::TConnection::checkIdleBufferMemLimit(size_t readLimit,
 TNonblockingServer::~TNonblockingServer() {
   // Close any active connections (moves them to the idle connection stack)
   while (activeConnections_.size()) {
-    activeConnections_.front()->close();
+    TConnection* connection = activeConnections_.front();
+    connection->close();
+    // the IO threads are gone, so collect the requests close() waits for here
+    while (connection->isClosePending() && !activeConnections_.empty()
+           && activeConnections_.front() == connection) {
+      THRIFT_SLEEP_USEC(1000);
+      connection->notified();
+    }
   }
   // Clean up unused TConnection objects in connectionStack_
   while (!connectionStack_.empty()) {
@@ -886,18 +1835,23 @@ TNonblockingServer::~TNonblockingServer() {
  * Creates a new connection either by reusing an object off the stack or
  * by allocating a new one entirely
  */
-TNonblockingServer::TConnection* TNonblockingServer::createConnection(THRIFT_SOCKET socket,
-                                                                      const sockaddr* addr,
-                                                                      socklen_t addrLen) {
+TNonblockingServer::TConnection* TNonblockingServer::createConnection(
+    THRIFT_SOCKET socket,
+    const sockaddr* addr,
+    socklen_t addrLen,
+    TNonblockingIOThread* acceptThread) {
   // Check the stack
   Guard g(connMutex_);
 
-  // pick an IO thread to handle this connection -- currently round robin
-  assert(nextIOThread_ < ioThreads_.size());
-  int selectedThreadIdx = nextIOThread_;
-  nextIOThread_ = static_cast<uint32_t>((nextIOThread_ + 1) % ioThreads_.size());
+  // pick an IO thread to handle this connection -- the accepting thread if
+  // every thread has its own listener, otherwise ask the placement policy
+  TNonblockingIOThread* ioThread = acceptThread;
+  if (!useReusePortListeners_) {
+    size_t selectedThreadIdx = placementPolicy_->placeConnection(ioThreads_);
+    assert(selectedThreadIdx < ioThreads_.size());
 
-  TNonblockingIOThread* ioThread = ioThreads_[selectedThreadIdx].get();
+    ioThread = ioThreads_[selectedThreadIdx].get();
+  }
 
   // Check the connection stack to see if we can re-use
   TConnection* result = NULL;
@@ -937,10 +1891,12 @@ void TNonblockingServer::returnConnection(TConnection* connection) {
  * Server socket had something happen.  We accept all waiting client
  * connections on fd and assign TConnection objects to handle those requests.
  */
-void TNonblockingServer::handleEvent(THRIFT_SOCKET fd, short which) {
+void TNonblockingServer::handleEvent(THRIFT_SOCKET fd,
+                                     short which,
+                                     TNonblockingIOThread* acceptThread) {
   (void)which;
   // Make sure that libevent didn't mess up the socket handles
-  assert(fd == serverSocket_);
+  assert(fd == serverSocket_ || useReusePortListeners_);
 
   // Server socket accepted a new connection
   socklen_t addrLen;
@@ -955,64 +1911,10 @@ void TNonblockingServer::handleEvent(THRIFT_SOCKET fd, short which) {
   // one, this helps us to avoid having to go back into the libevent engine so
   // many times
   while ((clientSocket = ::accept(fd, addrp, &addrLen)) != -1) {
-    // If we're overloaded, take action here
-    if (overloadAction_ != T_OVERLOAD_NO_ACTION && serverOverloaded()) {
-      Guard g(connMutex_);
-      nConnectionsDropped_++;
-      nTotalConnectionsDropped_++;
-      if (overloadAction_ == T_OVERLOAD_CLOSE_ON_ACCEPT) {
-        ::THRIFT_CLOSESOCKET(clientSocket);
-        return;
-      } else if (overloadAction_ == T_OVERLOAD_DRAIN_TASK_QUEUE) {
-        if (!drainPendingTask()) {
-          // Nothing left to discard, so we drop connection instead.
-          ::THRIFT_CLOSESOCKET(clientSocket);
-          return;
-        }
-      }
-    }
-
-    // Explicitly set this socket to NONBLOCK mode
-    int flags;
-    if ((flags = THRIFT_FCNTL(clientSocket, THRIFT_F_GETFL, 0)) < 0
-        || THRIFT_FCNTL(clientSocket, THRIFT_F_SETFL, flags | THRIFT_O_NONBLOCK) < 0) {
-      GlobalOutput.perror("thriftServerEventHandler: set THRIFT_O_NONBLOCK (THRIFT_FCNTL) ",
-                          THRIFT_GET_SOCKET_ERROR);
-      ::THRIFT_CLOSESOCKET(clientSocket);
+    if (!acceptConnection(clientSocket, addrp, addrLen, acceptThread)) {
       return;
     }
 
-    // Create a new TConnection for this client socket.
-    TConnection* clientConnection = createConnection(clientSocket, addrp, addrLen);
-
-    // Fail fast if we could not create a TConnection object
-    if (clientConnection == NULL) {
-      GlobalOutput.printf("thriftServerEventHandler: failed TConnection factory");
-      ::THRIFT_CLOSESOCKET(clientSocket);
-      return;
-    }
-
-    /*
-     * Either notify the ioThread that is assigned this connection to
-     * start processing, or if it is us, we'll just ask this
-     * connection to do its initial state change here.
-     *
-     * (We need to avoid writing to our own notification pipe, to
-     * avoid possible deadlocks if the pipe is full.)
-     *
-     * The IO thread #0 is the only one that handles these listen
-     * events, so unless the connection has been assigned to thread #0
-     * we know it's not on our thread.
-     */
-    if (clientConnection->getIOThreadNumber() == 0) {
-      clientConnection->transition();
-    } else {
-      if (!clientConnection->notifyIOThread()) {
-        GlobalOutput.perror("[ERROR] notifyIOThread failed on fresh connection, closing", errno);
-        returnConnection(clientConnection);
-      }
-    }
-
     // addrLen is written by the accept() call, so needs to be set before the next call.
     addrLen = sizeof(addrStorage);
   }
@@ -1024,10 +1926,81 @@ void TNonblockingServer::handleEvent(THRIFT_SOCKET fd, short which) {
   }
 }
 
+bool TNonblockingServer::acceptConnection(THRIFT_SOCKET clientSocket,
+                                          const sockaddr* addr,
+                                          socklen_t addrLen,
+                                          TNonblockingIOThread* acceptThread) {
+  // If we're overloaded, take action here
+  if ((overloadAction_ == T_OVERLOAD_CLOSE_ON_ACCEPT
+       || overloadAction_ == T_OVERLOAD_DRAIN_TASK_QUEUE) && serverOverloaded()) {
+    Guard g(connMutex_);
+    nConnectionsDropped_++;
+    nTotalConnectionsDropped_++;
+    if (overloadAction_ == T_OVERLOAD_CLOSE_ON_ACCEPT) {
+      ::THRIFT_CLOSESOCKET(clientSocket);
+      return false;
+    } else if (overloadAction_ == T_OVERLOAD_DRAIN_TASK_QUEUE) {
+      if (!drainPendingTask()) {
+        // Nothing left to discard, so we drop connection instead.
+        ::THRIFT_CLOSESOCKET(clientSocket);
+        return false;
+      }
+    }
+  }
+
+  // Explicitly set this socket to NONBLOCK mode
+  int flags;
+  if ((flags = THRIFT_FCNTL(clientSocket, THRIFT_F_GETFL, 0)) < 0
+      || THRIFT_FCNTL(clientSocket, THRIFT_F_SETFL, flags | THRIFT_O_NONBLOCK) < 0) {
+    GlobalOutput.perror("thriftServerEventHandler: set THRIFT_O_NONBLOCK (THRIFT_FCNTL) ",
+                        THRIFT_GET_SOCKET_ERROR);
+    ::THRIFT_CLOSESOCKET(clientSocket);
+    return false;
+  }
+
+  // Create a new TConnection for this client socket.
+  TConnection* clientConnection = createConnection(clientSocket, addr, addrLen, acceptThread);
+
+  // Fail fast if we could not create a TConnection object
+  if (clientConnection == NULL) {
+    GlobalOutput.printf("thriftServerEventHandler: failed TConnection factory");
+    ::THRIFT_CLOSESOCKET(clientSocket);
+    return false;
+  }
+
+  /*
+   * Either notify the ioThread that is assigned this connection to
+   * start processing, or if it is us, we'll just ask this
+   * connection to do its initial state change here.
+   *
+   * (We need to avoid writing to our own notification pipe, to
+   * avoid possible deadlocks if the pipe is full.)
+   *
+   * The connection is on our thread if it was assigned to the IO
+   * thread owning the listen socket.
+   */
+  if (clientConnection->getIOThreadNumber() == acceptThread->getThreadNumber()) {
+    clientConnection->transition();
+  } else {
+    if (!clientConnection->notifyIOThread()) {
+      GlobalOutput.perror("[ERROR] notifyIOThread failed on fresh connection, closing", errno);
+      returnConnection(clientConnection);
+    }
+  }
+  return true;
+}
+
 /**
  * Creates a socket to listen on and binds it to the local port.
  */
 void TNonblockingServer::createAndListenOnSocket() {
+  listenSocket(createAndBindSocket(port_));
+}
+
+/**
+ * Creates a socket and binds it to the wildcard address on a port.
+ */
+THRIFT_SOCKET TNonblockingServer::createAndBindSocket(int port) {
 #ifdef _WIN32
   TWinsockSingleton::create();
 #endif // _WIN32
@@ -1037,15 +2010,15 @@ void TNonblockingServer::createAndListenOnSocket() {
   struct addrinfo hints, *res, *res0;
   int error;
 
-  char port[sizeof("65536") + 1];
+  char portStr[sizeof("65536") + 1];
   memset(&hints, 0, sizeof(hints));
   hints.ai_family = PF_UNSPEC;
   hints.ai_socktype = SOCK_STREAM;
   hints.ai_flags = AI_PASSIVE | AI_ADDRCONFIG;
-  sprintf(port, "%d", port_);
+  sprintf(portStr, "%d", port);
 
   // Wildcard address
-  error = getaddrinfo(NULL, port, &hints, &res0);
+  error = getaddrinfo(NULL, portStr, &hints, &res0);
   if (error) {
     throw TException("TNonblockingServer::serve() getaddrinfo "
                      + string(THRIFT_GAI_STRERROR(error)));
@@ -1079,19 +2052,32 @@ void TNonblockingServer::createAndListenOnSocket() {
   // Set THRIFT_NO_SOCKET_CACHING to avoid 2MSL delay on server restart
   setsockopt(s, SOL_SOCKET, THRIFT_NO_SOCKET_CACHING, const_cast_sockopt(&one), sizeof(one));
 
+#ifdef SO_REUSEPORT
+  // Every IO thread binds a listen socket of its own to the same port
+  if (useReusePortListeners_
+      && -1 == setsockopt(s, SOL_SOCKET, SO_REUSEPORT, const_cast_sockopt(&one), sizeof(one))) {
+    int errno_copy = THRIFT_GET_SOCKET_ERROR;
+    ::THRIFT_CLOSESOCKET(s);
+    freeaddrinfo(res0);
+    throw TTransportException(TTransportException::NOT_OPEN,
+                              "TNonblockingServer::serve() SO_REUSEPORT",
+                              errno_copy);
+  }
+#endif
+
   if (::bind(s, res->ai_addr, static_cast<int>(res->ai_addrlen)) == -1) {
+    int errno_copy = THRIFT_GET_SOCKET_ERROR;
     ::THRIFT_CLOSESOCKET(s);
     freeaddrinfo(res0);
     throw TTransportException(TTransportException::NOT_OPEN,
                               "TNonblockingServer::serve() bind",
-                              THRIFT_GET_SOCKET_ERROR);
+                              errno_copy);
   }
 
   // Done with the addr info
   freeaddrinfo(res0);
 
-  // Set up this file descriptor for listening
-  listenSocket(s);
+  return s;
 }
 
 /**
@@ -1099,6 +2085,29 @@ void TNonblockingServer::createAndListenOnSocket() {
  * to prepare for use in the server.
  */
 void TNonblockingServer::listenSocket(THRIFT_SOCKET s) {
+  setupListenSocket(s);
+
+  // Cool, this socket is good to go, set it as the serverSocket_
+  serverSocket_ = s;
+
+  if (!port_) {
+    struct sockaddr_storage addr;
+    socklen_t size = sizeof(addr);
+    if (!getsockname(serverSocket_, reinterpret_cast<sockaddr*>(&addr), &size)) {
+      if (addr.ss_family == AF_INET6) {
+        const struct sockaddr_in6* sin = reinterpret_cast<const struct sockaddr_in6*>(&addr);
+        listenPort_ = ntohs(sin->sin6_port);
+      } else {
+        const struct sockaddr_in* sin = reinterpret_cast<const struct sockaddr_in*>(&addr);
+        listenPort_ = ntohs(sin->sin_port);
+      }
+    } else {
+      GlobalOutput.perror("TNonblocking: failed to get listen port: ", THRIFT_GET_SOCKET_ERROR);
+    }
+  }
+}
+
+void TNonblockingServer::setupListenSocket(THRIFT_SOCKET s) {
   // Set socket to nonblocking mode
   int flags;
   if ((flags = THRIFT_FCNTL(s, THRIFT_F_GETFL, 0)) < 0
@@ -1132,25 +2141,17 @@ void TNonblockingServer::listenSocket(THRIFT_SOCKET s) {
     ::THRIFT_CLOSESOCKET(s);
     throw TTransportException(TTransportException::NOT_OPEN, "TNonblockingServer::serve() listen");
   }
+}
 
-  // Cool, this socket is good to go, set it as the serverSocket_
-  serverSocket_ = s;
-
-  if (!port_) {
-    struct sockaddr_storage addr;
-    socklen_t size = sizeof(addr);
-    if (!getsockname(serverSocket_, reinterpret_cast<sockaddr*>(&addr), &size)) {
-      if (addr.ss_family == AF_INET6) {
-        const struct sockaddr_in6* sin = reinterpret_cast<const struct sockaddr_in6*>(&addr);
-        listenPort_ = ntohs(sin->sin6_port);
-      } else {
-        const struct sockaddr_in* sin = reinterpret_cast<const struct sockaddr_in*>(&addr);
-        listenPort_ = ntohs(sin->sin_port);
-      }
-    } else {
-      GlobalOutput.perror("TNonblocking: failed to get listen port: ", THRIFT_GET_SOCKET_ERROR);
-    }
-  }
+/**
+ * Creates one more listen socket on the port of serverSocket_.  This only
+ * succeeds if all sockets bound to the port have SO_REUSEPORT set.
+ */
+THRIFT_SOCKET TNonblockingServer::createReusePortListener() {
+  assert(useReusePortListeners_);
+  THRIFT_SOCKET s = createAndBindSocket(listenPort_);
+  setupListenSocket(s);
+  return s;
 }
 
 void TNonblockingServer::setThreadManager(boost::shared_ptr<ThreadManager> threadManager) {
@@ -1167,6 +2168,9 @@ void TNonblockingServer::setThreadManager(boost::shared_ptr<ThreadManager> threa
 }
 
 bool TNonblockingServer::serverOverloaded() {
+  // With reuse-port listeners several IO threads check this concurrently
+  Guard g(connMutex_);
+
   size_t activeConnections = numTConnections_ - connectionStack_.size();
   if (numActiveProcessors_ > maxActiveProcessors_ || activeConnections > maxConnections_) {
     if (!overloaded_) {
@@ -1189,13 +2193,27 @@ bool TNonblockingServer::serverOverloaded() {
   return overloaded_;
 }
 
+size_t TNonblockingServer::getTaskPriority(TProtocol* protocol, std::string& name) {
+  try {
+    TMessageType type;
+    int32_t seqid;
+    protocol->readMessageBegin(name, type, seqid);
+    return getMethodPriority(name);
+  } catch (const TException&) {
+    // leave it to the processor to report
+    return defaultTaskPriority_;
+  }
+}
+
 bool TNonblockingServer::drainPendingTask() {
   if (threadManager_) {
     boost::shared_ptr<Runnable> task = threadManager_->removeNextPending();
     if (task) {
-      TConnection* connection = static_cast<TConnection::Task*>(task.get())->getTConnection();
-      assert(connection && connection->getServer() && connection->getState() == APP_WAIT_TASK);
-      connection->forceClose();
+      TConnection::Task* connectionTask = static_cast<TConnection::Task*>(task.get());
+      TConnection* connection = connectionTask->getTConnection();
+      assert(connection && connection->getServer()
+             && (connectionTask->getRequest() || connection->getState() == APP_WAIT_TASK));
+      connection->forceClose(connectionTask->getRequest());
       return true;
     }
   }
@@ -1203,9 +2221,11 @@ bool TNonblockingServer::drainPendingTask() {
 }
 
 void TNonblockingServer::expireClose(boost::shared_ptr<Runnable> task) {
-  TConnection* connection = static_cast<TConnection::Task*>(task.get())->getTConnection();
-  assert(connection && connection->getServer() && connection->getState() == APP_WAIT_TASK);
-  connection->forceClose();
+  TConnection::Task* connectionTask = static_cast<TConnection::Task*>(task.get());
+  TConnection* connection = connectionTask->getTConnection();
+  assert(connection && connection->getServer()
+         && (connectionTask->getRequest() || connection->getState() == APP_WAIT_TASK));
+  connection->forceClose(connectionTask->getRequest());
 }
 
 void TNonblockingServer::stop() {
@@ -1221,6 +2241,21 @@ void TNonblockingServer::stop() {
 void TNonblockingServer::registerEvents(event_base* user_event_base) {
   userEventBase_ = user_event_base;
 
+#ifndef SO_REUSEPORT
+  if (useReusePortListeners_) {
+    GlobalOutput.printf("TNonblockingServer: SO_REUSEPORT is not supported, using one listener.");
+    useReusePortListeners_ = false;
+  }
+#endif
+
+  // the ring is drained when the IO thread leaves its loop, which a user
+  // event base does not tell us about
+  if (ioEngine_ == T_IO_ENGINE_IO_URING && (userEventBase_ || !TIOUring::isSupported())) {
+    GlobalOutput.printf("TNonblockingServer: io_uring is not %s, using libevent.",
+                        userEventBase_ ? "available with a user event base" : "supported");
+    ioEngine_ = T_IO_ENGINE_LIBEVENT;
+  }
+
   // init listen socket
   if (serverSocket_ == THRIFT_INVALID_SOCKET)
     createAndListenOnSocket();
@@ -1234,8 +2269,14 @@ void TNonblockingServer::registerEvents(event_base* user_event_base) {
   assert(numIOThreads_ == 1 || !userEventBase_);
 
   for (uint32_t id = 0; id < numIOThreads_; ++id) {
-    // the first IO thread also does the listening on server socket
-    THRIFT_SOCKET listenFd = (id == 0 ? serverSocket_ : THRIFT_INVALID_SOCKET);
+    // the first IO thread also does the listening on server socket; with
+    // reuse-port listeners every other IO thread gets a socket of its own
+    THRIFT_SOCKET listenFd = THRIFT_INVALID_SOCKET;
+    if (id == 0) {
+      listenFd = serverSocket_;
+    } else if (useReusePortListeners_) {
+      listenFd = createReusePortListener();
+    }
 
     shared_ptr<TNonblockingIOThread> thread(
         new TNonblockingIOThread(this, id, listenFd, useHighPriorityIOThreads_));
@@ -1252,9 +2293,11 @@ void TNonblockingServer::registerEvents(event_base* user_event_base) {
   assert(ioThreads_.size() == numIOThreads_);
   assert(ioThreads_.size() > 0);
 
-  GlobalOutput.printf("TNonblockingServer: Serving on port %d, %d io threads.",
+  GlobalOutput.printf("TNonblockingServer: Serving on port %d, %d io threads%s%s.",
                       listenPort_,
-                      ioThreads_.size());
+                      ioThreads_.size(),
+                      useReusePortListeners_ ? " with reuse-port listeners" : "",
+                      ioEngine_ == T_IO_ENGINE_IO_URING ? " on io_uring" : "");
 
   // Launch all the secondary IO threads in separate threads
   if (ioThreads_.size() > 1) {
@@ -1277,7 +2320,11 @@ void TNonblockingServer::registerEvents(event_base* user_event_base) {
     }
   }
 
-  // Register the events for the primary (listener) IO thread
+  // Register the events for the primary (listener) IO thread, which serve()
+  // runs on the calling thread
+  if (!userEventBase_) {
+    ioThreads_[0]->setAffinity();
+  }
   ioThreads_[0]->registerEvents();
 }
 
@@ -1301,6 +2348,55 @@ void TNonblockingServer::serve() {
   }
 }
 
+size_t TRoundRobinPlacementPolicy::placeConnection(
+    const std::vector<boost::shared_ptr<TNonblockingIOThread> >& ioThreads) {
+  size_t selected = next_ % ioThreads.size();
+  next_ = selected + 1;
+  return selected;
+}
+
+size_t TLeastConnectionsPlacementPolicy::placeConnection(
+    const std::vector<boost::shared_ptr<TNonblockingIOThread> >& ioThreads) {
+  size_t selected = 0;
+  for (size_t i = 1; i < ioThreads.size(); ++i) {
+    if (ioThreads[i]->getNumConnections() < ioThreads[selected]->getNumConnections()) {
+      selected = i;
+    }
+  }
+  return selected;
+}
+
+uint32_t TTwoChoicesPlacementPolicy::nextRandom() {
+  // xorshift32; we only need a cheap, roughly uniform choice
+  state_ ^= state_ << 13;
+  state_ ^= state_ >> 17;
+  state_ ^= state_ << 5;
+  return state_;
+}
+
+size_t TTwoChoicesPlacementPolicy::placeConnection(
+    const std::vector<boost::shared_ptr<TNonblockingIOThread> >& ioThreads) {
+  size_t n = ioThreads.size();
+  if (n == 1) {
+    return 0;
+  }
+  size_t a = nextRandom() % n;
+  size_t b = nextRandom() % (n - 1);
+  if (b >= a) {
+    ++b;
+  }
+
+  const TNonblockingIOThread* ta = ioThreads[a].get();
+  const TNonblockingIOThread* tb = ioThreads[b].get();
+  if (ta->getNumActiveTasks() != tb->getNumActiveTasks()) {
+    return ta->getNumActiveTasks() < tb->getNumActiveTasks() ? a : b;
+  }
+  if (ta->getNumPendingBytes() != tb->getNumPendingBytes()) {
+    return ta->getNumPendingBytes() < tb->getNumPendingBytes() ? a : b;
+  }
+  return tb->getNumConnections() < ta->getNumConnections() ? b : a;
+}
+
 TNonblockingIOThread::TNonblockingIOThread(TNonblockingServer* server,
                                            int number,
                                            THRIFT_SOCKET listenSocket,
@@ -1310,9 +2406,17 @@ TNonblockingIOThread::TNonblockingIOThread(TNonblockingServer* server,
     listenSocket_(listenSocket),
     useHighPriority_(useHighPriority),
     eventBase_(NULL),
-    ownEventBase_(false) {
-  notificationPipeFDs_[0] = -1;
-  notificationPipeFDs_[1] = -1;
+    ownEventBase_(false),
+    notificationQueue_(NOTIFICATION_QUEUE_SIZE),
+    numConnections_(0),
+    numActiveTasks_(0),
+    numPendingBytes_(0),
+    queueDelayOverloaded_(false),
+    minQueueDelay_(0),
+    queueDelayIntervalEnd_(0),
+    bufferPool_(server->getBufferPoolLimit()),
+    ringStopping_(false),
+    affinitySet_(false) {
 }
 
 TNonblockingIOThread::~TNonblockingIOThread() {
@@ -1331,43 +2435,7 @@ TNonblockingIOThread::~TNonblockingIOThread() {
     listenSocket_ = THRIFT_INVALID_SOCKET;
   }
 
-  for (int i = 0; i < 2; ++i) {
-    if (notificationPipeFDs_[i] >= 0) {
-      if (0 != ::THRIFT_CLOSESOCKET(notificationPipeFDs_[i])) {
-        GlobalOutput.perror("TNonblockingIOThread notificationPipe close(): ",
-                            THRIFT_GET_SOCKET_ERROR);
-      }
-      notificationPipeFDs_[i] = THRIFT_INVALID_SOCKET;
-    }
-  }
-}
-
-void TNonblockingIOThread::createNotificationPipe() {
-  if (evutil_socketpair(AF_LOCAL, SOCK_STREAM, 0, notificationPipeFDs_) == -1) {
-    GlobalOutput.perror("TNonblockingServer::createNotificationPipe ", EVUTIL_SOCKET_ERROR());
-    throw TException("can't create notification pipe");
-  }
-  if (evutil_make_socket_nonblocking(notificationPipeFDs_[0]) < 0
-      || evutil_make_socket_nonblocking(notificationPipeFDs_[1]) < 0) {
-    ::THRIFT_CLOSESOCKET(notificationPipeFDs_[0]);
-    ::THRIFT_CLOSESOCKET(notificationPipeFDs_[1]);
-    throw TException("TNonblockingServer::createNotificationPipe() THRIFT_O_NONBLOCK");
-  }
-  for (int i = 0; i < 2; ++i) {
-#if LIBEVENT_VERSION_NUMBER < 0x02000000
-    int flags;
-    if ((flags = THRIFT_FCNTL(notificationPipeFDs_[i], F_GETFD, 0)) < 0
-        || THRIFT_FCNTL(notificationPipeFDs_[i], F_SETFD, flags | FD_CLOEXEC) < 0) {
-#else
-    if (evutil_make_socket_closeonexec(notificationPipeFDs_[i]) < 0) {
-#endif
-      ::THRIFT_CLOSESOCKET(notificationPipeFDs_[0]);
-      ::THRIFT_CLOSESOCKET(notificationPipeFDs_[1]);
-      throw TException(
-          "TNonblockingServer::createNotificationPipe() "
-          "FD_CLOEXEC");
-    }
-  }
+  notificationQueue_.close();
 }
 
 /**
@@ -1390,13 +2458,41 @@ void TNonblockingIOThread::registerEvents() {
                         event_base_get_method(eventBase_));
   }
 
-  if (listenSocket_ >= 0) {
+  if (server_->getIOEngine() == T_IO_ENGINE_IO_URING) {
+    ring_.open(IO_URING_ENTRIES, IO_URING_BUFFER_COUNT, IO_URING_BUFFER_SIZE);
+    ringStopping_ = false;
+
+    // libevent still drives the loop and tells us when completions arrive
+    event_set(&ringEvent_,
+              ring_.getEventFD(),
+              EV_READ | EV_PERSIST,
+              TNonblockingIOThread::ringHandler,
+              this);
+    event_base_set(eventBase_, &ringEvent_);
+    if (-1 == event_add(&ringEvent_, 0)) {
+      throw TException(
+          "TNonblockingServer::serve(): "
+          "event_add() failed on io_uring completion event");
+    }
+    GlobalOutput.printf("TNonblocking: IO thread #%d registered for io_uring.", number_);
+  }
+
+  if (listenSocket_ >= 0 && ring_.isOpen()) {
+    // a multishot accept stays armed for every connection
+    ring_.accept(listenSocket_, reinterpret_cast<uintptr_t>(this) | RING_ACCEPT);
+    int ret = ring_.submit();
+    if (ret < 0) {
+      GlobalOutput.perror("TNonblockingIOThread: io_uring submit ", -ret);
+      throw TException("TNonblockingServer::serve(): io_uring accept failed");
+    }
+    GlobalOutput.printf("TNonblocking: IO thread #%d registered for listen.", number_);
+  } else if (listenSocket_ >= 0) {
     // Register the server event
     event_set(&serverEvent_,
               listenSocket_,
               EV_READ | EV_PERSIST,
               TNonblockingIOThread::listenHandler,
-              server_);
+              this);
     event_base_set(eventBase_, &serverEvent_);
 
     // Add the event and start up the server
@@ -1408,7 +2504,7 @@ void TNonblockingIOThread::registerEvents() {
     GlobalOutput.printf("TNonblocking: IO thread #%d registered for listen.", number_);
   }
 
-  createNotificationPipe();
+  notificationQueue_.open();
 
   // Create an event to be notified when a task finishes
   event_set(&notificationEvent_,
@@ -1430,90 +2526,160 @@ void TNonblockingIOThread::registerEvents() {
 }
 
 bool TNonblockingIOThread::notify(TNonblockingServer::TConnection* conn) {
-  THRIFT_SOCKET fd = getNotificationSendFD();
-  if (fd < 0) {
+  return notificationQueue_.push(conn);
+}
+
+bool TNonblockingIOThread::shedTask(int64_t queueDelay) {
+  if (!server_->shedsOnQueueDelay()) {
     return false;
   }
 
-  fd_set wfds, efds;
-  long ret = -1;
-  long kSize = sizeof(conn);
-  const char* pos = reinterpret_cast<const char*>(&conn);
-
-  while (kSize > 0) {
-    FD_ZERO(&wfds);
-    FD_ZERO(&efds);
-    FD_SET(fd, &wfds);
-    FD_SET(fd, &efds);
-    ret = select(static_cast<int>(fd + 1), NULL, &wfds, &efds, NULL);
-    if (ret < 0) {
-      return false;
-    } else if (ret == 0) {
-      continue;
+  // CoDel: a burst drains within an interval, so only a delay that no task
+  // escaped for a whole interval means the queue is standing.  The worker
+  // that ends an interval judges it; the others only lower its minimum.
+  int64_t target = server_->getQueueDelayTarget() * 1000;
+  int64_t now = Util::currentTimeUsec();
+  int64_t intervalEnd = queueDelayIntervalEnd_.load();
+  if (now >= intervalEnd
+      && queueDelayIntervalEnd_.compare_exchange_strong(
+             intervalEnd,
+             now + server_->getQueueDelayInterval() * 1000)) {
+    bool overloaded = minQueueDelay_.exchange(queueDelay) > target;
+    bool wasOverloaded = queueDelayOverloaded_.exchange(overloaded);
+    if (overloaded && !wasOverloaded) {
+      GlobalOutput.printf("TNonblockingServer: IO thread #%d queue delay overload begun.",
+                          number_);
+    } else if (!overloaded && wasOverloaded) {
+      GlobalOutput.printf("TNonblockingServer: IO thread #%d queue delay overload ended; "
+                          "%llu shed in total",
+                          number_,
+                          static_cast<unsigned long long>(server_->nTotalTasksShed_));
     }
-
-    if (FD_ISSET(fd, &efds)) {
-      ::THRIFT_CLOSESOCKET(fd);
-      return false;
+  } else {
+    int64_t minQueueDelay = minQueueDelay_.load();
+    while (queueDelay < minQueueDelay
+           && !minQueueDelay_.compare_exchange_weak(minQueueDelay, queueDelay)) {
     }
+  }
 
-    if (FD_ISSET(fd, &wfds)) {
-      ret = send(fd, pos, kSize, 0);
-      if (ret < 0) {
-        if (errno == EAGAIN) {
-          continue;
-        }
+  // while overloaded, shed the tasks that waited well past the target so
+  // that the rest get through in time
+  bool shed = queueDelayOverloaded_ && queueDelay > 2 * target;
+  if (shed) {
+    ++server_->nTotalTasksShed_;
+  }
+  return shed;
+}
 
-        ::THRIFT_CLOSESOCKET(fd);
-        return false;
-      }
+/* static */
+void TNonblockingIOThread::notifyHandler(evutil_socket_t fd, short which, void* v) {
+  TNonblockingIOThread* ioThread = (TNonblockingIOThread*)v;
+  assert(ioThread);
+  (void)fd;
+  (void)which;
+
+  // clear the signal before draining, so that anything queued after the
+  // last pop below wakes us up again
+  if (!ioThread->notificationQueue_.clearSignal()) {
+    ioThread->breakLoop(true);
+    return;
+  }
 
-      kSize -= ret;
-      pos += ret;
+  void* item;
+  while (ioThread->notificationQueue_.pop(item)) {
+    TNonblockingServer::TConnection* connection = static_cast<TNonblockingServer::TConnection*>(item);
+    if (connection == NULL) {
+      // this is the command to stop our thread, exit the handler!
+      return;
     }
+    connection->notified();
   }
 
-  return true;
+  // submit what the connections queued on the ring
+  if (ioThread->ring_.isOpen()) {
+    ioThread->flushRing();
+  }
 }
 
 /* static */
-void TNonblockingIOThread::notifyHandler(evutil_socket_t fd, short which, void* v) {
+void TNonblockingIOThread::ringHandler(evutil_socket_t fd, short which, void* v) {
   TNonblockingIOThread* ioThread = (TNonblockingIOThread*)v;
   assert(ioThread);
+  (void)fd;
   (void)which;
 
-  while (true) {
-    TNonblockingServer::TConnection* connection = 0;
-    const int kSize = sizeof(connection);
-    long nBytes = recv(fd, cast_sockopt(&connection), kSize, 0);
-    if (nBytes == kSize) {
-      if (connection == NULL) {
-        // this is the command to stop our thread, exit the handler!
-        return;
-      }
-      connection->transition();
-    } else if (nBytes > 0) {
-      // throw away these bytes and hope that next time we get a solid read
-      GlobalOutput.printf("notifyHandler: Bad read of %d bytes, wanted %d", nBytes, kSize);
-      ioThread->breakLoop(true);
-      return;
-    } else if (nBytes == 0) {
-      GlobalOutput.printf("notifyHandler: Notify socket closed!");
-      // exit the loop
-      break;
-    } else { // nBytes < 0
-      if (THRIFT_GET_SOCKET_ERROR != THRIFT_EWOULDBLOCK
-          && THRIFT_GET_SOCKET_ERROR != THRIFT_EAGAIN) {
-        GlobalOutput.perror("TNonblocking: notifyHandler read() failed: ", THRIFT_GET_SOCKET_ERROR);
-        ioThread->breakLoop(true);
-        return;
-      }
-      // exit the loop
-      break;
+  // as for notifications, completions posted after the drain signal again
+  ioThread->ring_.clearSignal();
+  ioThread->handleCompletions();
+  ioThread->flushRing();
+}
+
+void TNonblockingIOThread::handleCompletions() {
+  TIOUring::Completion completion;
+  while (ring_.nextCompletion(completion)) {
+    int op = static_cast<int>(completion.userData & RING_OP_MASK);
+    uintptr_t target = static_cast<uintptr_t>(completion.userData & ~uint64_t(RING_OP_MASK));
+    if (op == RING_ACCEPT) {
+      acceptCompleted(completion);
+    } else if (op == RING_RECV || op == RING_SEND) {
+      reinterpret_cast<TNonblockingServer::TConnection*>(target)->ringCompleted(op, completion);
+    }
+    // cancellations complete with RING_CANCEL, the cancelled request on its own
+  }
+}
+
+void TNonblockingIOThread::acceptCompleted(const TIOUring::Completion& completion) {
+  if (completion.result >= 0) {
+    THRIFT_SOCKET clientSocket = completion.result;
+    sockaddr_storage addrStorage;
+    socklen_t addrLen = sizeof(addrStorage);
+    if (ringStopping_
+        || ::getpeername(clientSocket, (sockaddr*)&addrStorage, &addrLen) != 0) {
+      ::THRIFT_CLOSESOCKET(clientSocket);
+    } else {
+      server_->acceptConnection(clientSocket, (sockaddr*)&addrStorage, addrLen, this);
+    }
+  } else if (completion.result != -ECANCELED) {
+    GlobalOutput.perror("thriftServerEventHandler: io_uring accept() ", -completion.result);
+  }
+
+  // an accept that stopped on an error is armed again
+  if (!completion.more && !ringStopping_) {
+    try {
+      ring_.accept(listenSocket_, reinterpret_cast<uintptr_t>(this) | RING_ACCEPT);
+    } catch (const TException& e) {
+      GlobalOutput.printf("TNonblockingIOThread: %s, no longer accepting", e.what());
+      breakLoop(true);
     }
   }
 }
 
+void TNonblockingIOThread::flushRing() {
+  // a ready pass may queue more connections, which get theirs as well
+  for (size_t i = 0; i < ringReady_.size(); ++i) {
+    ringReady_[i]->ringReadyPass();
+  }
+  ringReady_.clear();
+
+  // requests that do not fit now stay queued for the next try
+  int ret = ring_.submit();
+  if (ret < 0 && ret != -EAGAIN && ret != -EBUSY && ret != -EINTR) {
+    GlobalOutput.perror("TNonblockingIOThread: io_uring submit ", -ret);
+  }
+}
+
+void TNonblockingIOThread::cleanupRing() {
+  // the connections stay open, but nothing on the ring may refer to them
+  ringStopping_ = true;
+  ring_.cancelAll(RING_CANCEL);
+  flushRing();
+  while (ring_.getNumInFlight() > 0 && ring_.waitForCompletion()) {
+    handleCompletions();
+    flushRing();
+  }
+  ring_.close();
+}
+
 void TNonblockingIOThread::breakLoop(bool error) {
   if (error) {
     GlobalOutput.printf("TNonblockingServer: IO thread #%d exiting with error.", number_);
@@ -1568,7 +2734,28 @@ void TNonblockingIOThread::setCurrentThreadHighPriority(bool value) {
 #endif
 }
 
+void TNonblockingIOThread::setAffinity() {
+  if (affinitySet_) {
+    return;
+  }
+  affinitySet_ = true;
+
+  std::vector<int> cpus = server_->getIOThreadAffinity().cpusFor(number_);
+  if (!cpus.empty()) {
+    if (ThreadAffinity::setCurrentThreadCpus(cpus)) {
+      GlobalOutput.printf("TNonblocking: IO thread #%d pinned to %d CPU(s).",
+                          number_,
+                          static_cast<int>(cpus.size()));
+    } else {
+      GlobalOutput.printf("TNonblocking: IO thread #%d could not set CPU affinity.", number_);
+    }
+  }
+}
+
 void TNonblockingIOThread::run() {
+  // pin first, so that the event base and ring get allocated on our node
+  setAffinity();
+
   if (eventBase_ == NULL)
     registerEvents();
 
@@ -1592,8 +2779,11 @@ void TNonblockingIOThread::run() {
 }
 
 void TNonblockingIOThread::cleanupEvents() {
-  // stop the listen socket, if any
-  if (listenSocket_ >= 0) {
+  if (ring_.isOpen()) {
+    event_del(&ringEvent_);
+    cleanupRing();
+  } else if (listenSocket_ >= 0) {
+    // stop the listen socket, if any
     if (event_del(&serverEvent_) == -1) {
       GlobalOutput.perror("TNonblockingIOThread::stop() event_del: ", THRIFT_GET_SOCKET_ERROR);
     }
@@ -21,6 +21,9 @@
 #define _THRIFT_SERVER_TNONBLOCKINGSERVER_H_ 1
 
 #include <thrift/Thrift.h>
+#include <thrift/server/TBufferPool.h>
+#include <thrift/server/TIOUring.h>
+#include <thrift/server/TNotificationQueue.h>
 #include <thrift/server/TServer.h>
 #include <thrift/transport/PlatformSocket.h>
 #include <thrift/transport/TBufferTransports.h>
@@ -29,7 +32,10 @@
 #include <climits>
 #include <thrift/concurrency/Thread.h>
 #include <thrift/concurrency/PlatformThreadFactory.h>
+#include <thrift/concurrency/ThreadAffinity.h>
 #include <thrift/concurrency/Mutex.h>
+#include <boost/atomic.hpp>
+#include <map>
 #include <stack>
 #include <vector>
 #include <string>
@@ -53,6 +59,7 @@ using apache::thrift::concurrency::ThreadManager;
 using apache::thrift::concurrency::PlatformThreadFactory;
 using apache::thrift::concurrency::ThreadFactory;
 using apache::thrift::concurrency::Thread;
+using apache::thrift::concurrency::ThreadAffinity;
 using apache::thrift::concurrency::Mutex;
 using apache::thrift::concurrency::Guard;
 
@@ -106,11 +113,74 @@ inline SOCKOPT_CAST_T* cast_sockopt(T* v) {
 enum TOverloadAction {
   T_OVERLOAD_NO_ACTION,       ///< Don't handle overload */
   T_OVERLOAD_CLOSE_ON_ACCEPT, ///< Drop new connections immediately */
-  T_OVERLOAD_DRAIN_TASK_QUEUE ///< Drop some tasks from head of task queue */
+  T_OVERLOAD_DRAIN_TASK_QUEUE, ///< Drop some tasks from head of task queue */
+  T_OVERLOAD_REJECT_ON_QUEUE_DELAY, ///< Fail tasks that queued too long */
+  T_OVERLOAD_CLOSE_ON_QUEUE_DELAY   ///< Close connections whose tasks queued too long */
+};
+
+/// Ways for the IO threads to do socket IO.
+enum TIOEngine {
+  T_IO_ENGINE_LIBEVENT, ///< Read and write on libevent readiness events */
+  T_IO_ENGINE_IO_URING  ///< Batch accepts, receives and sends on Linux io_uring */
 };
 
 class TNonblockingIOThread;
 
+/**
+ * Chooses the IO thread that a newly accepted connection is handed to.
+ * Called with the server's connection mutex held, so implementations see
+ * one call at a time.  The load counters of the IO threads are updated by
+ * the IO threads themselves and may be slightly stale.
+ */
+class TConnectionPlacementPolicy {
+public:
+  virtual ~TConnectionPlacementPolicy() {}
+
+  /**
+   * Pick an IO thread for a new connection.
+   *
+   * @param ioThreads the IO threads of the server (never empty).
+   * @return index into ioThreads of the chosen thread.
+   */
+  virtual size_t placeConnection(
+      const std::vector<boost::shared_ptr<TNonblockingIOThread> >& ioThreads) = 0;
+};
+
+/// Hands connections to the IO threads in turn (the default).
+class TRoundRobinPlacementPolicy : public TConnectionPlacementPolicy {
+public:
+  TRoundRobinPlacementPolicy() : next_(0) {}
+
+  size_t placeConnection(const std::vector<boost::shared_ptr<TNonblockingIOThread> >& ioThreads);
+
+private:
+  size_t next_;
+};
+
+/// Hands each connection to the IO thread with the fewest open connections.
+class TLeastConnectionsPlacementPolicy : public TConnectionPlacementPolicy {
+public:
+  size_t placeConnection(const std::vector<boost::shared_ptr<TNonblockingIOThread> >& ioThreads);
+};
+
+/**
+ * Samples two IO threads at random and hands the connection to the one
+ * with less pending work: fewer requests in flight, then fewer pending
+ * bytes, then fewer connections.  Avoids the herding of always picking the
+ * least loaded thread when the counters lag behind.
+ */
+class TTwoChoicesPlacementPolicy : public TConnectionPlacementPolicy {
+public:
+  TTwoChoicesPlacementPolicy(uint32_t seed = 0x2545F491) : state_(seed ? seed : 1) {}
+
+  size_t placeConnection(const std::vector<boost::shared_ptr<TNonblockingIOThread> >& ioThreads);
+
+private:
+  uint32_t nextRandom();
+
+  uint32_t state_;
+};
+
 class TNonblockingServer : public TServer {
 private:
   class TConnection;
@@ -145,6 +215,12 @@ private:
   /// # of calls before resizing oversized buffers (0 = check only on close)
   static const int RESIZE_BUFFER_EVERY_N = 512;
 
+  /// Default target for queueing delay in milliseconds
+  static const int QUEUE_DELAY_TARGET = 5;
+
+  /// Default interval for tracking queueing delay in milliseconds
+  static const int QUEUE_DELAY_INTERVAL = 100;
+
   /// # of IO threads to use by default
   static const int DEFAULT_IO_THREADS = 1;
 
@@ -154,6 +230,15 @@ private:
   /// Whether to set high scheduling priority for IO threads
   bool useHighPriorityIOThreads_;
 
+  /// CPUs the IO threads run on
+  ThreadAffinity ioThreadAffinity_;
+
+  /// Whether every IO thread accepts on its own SO_REUSEPORT listen socket
+  bool useReusePortListeners_;
+
+  /// How the IO threads do socket IO
+  TIOEngine ioEngine_;
+
   /// Server socket file descriptor
   THRIFT_SOCKET serverSocket_;
 
@@ -178,8 +263,8 @@ private:
   // Vector of IOThread objects that will handle our IO
   std::vector<boost::shared_ptr<TNonblockingIOThread> > ioThreads_;
 
-  // Index of next IO Thread to be used (for round-robin)
-  uint32_t nextIOThread_;
+  // Chooses the IO thread for each new connection
+  boost::shared_ptr<TConnectionPlacementPolicy> placementPolicy_;
 
   // Synchronizes access to connection stack and similar data
   Mutex connMutex_;
@@ -196,6 +281,12 @@ private:
   /// Limit for number of connections processing or waiting to process
   size_t maxActiveProcessors_;
 
+  /// Limit for requests of one connection in flight at once (1 = no pipelining)
+  size_t maxPipelinedRequests_;
+
+  /// Whether pipelined responses are sent as soon as they complete
+  bool outOfOrderResponses_;
+
   /// Limit for number of open connections
   size_t maxConnections_;
 
@@ -205,6 +296,12 @@ private:
   /// Time in milliseconds before an unperformed task expires (0 == infinite).
   int64_t taskExpireTime_;
 
+  /// Thread manager priority of the calls of each method listed
+  std::map<std::string, size_t> methodPriorities_;
+
+  /// Thread manager priority of the calls of methods not listed
+  size_t defaultTaskPriority_;
+
   /**
    * Hysteresis for overload state.  This is the fraction of the overload
    * value that needs to be reached before the overload state is cleared;
@@ -215,6 +312,16 @@ private:
   /// Action to take when we're overloaded.
   TOverloadAction overloadAction_;
 
+  /**
+   * Queueing delay in milliseconds that tasks may see under the queue delay
+   * overload actions.  The server is overloaded when no task in a whole
+   * interval got away with less.
+   */
+  int64_t queueDelayTarget_;
+
+  /// Interval in milliseconds over which queueing delay is tracked.
+  int64_t queueDelayInterval_;
+
   /**
    * The write buffer is initialized (and when idleWriteBufferLimit_ is checked
    * and found to be exceeded, reinitialized) to this size.
@@ -244,6 +351,12 @@ private:
    */
   int32_t resizeBufferEveryN_;
 
+  /**
+   * Bytes each IO thread keeps in its pool of connection buffers.
+   * 0 disables pooling, and each connection keeps its own buffers.
+   */
+  size_t bufferPoolLimit_;
+
   /// Set if we are currently in an overloaded state.
   bool overloaded_;
 
@@ -253,6 +366,9 @@ private:
   /// Count of connections dropped on overload since server started
   uint64_t nTotalConnectionsDropped_;
 
+  /// Count of tasks shed because of queueing delay since server started
+  boost::atomic<uint64_t> nTotalTasksShed_;
+
   /**
    * This is a stack of all the objects that have been created but that
    * are NOT currently in use. When we close a connection, we place it on this
@@ -276,14 +392,33 @@ private:
    *
    * @param fd the listen socket.
    * @param which the event flag that triggered the handler.
+   * @param acceptThread the IO thread that owns the listen socket.
    */
-  void handleEvent(THRIFT_SOCKET fd, short which);
+  void handleEvent(THRIFT_SOCKET fd, short which, TNonblockingIOThread* acceptThread);
+
+  /**
+   * Sets up a TConnection for an accepted client socket and hands it to
+   * its IO thread, or drops the socket if we are overloaded.
+   *
+   * @param clientSocket the accepted socket.
+   * @param addr the address of the client.
+   * @param addrLen the length of addr.
+   * @param acceptThread the IO thread that owns the listen socket.
+   * @return false if the socket was dropped.
+   */
+  bool acceptConnection(THRIFT_SOCKET clientSocket,
+                        const sockaddr* addr,
+                        socklen_t addrLen,
+                        TNonblockingIOThread* acceptThread);
 
   void init(int port) {
     serverSocket_ = THRIFT_INVALID_SOCKET;
     numIOThreads_ = DEFAULT_IO_THREADS;
-    nextIOThread_ = 0;
+    placementPolicy_.reset(new TRoundRobinPlacementPolicy());
     useHighPriorityIOThreads_ = false;
+    ioThreadAffinity_ = ThreadAffinity();
+    useReusePortListeners_ = false;
+    ioEngine_ = T_IO_ENGINE_LIBEVENT;
     port_ = port;
     listenPort_ = port;
     userEventBase_ = NULL;
@@ -292,18 +427,25 @@ private:
     numActiveProcessors_ = 0;
     connectionStackLimit_ = CONNECTION_STACK_LIMIT;
     maxActiveProcessors_ = MAX_ACTIVE_PROCESSORS;
+    maxPipelinedRequests_ = 1;
+    outOfOrderResponses_ = false;
     maxConnections_ = MAX_CONNECTIONS;
     maxFrameSize_ = MAX_FRAME_SIZE;
     taskExpireTime_ = 0;
+    defaultTaskPriority_ = 0;
     overloadHysteresis_ = 0.8;
     overloadAction_ = T_OVERLOAD_NO_ACTION;
+    queueDelayTarget_ = QUEUE_DELAY_TARGET;
+    queueDelayInterval_ = QUEUE_DELAY_INTERVAL;
     writeBufferDefaultSize_ = WRITE_BUFFER_DEFAULT_SIZE;
     idleReadBufferLimit_ = IDLE_READ_BUFFER_LIMIT;
     idleWriteBufferLimit_ = IDLE_WRITE_BUFFER_LIMIT;
     resizeBufferEveryN_ = RESIZE_BUFFER_EVERY_N;
+    bufferPoolLimit_ = 0;
     overloaded_ = false;
     nConnectionsDropped_ = 0;
     nTotalConnectionsDropped_ = 0;
+    nTotalTasksShed_ = 0;
   }
 
 public:
@@ -409,9 +551,78 @@ public:
   /** Set whether the IO threads will get high scheduling priority. */
   void setUseHighPriorityIOThreads(bool val) { useHighPriorityIOThreads_ = val; }
 
+  /** Return the CPUs the IO threads run on. */
+  const ThreadAffinity& getIOThreadAffinity() const { return ioThreadAffinity_; }
+
+  /**
+   * Set the CPUs the IO threads run on.  IO thread N gets the CPUs of thread
+   * N of affinity, so ThreadAffinity::roundRobin() pins IO thread N to the
+   * Nth CPU listed.  IO thread 0 is the thread that calls serve().  Each
+   * IO thread is pinned before it sets up its event base.
+   */
+  void setIOThreadAffinity(const ThreadAffinity& affinity) { ioThreadAffinity_ = affinity; }
+
   /** Return the number of IO threads used by this server. */
   size_t getNumIOThreads() const { return numIOThreads_; }
 
+  /** Return whether each IO thread accepts on its own SO_REUSEPORT listener. */
+  bool useReusePortListeners() const { return useReusePortListeners_; }
+
+  /**
+   * Set whether each IO thread gets its own listen socket bound to the
+   * server port with SO_REUSEPORT.  The kernel then spreads incoming
+   * connections over the IO threads, and each connection is served by the
+   * thread that accepted it instead of being handed off from IO thread #0.
+   * Can only be used before the call to serve().  Ignored (with a warning)
+   * on platforms without SO_REUSEPORT.  If the listen socket is supplied
+   * through listenSocket(), it must have SO_REUSEPORT set before bind().
+   */
+  void setUseReusePortListeners(bool val) { useReusePortListeners_ = val; }
+
+  /** Return how the IO threads do socket IO. */
+  TIOEngine getIOEngine() const { return ioEngine_; }
+
+  /**
+   * Set how the IO threads do socket IO.  With T_IO_ENGINE_IO_URING each
+   * IO thread keeps accepts and receives armed on an io_uring and submits
+   * them, along with its sends, once per pass of its event loop; libevent
+   * still runs the loop and delivers task completions.  Can only be used
+   * before the call to serve().  Falls back to T_IO_ENGINE_LIBEVENT (with
+   * a warning) where io_uring is not available, and with a user-provided
+   * event base.
+   */
+  void setIOEngine(TIOEngine ioEngine) { ioEngine_ = ioEngine; }
+
+  /**
+   * Return the IO threads of this server.  Empty until serve() or
+   * registerEvents() has been called.  Their load counters show how the
+   * connections and work are spread.
+   */
+  const std::vector<boost::shared_ptr<TNonblockingIOThread> >& getIOThreads() const {
+    return ioThreads_;
+  }
+
+  /** Return the policy used to pick the IO thread of new connections. */
+  boost::shared_ptr<TConnectionPlacementPolicy> getPlacementPolicy() const {
+    return placementPolicy_;
+  }
+
+  /**
+   * Set the policy used to pick the IO thread of new connections.  Not used
+   * for connections accepted by reuse-port listeners, which stay on the
+   * accepting thread.
+   *
+   * @param policy the placement policy; NULL restores round robin.
+   */
+  void setPlacementPolicy(boost::shared_ptr<TConnectionPlacementPolicy> policy) {
+    Guard g(connMutex_);
+    if (policy) {
+      placementPolicy_ = policy;
+    } else {
+      placementPolicy_.reset(new TRoundRobinPlacementPolicy());
+    }
+  }
+
   /**
    * Get the maximum number of unused TConnection we will hold in reserve.
    *
@@ -428,10 +639,72 @@ public:
 
   bool isThreadPoolProcessing() const { return threadPoolProcessing_; }
 
-  void addTask(boost::shared_ptr<Runnable> task) {
-    threadManager_->add(task, 0LL, taskExpireTime_);
+  void addTask(boost::shared_ptr<Runnable> task, size_t priority = 0) {
+    threadManager_->add(task, 0LL, taskExpireTime_, priority);
+  }
+
+  /**
+   * Get the thread manager priority of the calls of a method.
+   *
+   * @param name the method name.
+   * @return the priority set for it, or the default priority.
+   */
+  size_t getMethodPriority(const std::string& name) const {
+    std::map<std::string, size_t>::const_iterator it = methodPriorities_.find(name);
+    return it == methodPriorities_.end() ? defaultTaskPriority_ : it->second;
   }
 
+  /**
+   * Set the thread manager priority of the calls of a method, so that cheap
+   * or latency critical calls can get ahead of bulk work waiting for the
+   * workers.  Only has an effect with a thread manager that has several
+   * priorities, such as ThreadManager::newPriorityThreadManager().  The
+   * method name is read from the message header of each request before it
+   * is queued, through a protocol each connection keeps for it, which costs a
+   * little per request as long as any method priority is set.  Can only be
+   * used before the call to serve().
+   *
+   * @param name the method name as sent by clients, including the service
+   *             name prefix where a TMultiplexedProcessor is used.
+   * @param priority the priority, 0 being the highest.
+   */
+  void setMethodPriority(const std::string& name, size_t priority) {
+    methodPriorities_[name] = priority;
+  }
+
+  /**
+   * Get the thread manager priority of the calls of methods that have none set.
+   *
+   * @return the priority, 0 being the highest.
+   */
+  size_t getDefaultTaskPriority() const { return defaultTaskPriority_; }
+
+  /**
+   * Set the thread manager priority of the calls of methods that have none
+   * set with setMethodPriority().  Can only be used before the call to serve().
+   *
+   * @param priority the priority, 0 being the highest.
+   */
+  void setDefaultTaskPriority(size_t priority) { defaultTaskPriority_ = priority; }
+
+  /**
+   * Whether any method has a priority set with setMethodPriority().
+   *
+   * @return true if the method name of requests needs to be read before they are queued.
+   */
+  bool hasMethodPriorities() const { return !methodPriorities_.empty(); }
+
+  /**
+   * Get the thread manager priority of a request from the method name in its
+   * message header.
+   *
+   * @param protocol a protocol positioned at the start of the request.
+   * @param name where to read the method name to, reused across requests.
+   * @return the priority of the method, or the default priority if none is
+   *         set or the header cannot be read.
+   */
+  size_t getTaskPriority(TProtocol* protocol, std::string& name);
+
   /**
    * Return the count of sockets currently connected to.
    *
@@ -507,6 +780,40 @@ public:
     maxActiveProcessors_ = maxActiveProcessors;
   }
 
+  /**
+   * Get the maximum # of requests from one connection processed at once.
+   *
+   * @return current setting; 1 means requests are not pipelined.
+   */
+  size_t getMaxPipelinedRequests() const { return maxPipelinedRequests_; }
+
+  /**
+   * Set the maximum # of requests from one connection processed at once.
+   *
+   * With a limit above 1 and a thread manager, a connection keeps reading
+   * frames while earlier ones are being processed, and dispatches each one
+   * as its own task.  The processor (and its handler) must then cope with
+   * concurrent calls from the same connection.  Only affects connections
+   * accepted after the call.
+   *
+   * @param maxPipelinedRequests new limit; 0 is treated as 1.
+   */
+  void setMaxPipelinedRequests(size_t maxPipelinedRequests) {
+    maxPipelinedRequests_ = maxPipelinedRequests > 0 ? maxPipelinedRequests : 1;
+  }
+
+  /** Return whether pipelined responses may be sent out of order. */
+  bool getOutOfOrderResponses() const { return outOfOrderResponses_; }
+
+  /**
+   * Set whether pipelined responses are sent as soon as they are ready
+   * rather than in request order.  Only for clients that match responses
+   * to requests by seqid, such as the generated concurrent clients.
+   */
+  void setOutOfOrderResponses(bool outOfOrderResponses) {
+    outOfOrderResponses_ = outOfOrderResponses;
+  }
+
   /**
    * Get the maximum allowed frame size.
    *
@@ -571,6 +878,56 @@ public:
    */
   void setTaskExpireTime(int64_t taskExpireTime) { taskExpireTime_ = taskExpireTime; }
 
+  /**
+   * Get the queueing delay the queue delay overload actions aim for.
+   *
+   * @return the target delay in milliseconds.
+   */
+  int64_t getQueueDelayTarget() const { return queueDelayTarget_; }
+
+  /**
+   * Set the queueing delay the queue delay overload actions aim for.  Once
+   * every task an IO thread read in an interval has waited longer than this
+   * in the thread manager, its tasks waiting over twice as long are shed
+   * until the delay falls below it again.
+   *
+   * @param target the target delay in milliseconds.
+   */
+  void setQueueDelayTarget(int64_t target) { queueDelayTarget_ = target; }
+
+  /**
+   * Get the interval over which queueing delay is tracked.
+   *
+   * @return the interval in milliseconds.
+   */
+  int64_t getQueueDelayInterval() const { return queueDelayInterval_; }
+
+  /**
+   * Set the interval over which queueing delay is tracked.  It should be
+   * longer than a burst of requests the server is expected to absorb.
+   *
+   * @param interval the interval in milliseconds.
+   */
+  void setQueueDelayInterval(int64_t interval) { queueDelayInterval_ = interval; }
+
+  /**
+   * Get the number of tasks shed because of queueing delay.
+   *
+   * @return count of tasks failed or closed since the server started.
+   */
+  uint64_t getNumTasksShed() const { return nTotalTasksShed_; }
+
+  /**
+   * Determine if tasks may be shed because of queueing delay, which is only
+   * measured then.
+   *
+   * @return true under the queue delay overload actions.
+   */
+  bool shedsOnQueueDelay() const {
+    return overloadAction_ == T_OVERLOAD_REJECT_ON_QUEUE_DELAY
+           || overloadAction_ == T_OVERLOAD_CLOSE_ON_QUEUE_DELAY;
+  }
+
   /**
    * Determine if the server is currently overloaded.
    * This function checks the maximums for open connections and connections
@@ -674,6 +1031,25 @@ public:
    */
   void setResizeBufferEveryN(int32_t count) { resizeBufferEveryN_ = count; }
 
+  /**
+   * Get the # of bytes each IO thread keeps in its buffer pool.
+   *
+   * @return current limit, 0 if buffers are not pooled.
+   */
+  size_t getBufferPoolLimit() const { return bufferPoolLimit_; }
+
+  /**
+   * Pool connection buffers per IO thread.  Connections then borrow their
+   * read and write buffers from the pool only while a frame is in flight
+   * and return them when idle, instead of each keeping its own; the idle
+   * buffer limits and resize checks no longer apply.  Returned buffers are
+   * kept for reuse up to limit bytes per IO thread.  Can only be used
+   * before the call to serve().
+   *
+   * @param limit bytes kept for reuse per IO thread, or 0 to disable pooling.
+   */
+  void setBufferPoolLimit(size_t limit) { bufferPoolLimit_ = limit; }
+
   /**
    * Main workhorse function, starts up the server listening on a port and
    * loops over the libevent handler.
@@ -718,6 +1094,31 @@ public:
   bool getHeaderTransport();
 
 private:
+  /**
+   * Creates a socket and binds it to the wildcard address on the given port.
+   *
+   * @param port the port to bind to, or zero to let the OS choose one.
+   * @return descriptor of the bound (but not yet listening) socket.
+   */
+  THRIFT_SOCKET createAndBindSocket(int port);
+
+  /**
+   * Sets the socket options we want on a listen socket and starts
+   * listening on it.  The socket is closed if anything fails.
+   *
+   * @param fd descriptor of a bound socket.
+   */
+  void setupListenSocket(THRIFT_SOCKET fd);
+
+  /**
+   * Creates an additional listen socket bound to the port the server
+   * is listening on, for use by an IO thread when reuse-port listeners
+   * are enabled.
+   *
+   * @return descriptor of the new listening socket.
+   */
+  THRIFT_SOCKET createReusePortListener();
+
   /**
    * Callback function that the threadmanager calls when a task reaches
    * its expiration time.  It is needed to clean up the expired connection.
@@ -734,9 +1135,13 @@ private:
    * @param socket FD of socket associated with this connection.
    * @param addr the sockaddr of the client
    * @param addrLen the length of addr
+   * @param acceptThread the IO thread that accepted the connection.
    * @return pointer to initialized TConnection object.
    */
-  TConnection* createConnection(THRIFT_SOCKET socket, const sockaddr* addr, socklen_t addrLen);
+  TConnection* createConnection(THRIFT_SOCKET socket,
+                                const sockaddr* addr,
+                                socklen_t addrLen,
+                                TNonblockingIOThread* acceptThread);
 
   /**
    * Returns a connection to pool or deletion.  If the connection pool
@@ -774,10 +1179,26 @@ public:
   Thread::id_t getThreadId() const { return threadId_; }
 
   // Returns the send-fd for task complete notifications.
-  evutil_socket_t getNotificationSendFD() const { return notificationPipeFDs_[1]; }
+  evutil_socket_t getNotificationSendFD() const { return notificationQueue_.getSendFD(); }
 
   // Returns the read-fd for task complete notifications.
-  evutil_socket_t getNotificationRecvFD() const { return notificationPipeFDs_[0]; }
+  evutil_socket_t getNotificationRecvFD() const { return notificationQueue_.getRecvFD(); }
+
+  // Returns the number of connections currently assigned to this thread.
+  int32_t getNumConnections() const { return numConnections_; }
+
+  // Returns the number of requests read on this thread whose processing
+  // has not finished yet.
+  int32_t getNumActiveTasks() const { return numActiveTasks_; }
+
+  // Returns the number of request bytes waiting for or in processing plus
+  // the number of response bytes not yet sent on this thread.
+  int64_t getNumPendingBytes() const { return numPendingBytes_; }
+
+  // Returns the pool connection buffers are borrowed from, whose counters
+  // show how well it is sized.  Only used if the server's buffer pool limit
+  // is non-zero.
+  const TBufferPool& getBufferPool() const { return bufferPool_; }
 
   // Returns the actual thread object associated with this IO thread.
   boost::shared_ptr<Thread> getThread() const { return thread_; }
@@ -788,6 +1209,11 @@ public:
   // Used by TConnection objects to indicate processing has finished.
   bool notify(TNonblockingServer::TConnection* conn);
 
+  // Determines if a task read on this thread that waited queueDelay
+  // microseconds should be shed instead of run, under the queue delay
+  // overload actions.  Called by the worker threads.
+  bool shedTask(int64_t queueDelay);
+
   // Enters the event loop and does not return until a call to stop().
   virtual void run();
 
@@ -800,12 +1226,16 @@ public:
   /// Registers the events for the notification & listen sockets
   void registerEvents();
 
+  /// Pins the calling thread to the CPUs of this IO thread, once
+  void setAffinity();
+
 private:
+  friend class TNonblockingServer::TConnection;
+
   /**
    * C-callable event handler for signaling task completion.  Provides a
-   * callback that libevent can understand that will read a connection
-   * object's address from a pipe and call connection->transition() for
-   * that object.
+   * callback that libevent can understand that will drain the connections
+   * queued by notify() and call connection->transition() for each of them.
    *
    * @param fd the descriptor the event occurred on.
    */
@@ -817,18 +1247,39 @@ private:
    *
    * @param fd the descriptor the event occurred on.
    * @param which the flags associated with the event.
-   * @param v void* callback arg where we placed TNonblockingServer's "this".
+   * @param v void* callback arg where we placed TNonblockingIOThread's "this".
    */
   static void listenHandler(evutil_socket_t fd, short which, void* v) {
-    ((TNonblockingServer*)v)->handleEvent(fd, which);
+    TNonblockingIOThread* ioThread = (TNonblockingIOThread*)v;
+    ioThread->getServer()->handleEvent(fd, which, ioThread);
   }
 
+  /**
+   * C-callable event handler for io_uring completions.  Hands each
+   * completion to the connection or acceptor it belongs to, then submits
+   * the requests queued meanwhile.
+   *
+   * @param fd the ring's eventfd.
+   * @param which the flags associated with the event.
+   * @param v void* callback arg where we placed TNonblockingIOThread's "this".
+   */
+  static void ringHandler(evutil_socket_t fd, short which, void* v);
+
+  /// Dispatches the completions waiting on the ring.
+  void handleCompletions();
+
+  /// Handles a connection accepted by the ring's multishot accept.
+  void acceptCompleted(const TIOUring::Completion& completion);
+
+  /// Gives queued connections their ready pass and submits queued requests.
+  void flushRing();
+
+  /// Cancels what is in flight on the ring, waits for it and closes it.
+  void cleanupRing();
+
   /// Exits the loop ASAP in case of shutdown or error.
   void breakLoop(bool error);
 
-  /// Create the pipe used to notify I/O process of task completion.
-  void createNotificationPipe();
-
   /// Unregisters our events for notification and listen sockets.
   void cleanupEvents();
 
@@ -836,6 +1287,19 @@ private:
   void setCurrentThreadHighPriority(bool value);
 
 private:
+  /// Capacity of the task completion queue
+  static const size_t NOTIFICATION_QUEUE_SIZE = 4096;
+
+  /// Requests that can be queued on the io_uring between submits
+  static const uint32_t IO_URING_ENTRIES = 1024;
+
+  /// Number and size of the io_uring receive buffers
+  static const uint32_t IO_URING_BUFFER_COUNT = 256;
+  static const uint32_t IO_URING_BUFFER_SIZE = 16 * 1024;
+
+  /// What a ring request is for, kept in the low bits of its user data
+  enum RingOp { RING_CANCEL = 0, RING_ACCEPT = 1, RING_RECV = 2, RING_SEND = 3, RING_OP_MASK = 3 };
+
   /// associated server
   TNonblockingServer* server_;
 
@@ -864,11 +1328,43 @@ private:
   /// Used with eventBase_ for task completion notification
   struct event notificationEvent_;
 
-  /// File descriptors for pipe used for task completion notification.
-  evutil_socket_t notificationPipeFDs_[2];
+  /// Connections whose task has completed, with the descriptor that wakes
+  /// this thread up when the queue becomes non-empty.
+  TNotificationQueue notificationQueue_;
 
   /// Actual IO Thread
   boost::shared_ptr<Thread> thread_;
+
+  /// Load counters, updated by the connections of this thread
+  boost::atomic<int32_t> numConnections_;
+  boost::atomic<int32_t> numActiveTasks_;
+  boost::atomic<int64_t> numPendingBytes_;
+
+  /// Queue delay state of the tasks read on this thread, shared by the
+  /// worker threads without a lock: whether the delay stays above the
+  /// target, the shortest delay in microseconds seen in the current interval
+  /// and the end of that interval
+  boost::atomic<bool> queueDelayOverloaded_;
+  boost::atomic<int64_t> minQueueDelay_;
+  boost::atomic<int64_t> queueDelayIntervalEnd_;
+
+  /// Buffers lent to the connections of this thread
+  TBufferPool bufferPool_;
+
+  /// Socket IO of this thread if the server uses io_uring; closed otherwise
+  TIOUring ring_;
+
+  /// Used with eventBase_ for the ring's completion eventfd
+  struct event ringEvent_;
+
+  /// Connections waiting for a ready pass of their state machine
+  std::vector<TNonblockingServer::TConnection*> ringReady_;
+
+  /// Set while the ring is being torn down
+  bool ringStopping_;
+
+  /// Whether setAffinity() has run
+  bool affinitySet_;
 };
 }
 }
@@ -0,0 +1,253 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <thrift/thrift-config.h>
+
+#include <thrift/server/TNotificationQueue.h>
+
+#include <event.h>
+
+#ifdef HAVE_SYS_EVENTFD_H
+#include <sys/eventfd.h>
+#endif
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+
+#include <stdint.h>
+
+namespace apache {
+namespace thrift {
+namespace server {
+
+TNotificationQueue::TNotificationQueue(size_t capacity)
+  : mask_(0), enqueuePos_(0), dequeuePos_(0), pending_(0), eventFD_(false) {
+  size_t size = 2;
+  while (size < capacity) {
+    size <<= 1;
+  }
+  mask_ = size - 1;
+  cells_.reset(new Cell[size]);
+  for (size_t i = 0; i < size; ++i) {
+    cells_[i].sequence.store(i, boost::memory_order_relaxed);
+    cells_[i].item = NULL;
+  }
+  fds_[0] = THRIFT_INVALID_SOCKET;
+  fds_[1] = THRIFT_INVALID_SOCKET;
+}
+
+TNotificationQueue::~TNotificationQueue() {
+  close();
+}
+
+void TNotificationQueue::open() {
+  if (isOpen()) {
+    return;
+  }
+
+#ifdef HAVE_SYS_EVENTFD_H
+  int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (fd >= 0) {
+    fds_[0] = fds_[1] = fd;
+    eventFD_ = true;
+    return;
+  }
+  GlobalOutput.perror("TNotificationQueue::open() eventfd, falling back to socketpair ", errno);
+#endif
+
+  evutil_socket_t pair[2];
+  if (evutil_socketpair(AF_LOCAL, SOCK_STREAM, 0, pair) == -1) {
+    GlobalOutput.perror("TNotificationQueue::open() ", EVUTIL_SOCKET_ERROR());
+    throw TException("can't create notification pipe");
+  }
+  if (evutil_make_socket_nonblocking(pair[0]) < 0
+      || evutil_make_socket_nonblocking(pair[1]) < 0) {
+    ::THRIFT_CLOSESOCKET(pair[0]);
+    ::THRIFT_CLOSESOCKET(pair[1]);
+    throw TException("TNotificationQueue::open() THRIFT_O_NONBLOCK");
+  }
+  for (int i = 0; i < 2; ++i) {
+#if LIBEVENT_VERSION_NUMBER < 0x02000000
+    int flags;
+    if ((flags = THRIFT_FCNTL(pair[i], F_GETFD, 0)) < 0
+        || THRIFT_FCNTL(pair[i], F_SETFD, flags | FD_CLOEXEC) < 0) {
+#else
+    if (evutil_make_socket_closeonexec(pair[i]) < 0) {
+#endif
+      ::THRIFT_CLOSESOCKET(pair[0]);
+      ::THRIFT_CLOSESOCKET(pair[1]);
+      throw TException("TNotificationQueue::open() FD_CLOEXEC");
+    }
+  }
+  fds_[0] = pair[0];
+  fds_[1] = pair[1];
+  eventFD_ = false;
+}
+
+void TNotificationQueue::close() {
+  int count = eventFD_ ? 1 : 2;
+  for (int i = 0; i < count; ++i) {
+    if (fds_[i] != THRIFT_INVALID_SOCKET) {
+      if (0 != ::THRIFT_CLOSESOCKET(fds_[i])) {
+        GlobalOutput.perror("TNotificationQueue close(): ", THRIFT_GET_SOCKET_ERROR);
+      }
+    }
+  }
+  fds_[0] = THRIFT_INVALID_SOCKET;
+  fds_[1] = THRIFT_INVALID_SOCKET;
+  eventFD_ = false;
+}
+
+bool TNotificationQueue::push(void* item) {
+  if (!isOpen()) {
+    return false;
+  }
+
+  while (!tryPush(item)) {
+    // the consumer has been signalled already, give it time to drain
+    THRIFT_SLEEP_USEC(50);
+  }
+
+  // only the push that makes the queue non-empty needs to wake the consumer
+  if (pending_.fetch_add(1, boost::memory_order_acq_rel) == 0) {
+    return signal();
+  }
+  return true;
+}
+
+bool TNotificationQueue::tryPush(void* item) {
+  // bounded queue after Dmitry Vyukov: each cell's sequence tells producers
+  // whether it is free for the current lap and the consumer whether it is full
+  size_t pos = enqueuePos_.load(boost::memory_order_relaxed);
+  Cell* cell;
+  while (true) {
+    cell = &cells_[pos & mask_];
+    size_t seq = cell->sequence.load(boost::memory_order_acquire);
+    intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+    if (diff == 0) {
+      if (enqueuePos_.compare_exchange_weak(pos, pos + 1, boost::memory_order_relaxed)) {
+        break;
+      }
+    } else if (diff < 0) {
+      return false;
+    } else {
+      pos = enqueuePos_.load(boost::memory_order_relaxed);
+    }
+  }
+  cell->item = item;
+  cell->sequence.store(pos + 1, boost::memory_order_release);
+  return true;
+}
+
+bool TNotificationQueue::pop(void*& item) {
+  Cell* cell = &cells_[dequeuePos_ & mask_];
+  size_t seq = cell->sequence.load(boost::memory_order_acquire);
+  if ((intptr_t)seq - (intptr_t)(dequeuePos_ + 1) < 0) {
+    // a producer that claimed this cell has not filled it yet, while later
+    // ones may already have counted their items without signalling; keep
+    // the descriptor readable so that the consumer comes back for them
+    if (pending_.load(boost::memory_order_acquire) > 0) {
+      signal();
+    }
+    return false;
+  }
+  item = cell->item;
+  cell->sequence.store(dequeuePos_ + mask_ + 1, boost::memory_order_release);
+  ++dequeuePos_;
+
+  // may briefly go negative when an item is popped before its producer
+  // counted it; that producer then sees a non-zero count and skips signalling
+  pending_.fetch_sub(1, boost::memory_order_acq_rel);
+  return true;
+}
+
+bool TNotificationQueue::signal() {
+  THRIFT_SOCKET fd = getSendFD();
+  while (true) {
+    long ret;
+#ifdef HAVE_SYS_EVENTFD_H
+    if (eventFD_) {
+      uint64_t one = 1;
+      ret = ::write(fd, &one, sizeof(one));
+    } else
+#endif
+    {
+      char one = 1;
+      ret = send(fd, &one, sizeof(one), 0);
+    }
+    if (ret > 0) {
+      return true;
+    }
+    int err = THRIFT_GET_SOCKET_ERROR;
+    if (err == THRIFT_EINTR) {
+      continue;
+    }
+    // a full socket buffer or eventfd counter still leaves the consumer
+    // with a readable descriptor, so the wakeup is not lost
+    return err == THRIFT_EAGAIN || err == THRIFT_EWOULDBLOCK;
+  }
+}
+
+bool TNotificationQueue::clearSignal() {
+  THRIFT_SOCKET fd = getRecvFD();
+  if (fd == THRIFT_INVALID_SOCKET) {
+    return false;
+  }
+  while (true) {
+    long ret;
+#ifdef HAVE_SYS_EVENTFD_H
+    if (eventFD_) {
+      uint64_t count;
+      ret = ::read(fd, &count, sizeof(count));
+    } else
+#endif
+    {
+      char buf[64];
+      ret = recv(fd, buf, sizeof(buf), 0);
+    }
+    if (ret > 0) {
+      // the eventfd counter resets on every read; socket bytes may need several
+      if (eventFD_) {
+        return true;
+      }
+      continue;
+    }
+    if (ret == 0) {
+      GlobalOutput.printf("TNotificationQueue: notify socket closed!");
+      return false;
+    }
+    int err = THRIFT_GET_SOCKET_ERROR;
+    if (err == THRIFT_EINTR) {
+      continue;
+    }
+    if (err == THRIFT_EAGAIN || err == THRIFT_EWOULDBLOCK) {
+      return true;
+    }
+    GlobalOutput.perror("TNotificationQueue: read() failed: ", err);
+    return false;
+  }
+}
+}
+}
+} // apache::thrift::server
@@ -0,0 +1,136 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef _THRIFT_SERVER_TNOTIFICATIONQUEUE_H_
+#define _THRIFT_SERVER_TNOTIFICATIONQUEUE_H_ 1
+
+#include <thrift/Thrift.h>
+#include <thrift/transport/PlatformSocket.h>
+
+#include <boost/atomic.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/scoped_array.hpp>
+
+namespace apache {
+namespace thrift {
+namespace server {
+
+/**
+ * Bounded multi-producer, single-consumer queue of pointers, paired with a
+ * file descriptor the consumer can wait on in its event loop.
+ *
+ * Producers push without taking a lock.  The descriptor (an eventfd where
+ * available, a socket pair otherwise) is only signalled when the queue goes
+ * from empty to non-empty, so a burst of pushes costs a single system call
+ * and a single wakeup.  After clearing the signal the consumer pops until
+ * the queue is empty.
+ *
+ * When the queue is full, producers back off briefly until the consumer
+ * makes room.
+ */
+class TNotificationQueue : boost::noncopyable {
+public:
+  /**
+   * Creates a queue holding at least capacity items (rounded up to a power
+   * of two).  No descriptor exists until open() is called.
+   */
+  explicit TNotificationQueue(size_t capacity = 1024);
+
+  ~TNotificationQueue();
+
+  /**
+   * Creates the notification descriptor.
+   *
+   * @throw TException if the descriptor cannot be created.
+   */
+  void open();
+
+  /// Closes the notification descriptor.
+  void close();
+
+  /// Returns true when open() has been called and close() has not.
+  bool isOpen() const { return fds_[0] != THRIFT_INVALID_SOCKET; }
+
+  /// Returns the descriptor the consumer waits on for readability.
+  THRIFT_SOCKET getRecvFD() const { return fds_[0]; }
+
+  /// Returns the descriptor producers signal.  Same as getRecvFD() for eventfd.
+  THRIFT_SOCKET getSendFD() const { return fds_[1]; }
+
+  /// Returns true if the notification descriptor is a Linux eventfd.
+  bool usesEventFD() const { return eventFD_; }
+
+  /// Returns the number of items the queue can hold.
+  size_t getCapacity() const { return mask_ + 1; }
+
+  /**
+   * Enqueues an item, signalling the descriptor if the queue was empty.
+   * May be called from any thread.
+   *
+   * @return false if the descriptor is closed or could not be signalled
+   *         (check THRIFT_GET_SOCKET_ERROR).
+   */
+  bool push(void* item);
+
+  /**
+   * Dequeues the oldest item.  Only the consumer may call this.
+   *
+   * @return false if the queue is empty.
+   */
+  bool pop(void*& item);
+
+  /**
+   * Consumes any pending signal on the descriptor.  The consumer calls this
+   * before draining the queue with pop().
+   *
+   * @return false if the descriptor was closed or failed; true otherwise,
+   *         including when there was nothing to consume.
+   */
+  bool clearSignal();
+
+private:
+  struct Cell {
+    boost::atomic<size_t> sequence;
+    void* item;
+  };
+
+  bool tryPush(void* item);
+  bool signal();
+
+  size_t mask_;
+  boost::scoped_array<Cell> cells_;
+
+  /// Producer and consumer positions, kept on separate cache lines.
+  char pad0_[64];
+  boost::atomic<size_t> enqueuePos_;
+  char pad1_[64];
+  size_t dequeuePos_;
+  char pad2_[64];
+
+  /// Pushed minus popped items; the push that raises it from zero signals.
+  boost::atomic<int64_t> pending_;
+
+  THRIFT_SOCKET fds_[2];
+  bool eventFD_;
+};
+}
+}
+} // apache::thrift::server
+
+#endif // #ifndef _THRIFT_SERVER_TNOTIFICATIONQUEUE_H_
@@ -226,6 +226,29 @@ void TFramedTransport::writeSlow(const uint8_t* buf, uint32_t len) {
   while (new_size < len + have) {
     new_size = new_size > 0 ? new_size * 2 : 1;
   }
+  resizeWriteBuffer(new_size);
+
+  // Copy the data into the new buffer.
+  memcpy(wBase_, buf, len);
+  wBase_ += len;
+}
+
+void TFramedTransport::reserveWrite(uint32_t len) {
+  uint32_t have = static_cast<uint32_t>(wBase_ - wBuf_.get());
+  if (len <= wBufSize_ - have) {
+    return;
+  }
+  if (len + have < have /* overflow */ || len + have > 0x7fffffff) {
+    throw TTransportException(TTransportException::BAD_ARGS,
+                              "Attempted to write over 2 GB to TFramedTransport.");
+  }
+  // Just enough for a large frame, but still at least double, so that
+  // reserving a little at a time costs no more than writing does.
+  resizeWriteBuffer((std::max)(len + have, (std::min)(wBufSize_ * 2, 0x7fffffffU)));
+}
+
+void TFramedTransport::resizeWriteBuffer(uint32_t new_size) {
+  uint32_t have = static_cast<uint32_t>(wBase_ - wBuf_.get());
 
   // TODO(dreiss): Consider modifying this class to use malloc/free
   // so we can use realloc here.
@@ -241,10 +264,6 @@ void TFramedTransport::writeSlow(const uint8_t* buf, uint32_t len) {
   wBufSize_ = new_size;
   wBase_ = wBuf_.get() + have;
   wBound_ = wBuf_.get() + wBufSize_;
-
-  // Copy the data into the new buffer.
-  memcpy(wBase_, buf, len);
-  wBase_ += len;
 }
 
 void TFramedTransport::flush() {
@@ -366,7 +385,27 @@ void TMemoryBuffer::ensureCanWrite(uint32_t len) {
     new_size = new_size > 0 ? new_size * 2 : 1;
     avail = available_write() + (new_size - bufferSize_);
   }
+  resizeBuffer(new_size);
+}
+
+void TMemoryBuffer::reserveWrite(uint32_t len) {
+  uint32_t avail = available_write();
+  if (!owner_ || len <= avail) {
+    return;
+  }
+  if (len - avail > (std::numeric_limits<uint32_t>::max)() - bufferSize_) {
+    throw TTransportException(TTransportException::BAD_ARGS,
+                              "Attempted to reserve over 4 GB in TMemoryBuffer.");
+  }
+  // Just enough for a large message, but still at least double, so that
+  // reserving a little at a time costs no more than writing does.
+  uint32_t doubled = bufferSize_ > (std::numeric_limits<uint32_t>::max)() / 2
+                         ? (std::numeric_limits<uint32_t>::max)()
+                         : bufferSize_ * 2;
+  resizeBuffer((std::max)(bufferSize_ + (len - avail), doubled));
+}
 
+void TMemoryBuffer::resizeBuffer(uint32_t new_size) {
   // Allocate into a new pointer so we don't bork ours if it fails.
   uint8_t* new_buffer = static_cast<uint8_t*>(std::realloc(buffer_, new_size));
   if (new_buffer == NULL) {
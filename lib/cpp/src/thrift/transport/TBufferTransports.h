@@ -360,6 +360,11 @@ public:
 
   virtual void flush();
 
+  /**
+   * Grows the frame buffer, where needed, to fit len more bytes in one go.
+   */
+  virtual void reserveWrite(uint32_t len);
+
   uint32_t readEnd();
 
   uint32_t writeEnd();
@@ -398,6 +403,9 @@ protected:
    */
   virtual bool readFrame();
 
+  /// Moves what has been written to a new write buffer of new_size bytes.
+  void resizeWriteBuffer(uint32_t new_size);
+
   void initPointers() {
     setReadBuffer(NULL, 0);
     setWriteBuffer(wBuf_.get(), wBufSize_);
@@ -622,6 +630,20 @@ public:
     // Our old self gets destroyed.
   }
 
+  /**
+   * Give up the underlying buffer, leaving this TMemoryBuffer empty but
+   * writable.  The caller must free() the returned memory.
+   *
+   * @param sz  Set to the allocated size of the returned buffer.
+   * @return the buffer, or NULL (with sz set to 0) if it was not owned.
+   */
+  uint8_t* releaseBuffer(uint32_t* sz) {
+    uint8_t* buf = owner_ ? buffer_ : NULL;
+    *sz = owner_ ? bufferSize_ : 0;
+    initCommon(NULL, 0, true, 0);
+    return buf;
+  }
+
   std::string readAsString(uint32_t len) {
     std::string str;
     (void)readAppendToString(str, len);
@@ -667,6 +689,10 @@ public:
   // that had been provided by getWritePtr().
   void wroteBytes(uint32_t len);
 
+  // Grows the buffer, where needed, to fit len more bytes in one go.  Does
+  // nothing for a buffer it does not own.
+  virtual void reserveWrite(uint32_t len);
+
   /*
    * TVirtualTransport provides a default implementation of readAll().
    * We want to use the TBufferBase version instead.
@@ -690,6 +716,9 @@ protected:
   // Make sure there's at least 'len' bytes available for writing.
   void ensureCanWrite(uint32_t len);
 
+  // Move the contents to a new buffer of new_size bytes.
+  void resizeBuffer(uint32_t new_size);
+
   // Compute the position and available data for reading.
   void computeRead(uint32_t len, uint8_t** out_start, uint32_t* out_give);
 
@@ -178,6 +178,17 @@ public:
     // default behaviour is to do nothing
   }
 
+  /**
+   * Hints that len more bytes are about to be written, so that a buffering
+   * transport can grow its buffer for them once rather than as they come.
+   *
+   * @param len  How many bytes will be written
+   * @throws TTransportException if an error occurs
+   */
+  virtual void reserveWrite(uint32_t /* len */) {
+    // default behaviour is to do nothing
+  }
+
   /**
    * Attempts to return a pointer to \c len bytes, possibly copied into \c buf.
    * Does not consume the bytes read (i.e.: a later read will return the same
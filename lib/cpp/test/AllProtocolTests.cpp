@@ -21,12 +21,14 @@
 
 #include <thrift/protocol/TBinaryProtocol.h>
 #include <thrift/protocol/TCompactProtocol.h>
+#include <thrift/protocol/TJSONProtocol.h>
 #include <thrift/transport/TBufferTransports.h>
 
 #define BOOST_TEST_MODULE AllProtocolTests
 #include <boost/test/unit_test.hpp>
 
 #include "AllProtocolTests.tcc"
+#include "gen-cpp/DebugProtoTest_types.h"
 
 using namespace apache::thrift;
 using namespace apache::thrift::protocol;
@@ -45,3 +47,258 @@ BOOST_AUTO_TEST_CASE(test_little_binary_protocol) {
 BOOST_AUTO_TEST_CASE(test_compact_protocol) {
   testProtocol<TCompactProtocol>("TCompactProtocol");
 }
+
+/**
+ * Writes value to a new TMemoryBuffer with a Protocol.
+ */
+template <typename Protocol, typename Struct>
+shared_ptr<TMemoryBuffer> writeBuffer(const Struct& value) {
+  shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+  Protocol prot(buffer);
+  value.write(&prot);
+  return buffer;
+}
+
+template <typename Protocol>
+void testBorrowedViews() {
+  thrift::test::debug::BlobViews a;
+  a.blob = std::string(1000, 'x');
+  a.chunks.push_back("first chunk");
+  a.chunks.push_back("");
+  a.chunks.push_back("third chunk");
+  shared_ptr<TMemoryBuffer> buffer = writeBuffer<Protocol>(a);
+  std::string written = buffer->getBufferAsString();
+
+  // views own copies until borrowing is allowed
+  Protocol prot(buffer);
+  thrift::test::debug::BlobViews copied;
+  copied.read(&prot);
+  BOOST_CHECK(a == copied);
+  BOOST_CHECK(copied.blob.getOwner() != buffer);
+
+  buffer->resetBuffer((uint8_t*)written.data(), static_cast<uint32_t>(written.size()));
+  const char* begin = written.data();
+  const char* end = begin + written.size();
+  prot.setBorrowViews(true);
+  thrift::test::debug::BlobViews borrowed;
+  borrowed.read(&prot);
+  BOOST_CHECK(a == borrowed);
+  BOOST_CHECK_EQUAL(std::string("unnamed"), borrowed.name.str());
+  BOOST_CHECK(borrowed.blob.data() >= begin && borrowed.blob.end() <= end);
+  BOOST_CHECK(borrowed.chunks[2].data() >= begin && borrowed.chunks[2].end() <= end);
+  BOOST_CHECK(borrowed.chunks[1].empty());
+
+  // and the views keep the buffer alive
+  BOOST_CHECK(borrowed.blob.getOwner() == buffer);
+
+  // a frame of several structs lends each its own part
+  shared_ptr<TMemoryBuffer> frame(new TMemoryBuffer());
+  Protocol framed(frame);
+  a.write(&framed);
+  a.write(&framed);
+  uint8_t* data;
+  uint32_t size;
+  frame->getBuffer(&data, &size);
+  framed.setBorrowViews(true);
+  thrift::test::debug::BlobViews first;
+  thrift::test::debug::BlobViews second;
+  first.read(&framed);
+  second.read(&framed);
+  BOOST_CHECK(a == first);
+  BOOST_CHECK(a == second);
+  BOOST_CHECK(first.blob.data() >= reinterpret_cast<const char*>(data));
+  BOOST_CHECK(first.chunks[2].end() <= second.blob.data());
+  BOOST_CHECK(second.chunks[2].end() <= reinterpret_cast<const char*>(data + size));
+}
+
+BOOST_AUTO_TEST_CASE(test_borrowed_views) {
+  testBorrowedViews<TBinaryProtocol>();
+  testBorrowedViews<TLEBinaryProtocol>();
+  testBorrowedViews<TCompactProtocol>();
+}
+
+/**
+ * Writes lists nested depth deep around an i32, followed by 42.
+ */
+template <typename Protocol>
+shared_ptr<TMemoryBuffer> writeNestedLists(int depth) {
+  shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+  Protocol prot(buffer);
+  for (int i = 1; i < depth; i++) {
+    prot.writeListBegin(T_LIST, 1);
+  }
+  prot.writeListBegin(T_I32, 1);
+  prot.writeI32(depth);
+  prot.writeI32(42);
+  return buffer;
+}
+
+void checkSkipThrows(TProtocol& prot, TType type, TProtocolException::TProtocolExceptionType expected) {
+  try {
+    prot.skip(type);
+    BOOST_ERROR("skip did not throw");
+  } catch (const TProtocolException& e) {
+    BOOST_CHECK_EQUAL(e.getType(), expected);
+  }
+}
+
+template <typename Protocol>
+void testSkip(TProtocolFactory& limitedFactory) {
+  thrift::test::debug::OneOfEach ooe;
+  ooe.im_true = true;
+  ooe.double_precision = 3.25;
+  ooe.some_characters = "skipped";
+  for (int64_t ix = 0; ix < 100; ++ix) {
+    ooe.i64_list.push_back(ix * ix * ix * ix * ix * ix * ix * ix * ix - ix);
+  }
+  thrift::test::debug::HolyMoley a;
+  a.big.assign(3, ooe);
+  a.contain.insert(std::vector<std::string>(2, "a string"));
+  a.bonks["bonk"].resize(2);
+  shared_ptr<TMemoryBuffer> buffer = writeBuffer<Protocol>(a);
+  uint32_t size = buffer->available_read();
+  Protocol(buffer).writeI32(42);
+  std::string written = buffer->getBufferAsString();
+
+  // skipping in the buffer ends where the struct does
+  Protocol prot(buffer);
+  int32_t after;
+  BOOST_CHECK_EQUAL(prot.skip(T_STRUCT), size);
+  prot.readI32(after);
+  BOOST_CHECK_EQUAL(after, 42);
+
+  // as does skipping the usual way, when the transport cannot lend it whole
+  shared_ptr<TMemoryBuffer> other(
+      new TMemoryBuffer((uint8_t*)written.data(), static_cast<uint32_t>(written.size())));
+  shared_ptr<TBufferedTransport> buffered(new TBufferedTransport(other, 16));
+  Protocol small(buffered);
+  BOOST_CHECK_EQUAL(small.skip(T_STRUCT), size);
+  small.readI32(after);
+  BOOST_CHECK_EQUAL(after, 42);
+
+  // limits are enforced as they are when reading
+  buffer->resetBuffer((uint8_t*)written.data(), static_cast<uint32_t>(written.size()));
+  shared_ptr<TProtocol> limited = limitedFactory.getProtocol(buffer);
+  checkSkipThrows(*limited, T_STRUCT, TProtocolException::SIZE_LIMIT);
+
+  buffer->resetBuffer((uint8_t*)written.data(), static_cast<uint32_t>(written.size()));
+  Protocol shallow(buffer);
+  shallow.setRecurisionLimit(2);
+  checkSkipThrows(shallow, T_STRUCT, TProtocolException::DEPTH_LIMIT);
+
+  // nesting past the recursion limit throws, in the buffer and the usual way
+  std::string deep = writeNestedLists<Protocol>(100)->getBufferAsString();
+  other->resetBuffer((uint8_t*)deep.data(), static_cast<uint32_t>(deep.size()));
+  Protocol nesting(other);
+  checkSkipThrows(nesting, T_LIST, TProtocolException::DEPTH_LIMIT);
+  Protocol nestingSmall(shared_ptr<TTransport>(new TBufferedTransport(other, 16)));
+  checkSkipThrows(nestingSmall, T_LIST, TProtocolException::DEPTH_LIMIT);
+
+  // and leaves the protocol able to skip shallower values
+  std::string nested = writeNestedLists<Protocol>(8)->getBufferAsString();
+  other->resetBuffer((uint8_t*)nested.data(), static_cast<uint32_t>(nested.size()));
+  nesting.skip(T_LIST);
+  nesting.readI32(after);
+  BOOST_CHECK_EQUAL(after, 42);
+}
+
+BOOST_AUTO_TEST_CASE(test_skip) {
+  TBinaryProtocolFactory binaryFactory(0, 2, false, true);
+  testSkip<TBinaryProtocol>(binaryFactory);
+  TLEBinaryProtocolFactory littleFactory(0, 2, false, true);
+  testSkip<TLEBinaryProtocol>(littleFactory);
+  TCompactProtocolFactory compactFactory(0, 2);
+  testSkip<TCompactProtocol>(compactFactory);
+}
+
+/**
+ * Checks that value's serializedSize() is the number of bytes it writes,
+ * whether or not the struct's type is to hand, and returns it.
+ */
+template <typename Protocol, typename Struct>
+uint32_t checkSerializedSize(const Struct& value) {
+  shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+  Protocol prot(buffer);
+  uint32_t size = value.serializedSize(&prot);
+  BOOST_CHECK_EQUAL(value.serializedSize(static_cast<TProtocol*>(&prot)), size);
+  BOOST_CHECK_EQUAL(value.write(&prot), size);
+  BOOST_CHECK_EQUAL(buffer->available_read(), size);
+  return size;
+}
+
+template <typename Protocol>
+void testSerializedSize() {
+  using namespace thrift::test::debug;
+
+  OneOfEach ooe;
+  ooe.im_true = true;
+  ooe.im_false = false;
+  ooe.integer16 = -300;
+  ooe.integer32 = -70000;
+  ooe.integer64 = -((int64_t)1 << 50);
+  ooe.some_characters = std::string(200, 'c');
+  ooe.i16_list.push_back(-1);
+  ooe.i64_list.push_back((int64_t)1 << 62);
+  checkSerializedSize<Protocol>(OneOfEach());
+  checkSerializedSize<Protocol>(ooe);
+
+  HolyMoley a;
+  a.big.assign(300, ooe);
+  a.contain.insert(std::vector<std::string>(2, "a string"));
+  a.bonks["bonk"].resize(20);
+  a.bonks["empty"];
+  uint32_t size = checkSerializedSize<Protocol>(a);
+
+  // bool fields and lists, strings and containers either side of the
+  // lengths where their headers grow, negative field ids and field id gaps
+  CompactProtoTestStruct compact;
+  compact.a_byte = -1;
+  compact.a_i64 = (std::numeric_limits<int64_t>::min)();
+  compact.a_string = std::string(127, 's');
+  compact.a_binary = std::string(128, '\0');
+  compact.true_field = true;
+  compact.boolean_list.assign(14, true);
+  compact.struct_list.resize(15);
+  for (int8_t i = 0; i < 16; i++) {
+    compact.byte_set.insert(i);
+    compact.byte_string_map[i] = "";
+  }
+  compact.byte_list_map[1].push_back(1);
+  checkSerializedSize<Protocol>(compact);
+  TupleProtocolTestStruct tuple;
+  tuple.__set_field1(-1);
+  tuple.__set_field12(1 << 30);
+  checkSerializedSize<Protocol>(tuple);
+  checkSerializedSize<Protocol>(BigFieldIdStruct());
+
+  // lazy fields are sized from their bytes until they are decoded
+  LazyHolder lazy;
+  lazy.payload = ooe;
+  lazy.__set_note(a.bonks["bonk"][0]);
+  shared_ptr<TMemoryBuffer> buffer = writeBuffer<Protocol>(lazy);
+  Protocol prot(buffer);
+  lazy.read(&prot);
+  BOOST_CHECK(lazy.payload.isRaw());
+  checkSerializedSize<Protocol>(lazy);
+
+  // writing reserved grows the buffer once, to just the size of the struct
+  shared_ptr<TMemoryBuffer> reserved(new TMemoryBuffer());
+  Protocol reservedProt(reserved);
+  BOOST_CHECK_EQUAL(writeReserved(reservedProt, a), size);
+  BOOST_CHECK_EQUAL(reserved->available_write(), 0u);
+  BOOST_CHECK_EQUAL(reserved->getBufferAsString(), writeBuffer<Protocol>(a)->getBufferAsString());
+}
+
+BOOST_AUTO_TEST_CASE(test_serialized_size) {
+  testSerializedSize<TBinaryProtocol>();
+  testSerializedSize<TLEBinaryProtocol>();
+  testSerializedSize<TCompactProtocol>();
+
+  // protocols that cannot size are written as usual
+  thrift::test::debug::OneOfEach ooe;
+  shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+  TJSONProtocol json(buffer);
+  BOOST_CHECK_THROW(ooe.serializedSize(&json), TProtocolException);
+  uint32_t size = writeReserved(json, ooe);
+  BOOST_CHECK_EQUAL(size, buffer->available_read());
+}
@@ -21,6 +21,7 @@
 #define _THRIFT_TEST_GENERICPROTOCOLTEST_TCC_ 1
 
 #include <limits>
+#include <vector>
 
 #include <thrift/protocol/TBinaryProtocol.h>
 #include <thrift/transport/TBufferTransports.h>
@@ -125,6 +126,68 @@ void testMessage() {
   }
 }
 
+template <typename TProto, typename Val>
+void testArray(uint32_t bufferSize) {
+  // A mix of one byte, mid sized and full width values, so that runs of
+  // each are split across chunks and across the transport buffer
+  std::vector<Val> values;
+  for (int i = 0; i < 300; i++) {
+    Val val = static_cast<Val>(i % 7 == 0 ? 63 - i : i % 3);
+    if (i % 11 == 0) {
+      val = static_cast<Val>((std::numeric_limits<Val>::max)() - i);
+    } else if (i % 13 == 0) {
+      val = (std::numeric_limits<Val>::min)();
+    } else if (i > 100 && i < 150) {
+      val = static_cast<Val>(-(i << 9));
+    }
+    values.push_back(val);
+  }
+
+  shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+  shared_ptr<TTransport> transport = buffer;
+  if (bufferSize > 0) {
+    transport.reset(new TBufferedTransport(buffer, bufferSize, bufferSize));
+  }
+  shared_ptr<TProtocol> protocol(new TProto(transport));
+
+  for (size_t i = 0; i < values.size(); i++) {
+    GenericIO::write(protocol, values[i]);
+  }
+  protocol->writeByte(42);
+  transport->flush();
+
+  std::vector<Val> out(values.size());
+  GenericIO::readArray(protocol, &out[0], static_cast<uint32_t>(out.size()));
+  int8_t marker;
+  protocol->readByte(marker);
+  if (out != values || marker != 42) {
+    THRIFT_SNPRINTF(errorMessage,
+                    ERR_LEN,
+                    "Invalid array test (type: %s, buffer: %u)",
+                    ClassNames::getName<Val>(),
+                    bufferSize);
+    throw TException(errorMessage);
+  }
+
+  // and the other way round
+  GenericIO::writeArray(protocol, &values[0], static_cast<uint32_t>(values.size()));
+  protocol->writeByte(42);
+  transport->flush();
+
+  for (size_t i = 0; i < out.size(); i++) {
+    GenericIO::read(protocol, out[i]);
+  }
+  protocol->readByte(marker);
+  if (out != values || marker != 42) {
+    THRIFT_SNPRINTF(errorMessage,
+                    ERR_LEN,
+                    "Invalid array write test (type: %s, buffer: %u)",
+                    ClassNames::getName<Val>(),
+                    bufferSize);
+    throw TException(errorMessage);
+  }
+}
+
 template <typename TProto>
 void testProtocol(const char* protoname) {
   try {
@@ -200,6 +263,13 @@ void testProtocol(const char* protoname) {
       testField<TProto, T_I64, int64_t>(-(1L << i));
     }
 
+    testArray<TProto, int32_t>(0);
+    testArray<TProto, int32_t>(7);
+    testArray<TProto, int64_t>(0);
+    testArray<TProto, int64_t>(13);
+    testArray<TProto, double>(0);
+    testArray<TProto, double>(13);
+
     testNaked<TProto, double>(123.456);
 
     testNaked<TProto, std::string>("");
@@ -0,0 +1,165 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+/*
+ * Reads DebugProtoTest structs generated with the cpp:arena option, once
+ * allocating from the heap and once from a TArena.  Both make the same
+ * allocations, so the count taken from the arena holds for the heap too.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include <iostream>
+#include <sstream>
+#include "thrift/TArena.h"
+#include "thrift/transport/TBufferTransports.h"
+#include "thrift/protocol/TBinaryProtocol.h"
+#include "arena/gen-cpp/DebugProtoTest_types.h"
+
+#ifdef HAVE_SYS_TIME_H
+#include <sys/time.h>
+#endif
+
+namespace thrift {
+namespace test {
+namespace debug {
+
+bool Empty::operator<(Empty const& other) const {
+  (void)other;
+  // It is empty, so all are equal.
+  return false;
+}
+}
+}
+}
+
+class Timer {
+public:
+  timeval vStart;
+
+  Timer() { THRIFT_GETTIMEOFDAY(&vStart, 0); }
+  void start() { THRIFT_GETTIMEOFDAY(&vStart, 0); }
+
+  double frame() {
+    timeval vEnd;
+    THRIFT_GETTIMEOFDAY(&vEnd, 0);
+    double dstart = vStart.tv_sec + ((double)vStart.tv_usec / 1000000.0);
+    double dend = vEnd.tv_sec + ((double)vEnd.tv_usec / 1000000.0);
+    return dend - dstart;
+  }
+};
+
+static std::string text(const char* prefix, int i) {
+  std::ostringstream out;
+  out << prefix << " number " << i << ", long enough to need an allocation";
+  return out.str();
+}
+
+int main() {
+  using namespace std;
+  using namespace thrift::test::debug;
+  using namespace apache::thrift;
+  using namespace apache::thrift::transport;
+  using namespace apache::thrift::protocol;
+
+  HolyMoley hm;
+  for (int i = 0; i < 100; i++) {
+    OneOfEach ooe;
+    ooe.integer32 = i;
+    ooe.some_characters = text("characters", i).c_str();
+    ooe.zomg_unicode = text("\xd7\n\a\t", i).c_str();
+    ooe.base64 = text("\1\2\3\255", i).c_str();
+    hm.big.push_back(ooe);
+  }
+  for (int i = 0; i < 20; i++) {
+    std::vector<TArenaString, TArenaAllocator<TArenaString> > strings;
+    for (int j = 0; j < 5; j++) {
+      strings.push_back(text("contained", i * 5 + j).c_str());
+    }
+    hm.contain.insert(strings);
+
+    std::vector<Bonk, TArenaAllocator<Bonk> >& bonks = hm.bonks[text("bonks", i).c_str()];
+    for (int j = 0; j < 10; j++) {
+      Bonk bonk;
+      bonk.type = j;
+      bonk.message = text("message", j).c_str();
+      bonks.push_back(bonk);
+    }
+  }
+
+  boost::shared_ptr<TMemoryBuffer> buf(new TMemoryBuffer());
+  TBinaryProtocolT<TMemoryBuffer> prot(buf);
+  hm.write(&prot);
+
+  uint8_t* data = NULL;
+  uint32_t datasize = 0;
+  buf->getBuffer(&data, &datasize);
+
+  boost::shared_ptr<TMemoryBuffer> buf2(new TMemoryBuffer(data, datasize));
+  TBinaryProtocolT<TMemoryBuffer> prot2(buf2);
+  int num = 2000;
+
+  {
+    Timer timer;
+
+    for (int i = 0; i < num; i++) {
+      buf2->resetBuffer(data, datasize);
+      HolyMoley hm2;
+      hm2.read(&prot2);
+      if (i == 0 && !(hm2 == hm)) {
+        cerr << "Heap read does not match" << endl;
+        return 1;
+      }
+    }
+
+    double elapsed = timer.frame();
+    cout << " Heap read: " << num / (1000 * elapsed) << " kHz" << endl;
+  }
+
+  {
+    TArena arena;
+    uint64_t allocations = 0;
+    size_t reserved = 0;
+    Timer timer;
+
+    for (int i = 0; i < num; i++) {
+      buf2->resetBuffer(data, datasize);
+      {
+        TArena::Scope scope(arena);
+        HolyMoley hm2;
+        hm2.read(&prot2);
+        if (i == 0 && !(hm2 == hm)) {
+          cerr << "Arena read does not match" << endl;
+          return 1;
+        }
+      }
+      allocations = arena.getAllocationCount();
+      reserved = arena.getBytesReserved();
+      // one release frees the whole object graph
+      arena.release();
+    }
+
+    double elapsed = timer.frame();
+    cout << "Arena read: " << num / (1000 * elapsed) << " kHz, " << allocations
+         << " allocations per read in " << reserved / 1024 << " KB of blocks" << endl;
+  }
+
+  return 0;
+}
@@ -25,6 +25,7 @@
 #include <math.h>
 #include "thrift/transport/TBufferTransports.h"
 #include "thrift/protocol/TBinaryProtocol.h"
+#include "thrift/protocol/TCompactProtocol.h"
 #include "gen-cpp/DebugProtoTest_types.h"
 
 #ifdef HAVE_SYS_TIME_H
@@ -47,6 +48,57 @@ public:
   }
 };
 
+/**
+ * Reads count compact i64s one at a time and as a single array, to compare
+ * the two on one distribution of values.
+ */
+void benchmarkVarints(const char* name, const std::vector<int64_t>& values) {
+  using namespace std;
+  using namespace apache::thrift::transport;
+  using namespace apache::thrift::protocol;
+
+  boost::shared_ptr<TMemoryBuffer> buf(new TMemoryBuffer(values.size() * 10));
+  {
+    TCompactProtocolT<TMemoryBuffer> prot(buf);
+    for (size_t i = 0; i < values.size(); i++) {
+      prot.writeI64(values[i]);
+    }
+  }
+
+  uint8_t* data = NULL;
+  uint32_t datasize = 0;
+  buf->getBuffer(&data, &datasize);
+
+  uint32_t num = static_cast<uint32_t>(values.size());
+  std::vector<int64_t> out(values.size());
+
+  {
+    boost::shared_ptr<TMemoryBuffer> buf2(new TMemoryBuffer(data, datasize));
+    TCompactProtocolT<TMemoryBuffer> prot(buf2);
+    Timer timer;
+
+    for (uint32_t i = 0; i < num; i++) {
+      prot.readI64(out[i]);
+    }
+    double elapsed = timer.frame();
+    cout << " Varint read " << name << ": " << num / (1000 * elapsed) << " kHz" << endl;
+  }
+
+  {
+    boost::shared_ptr<TMemoryBuffer> buf2(new TMemoryBuffer(data, datasize));
+    TCompactProtocolT<TMemoryBuffer> prot(buf2);
+    Timer timer;
+
+    prot.readI64Array(&out[0], num);
+    double elapsed = timer.frame();
+    cout << " Varint array read " << name << ": " << num / (1000 * elapsed) << " kHz" << endl;
+  }
+
+  if (out != values) {
+    cout << " Varint array read " << name << " returned the wrong values" << endl;
+  }
+}
+
 int main() {
   using namespace std;
   using namespace thrift::test::debug;
@@ -101,6 +153,27 @@ int main() {
     cout << " Read big endian: " << num / (1000 * elapsed) << " kHz" << endl;
   }
 
+  {
+    boost::shared_ptr<TMemoryBuffer> buf2(new TMemoryBuffer(data, datasize));
+    TBinaryProtocolT<TMemoryBuffer> prot(buf2);
+    double elapsed = 0.0;
+    Timer timer;
+
+    for (int i = 0; i < num; i++) {
+      apache::thrift::protocol::skip(prot, T_STRUCT);
+    }
+    elapsed = timer.frame();
+    cout << " Generic skip big endian: " << num / (1000 * elapsed) << " kHz" << endl;
+
+    buf2->resetBuffer(data, datasize);
+    timer.start();
+    for (int i = 0; i < num; i++) {
+      prot.skip(T_STRUCT);
+    }
+    elapsed = timer.frame();
+    cout << " Skip big endian: " << num / (1000 * elapsed) << " kHz" << endl;
+  }
+
   {
     buf->resetBuffer();
     TBinaryProtocolT<TMemoryBuffer, TNetworkLittleEndian> prot(buf);
@@ -238,6 +311,28 @@ int main() {
     cout << " Double read big endian: " << num / (1000 * elapsed) << " kHz" << endl;
   }
 
+  num = 1000000;
+  {
+    std::vector<int64_t> small, medium, large, negative, mixed;
+    uint64_t state = 88172645463325252ULL;
+    for (int x = 0; x < num; ++x) {
+      // xorshift, so every run sees the same values
+      state ^= state << 13;
+      state ^= state >> 7;
+      state ^= state << 17;
+      small.push_back(static_cast<int64_t>(state % 64));
+      medium.push_back(static_cast<int64_t>(state % 1000000));
+      large.push_back(static_cast<int64_t>(state));
+      negative.push_back(-static_cast<int64_t>(state % 100000));
+      mixed.push_back(x % 4 == 0 ? static_cast<int64_t>(state) : static_cast<int64_t>(state % 100));
+    }
+
+    benchmarkVarints("small", small);
+    benchmarkVarints("medium", medium);
+    benchmarkVarints("large", large);
+    benchmarkVarints("negative", negative);
+    benchmarkVarints("mixed", mixed);
+  }
 
   return 0;
 }
@@ -0,0 +1,202 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+/*
+ * Looks up the ThriftTest method names with the switch the generated
+ * processor uses, and with the std::map processors used to keep, then
+ * dispatches whole calls through ThriftTestProcessor, directly and through
+ * a TMultiplexedProcessor with 50 services.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "thrift/processor/TMultiplexedProcessor.h"
+#include "thrift/transport/TBufferTransports.h"
+#include "thrift/protocol/TBinaryProtocol.h"
+#include "gen-cpp/ThriftTest.h"
+
+#ifdef HAVE_SYS_TIME_H
+#include <sys/time.h>
+#endif
+
+class Timer {
+public:
+  timeval vStart;
+
+  Timer() { THRIFT_GETTIMEOFDAY(&vStart, 0); }
+  void start() { THRIFT_GETTIMEOFDAY(&vStart, 0); }
+
+  double frame() {
+    timeval vEnd;
+    THRIFT_GETTIMEOFDAY(&vEnd, 0);
+    double dstart = vStart.tv_sec + ((double)vStart.tv_usec / 1000000.0);
+    double dend = vEnd.tv_sec + ((double)vEnd.tv_usec / 1000000.0);
+    return dend - dstart;
+  }
+};
+
+static const char* const METHODS[] = {"testVoid",
+                                      "testString",
+                                      "testBool",
+                                      "testByte",
+                                      "testI32",
+                                      "testI64",
+                                      "testDouble",
+                                      "testBinary",
+                                      "testStruct",
+                                      "testNest",
+                                      "testMap",
+                                      "testStringMap",
+                                      "testSet",
+                                      "testList",
+                                      "testEnum",
+                                      "testTypedef",
+                                      "testMapMap",
+                                      "testInsanity",
+                                      "testMulti",
+                                      "testException",
+                                      "testMultiException",
+                                      "testOneway"};
+
+static const int METHOD_COUNT = sizeof(METHODS) / sizeof(METHODS[0]);
+
+static const int SERVICE_COUNT = 50;
+
+/**
+ * Writes a testVoid call to buffer, naming the method name.
+ */
+static void writeCall(boost::shared_ptr<apache::thrift::transport::TMemoryBuffer> buffer,
+                      const std::string& name) {
+  using namespace apache::thrift::protocol;
+
+  TBinaryProtocol prot(buffer);
+  prot.writeMessageBegin(name, T_CALL, 1);
+  thrift::test::ThriftTest_testVoid_pargs args;
+  args.write(&prot);
+  prot.writeMessageEnd();
+}
+
+int main() {
+  using namespace std;
+  using namespace apache::thrift::protocol;
+  using namespace apache::thrift::transport;
+  using thrift::test::ThriftTestProcessor;
+
+  // the names a server is sent, with a few it does not know
+  vector<string> names(METHODS, METHODS + METHOD_COUNT);
+  names.push_back("testVoidd");
+  names.push_back("TestVoid");
+  names.push_back("");
+
+  map<string, int32_t> processMap;
+  for (int32_t i = 0; i < METHOD_COUNT; i++) {
+    processMap[METHODS[i]] = i;
+  }
+
+  const int num = 200000;
+  int64_t mapSum = 0;
+  Timer timer;
+  for (int i = 0; i < num; i++) {
+    for (size_t j = 0; j < names.size(); j++) {
+      map<string, int32_t>::const_iterator it = processMap.find(names[j]);
+      mapSum += it == processMap.end() ? -1 : it->second;
+    }
+  }
+  double elapsed = timer.frame();
+  cout << "  Map lookup: " << num * names.size() / (1000 * elapsed) << " kHz" << endl;
+
+  int64_t switchSum = 0;
+  timer.start();
+  for (int i = 0; i < num; i++) {
+    for (size_t j = 0; j < names.size(); j++) {
+      switchSum += ThriftTestProcessor::findMethod(names[j]);
+    }
+  }
+  elapsed = timer.frame();
+  cout << "Switch lookup: " << num * names.size() / (1000 * elapsed) << " kHz" << endl;
+
+  if (mapSum != switchSum) {
+    cerr << "Switch lookup does not match the map" << endl;
+    return 1;
+  }
+
+  // a whole testVoid call, read, handled and answered
+  boost::shared_ptr<TMemoryBuffer> request(new TMemoryBuffer());
+  writeCall(request, "testVoid");
+
+  uint8_t* data = NULL;
+  uint32_t datasize = 0;
+  request->getBuffer(&data, &datasize);
+  boost::shared_ptr<TMemoryBuffer> in(new TMemoryBuffer(data, datasize));
+  boost::shared_ptr<TMemoryBuffer> out(new TMemoryBuffer());
+  boost::shared_ptr<TProtocol> inProt(new TBinaryProtocol(in));
+  boost::shared_ptr<TProtocol> outProt(new TBinaryProtocol(out));
+  boost::shared_ptr<thrift::test::ThriftTestIf> handler(new thrift::test::ThriftTestNull());
+  ThriftTestProcessor processor(handler);
+
+  const int calls = 200000;
+  timer.start();
+  for (int i = 0; i < calls; i++) {
+    in->resetBuffer(data, datasize);
+    out->resetBuffer();
+    processor.process(inProt, outProt, NULL);
+  }
+  elapsed = timer.frame();
+  cout << "Dispatch testVoid: " << calls / (1000 * elapsed) << " kHz" << endl;
+
+  // the same call to each of the services behind a TMultiplexedProcessor
+  apache::thrift::TMultiplexedProcessor multiplexed;
+  vector<boost::shared_ptr<TMemoryBuffer> > requests;
+  for (int i = 0; i < SERVICE_COUNT; i++) {
+    ostringstream service;
+    service << "ThriftTest" << i;
+    multiplexed.registerProcessor(service.str(),
+                                  boost::shared_ptr<ThriftTestProcessor>(
+                                      new ThriftTestProcessor(handler)));
+    requests.push_back(boost::shared_ptr<TMemoryBuffer>(new TMemoryBuffer()));
+    writeCall(requests.back(), service.str() + ":testVoid");
+  }
+
+  timer.start();
+  for (int i = 0; i < calls; i++) {
+    requests[i % SERVICE_COUNT]->getBuffer(&data, &datasize);
+    in->resetBuffer(data, datasize);
+    out->resetBuffer();
+    multiplexed.process(inProt, outProt, NULL);
+  }
+  elapsed = timer.frame();
+  cout << "Multiplexed testVoid: " << calls / (1000 * elapsed) << " kHz" << endl;
+
+  std::string name;
+  TMessageType type;
+  int32_t seqid;
+  outProt->readMessageBegin(name, type, seqid);
+  if (name != "testVoid" || type != T_REPLY) {
+    cerr << "Multiplexed call got no testVoid reply" << endl;
+    return 1;
+  }
+
+  return 0;
+}
@@ -105,6 +105,30 @@ public:
   static uint32_t read(shared_ptr<TProtocol> proto, std::string& val) {
     return proto->readString(val);
   }
+
+  static uint32_t readArray(shared_ptr<TProtocol> proto, int32_t* vals, uint32_t count) {
+    return proto->readI32Array(vals, count);
+  }
+
+  static uint32_t readArray(shared_ptr<TProtocol> proto, int64_t* vals, uint32_t count) {
+    return proto->readI64Array(vals, count);
+  }
+
+  static uint32_t readArray(shared_ptr<TProtocol> proto, double* vals, uint32_t count) {
+    return proto->readDoubleArray(vals, count);
+  }
+
+  static uint32_t writeArray(shared_ptr<TProtocol> proto, const int32_t* vals, uint32_t count) {
+    return proto->writeI32Array(vals, count);
+  }
+
+  static uint32_t writeArray(shared_ptr<TProtocol> proto, const int64_t* vals, uint32_t count) {
+    return proto->writeI64Array(vals, count);
+  }
+
+  static uint32_t writeArray(shared_ptr<TProtocol> proto, const double* vals, uint32_t count) {
+    return proto->writeDoubleArray(vals, count);
+  }
 };
 
 #endif
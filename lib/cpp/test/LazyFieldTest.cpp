@@ -0,0 +1,167 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <thrift/protocol/TBinaryProtocol.h>
+#include <thrift/protocol/TCompactProtocol.h>
+#include <thrift/protocol/TJSONProtocol.h>
+#include <thrift/transport/TBufferTransports.h>
+#include "gen-cpp/DebugProtoTest_types.h"
+
+#define BOOST_TEST_MODULE LazyFieldTest
+#include <boost/test/unit_test.hpp>
+
+using namespace thrift::test::debug;
+using namespace apache::thrift::protocol;
+using namespace apache::thrift::transport;
+using boost::shared_ptr;
+
+LazyHolder makeHolder() {
+  LazyHolder a;
+  a.id = 7;
+  a.payload = OneOfEach();
+  a.payload.getMutable().some_characters = "lazy";
+  a.payload.getMutable().i16_list.push_back(4);
+  a.tail = "after";
+  return a;
+}
+
+template <typename Protocol>
+void testLazyFields() {
+  LazyHolder a = makeHolder();
+  shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+  Protocol prot(buffer);
+  a.write(&prot);
+  std::string written = buffer->getBufferAsString();
+
+  // the payload is read as bytes, and decoded when first used
+  LazyHolder b;
+  b.read(&prot);
+  BOOST_CHECK(b.payload.isRaw());
+  BOOST_CHECK_EQUAL(b.tail, "after");
+  BOOST_CHECK(!b.__isset.note);
+  BOOST_CHECK_EQUAL(b.payload->some_characters, "lazy");
+  BOOST_CHECK(a == b);
+
+  // reading does not stop the bytes being written back as they were
+  b.write(&prot);
+  BOOST_CHECK_EQUAL(buffer->getBufferAsString(), written);
+
+  // copies keep the bytes, and decode them on their own
+  LazyHolder c;
+  c.read(&prot);
+  LazyHolder copy(c);
+  BOOST_CHECK(copy.payload.isRaw());
+  BOOST_CHECK(a == copy);
+  BOOST_CHECK(c.payload.isRaw());
+
+  // values the transport cannot lend whole are decoded as they are read
+  shared_ptr<TMemoryBuffer> other(
+      new TMemoryBuffer((uint8_t*)written.data(), static_cast<uint32_t>(written.size())));
+  shared_ptr<TBufferedTransport> buffered(new TBufferedTransport(other, 16));
+  Protocol small(buffered);
+  LazyHolder e;
+  e.read(&small);
+  BOOST_CHECK(!e.payload.isRaw());
+  BOOST_CHECK(a == e);
+
+  // changing the payload does
+  b.payload.getMutable().some_characters = "changed";
+  BOOST_CHECK(!b.payload.isRaw());
+  b.write(&prot);
+  LazyHolder d;
+  d.read(&prot);
+  BOOST_CHECK_EQUAL(d.payload->some_characters, "changed");
+}
+
+BOOST_AUTO_TEST_CASE(test_lazy_binary) {
+  testLazyFields<TBinaryProtocol>();
+}
+
+BOOST_AUTO_TEST_CASE(test_lazy_little_binary) {
+  testLazyFields<TLEBinaryProtocol>();
+}
+
+BOOST_AUTO_TEST_CASE(test_lazy_compact) {
+  testLazyFields<TCompactProtocol>();
+}
+
+/*
+ * Raw bytes are only copied out to protocols that encode values the same
+ * way, and anything else encodes the decoded value.
+ */
+template <typename From, typename To>
+void testRawFormat() {
+  LazyHolder a = makeHolder();
+  a.__set_note(Bonk());
+  a.note.getMutable().message = "note";
+  shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+  From from(buffer);
+  a.write(&from);
+  LazyHolder b;
+  b.read(&from);
+  BOOST_CHECK(b.payload.isRaw());
+  BOOST_CHECK(b.note.isRaw());
+
+  To to(buffer);
+  BOOST_CHECK_EQUAL(b.serializedSize(&to), b.write(&to));
+  LazyHolder c;
+  c.read(&to);
+  BOOST_CHECK(a == c);
+  BOOST_CHECK_EQUAL(c.note->message, "note");
+}
+
+BOOST_AUTO_TEST_CASE(test_lazy_raw_format) {
+  testRawFormat<TBinaryProtocol, TCompactProtocol>();
+  testRawFormat<TCompactProtocol, TBinaryProtocol>();
+  testRawFormat<TBinaryProtocol, TLEBinaryProtocol>();
+  testRawFormat<TLEBinaryProtocol, TBinaryProtocol>();
+}
+
+BOOST_AUTO_TEST_CASE(test_lazy_json) {
+  // protocols without a raw format read and write the decoded value
+  LazyHolder a = makeHolder();
+  shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+  TJSONProtocol json(buffer);
+  a.write(&json);
+  LazyHolder b;
+  b.read(&json);
+  BOOST_CHECK(!b.payload.isRaw());
+  BOOST_CHECK(a == b);
+}
+
+BOOST_AUTO_TEST_CASE(test_lazy_mistyped) {
+  // a lazy field of the wrong type is skipped rather than kept
+  shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+  TBinaryProtocol prot(buffer);
+  prot.writeStructBegin("LazyHolder");
+  prot.writeFieldBegin("payload", T_I32, 2);
+  prot.writeI32(2);
+  prot.writeFieldEnd();
+  prot.writeFieldBegin("tail", T_STRING, 4);
+  prot.writeString(std::string("after"));
+  prot.writeFieldEnd();
+  prot.writeFieldStop();
+  prot.writeStructEnd();
+
+  LazyHolder a;
+  a.read(&prot);
+  BOOST_CHECK(!a.__isset.payload);
+  BOOST_CHECK(!a.payload.isRaw());
+  BOOST_CHECK_EQUAL(a.tail, "after");
+}
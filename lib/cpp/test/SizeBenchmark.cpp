@@ -0,0 +1,165 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+/*
+ * Writes HolyMoleys of 1KB to 10MB into fresh TMemoryBuffers, as they are
+ * written today and after reserving their serializedSize(), counting how
+ * often the buffer is reallocated and how many bytes that copies.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include <iostream>
+#include <string>
+#include "thrift/transport/TBufferTransports.h"
+#include "thrift/protocol/TBinaryProtocol.h"
+#include "thrift/protocol/TCompactProtocol.h"
+#include "gen-cpp/DebugProtoTest_types.h"
+
+#ifdef HAVE_SYS_TIME_H
+#include <sys/time.h>
+#endif
+
+class Timer {
+public:
+  timeval vStart;
+
+  Timer() { THRIFT_GETTIMEOFDAY(&vStart, 0); }
+  void start() { THRIFT_GETTIMEOFDAY(&vStart, 0); }
+
+  double frame() {
+    timeval vEnd;
+    THRIFT_GETTIMEOFDAY(&vEnd, 0);
+    double dstart = vStart.tv_sec + ((double)vStart.tv_usec / 1000000.0);
+    double dend = vEnd.tv_sec + ((double)vEnd.tv_usec / 1000000.0);
+    return dend - dstart;
+  }
+};
+
+/**
+ * Writes to a TMemoryBuffer, counting the times its buffer grows and the
+ * bytes it held each time, which growing copies.
+ */
+class CountingTransport
+    : public apache::thrift::transport::TVirtualTransport<CountingTransport> {
+public:
+  CountingTransport() { reset(); }
+
+  void write(const uint8_t* buf, uint32_t len) {
+    buffer_->write(buf, len);
+    count();
+  }
+
+  void reserveWrite(uint32_t len) {
+    buffer_->reserveWrite(len);
+    count();
+  }
+
+  void reset() {
+    buffer_.reset(new apache::thrift::transport::TMemoryBuffer());
+    capacity_ = buffer_->available_write();
+    reallocs = 0;
+    copied = 0;
+  }
+
+  int reallocs;
+  uint64_t copied;
+
+private:
+  void count() {
+    uint32_t capacity = buffer_->available_write() + buffer_->available_read();
+    if (capacity != capacity_) {
+      reallocs++;
+      copied += buffer_->available_read();
+      capacity_ = capacity;
+    }
+  }
+
+  boost::shared_ptr<apache::thrift::transport::TMemoryBuffer> buffer_;
+  uint32_t capacity_;
+};
+
+template <typename Protocol, typename Transport>
+void write(Transport transport, const thrift::test::debug::HolyMoley& value, bool reserve) {
+  Protocol prot(transport);
+  if (reserve) {
+    apache::thrift::protocol::writeReserved(prot, value);
+  } else {
+    value.write(&prot);
+  }
+}
+
+template <typename Protocol>
+void benchmark(const std::string& name, const thrift::test::debug::HolyMoley& value, int num) {
+  using namespace std;
+  using apache::thrift::transport::TMemoryBuffer;
+
+  boost::shared_ptr<CountingTransport> counting(new CountingTransport());
+  boost::shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+  Protocol prot(buffer);
+  uint32_t size = value.serializedSize(&prot);
+
+  double elapsed[2];
+  int reallocs[2];
+  uint64_t copied[2];
+  for (int reserve = 0; reserve < 2; reserve++) {
+    counting->reset();
+    write<Protocol>(counting, value, reserve != 0);
+    reallocs[reserve] = counting->reallocs;
+    copied[reserve] = counting->copied;
+
+    Timer timer;
+    for (int i = 0; i < num; i++) {
+      buffer->resetBuffer(TMemoryBuffer::defaultSize);
+      write<Protocol>(buffer, value, reserve != 0);
+    }
+    elapsed[reserve] = timer.frame();
+  }
+
+  cout << name << " " << size << " bytes: " << reallocs[0] << " -> " << reallocs[1]
+       << " reallocs, " << copied[0] << " -> " << copied[1] << " bytes copied, "
+       << (double)size * num / (1024 * 1024 * elapsed[0]) << " -> "
+       << (double)size * num / (1024 * 1024 * elapsed[1]) << " MB/s" << endl;
+}
+
+int main() {
+  thrift::test::debug::OneOfEach ooe;
+  ooe.im_true = true;
+  ooe.integer32 = 1 << 20;
+  ooe.some_characters = std::string(64, 'x');
+  ooe.i16_list.push_back(1);
+  ooe.i64_list.push_back(1);
+
+  boost::shared_ptr<apache::thrift::transport::TMemoryBuffer> buffer(
+      new apache::thrift::transport::TMemoryBuffer());
+  apache::thrift::protocol::TBinaryProtocol prot(buffer);
+  uint32_t elementSize = ooe.serializedSize(&prot);
+
+  // each size is written 64MB worth of times
+  const uint32_t sizes[] = {1024, 16 * 1024, 256 * 1024, 1024 * 1024, 10 * 1024 * 1024};
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    thrift::test::debug::HolyMoley value;
+    value.big.assign(sizes[i] / elementSize + 1, ooe);
+    int num = (64 * 1024 * 1024) / sizes[i] + 1;
+    benchmark<apache::thrift::protocol::TBinaryProtocol>("Binary", value, num);
+    benchmark<apache::thrift::protocol::TCompactProtocol>("Compact", value, num);
+  }
+  return 0;
+}
@@ -0,0 +1,182 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+/*
+ * Writes and reads DebugProtoTest and ThriftTest structs with the binary and
+ * compact protocols.  Built as StructBenchmark from the usual generated code,
+ * and as TableBenchmark from code generated with the cpp:tables option, so
+ * the two can be compared.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include <iostream>
+#include <sstream>
+#include "thrift/transport/TBufferTransports.h"
+#include "thrift/protocol/TBinaryProtocol.h"
+#include "thrift/protocol/TCompactProtocol.h"
+#ifdef STRUCT_BENCHMARK_TABLES
+#include "thrift/protocol/TDebugProtocol.h"
+#include "tables/gen-cpp/DebugProtoTest_types.h"
+#include "tables/gen-cpp/ThriftTest_types.h"
+#else
+#include "gen-cpp/DebugProtoTest_types.h"
+#include "gen-cpp/ThriftTest_types.h"
+#endif
+
+#ifdef HAVE_SYS_TIME_H
+#include <sys/time.h>
+#endif
+
+#ifdef STRUCT_BENCHMARK_TABLES
+// the extras the usual test library has for its own copy of the types
+namespace thrift {
+namespace test {
+namespace debug {
+
+bool Empty::operator<(Empty const& other) const {
+  (void)other;
+  // It is empty, so all are equal.
+  return false;
+}
+}
+
+bool Insanity::operator<(thrift::test::Insanity const& other) const {
+  using apache::thrift::ThriftDebugString;
+  return ThriftDebugString(*this) < ThriftDebugString(other);
+}
+}
+}
+#endif
+
+class Timer {
+public:
+  timeval vStart;
+
+  Timer() { THRIFT_GETTIMEOFDAY(&vStart, 0); }
+  void start() { THRIFT_GETTIMEOFDAY(&vStart, 0); }
+
+  double frame() {
+    timeval vEnd;
+    THRIFT_GETTIMEOFDAY(&vEnd, 0);
+    double dstart = vStart.tv_sec + ((double)vStart.tv_usec / 1000000.0);
+    double dend = vEnd.tv_sec + ((double)vEnd.tv_usec / 1000000.0);
+    return dend - dstart;
+  }
+};
+
+static std::string text(const char* prefix, int i) {
+  std::ostringstream out;
+  out << prefix << " number " << i;
+  return out.str();
+}
+
+/**
+ * Writes value num times, then reads it back num times.
+ *
+ * @return false if what is read does not match what was written.
+ */
+template <class Protocol_, class Struct_>
+bool benchmark(const char* name, const Struct_& value, int num) {
+  using namespace std;
+  using namespace apache::thrift::transport;
+
+  boost::shared_ptr<TMemoryBuffer> buf(new TMemoryBuffer());
+  Protocol_ prot(buf);
+  double elapsed = 0.0;
+  Timer timer;
+
+  for (int i = 0; i < num; i++) {
+    buf->resetBuffer();
+    value.write(&prot);
+  }
+  elapsed = timer.frame();
+  cout << "Write " << name << ": " << num / (1000 * elapsed) << " kHz" << endl;
+
+  uint8_t* data = NULL;
+  uint32_t datasize = 0;
+  buf->getBuffer(&data, &datasize);
+  boost::shared_ptr<TMemoryBuffer> buf2(new TMemoryBuffer(data, datasize));
+  Protocol_ prot2(buf2);
+  Struct_ read;
+  timer.start();
+
+  for (int i = 0; i < num; i++) {
+    buf2->resetBuffer(data, datasize);
+    read.read(&prot2);
+  }
+  elapsed = timer.frame();
+  cout << " Read " << name << ": " << num / (1000 * elapsed) << " kHz" << endl;
+
+  if (!(read == value)) {
+    cerr << " Read " << name << " does not match" << endl;
+    return false;
+  }
+  return true;
+}
+
+int main() {
+  using namespace apache::thrift::protocol;
+  using namespace apache::thrift::transport;
+
+  thrift::test::debug::HolyMoley hm;
+  for (int i = 0; i < 100; i++) {
+    thrift::test::debug::OneOfEach ooe;
+    ooe.im_true = true;
+    ooe.integer32 = i;
+    ooe.double_precision = i / 3.0;
+    ooe.some_characters = text("characters", i);
+    ooe.base64 = text("\1\2\3\255", i);
+    hm.big.push_back(ooe);
+  }
+  for (int i = 0; i < 20; i++) {
+    std::vector<std::string> strings;
+    for (int j = 0; j < 5; j++) {
+      strings.push_back(text("contained", i * 5 + j));
+    }
+    hm.contain.insert(strings);
+
+    std::vector<thrift::test::debug::Bonk>& bonks = hm.bonks[text("bonks", i)];
+    for (int j = 0; j < 10; j++) {
+      thrift::test::debug::Bonk bonk;
+      bonk.type = j;
+      bonk.message = text("message", j);
+      bonks.push_back(bonk);
+    }
+  }
+
+  thrift::test::Insanity insanity;
+  for (int i = 0; i < 5; i++) {
+    insanity.userMap[static_cast<thrift::test::Numberz::type>(i + 1)] = i * 1000;
+    thrift::test::Xtruct xtruct;
+    xtruct.string_thing = text("thing", i);
+    xtruct.byte_thing = static_cast<int8_t>(i);
+    xtruct.i32_thing = i * 100000;
+    xtruct.i64_thing = static_cast<int64_t>(i) << 40;
+    insanity.xtructs.push_back(xtruct);
+  }
+
+  bool ok = true;
+  ok = benchmark<TBinaryProtocolT<TMemoryBuffer> >("binary HolyMoley", hm, 2000) && ok;
+  ok = benchmark<TCompactProtocolT<TMemoryBuffer> >("compact HolyMoley", hm, 2000) && ok;
+  ok = benchmark<TBinaryProtocolT<TMemoryBuffer> >("binary Insanity", insanity, 200000) && ok;
+  ok = benchmark<TCompactProtocolT<TMemoryBuffer> >("compact Insanity", insanity, 200000) && ok;
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,254 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <string>
+#include <thrift/protocol/TBinaryProtocol.h>
+#include <thrift/protocol/TCompactProtocol.h>
+#include <thrift/transport/TBufferTransports.h>
+#include "tables/gen-cpp/StructTableTest_types.h"
+
+#define BOOST_TEST_MODULE StructTableTest
+#include <boost/test/unit_test.hpp>
+
+using namespace thrift::test::tables;
+using namespace apache::thrift;
+using namespace apache::thrift::transport;
+using namespace apache::thrift::protocol;
+
+/*
+ * Fields is read and written from its table, ExpandedFields by the code
+ * generated for each of its fields; they must not be told apart on the wire
+ * or in their __isset flags.
+ */
+
+template <typename Struct, typename InnerStruct>
+void fill(Struct& s) {
+  InnerStruct inner;
+  inner.value = 5;
+  inner.__set_name("five");
+  s.id = 42;
+  s.__set_label("label");
+  s.__set_count(-(1LL << 40));
+  s.inners.push_back(inner);
+  inner.value = -6;
+  inner.__isset.name = false;
+  s.inners.push_back(inner);
+  s.__isset.inners = true;
+  s.counts["one"] = 1;
+  s.counts["two"] = 2;
+  s.__isset.counts = true;
+  s.tags.insert(3);
+  s.tags.insert(-3);
+  s.__isset.tags = true;
+  s.__set_color(Color::GREEN);
+  s.__set_data(std::string("\0\1\2\3", 4));
+  s.__set_ratio(0.25);
+  s.__set_flag(true);
+  s.__set_small(-1);
+  s.__set_extra(inner);
+}
+
+template <typename Protocol, typename Struct>
+std::string serialize(const Struct& s) {
+  boost::shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+  Protocol prot(buffer);
+  uint32_t xfer = s.write(&prot);
+  std::string bytes = buffer->getBufferAsString();
+  BOOST_CHECK_EQUAL(xfer, bytes.size());
+  BOOST_CHECK_EQUAL(s.serializedSize(&prot), bytes.size());
+  return bytes;
+}
+
+template <typename Protocol, typename Struct>
+void deserialize(const std::string& bytes, Struct& s) {
+  boost::shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+  buffer->write(reinterpret_cast<const uint8_t*>(bytes.data()),
+                static_cast<uint32_t>(bytes.size()));
+  Protocol prot(buffer);
+  BOOST_CHECK_EQUAL(s.read(&prot), bytes.size());
+}
+
+void checkIsset(const Fields& table, const ExpandedFields& expanded) {
+  BOOST_CHECK_EQUAL(table.__isset.label, expanded.__isset.label);
+  BOOST_CHECK_EQUAL(table.__isset.count, expanded.__isset.count);
+  BOOST_CHECK_EQUAL(table.__isset.inners, expanded.__isset.inners);
+  BOOST_CHECK_EQUAL(table.__isset.counts, expanded.__isset.counts);
+  BOOST_CHECK_EQUAL(table.__isset.tags, expanded.__isset.tags);
+  BOOST_CHECK_EQUAL(table.__isset.color, expanded.__isset.color);
+  BOOST_CHECK_EQUAL(table.__isset.data, expanded.__isset.data);
+  BOOST_CHECK_EQUAL(table.__isset.ratio, expanded.__isset.ratio);
+  BOOST_CHECK_EQUAL(table.__isset.flag, expanded.__isset.flag);
+  BOOST_CHECK_EQUAL(table.__isset.small, expanded.__isset.small);
+  BOOST_CHECK_EQUAL(table.__isset.extra, expanded.__isset.extra);
+  BOOST_REQUIRE_EQUAL(table.inners.size(), expanded.inners.size());
+  for (size_t i = 0; i < table.inners.size(); i++) {
+    BOOST_CHECK_EQUAL(table.inners[i].__isset.value, expanded.inners[i].__isset.value);
+    BOOST_CHECK_EQUAL(table.inners[i].__isset.name, expanded.inners[i].__isset.name);
+  }
+  BOOST_CHECK_EQUAL(table.extra.__isset.value, expanded.extra.__isset.value);
+  BOOST_CHECK_EQUAL(table.extra.__isset.name, expanded.extra.__isset.name);
+}
+
+/*
+ * Reads bytes into both structs, checks they agree, and returns what the
+ * table wrote back.
+ */
+template <typename Protocol>
+std::string readBoth(const std::string& bytes, Fields& table, ExpandedFields& expanded) {
+  deserialize<Protocol>(bytes, table);
+  deserialize<Protocol>(bytes, expanded);
+  checkIsset(table, expanded);
+  std::string written = serialize<Protocol>(table);
+  BOOST_CHECK(written == serialize<Protocol>(expanded));
+  return written;
+}
+
+template <typename Protocol>
+void testMatchesExpanded() {
+  Fields table;
+  ExpandedFields expanded;
+  BOOST_CHECK(serialize<Protocol>(table) == serialize<Protocol>(expanded));
+
+  fill<Fields, Inner>(table);
+  fill<ExpandedFields, ExpandedInner>(expanded);
+  std::string bytes = serialize<Protocol>(table);
+  BOOST_CHECK(bytes == serialize<Protocol>(expanded));
+
+  Fields tableRead;
+  ExpandedFields expandedRead;
+  BOOST_CHECK(readBoth<Protocol>(bytes, tableRead, expandedRead) == bytes);
+  BOOST_CHECK(tableRead == table);
+}
+
+BOOST_AUTO_TEST_CASE(test_binary_matches_expanded) {
+  testMatchesExpanded<TBinaryProtocol>();
+}
+
+BOOST_AUTO_TEST_CASE(test_compact_matches_expanded) {
+  testMatchesExpanded<TCompactProtocol>();
+}
+
+template <typename Protocol>
+void testMissingRequired() {
+  boost::shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+  Protocol prot(buffer);
+  prot.writeStructBegin("Fields");
+  prot.writeFieldBegin("label", T_STRING, 2);
+  prot.writeString(std::string("no id"));
+  prot.writeFieldEnd();
+  prot.writeFieldStop();
+  prot.writeStructEnd();
+  std::string bytes = buffer->getBufferAsString();
+
+  Fields table;
+  ExpandedFields expanded;
+  BOOST_CHECK_THROW(deserialize<Protocol>(bytes, table), TProtocolException);
+  BOOST_CHECK_THROW(deserialize<Protocol>(bytes, expanded), TProtocolException);
+  BOOST_CHECK_EQUAL(table.label, "no id");
+  BOOST_CHECK_EQUAL(expanded.label, "no id");
+  checkIsset(table, expanded);
+}
+
+BOOST_AUTO_TEST_CASE(test_missing_required) {
+  testMissingRequired<TBinaryProtocol>();
+  testMissingRequired<TCompactProtocol>();
+}
+
+template <typename Protocol>
+void testSkipsUnknownAndMistyped() {
+  boost::shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+  Protocol prot(buffer);
+  prot.writeStructBegin("Fields");
+  prot.writeFieldBegin("id", T_I32, 1);
+  prot.writeI32(7);
+  prot.writeFieldEnd();
+
+  // an unknown field of nested containers
+  prot.writeFieldBegin("unknown", T_LIST, 50);
+  prot.writeListBegin(T_MAP, 2);
+  for (int i = 0; i < 2; i++) {
+    prot.writeMapBegin(T_STRING, T_SET, 1);
+    prot.writeString(std::string("key"));
+    prot.writeSetBegin(T_DOUBLE, 2);
+    prot.writeDouble(1.5);
+    prot.writeDouble(2.5);
+    prot.writeSetEnd();
+    prot.writeMapEnd();
+  }
+  prot.writeListEnd();
+  prot.writeFieldEnd();
+
+  // count is an i64, not a string
+  prot.writeFieldBegin("count", T_STRING, 3);
+  prot.writeString(std::string("not a count"));
+  prot.writeFieldEnd();
+
+  // tags is a set, not a list
+  prot.writeFieldBegin("tags", T_LIST, 6);
+  prot.writeListBegin(T_I16, 1);
+  prot.writeI16(9);
+  prot.writeListEnd();
+  prot.writeFieldEnd();
+
+  // the unknown and mistyped fields of a nested struct are skipped too
+  prot.writeFieldBegin("extra", T_STRUCT, 12);
+  prot.writeStructBegin("Inner");
+  prot.writeFieldBegin("unknown", T_STRUCT, 3);
+  prot.writeStructBegin("Unknown");
+  prot.writeFieldBegin("value", T_I64, 1);
+  prot.writeI64(1);
+  prot.writeFieldEnd();
+  prot.writeFieldStop();
+  prot.writeStructEnd();
+  prot.writeFieldEnd();
+  prot.writeFieldBegin("name", T_I32, 2);
+  prot.writeI32(2);
+  prot.writeFieldEnd();
+  prot.writeFieldBegin("value", T_I32, 1);
+  prot.writeI32(11);
+  prot.writeFieldEnd();
+  prot.writeFieldStop();
+  prot.writeStructEnd();
+  prot.writeFieldEnd();
+
+  prot.writeFieldBegin("flag", T_BOOL, 10);
+  prot.writeBool(true);
+  prot.writeFieldEnd();
+  prot.writeFieldStop();
+  prot.writeStructEnd();
+
+  Fields table;
+  ExpandedFields expanded;
+  readBoth<Protocol>(buffer->getBufferAsString(), table, expanded);
+  BOOST_CHECK_EQUAL(table.id, 7);
+  BOOST_CHECK(!table.__isset.count);
+  BOOST_CHECK(!table.__isset.tags);
+  BOOST_CHECK(table.tags.empty());
+  BOOST_CHECK(table.__isset.extra);
+  BOOST_CHECK(table.extra.__isset.value);
+  BOOST_CHECK(!table.extra.__isset.name);
+  BOOST_CHECK_EQUAL(table.extra.value, 11);
+  BOOST_CHECK(table.__isset.flag);
+  BOOST_CHECK(table.flag);
+}
+
+BOOST_AUTO_TEST_CASE(test_skips_unknown_and_mistyped) {
+  testSkipsUnknownAndMistyped<TBinaryProtocol>();
+  testSkipsUnknownAndMistyped<TCompactProtocol>();
+}
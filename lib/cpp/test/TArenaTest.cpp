@@ -0,0 +1,161 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <map>
+#include <vector>
+
+#include <boost/functional/hash.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/test/auto_unit_test.hpp>
+#include <boost/unordered_map.hpp>
+
+#include <thrift/TArena.h>
+#include <thrift/TToString.h>
+#include <thrift/protocol/TArenaProtocol.h>
+#include <thrift/protocol/TBinaryProtocol.h>
+#include <thrift/transport/TBufferTransports.h>
+
+using apache::thrift::TArena;
+using apache::thrift::TArenaAllocator;
+using apache::thrift::TArenaString;
+
+BOOST_AUTO_TEST_SUITE(TArenaTest)
+
+BOOST_AUTO_TEST_CASE(test_allocate) {
+  TArena arena(4096);
+  char* a = static_cast<char*>(arena.allocate(1));
+  char* b = static_cast<char*>(arena.allocate(24));
+  BOOST_CHECK_EQUAL(reinterpret_cast<uintptr_t>(a) % 16, 0u);
+  BOOST_CHECK_EQUAL(reinterpret_cast<uintptr_t>(b) % 16, 0u);
+  BOOST_CHECK_EQUAL(b - a, 16);
+  BOOST_CHECK_EQUAL(arena.getBytesReserved(), 4096u);
+
+  // large allocations get blocks of their own
+  arena.allocate(100000);
+  BOOST_CHECK_EQUAL(arena.getBytesReserved(), 4096u + 100000u);
+  BOOST_CHECK_EQUAL(static_cast<char*>(arena.allocate(1)) - b, 32);
+  BOOST_CHECK_EQUAL(arena.getAllocationCount(), 4u);
+
+  // a block is kept and reused
+  arena.release();
+  BOOST_CHECK_EQUAL(arena.getAllocationCount(), 0u);
+  BOOST_CHECK_EQUAL(arena.getBytesReserved(), 4096u);
+  BOOST_CHECK(arena.allocate(1) == a);
+}
+
+BOOST_AUTO_TEST_CASE(test_scope) {
+  TArena outer;
+  TArena inner;
+  BOOST_CHECK(TArena::current() == NULL);
+  {
+    TArena::Scope outerScope(outer);
+    BOOST_CHECK(TArena::current() == &outer);
+    {
+      TArena::Scope innerScope(inner);
+      BOOST_CHECK(TArena::current() == &inner);
+    }
+    BOOST_CHECK(TArena::current() == &outer);
+  }
+  BOOST_CHECK(TArena::current() == NULL);
+}
+
+BOOST_AUTO_TEST_CASE(test_containers) {
+  std::vector<int, TArenaAllocator<int> > heap;
+  BOOST_CHECK(heap.get_allocator().getArena() == NULL);
+  heap.push_back(1);
+
+  TArena arena;
+  {
+    TArena::Scope scope(arena);
+    std::map<TArenaString,
+             std::vector<int, TArenaAllocator<int> >,
+             std::less<TArenaString>,
+             TArenaAllocator<std::pair<const TArenaString, std::vector<int, TArenaAllocator<int> > > > >
+        m;
+    m["a string too long to be stored inline"].push_back(1);
+    m["a string too long to be stored inline"].push_back(2);
+    BOOST_CHECK(m.get_allocator().getArena() == &arena);
+    BOOST_CHECK(m.begin()->second.get_allocator().getArena() == &arena);
+    BOOST_CHECK(arena.getAllocationCount() >= 3u);
+    BOOST_CHECK_EQUAL(apache::thrift::to_string(m),
+                      "{a string too long to be stored inline: [1, 2]}");
+
+    // memory is only given back when the arena is released
+    uint64_t count = arena.getAllocationCount();
+    m.clear();
+    BOOST_CHECK_EQUAL(arena.getAllocationCount(), count);
+  }
+  arena.release();
+}
+
+BOOST_AUTO_TEST_CASE(test_copies) {
+  typedef std::vector<TArenaString, TArenaAllocator<TArenaString> > List;
+  typedef std::map<TArenaString, List, std::less<TArenaString>,
+                   TArenaAllocator<std::pair<const TArenaString, List> > > Map;
+  typedef boost::unordered_map<TArenaString, List, boost::hash<TArenaString>,
+                               std::equal_to<TArenaString>,
+                               TArenaAllocator<std::pair<const TArenaString, List> > > UnorderedMap;
+
+  TArena arena;
+  Map* inArena;
+  UnorderedMap* unorderedInArena;
+  {
+    TArena::Scope scope(arena);
+    inArena = new Map;
+    (*inArena)["a string too long to be stored inline"].push_back(
+        "another string too long to be stored inline");
+    unorderedInArena = new UnorderedMap(inArena->begin(), inArena->end());
+  }
+
+  // copies taken outside a scope go to the heap, elements included
+  Map m;
+  m = *inArena;
+  UnorderedMap u;
+  apache::thrift::arenaAssign(u, *unorderedInArena);
+  delete inArena;
+  delete unorderedInArena;
+  arena.release();
+
+  BOOST_CHECK(m.begin()->first.get_allocator().getArena() == NULL);
+  BOOST_CHECK(m.begin()->second.get_allocator().getArena() == NULL);
+  BOOST_CHECK(m.begin()->second[0].get_allocator().getArena() == NULL);
+  BOOST_CHECK(u.begin()->first.get_allocator().getArena() == NULL);
+  BOOST_CHECK(u.begin()->second.get_allocator().getArena() == NULL);
+  BOOST_CHECK(u.begin()->second[0].get_allocator().getArena() == NULL);
+  BOOST_CHECK(u.begin()->second[0] == "another string too long to be stored inline");
+}
+
+BOOST_AUTO_TEST_CASE(test_protocol_helpers) {
+  using apache::thrift::protocol::TBinaryProtocol;
+  using apache::thrift::transport::TMemoryBuffer;
+
+  boost::shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+  TBinaryProtocol protocol(buffer);
+
+  TArena arena;
+  TArena::Scope scope(arena);
+  TArenaString written("a string too long to be stored inline");
+  TArenaString read;
+  uint32_t size = apache::thrift::protocol::writeArenaString(protocol, written);
+  BOOST_CHECK_EQUAL(apache::thrift::protocol::readArenaString(protocol, read), size);
+  BOOST_CHECK(read == written);
+  BOOST_CHECK(read.get_allocator().getArena() == &arena);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,475 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <thrift/concurrency/Monitor.h>
+#include <thrift/concurrency/PlatformThreadFactory.h>
+#include <thrift/concurrency/ThreadAffinity.h>
+#include <thrift/concurrency/Util.h>
+#include <thrift/protocol/TBinaryProtocol.h>
+#include <thrift/server/TNonblockingServer.h>
+#include <thrift/server/TNotificationQueue.h>
+#include <thrift/transport/TBufferTransports.h>
+#include <thrift/transport/TSocket.h>
+
+#include "gen-cpp/ParentService.h"
+
+#include <boost/make_shared.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <event.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace apache::thrift;
+using namespace apache::thrift::concurrency;
+using namespace apache::thrift::protocol;
+using namespace apache::thrift::server;
+using namespace apache::thrift::transport;
+
+struct Handler : public test::ParentServiceIf {
+  int32_t incrementGeneration() { return 0; }
+  int32_t getGeneration() { return 0; }
+  void addString(const std::string&) {}
+  void getStrings(std::vector<std::string>&) {}
+  void getDataWait(std::string&, const int32_t) {}
+  void onewayWait() {}
+  void exceptionWait(const std::string&) {}
+  void unexpectedExceptionWait(const std::string&) {}
+};
+
+class ServerRunner : public Runnable {
+public:
+  ServerRunner(boost::shared_ptr<TNonblockingServer> server) : server_(server) {}
+
+  void run() { server_->serve(); }
+
+private:
+  boost::shared_ptr<TNonblockingServer> server_;
+};
+
+/**
+ * Opens a fresh connection for every call, so the server spends its time
+ * accepting and placing connections rather than processing requests.
+ */
+class AcceptClient : public Runnable {
+public:
+  AcceptClient(int port, size_t connections, Monitor& monitor, size_t& running)
+    : port_(port), connections_(connections), monitor_(monitor), running_(running) {}
+
+  void run() {
+    for (size_t ix = 0; ix < connections_; ++ix) {
+      boost::shared_ptr<TSocket> socket(new TSocket("127.0.0.1", port_));
+      socket->open();
+      test::ParentServiceClient client(
+          boost::make_shared<TBinaryProtocol>(boost::make_shared<TFramedTransport>(socket)));
+      client.getGeneration();
+      socket->close();
+    }
+
+    Synchronized s(monitor_);
+    if (--running_ == 0) {
+      monitor_.notify();
+    }
+  }
+
+private:
+  int port_;
+  size_t connections_;
+  Monitor& monitor_;
+  size_t& running_;
+};
+
+/**
+ * Makes calls calls over one connection and records the latency of each,
+ * so the server spends its time reading requests and writing responses.
+ */
+class RequestClient : public Runnable {
+public:
+  RequestClient(int port, size_t calls, Monitor& monitor, size_t& running)
+    : port_(port), calls_(calls), monitor_(monitor), running_(running) {}
+
+  void run() {
+    boost::shared_ptr<TSocket> socket(new TSocket("127.0.0.1", port_));
+    socket->setNoDelay(true);
+    socket->open();
+    test::ParentServiceClient client(
+        boost::make_shared<TBinaryProtocol>(boost::make_shared<TFramedTransport>(socket)));
+    latencies_.reserve(calls_);
+    for (size_t ix = 0; ix < calls_; ++ix) {
+      int64_t start = Util::currentTimeUsec();
+      client.getGeneration();
+      latencies_.push_back(Util::currentTimeUsec() - start);
+    }
+    socket->close();
+
+    Synchronized s(monitor_);
+    if (--running_ == 0) {
+      monitor_.notify();
+    }
+  }
+
+  const std::vector<int64_t>& getLatencies() const { return latencies_; }
+
+private:
+  int port_;
+  size_t calls_;
+  Monitor& monitor_;
+  size_t& running_;
+  std::vector<int64_t> latencies_;
+};
+
+static void quietOutput(const char*) {}
+
+static boost::shared_ptr<TNonblockingServer> newServer(size_t ioThreads,
+                                                       const ThreadAffinity& ioAffinity,
+                                                       bool reusePort,
+                                                       TIOEngine engine) {
+  boost::shared_ptr<TProcessor> processor(
+      new test::ParentServiceProcessor(boost::make_shared<Handler>()));
+  boost::shared_ptr<TNonblockingServer> server(new TNonblockingServer(processor, 0));
+  server->setNumIOThreads(ioThreads);
+  server->setIOThreadAffinity(ioAffinity);
+  server->setUseReusePortListeners(reusePort);
+  server->setIOEngine(engine);
+  return server;
+}
+
+/**
+ * Runs clientCount clients that each connect connections times against
+ * a server with the given configuration, and returns connections per second.
+ */
+static double benchmarkAccept(size_t ioThreads,
+                              const ThreadAffinity& ioAffinity,
+                              bool reusePort,
+                              TIOEngine engine,
+                              size_t clientCount,
+                              size_t connections) {
+  PlatformThreadFactory threadFactory;
+  threadFactory.setDetached(false);
+
+  boost::shared_ptr<TNonblockingServer> server = newServer(ioThreads, ioAffinity, reusePort, engine);
+  server->createAndListenOnSocket();
+  int port = server->getListenPort();
+  boost::shared_ptr<Thread> serverThread
+      = threadFactory.newThread(boost::make_shared<ServerRunner>(server));
+  serverThread->start();
+  // wait for the server to begin serving
+  THRIFT_SLEEP_USEC(100000);
+
+  Monitor monitor;
+  size_t running = clientCount;
+  std::vector<boost::shared_ptr<Thread> > clients;
+  for (size_t ix = 0; ix < clientCount; ++ix) {
+    clients.push_back(threadFactory.newThread(boost::shared_ptr<Runnable>(
+        new AcceptClient(port, connections, monitor, running))));
+  }
+
+  int64_t start = Util::currentTime();
+  for (size_t ix = 0; ix < clients.size(); ++ix) {
+    clients[ix]->start();
+  }
+  {
+    Synchronized s(monitor);
+    while (running > 0) {
+      monitor.wait();
+    }
+  }
+  int64_t elapsed = Util::currentTime() - start;
+
+  for (size_t ix = 0; ix < clients.size(); ++ix) {
+    clients[ix]->join();
+  }
+  server->stop();
+  serverThread->join();
+
+  return (double)(clientCount * connections) * 1000.0 / (double)(elapsed > 0 ? elapsed : 1);
+}
+
+/**
+ * Runs clientCount clients that each make calls calls over a connection of
+ * their own against a server using the given IO engine, and returns calls
+ * per second.  The median and 99th percentile latency in microseconds are
+ * returned through p50 and p99.
+ */
+static double benchmarkRequests(size_t ioThreads,
+                                const ThreadAffinity& ioAffinity,
+                                TIOEngine engine,
+                                size_t clientCount,
+                                size_t calls,
+                                int64_t& p50,
+                                int64_t& p99) {
+  PlatformThreadFactory threadFactory;
+  threadFactory.setDetached(false);
+
+  boost::shared_ptr<TNonblockingServer> server = newServer(ioThreads, ioAffinity, false, engine);
+  server->createAndListenOnSocket();
+  int port = server->getListenPort();
+  boost::shared_ptr<Thread> serverThread
+      = threadFactory.newThread(boost::make_shared<ServerRunner>(server));
+  serverThread->start();
+  // wait for the server to begin serving
+  THRIFT_SLEEP_USEC(100000);
+
+  Monitor monitor;
+  size_t running = clientCount;
+  std::vector<boost::shared_ptr<RequestClient> > clients;
+  std::vector<boost::shared_ptr<Thread> > clientThreads;
+  for (size_t ix = 0; ix < clientCount; ++ix) {
+    clients.push_back(
+        boost::shared_ptr<RequestClient>(new RequestClient(port, calls, monitor, running)));
+    clientThreads.push_back(threadFactory.newThread(clients.back()));
+  }
+
+  int64_t start = Util::currentTime();
+  for (size_t ix = 0; ix < clientThreads.size(); ++ix) {
+    clientThreads[ix]->start();
+  }
+  {
+    Synchronized s(monitor);
+    while (running > 0) {
+      monitor.wait();
+    }
+  }
+  int64_t elapsed = Util::currentTime() - start;
+
+  std::vector<int64_t> latencies;
+  for (size_t ix = 0; ix < clientThreads.size(); ++ix) {
+    clientThreads[ix]->join();
+    latencies.insert(latencies.end(),
+                     clients[ix]->getLatencies().begin(),
+                     clients[ix]->getLatencies().end());
+  }
+  server->stop();
+  serverThread->join();
+
+  std::sort(latencies.begin(), latencies.end());
+  p50 = latencies.empty() ? 0 : latencies[latencies.size() / 2];
+  p99 = latencies.empty() ? 0 : latencies[latencies.size() * 99 / 100];
+  return (double)(clientCount * calls) * 1000.0 / (double)(elapsed > 0 ? elapsed : 1);
+}
+
+/**
+ * Stands in for a worker thread: pushes completions onto an IO thread's
+ * notification queue as fast as it can.
+ */
+class CompletionProducer : public Runnable {
+public:
+  CompletionProducer(TNotificationQueue& queue, size_t completions)
+    : queue_(queue), completions_(completions) {}
+
+  void run() {
+    for (size_t ix = 0; ix < completions_; ++ix) {
+      queue_.push(this);
+    }
+  }
+
+private:
+  TNotificationQueue& queue_;
+  size_t completions_;
+};
+
+struct CompletionConsumer {
+  TNotificationQueue* queue;
+  event_base* base;
+  size_t remaining;
+  size_t wakeups;
+};
+
+static void completionHandler(evutil_socket_t, short, void* v) {
+  CompletionConsumer* consumer = (CompletionConsumer*)v;
+  ++consumer->wakeups;
+  consumer->queue->clearSignal();
+  void* item;
+  while (consumer->queue->pop(item)) {
+    if (--consumer->remaining == 0) {
+      event_base_loopbreak(consumer->base);
+    }
+  }
+}
+
+/**
+ * Pushes workers x completions items through a notification queue drained
+ * by a libevent loop, the way TNonblockingIOThread does, and returns
+ * completions per second.  The workers are placed by workerAffinity.  The
+ * average batch drained per wakeup is returned through batch.
+ */
+static double benchmarkCompletions(size_t workers,
+                                   const ThreadAffinity& workerAffinity,
+                                   size_t completions,
+                                   double& batch) {
+  PlatformThreadFactory threadFactory;
+  threadFactory.setDetached(false);
+  threadFactory.setAffinity(workerAffinity);
+
+  TNotificationQueue queue(4096);
+  queue.open();
+
+  CompletionConsumer consumer;
+  consumer.queue = &queue;
+  consumer.base = event_base_new();
+  consumer.remaining = workers * completions;
+  consumer.wakeups = 0;
+
+  struct event notificationEvent;
+  event_set(&notificationEvent,
+            queue.getRecvFD(),
+            EV_READ | EV_PERSIST,
+            completionHandler,
+            &consumer);
+  event_base_set(consumer.base, &notificationEvent);
+  event_add(&notificationEvent, 0);
+
+  std::vector<boost::shared_ptr<Thread> > producers;
+  for (size_t ix = 0; ix < workers; ++ix) {
+    producers.push_back(threadFactory.newThread(
+        boost::shared_ptr<Runnable>(new CompletionProducer(queue, completions))));
+  }
+
+  int64_t start = Util::currentTime();
+  for (size_t ix = 0; ix < producers.size(); ++ix) {
+    producers[ix]->start();
+  }
+  event_base_loop(consumer.base, 0);
+  int64_t elapsed = Util::currentTime() - start;
+
+  for (size_t ix = 0; ix < producers.size(); ++ix) {
+    producers[ix]->join();
+  }
+  event_del(&notificationEvent);
+  event_base_free(consumer.base);
+
+  batch = (double)(workers * completions) / (double)(consumer.wakeups > 0 ? consumer.wakeups : 1);
+  return (double)(workers * completions) * 1000.0 / (double)(elapsed > 0 ? elapsed : 1);
+}
+
+int main(int argc, char** argv) {
+  size_t ioThreads = 4;
+  size_t clientCount = 8;
+  size_t connections = 1000;
+  size_t calls = 10000;
+  size_t completions = 100000;
+  ThreadAffinity ioAffinity;
+  ThreadAffinity workerAffinity;
+
+  ostringstream usage;
+  usage << argv[0] << " [--io-threads=<count>] [--clients=<count>] [--connections=<count>]"
+        << " [--calls=<count>] [--completions=<count>] [--io-affinity=<cpus>]"
+        << " [--worker-affinity=<cpus>]" << endl
+        << "\tio-threads       Number of server IO threads.  Default is " << ioThreads << endl
+        << "\tclients          Number of client threads.  Default is " << clientCount << endl
+        << "\tconnections      Connections opened by each client.  Default is " << connections
+        << endl
+        << "\tcalls            Calls made by each client over one connection.  Default is "
+        << calls << endl
+        << "\tcompletions      Completions queued by each worker.  Default is " << completions
+        << endl
+        << "\tio-affinity      CPU list such as 0-3,8 to pin IO thread N to the Nth CPU of."
+        << "  Default is none" << endl
+        << "\tworker-affinity  CPU list to pin completion worker N to the Nth CPU of."
+        << "  Default is none" << endl;
+
+  map<string, string> args;
+  for (int ix = 1; ix < argc; ix++) {
+    string arg(argv[ix]);
+    if (arg.compare(0, 2, "--") != 0) {
+      cerr << usage.str();
+      return 1;
+    }
+    size_t end = arg.find_first_of("=", 2);
+    string key = string(arg, 2, end - 2);
+    args[key] = end != string::npos ? string(arg, end + 1) : "true";
+  }
+
+  if (!args["help"].empty()) {
+    cerr << usage.str();
+    return 0;
+  }
+  if (!args["io-threads"].empty()) {
+    ioThreads = atoi(args["io-threads"].c_str());
+  }
+  if (!args["clients"].empty()) {
+    clientCount = atoi(args["clients"].c_str());
+  }
+  if (!args["connections"].empty()) {
+    connections = atoi(args["connections"].c_str());
+  }
+  if (!args["calls"].empty()) {
+    calls = atoi(args["calls"].c_str());
+  }
+  if (!args["completions"].empty()) {
+    completions = atoi(args["completions"].c_str());
+  }
+  if (!args["io-affinity"].empty()) {
+    ioAffinity = ThreadAffinity::roundRobin(ThreadAffinity::parseCpuList(args["io-affinity"]));
+  }
+  if (!args["worker-affinity"].empty()) {
+    workerAffinity
+        = ThreadAffinity::roundRobin(ThreadAffinity::parseCpuList(args["worker-affinity"]));
+  }
+
+  // keep the server's per-thread start/stop messages out of the results
+  GlobalOutput.setOutputFunction(quietOutput);
+
+  cout << "Accept throughput, " << ioThreads << " IO threads, " << clientCount << " clients x "
+       << connections << " connections:" << endl;
+  cout << "  single listener:      "
+       << benchmarkAccept(ioThreads, ioAffinity, false, T_IO_ENGINE_LIBEVENT, clientCount, connections)
+       << " connections/sec" << endl;
+  cout << "  reuse-port listeners: "
+       << benchmarkAccept(ioThreads, ioAffinity, true, T_IO_ENGINE_LIBEVENT, clientCount, connections)
+       << " connections/sec" << endl;
+  if (TIOUring::isSupported()) {
+    cout << "  io_uring:             "
+         << benchmarkAccept(ioThreads, ioAffinity, false, T_IO_ENGINE_IO_URING, clientCount, connections)
+         << " connections/sec" << endl;
+  }
+
+  cout << "Request throughput, " << ioThreads << " IO threads, " << clientCount << " clients x "
+       << calls << " calls:" << endl;
+  const char* engineNames[] = {"libevent", "io_uring"};
+  TIOEngine engines[] = {T_IO_ENGINE_LIBEVENT, T_IO_ENGINE_IO_URING};
+  for (size_t ix = 0; ix < 2; ++ix) {
+    if (engines[ix] == T_IO_ENGINE_IO_URING && !TIOUring::isSupported()) {
+      cout << "  " << engineNames[ix] << ": not supported" << endl;
+      continue;
+    }
+    int64_t p50 = 0, p99 = 0;
+    double rate = benchmarkRequests(ioThreads, ioAffinity, engines[ix], clientCount, calls, p50, p99);
+    cout << "  " << engineNames[ix] << ": " << rate << " calls/sec, p50 " << p50 << " us, p99 "
+         << p99 << " us" << endl;
+  }
+
+  cout << "Completion throughput, " << completions << " completions per worker:" << endl;
+  for (size_t workers = 1; workers <= 64; workers *= 2) {
+    double batch = 0;
+    double rate = benchmarkCompletions(workers, workerAffinity, completions, batch);
+    cout << "  " << workers << " workers: " << rate << " completions/sec, " << batch
+         << " per wakeup" << endl;
+  }
+
+  return 0;
+}
@@ -21,12 +21,18 @@
 #include <boost/test/unit_test.hpp>
 #include <boost/smart_ptr.hpp>
 
+#include "thrift/TApplicationException.h"
 #include "thrift/concurrency/Thread.h"
+#include "thrift/concurrency/ThreadManager.h"
+#include "thrift/concurrency/Util.h"
 #include "thrift/server/TNonblockingServer.h"
+#include "thrift/server/TNotificationQueue.h"
 
 #include "gen-cpp/ParentService.h"
 
 #include <event.h>
+#include <cstdlib>
+#include <map>
 
 using namespace apache::thrift;
 
@@ -38,7 +44,11 @@ struct Handler : public test::ParentServiceIf {
   // dummy overrides not used in this test
   int32_t incrementGeneration() { return 0; }
   int32_t getGeneration() { return 0; }
-  void getDataWait(std::string&, const int32_t) {}
+  // sleeps for length milliseconds, so that pipelined calls finish out of order
+  void getDataWait(std::string& _return, const int32_t length) {
+    THRIFT_SLEEP_USEC(length * 1000);
+    _return.assign(length, 'x');
+  }
   void onewayWait() {}
   void exceptionWait(const std::string&) {}
   void unexpectedExceptionWait(const std::string&) {}
@@ -51,6 +61,7 @@ private:
     boost::shared_ptr<event_base> userEventBase;
     boost::shared_ptr<TProcessor> processor;
     boost::shared_ptr<server::TNonblockingServer> server;
+    apache::thrift::stdcxx::function<void(server::TNonblockingServer*)> configure;
 
     virtual void run() {
       // When binding to explicit port, allow retrying to workaround bind failures on ports in use
@@ -62,6 +73,14 @@ private:
     void startServer(int retry_count) {
       try {
         server.reset(new server::TNonblockingServer(processor, port));
+        // the whole suite runs again with THRIFT_TEST_IO_ENGINE=io_uring
+        const char* engine = getenv("THRIFT_TEST_IO_ENGINE");
+        if (engine && std::string(engine) == "io_uring") {
+          server->setIOEngine(server::T_IO_ENGINE_IO_URING);
+        }
+        if (configure) {
+          configure(server.get());
+        }
         if (userEventBase) {
           server->registerEvents(userEventBase.get());
         }
@@ -97,11 +116,16 @@ protected:
     userEventBase_.reset(user_event_base, EventDeleter());
   }
 
+  void setConfigure(apache::thrift::stdcxx::function<void(server::TNonblockingServer*)> configure) {
+    configure_ = configure;
+  }
+
   int startServer(int port) {
     boost::shared_ptr<Runner> runner(new Runner);
     runner->port = port;
     runner->processor = processor;
     runner->userEventBase = userEventBase_;
+    runner->configure = configure_;
 
     boost::scoped_ptr<apache::thrift::concurrency::ThreadFactory> threadFactory(
         new apache::thrift::concurrency::PlatformThreadFactory(
@@ -131,6 +155,7 @@ protected:
 
 private:
   boost::shared_ptr<event_base> userEventBase_;
+  apache::thrift::stdcxx::function<void(server::TNonblockingServer*)> configure_;
   boost::shared_ptr<test::ParentServiceProcessor> processor;
 protected:
   boost::shared_ptr<server::TNonblockingServer> server;
@@ -175,4 +200,412 @@ BOOST_FIXTURE_TEST_CASE(provide_event_base, Fixture) {
 #endif
 }
 
+static void useReusePortListeners(server::TNonblockingServer* server) {
+  server->setNumIOThreads(4);
+  server->setUseReusePortListeners(true);
+}
+
+BOOST_FIXTURE_TEST_CASE(reuse_port_listeners, Fixture) {
+  setConfigure(useReusePortListeners);
+  startServer(0);
+
+  // connections may land on any of the listeners, so open several
+  BOOST_CHECK(canCommunicate(server->getListenPort()));
+  for (int i = 0; i < 16; ++i) {
+    boost::shared_ptr<transport::TSocket> socket(
+        new transport::TSocket("localhost", server->getListenPort()));
+    socket->open();
+    test::ParentServiceClient client(boost::make_shared<protocol::TBinaryProtocol>(
+        boost::make_shared<transport::TFramedTransport>(socket)));
+    std::vector<std::string> strings;
+    client.getStrings(strings);
+    BOOST_CHECK_EQUAL(strings.size(), 1u);
+  }
+#ifdef SO_REUSEPORT
+  BOOST_CHECK(server->useReusePortListeners());
+#endif
+}
+
+static void useLeastConnectionsPlacement(server::TNonblockingServer* server) {
+  server->setNumIOThreads(4);
+  server->setPlacementPolicy(boost::make_shared<server::TLeastConnectionsPlacementPolicy>());
+}
+
+BOOST_FIXTURE_TEST_CASE(least_connections_placement, Fixture) {
+  setConfigure(useLeastConnectionsPlacement);
+  startServer(0);
+
+  // keep eight connections open; each IO thread should end up with two
+  std::vector<boost::shared_ptr<transport::TSocket> > sockets;
+  for (int i = 0; i < 8; ++i) {
+    boost::shared_ptr<transport::TSocket> socket(
+        new transport::TSocket("localhost", server->getListenPort()));
+    socket->open();
+    test::ParentServiceClient client(boost::make_shared<protocol::TBinaryProtocol>(
+        boost::make_shared<transport::TFramedTransport>(socket)));
+    BOOST_CHECK_EQUAL(client.getGeneration(), 0);
+    sockets.push_back(socket);
+  }
+
+  const std::vector<boost::shared_ptr<server::TNonblockingIOThread> >& ioThreads
+      = server->getIOThreads();
+  BOOST_REQUIRE_EQUAL(ioThreads.size(), 4u);
+  for (size_t i = 0; i < ioThreads.size(); ++i) {
+    BOOST_CHECK_EQUAL(ioThreads[i]->getNumConnections(), 2);
+    BOOST_CHECK_EQUAL(ioThreads[i]->getNumActiveTasks(), 0);
+  }
+
+  // closing connections drops them from the counters
+  for (size_t i = 0; i < sockets.size(); ++i) {
+    sockets[i]->close();
+  }
+  THRIFT_SLEEP_USEC(100000);
+  for (size_t i = 0; i < ioThreads.size(); ++i) {
+    BOOST_CHECK_EQUAL(ioThreads[i]->getNumConnections(), 0);
+    BOOST_CHECK_EQUAL(ioThreads[i]->getNumPendingBytes(), 0);
+  }
+}
+
+static void useTwoChoicesPlacement(server::TNonblockingServer* server) {
+  server->setNumIOThreads(3);
+  server->setPlacementPolicy(boost::make_shared<server::TTwoChoicesPlacementPolicy>());
+}
+
+BOOST_FIXTURE_TEST_CASE(two_choices_placement, Fixture) {
+  setConfigure(useTwoChoicesPlacement);
+  startServer(0);
+
+  BOOST_CHECK(canCommunicate(server->getListenPort()));
+}
+
+static void usePipelining(server::TNonblockingServer* server, bool outOfOrder) {
+  boost::shared_ptr<concurrency::ThreadManager> threadManager
+      = concurrency::ThreadManager::newSimpleThreadManager(4);
+  threadManager->threadFactory(boost::make_shared<concurrency::PlatformThreadFactory>());
+  threadManager->start();
+  server->setThreadManager(threadManager);
+  server->setMaxPipelinedRequests(4);
+  server->setOutOfOrderResponses(outOfOrder);
+}
+
+static void pipelineCalls(int port, std::vector<int32_t>& lengths) {
+  boost::shared_ptr<transport::TSocket> socket(new transport::TSocket("localhost", port));
+  socket->open();
+  test::ParentServiceClient client(boost::make_shared<protocol::TBinaryProtocol>(
+      boost::make_shared<transport::TFramedTransport>(socket)));
+
+  // the slowest call first; a oneway call in between has no response
+  for (int32_t length = 40; length > 0; length -= 10) {
+    client.send_getDataWait(length);
+    if (length == 30) {
+      client.send_onewayWait();
+    }
+  }
+  for (int i = 0; i < 4; ++i) {
+    std::string data;
+    client.recv_getDataWait(data);
+    lengths.push_back(static_cast<int32_t>(data.size()));
+  }
+
+  // the connection keeps working after the burst
+  BOOST_CHECK_EQUAL(client.getGeneration(), 0);
+}
+
+BOOST_FIXTURE_TEST_CASE(pipelined_in_order, Fixture) {
+  setConfigure(apache::thrift::stdcxx::bind(usePipelining,
+                                            apache::thrift::stdcxx::placeholders::_1,
+                                            false));
+  startServer(0);
+
+  std::vector<int32_t> lengths;
+  pipelineCalls(server->getListenPort(), lengths);
+  BOOST_REQUIRE_EQUAL(lengths.size(), 4u);
+  BOOST_CHECK_EQUAL(lengths[0], 40);
+  BOOST_CHECK_EQUAL(lengths[1], 30);
+  BOOST_CHECK_EQUAL(lengths[2], 20);
+  BOOST_CHECK_EQUAL(lengths[3], 10);
+}
+
+BOOST_FIXTURE_TEST_CASE(pipelined_out_of_order, Fixture) {
+  setConfigure(apache::thrift::stdcxx::bind(usePipelining,
+                                            apache::thrift::stdcxx::placeholders::_1,
+                                            true));
+  startServer(0);
+
+  // responses arrive as the calls finish, so the slowest comes last
+  std::vector<int32_t> lengths;
+  pipelineCalls(server->getListenPort(), lengths);
+  BOOST_REQUIRE_EQUAL(lengths.size(), 4u);
+  BOOST_CHECK_EQUAL(lengths[3], 40);
+  BOOST_CHECK_LT(lengths[0], lengths[3]);
+}
+
+static void useBufferPool(server::TNonblockingServer* server, bool pipelined) {
+  if (pipelined) {
+    usePipelining(server, true);
+  }
+  server->setBufferPoolLimit(1024 * 1024);
+}
+
+static void checkBuffersReturned(server::TNonblockingServer* server) {
+  THRIFT_SLEEP_USEC(100000);
+  const server::TBufferPool& pool = server->getIOThreads()[0]->getBufferPool();
+  BOOST_CHECK_EQUAL(pool.getNumBorrowed(), 0);
+  BOOST_CHECK_GT(pool.getNumPooledBytes(), 0);
+}
+
+BOOST_FIXTURE_TEST_CASE(buffer_pool, Fixture) {
+  setConfigure(apache::thrift::stdcxx::bind(useBufferPool,
+                                            apache::thrift::stdcxx::placeholders::_1,
+                                            false));
+  startServer(0);
+
+  boost::shared_ptr<transport::TSocket> socket(
+      new transport::TSocket("localhost", server->getListenPort()));
+  socket->open();
+  test::ParentServiceClient client(boost::make_shared<protocol::TBinaryProtocol>(
+      boost::make_shared<transport::TFramedTransport>(socket)));
+  for (int32_t length = 1; length < 64; length += 8) {
+    std::string data;
+    client.getDataWait(data, length);
+    BOOST_CHECK_EQUAL(data.size(), static_cast<size_t>(length));
+  }
+
+  // after the first calls the buffers come from the pool
+  const server::TBufferPool& pool = server->getIOThreads()[0]->getBufferPool();
+  BOOST_CHECK_GT(pool.getNumHits(), pool.getNumMisses());
+
+  socket->close();
+  checkBuffersReturned(server.get());
+}
+
+BOOST_FIXTURE_TEST_CASE(buffer_pool_pipelined, Fixture) {
+  setConfigure(apache::thrift::stdcxx::bind(useBufferPool,
+                                            apache::thrift::stdcxx::placeholders::_1,
+                                            true));
+  startServer(0);
+
+  std::vector<int32_t> lengths;
+  pipelineCalls(server->getListenPort(), lengths);
+  BOOST_CHECK_EQUAL(lengths.size(), 4u);
+  checkBuffersReturned(server.get());
+}
+
+static void usePipeliningWithSmallFrames(server::TNonblockingServer* server) {
+  useBufferPool(server, true);
+  server->setMaxFrameSize(1024);
+}
+
+BOOST_FIXTURE_TEST_CASE(pipelined_close_while_running, Fixture) {
+  setConfigure(usePipeliningWithSmallFrames);
+  startServer(0);
+
+  // each connection is closed by a frame that is too large while its calls
+  // are running, then again by the input that keeps coming after it
+  std::string junk(4096, 'x');
+  for (int i = 0; i < 4; ++i) {
+    boost::shared_ptr<transport::TSocket> socket(
+        new transport::TSocket("localhost", server->getListenPort()));
+    socket->open();
+    test::ParentServiceClient client(boost::make_shared<protocol::TBinaryProtocol>(
+        boost::make_shared<transport::TFramedTransport>(socket)));
+    // one less than the limit, so that the server reads on
+    for (int j = 0; j < 3; ++j) {
+      client.send_getDataWait(50);
+    }
+    // give the server the time to start the calls
+    THRIFT_SLEEP_USEC(20000);
+    int32_t tooLarge = (int32_t)htonl(0x7fffffff);
+    socket->write(reinterpret_cast<const uint8_t*>(&tooLarge), 4);
+    socket->write(reinterpret_cast<const uint8_t*>(junk.data()),
+                  static_cast<uint32_t>(junk.size()));
+    socket->close();
+  }
+
+  // the calls finish into connections that are waiting for them
+  THRIFT_SLEEP_USEC(500000);
+  const std::vector<boost::shared_ptr<server::TNonblockingIOThread> >& ioThreads
+      = server->getIOThreads();
+  for (size_t i = 0; i < ioThreads.size(); ++i) {
+    BOOST_CHECK_EQUAL(ioThreads[i]->getNumConnections(), 0);
+    BOOST_CHECK_EQUAL(ioThreads[i]->getNumActiveTasks(), 0);
+  }
+  checkBuffersReturned(server.get());
+  BOOST_CHECK(canCommunicate(server->getListenPort()));
+}
+
+static void useQueueDelayOverload(server::TNonblockingServer* server,
+                                  server::TOverloadAction action) {
+  boost::shared_ptr<concurrency::ThreadManager> threadManager
+      = concurrency::ThreadManager::newSimpleThreadManager(1);
+  threadManager->threadFactory(boost::make_shared<concurrency::PlatformThreadFactory>());
+  threadManager->start();
+  server->setThreadManager(threadManager);
+  server->setOverloadAction(action);
+  server->setQueueDelayTarget(1);
+  server->setQueueDelayInterval(10);
+}
+
+// Queues up one 20ms call per connection behind a single worker, and
+// counts the calls that failed with an exception of the given type.
+template <typename Exception>
+static int overloadBurst(int port) {
+  std::vector<boost::shared_ptr<test::ParentServiceClient> > clients;
+  for (int i = 0; i < 16; ++i) {
+    boost::shared_ptr<transport::TSocket> socket(new transport::TSocket("localhost", port));
+    socket->open();
+    clients.push_back(boost::make_shared<test::ParentServiceClient>(
+        boost::make_shared<protocol::TBinaryProtocol>(
+            boost::make_shared<transport::TFramedTransport>(socket))));
+  }
+  for (size_t i = 0; i < clients.size(); ++i) {
+    clients[i]->send_getDataWait(20);
+  }
+  int failed = 0;
+  for (size_t i = 0; i < clients.size(); ++i) {
+    try {
+      std::string data;
+      clients[i]->recv_getDataWait(data);
+      BOOST_CHECK_EQUAL(data.size(), 20u);
+    } catch (const Exception&) {
+      ++failed;
+    }
+  }
+  return failed;
+}
+
+BOOST_FIXTURE_TEST_CASE(queue_delay_reject, Fixture) {
+  setConfigure(apache::thrift::stdcxx::bind(useQueueDelayOverload,
+                                            apache::thrift::stdcxx::placeholders::_1,
+                                            server::T_OVERLOAD_REJECT_ON_QUEUE_DELAY));
+  startServer(0);
+
+  // the first calls get through, the standing queue behind them is shed
+  int rejected = overloadBurst<TApplicationException>(server->getListenPort());
+  BOOST_CHECK_GT(rejected, 0);
+  BOOST_CHECK_LT(rejected, 16);
+  BOOST_CHECK_EQUAL(server->getNumTasksShed(), static_cast<uint64_t>(rejected));
+
+  // once the queue is gone calls succeed again
+  BOOST_CHECK(canCommunicate(server->getListenPort()));
+}
+
+BOOST_FIXTURE_TEST_CASE(queue_delay_close, Fixture) {
+  setConfigure(apache::thrift::stdcxx::bind(useQueueDelayOverload,
+                                            apache::thrift::stdcxx::placeholders::_1,
+                                            server::T_OVERLOAD_CLOSE_ON_QUEUE_DELAY));
+  startServer(0);
+
+  int closed = overloadBurst<transport::TTransportException>(server->getListenPort());
+  BOOST_CHECK_GT(closed, 0);
+  BOOST_CHECK_LT(closed, 16);
+  BOOST_CHECK_EQUAL(server->getNumTasksShed(), static_cast<uint64_t>(closed));
+}
+
+static void useMethodPriorities(server::TNonblockingServer* server) {
+  boost::shared_ptr<concurrency::ThreadManager> threadManager
+      = concurrency::ThreadManager::newPriorityThreadManager(1, 2);
+  threadManager->threadFactory(boost::make_shared<concurrency::PlatformThreadFactory>());
+  threadManager->start();
+  server->setThreadManager(threadManager);
+  server->setDefaultTaskPriority(1);
+  server->setMethodPriority("getStrings", 0);
+}
+
+BOOST_FIXTURE_TEST_CASE(method_priority, Fixture) {
+  setConfigure(useMethodPriorities);
+  startServer(0);
+  BOOST_CHECK_EQUAL(server->getMethodPriority("getStrings"), 0u);
+  BOOST_CHECK_EQUAL(server->getMethodPriority("getDataWait"), 1u);
+
+  // queue up 240ms of bulk calls behind the single worker
+  std::vector<boost::shared_ptr<test::ParentServiceClient> > clients;
+  for (int i = 0; i < 9; ++i) {
+    boost::shared_ptr<transport::TSocket> socket(
+        new transport::TSocket("localhost", server->getListenPort()));
+    socket->open();
+    clients.push_back(boost::make_shared<test::ParentServiceClient>(
+        boost::make_shared<protocol::TBinaryProtocol>(
+            boost::make_shared<transport::TFramedTransport>(socket))));
+  }
+  for (size_t i = 1; i < clients.size(); ++i) {
+    clients[i]->send_getDataWait(30);
+  }
+  THRIFT_SLEEP_USEC(10000);
+
+  // the cheap call only waits for the bulk call already running
+  int64_t start = concurrency::Util::currentTime();
+  std::vector<std::string> strings;
+  clients[0]->getStrings(strings);
+  BOOST_CHECK_LT(concurrency::Util::currentTime() - start, 120);
+
+  for (size_t i = 1; i < clients.size(); ++i) {
+    std::string data;
+    clients[i]->recv_getDataWait(data);
+    BOOST_CHECK_EQUAL(data.size(), 30u);
+  }
+}
+
+struct Producer : public apache::thrift::concurrency::Runnable {
+  Producer(server::TNotificationQueue& queue, size_t count) : queue(queue), count(count) {}
+
+  virtual void run() {
+    for (size_t i = 0; i < count; ++i) {
+      BOOST_REQUIRE(queue.push(this));
+    }
+  }
+
+  server::TNotificationQueue& queue;
+  size_t count;
+};
+
+BOOST_AUTO_TEST_CASE(notification_queue) {
+  // a small queue so that producers regularly find it full
+  server::TNotificationQueue queue(16);
+  BOOST_CHECK_EQUAL(queue.getCapacity(), 16u);
+  BOOST_CHECK(!queue.push(NULL));
+  queue.open();
+  BOOST_REQUIRE(queue.isOpen());
+
+  const size_t kProducers = 4;
+  const size_t kCount = 10000;
+  apache::thrift::concurrency::PlatformThreadFactory threadFactory;
+  threadFactory.setDetached(false);
+  std::vector<boost::shared_ptr<Producer> > producers;
+  std::vector<boost::shared_ptr<apache::thrift::concurrency::Thread> > threads;
+  for (size_t i = 0; i < kProducers; ++i) {
+    producers.push_back(boost::shared_ptr<Producer>(new Producer(queue, kCount)));
+    threads.push_back(threadFactory.newThread(producers.back()));
+    threads.back()->start();
+  }
+
+  // drain the way the IO thread does: wait for the signal, clear it, pop
+  std::map<void*, size_t> received;
+  size_t total = 0;
+  while (total < kProducers * kCount) {
+    fd_set rfds;
+    FD_ZERO(&rfds);
+    FD_SET(queue.getRecvFD(), &rfds);
+    struct timeval timeout = {5, 0};
+    BOOST_REQUIRE_EQUAL(select(queue.getRecvFD() + 1, &rfds, NULL, NULL, &timeout), 1);
+    BOOST_REQUIRE(queue.clearSignal());
+    void* item;
+    while (queue.pop(item)) {
+      ++received[item];
+      ++total;
+    }
+  }
+  for (size_t i = 0; i < threads.size(); ++i) {
+    threads[i]->join();
+  }
+
+  void* item;
+  BOOST_CHECK(!queue.pop(item));
+  for (size_t i = 0; i < producers.size(); ++i) {
+    BOOST_CHECK_EQUAL(received[producers[i].get()], kCount);
+  }
+  queue.close();
+  BOOST_CHECK(!queue.isOpen());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
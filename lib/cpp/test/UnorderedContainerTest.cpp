@@ -0,0 +1,132 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <thrift/TToString.h>
+#include <thrift/protocol/TBinaryProtocol.h>
+#include <thrift/protocol/TCompactProtocol.h>
+#include <thrift/transport/TBufferTransports.h>
+#include "gen-cpp/DebugProtoTest_types.h"
+
+#define BOOST_TEST_MODULE UnorderedContainerTest
+#include <boost/test/unit_test.hpp>
+
+using namespace thrift::test::debug;
+using namespace apache::thrift::protocol;
+using namespace apache::thrift::transport;
+using apache::thrift::to_string;
+using boost::shared_ptr;
+
+template <typename Protocol>
+void testUnorderedContainers() {
+  UnorderedLookups a;
+  for (int i = 0; i < 100; i++) {
+    Bonk bonk;
+    bonk.type = i;
+    bonk.message = "bonk";
+    a.counts[to_string(i)] = i;
+    a.bonks.insert(bonk);
+    a.by_id[i] = bonk;
+  }
+  a.names[SomeEnum::TWO].push_back("two");
+  a.__isset.by_id = true;
+  a.ordered.insert(1);
+
+  shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+  Protocol prot(buffer);
+  a.write(&prot);
+
+  // room for the elements is made before they are read
+  UnorderedLookups b;
+  b.read(&prot);
+  BOOST_CHECK(a == b);
+  BOOST_CHECK_EQUAL(b.counts["42"], 42);
+  BOOST_CHECK(b.bonks.bucket_count() * b.bonks.max_load_factor() >= 100);
+  BOOST_CHECK_EQUAL(b.names[SomeEnum::TWO].front(), "two");
+
+  // equal structs hash the same, so they can be looked up
+  Bonk first = *b.bonks.begin();
+  BOOST_CHECK_EQUAL(hash_value(first), hash_value(a.by_id[first.type]));
+  BOOST_CHECK(b.bonks.count(a.by_id[7]) == 1);
+  BOOST_CHECK(to_string(b.names) == "{2: [two]}");
+
+  // reading again replaces the elements read before
+  UnorderedLookups empty;
+  empty.write(&prot);
+  b.read(&prot);
+  BOOST_CHECK(b.counts.empty());
+  BOOST_CHECK(b.bonks.empty());
+
+  // and empty containers and an unset optional one read back as written
+  empty.write(&prot);
+  UnorderedLookups c;
+  c.read(&prot);
+  BOOST_CHECK(empty == c);
+  BOOST_CHECK(!c.__isset.by_id);
+}
+
+BOOST_AUTO_TEST_CASE(test_unordered_binary) {
+  testUnorderedContainers<TBinaryProtocol>();
+}
+
+BOOST_AUTO_TEST_CASE(test_unordered_compact) {
+  testUnorderedContainers<TCompactProtocol>();
+}
+
+BOOST_AUTO_TEST_CASE(test_unordered_equality) {
+  // equality does not depend on the order elements were added in
+  UnorderedLookups a;
+  UnorderedLookups b;
+  for (int i = 0; i < 50; i++) {
+    a.counts[to_string(i)] = i;
+    b.counts[to_string(49 - i)] = 49 - i;
+  }
+  BOOST_CHECK(a == b);
+  b.counts["0"] = 1;
+  BOOST_CHECK(a != b);
+}
+
+BOOST_AUTO_TEST_CASE(test_unordered_duplicates) {
+  // keys repeated on the wire keep the last value, as ordered maps do
+  shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+  TBinaryProtocol prot(buffer);
+  Bonk bonk;
+  prot.writeStructBegin("UnorderedLookups");
+  prot.writeFieldBegin("counts", T_MAP, 1);
+  prot.writeMapBegin(T_STRING, T_I32, 2);
+  prot.writeString(std::string("key"));
+  prot.writeI32(1);
+  prot.writeString(std::string("key"));
+  prot.writeI32(2);
+  prot.writeMapEnd();
+  prot.writeFieldEnd();
+  prot.writeFieldBegin("bonks", T_SET, 2);
+  prot.writeSetBegin(T_STRUCT, 2);
+  bonk.write(&prot);
+  bonk.write(&prot);
+  prot.writeSetEnd();
+  prot.writeFieldEnd();
+  prot.writeFieldStop();
+  prot.writeStructEnd();
+
+  UnorderedLookups a;
+  a.read(&prot);
+  BOOST_CHECK_EQUAL(a.counts.size(), 1u);
+  BOOST_CHECK_EQUAL(a.counts["key"], 2);
+  BOOST_CHECK_EQUAL(a.bonks.size(), 1u);
+}
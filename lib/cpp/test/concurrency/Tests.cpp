@@ -64,6 +64,10 @@ int main(int argc, char** argv) {
     std::cout << "\t\tThreadFactory monitor timeout test" << std::endl;
 
     assert(threadFactoryTests.monitorTimeoutTest());
+
+    std::cout << "\t\tThreadFactory affinity test" << std::endl;
+
+    assert(threadFactoryTests.affinityTest());
   }
 
   if (runAll || args[0].compare("util") == 0) {
@@ -98,6 +102,28 @@ int main(int argc, char** argv) {
     TimerManagerTests timerManagerTests;
 
     assert(timerManagerTests.test00());
+
+    std::cout << "\t\tTimerManager test01" << std::endl;
+
+    assert(timerManagerTests.test01());
+
+    std::cout << "\t\tTimerManager test02" << std::endl;
+
+    assert(timerManagerTests.test02());
+  }
+
+  // too slow to run with the tests, only run on request
+  if (args[0].compare("timer-manager-benchmark") == 0) {
+
+    std::cout << "TimerManager benchmark tests..." << std::endl;
+
+    size_t count = 1000000;
+
+    std::cout << "\t\tTimerManager churn benchmark: timer count: " << count << std::endl;
+
+    TimerManagerTests timerManagerTests;
+
+    assert(timerManagerTests.churnBenchmark(count));
   }
 
   if (runAll || args[0].compare("thread-manager") == 0) {
@@ -123,6 +149,84 @@ int main(int argc, char** argv) {
                 << " delay: " << delay << std::endl;
 
       assert(threadManagerTests.blockTest(delay, workerCount));
+
+      std::cout << "\t\tThreadManager expire test" << std::endl;
+
+      assert(threadManagerTests.expireTest());
+
+      std::cout << "\t\tThreadManager stats test" << std::endl;
+
+      assert(threadManagerTests.statsTest());
+
+      std::cout << "\t\tThreadManager batch test" << std::endl;
+
+      assert(threadManagerTests.batchTest());
+
+      std::cout << "\t\tThreadManager batch wait test" << std::endl;
+
+      assert(threadManagerTests.batchWaitTest());
+
+      std::cout << "\t\tThreadManager pool size test" << std::endl;
+
+      assert(threadManagerTests.poolSizeTest());
+
+      std::cout << "\t\tThreadManager pool shrink test" << std::endl;
+
+      assert(threadManagerTests.poolShrinkTest());
+    }
+
+    {
+
+      size_t workerCount = 100;
+
+      size_t taskCount = 10000;
+
+      int64_t delay = 10LL;
+
+      std::cout << "\t\tWork stealing ThreadManager load test: worker count: " << workerCount
+                << " task count: " << taskCount << " delay: " << delay << std::endl;
+
+      ThreadManagerTests threadManagerTests(true);
+
+      assert(threadManagerTests.loadTest(taskCount, delay, workerCount));
+
+      std::cout << "\t\tWork stealing ThreadManager block test: worker count: " << workerCount
+                << " delay: " << delay << std::endl;
+
+      assert(threadManagerTests.blockTest(delay, workerCount));
+
+      std::cout << "\t\tWork stealing ThreadManager expire test" << std::endl;
+
+      assert(threadManagerTests.expireTest());
+
+      std::cout << "\t\tWork stealing ThreadManager stats test" << std::endl;
+
+      assert(threadManagerTests.statsTest());
+
+      std::cout << "\t\tWork stealing ThreadManager batch test" << std::endl;
+
+      assert(threadManagerTests.batchTest());
+
+      std::cout << "\t\tWork stealing ThreadManager batch wait test" << std::endl;
+
+      assert(threadManagerTests.batchWaitTest());
+
+      std::cout << "\t\tWork stealing ThreadManager pool size test" << std::endl;
+
+      assert(threadManagerTests.poolSizeTest());
+    }
+
+    {
+
+      std::cout << "\t\tPriority ThreadManager strict priority test" << std::endl;
+
+      ThreadManagerTests threadManagerTests;
+
+      assert(threadManagerTests.priorityTest(false));
+
+      std::cout << "\t\tPriority ThreadManager weighted priority test" << std::endl;
+
+      assert(threadManagerTests.priorityTest(true));
     }
   }
 
@@ -150,6 +254,13 @@ int main(int argc, char** argv) {
         ThreadManagerTests threadManagerTests;
 
         threadManagerTests.loadTest(taskCount, delay, workerCount);
+
+        std::cout << "\t\tWork stealing ThreadManager load test: worker count: " << workerCount
+                  << " task count: " << taskCount << " delay: " << delay << std::endl;
+
+        ThreadManagerTests workStealingTests(true);
+
+        workStealingTests.loadTest(taskCount, delay, workerCount);
       }
     }
   }
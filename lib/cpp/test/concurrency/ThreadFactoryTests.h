@@ -20,12 +20,15 @@
 #include <thrift/thrift-config.h>
 #include <thrift/concurrency/Thread.h>
 #include <thrift/concurrency/PlatformThreadFactory.h>
+#include <thrift/concurrency/ThreadAffinity.h>
 #include <thrift/concurrency/Monitor.h>
 #include <thrift/concurrency/Util.h>
 
 #include <assert.h>
+#include <algorithm>
 #include <iostream>
 #include <set>
+#include <vector>
 
 namespace apache {
 namespace thrift {
@@ -339,6 +342,97 @@ public:
 
     return success;
   }
+
+  class AffinityTask : public Runnable {
+
+  public:
+    AffinityTask(Monitor& monitor, size_t& count, std::vector<int>& cpus)
+      : _monitor(monitor), _count(count), _cpus(cpus) {}
+
+    void run() {
+      std::vector<int> cpus = ThreadAffinity::getCurrentThreadCpus();
+
+      Synchronized s(_monitor);
+
+      _cpus = cpus;
+
+      if (--_count == 0) {
+        _monitor.notify();
+      }
+    }
+
+    Monitor& _monitor;
+    size_t& _count;
+    std::vector<int>& _cpus;
+  };
+
+  /**
+   * Affinity test.  Parse a CPU list and look up NUMA node 0.  Then start one
+   * thread more than there are CPUs this test may run on, round robin over
+   * those CPUs, and verify that each thread was pinned to its CPU.
+   */
+  bool affinityTest() {
+    int listed[] = {0, 1, 2, 5, 7, 8};
+    std::vector<int> parsed = ThreadAffinity::parseCpuList("0-2,5,7-8\n");
+    if (parsed.size() != 6 || !std::equal(parsed.begin(), parsed.end(), listed)) {
+      std::cout << "\t\t\tFailure! could not parse CPU list" << std::endl;
+      return false;
+    }
+
+    try {
+      ThreadAffinity::numaNode(-1);
+      std::cout << "\t\t\tFailure! found NUMA node -1" << std::endl;
+      return false;
+    } catch (InvalidArgumentException&) {
+      // expected
+    }
+    std::vector<int> node = ThreadAffinity::getNumaNodeCpus(0);
+    if (!node.empty() && ThreadAffinity::numaNode(0).getCpus() != node) {
+      std::cout << "\t\t\tFailure! wrong CPUs for NUMA node 0" << std::endl;
+      return false;
+    }
+
+    std::vector<int> allowed = ThreadAffinity::getCurrentThreadCpus();
+    if (allowed.empty()) {
+      std::cout << "\t\t\tSuccess! affinity not supported here" << std::endl;
+      return true;
+    }
+
+    PlatformThreadFactory threadFactory = PlatformThreadFactory();
+    threadFactory.setDetached(true);
+    threadFactory.setAffinity(ThreadAffinity::roundRobin(allowed));
+
+    Monitor monitor;
+    size_t count = allowed.size() + 1;
+    std::vector<std::vector<int> > cpus(count);
+    for (size_t ix = 0; ix < cpus.size(); ix++) {
+      threadFactory.newThread(shared_ptr<Runnable>(new AffinityTask(monitor, count, cpus[ix])))
+          ->start();
+    }
+
+    {
+      Synchronized s(monitor);
+      try {
+        while (count != 0) {
+          monitor.wait(1000);
+        }
+      } catch (TimedOutException&) {
+        std::cout << "\t\t\tFailure! threads did not finish" << std::endl;
+        return false;
+      }
+    }
+
+    for (size_t ix = 0; ix < cpus.size(); ix++) {
+      if (cpus[ix] != std::vector<int>(1, allowed[ix % allowed.size()])) {
+        std::cout << "\t\t\tFailure! thread " << ix << " not pinned" << std::endl;
+        return false;
+      }
+    }
+
+    std::cout << "\t\t\tSuccess! pinned " << cpus.size() << " threads to " << allowed.size()
+              << " CPUs" << std::endl;
+    return true;
+  }
 };
 
 const double ThreadFactoryTests::TEST_TOLERANCE = .20;
@@ -24,10 +24,12 @@
 #include <thrift/concurrency/Util.h>
 
 #include <assert.h>
+#include <algorithm>
 #include <set>
 #include <iostream>
 #include <set>
 #include <stdint.h>
+#include <vector>
 
 namespace apache {
 namespace thrift {
@@ -41,6 +43,14 @@ class ThreadManagerTests {
   static const double TEST_TOLERANCE;
 
 public:
+  ThreadManagerTests(bool workStealing = false) : _workStealing(workStealing) {}
+
+  shared_ptr<ThreadManager> newThreadManager(size_t workerCount, size_t pendingTaskCountMax = 0) {
+    return _workStealing
+               ? ThreadManager::newWorkStealingThreadManager(workerCount, pendingTaskCountMax)
+               : ThreadManager::newSimpleThreadManager(workerCount, pendingTaskCountMax);
+  }
+
   class Task : public Runnable {
 
   public:
@@ -101,7 +111,7 @@ public:
 
     size_t activeCount = count;
 
-    shared_ptr<ThreadManager> threadManager = ThreadManager::newSimpleThreadManager(workerCount);
+    shared_ptr<ThreadManager> threadManager = newThreadManager(workerCount);
 
     shared_ptr<PlatformThreadFactory> threadFactory
         = shared_ptr<PlatformThreadFactory>(new PlatformThreadFactory());
@@ -247,8 +257,7 @@ public:
 
       size_t activeCounts[] = {workerCount, pendingTaskMaxCount, 1};
 
-      shared_ptr<ThreadManager> threadManager
-          = ThreadManager::newSimpleThreadManager(workerCount, pendingTaskMaxCount);
+      shared_ptr<ThreadManager> threadManager = newThreadManager(workerCount, pendingTaskMaxCount);
 
       shared_ptr<PlatformThreadFactory> threadFactory
           = shared_ptr<PlatformThreadFactory>(new PlatformThreadFactory());
@@ -381,6 +390,485 @@ public:
     std::cout << "\t\t\t" << (success ? "Success" : "Failure") << std::endl;
     return success;
   }
+
+  class ExpireCounter {
+
+  public:
+    ExpireCounter(size_t& count) : _count(count) {}
+
+    void operator()(shared_ptr<Runnable>) { _count++; }
+
+    size_t& _count;
+  };
+
+  /**
+   * Expire test.  Keep the only worker busy while count tasks that may wait
+   * for one millisecond queue up behind it.  Verify that none of them runs,
+   * and that each is reported to the expire callback and counted as expired.
+   */
+  bool expireTest(size_t count = 10) {
+    Monitor bmonitor;
+    Monitor monitor;
+    size_t blockCount = 1;
+    size_t runCount = count;
+    size_t expiredCount = 0;
+
+    shared_ptr<ThreadManager> threadManager = newThreadManager(1);
+    threadManager->threadFactory(shared_ptr<PlatformThreadFactory>(new PlatformThreadFactory()));
+    threadManager->setExpireCallback(ExpireCounter(expiredCount));
+    threadManager->start();
+
+    threadManager->add(shared_ptr<Runnable>(new BlockTask(monitor, bmonitor, blockCount)));
+    // give the worker time to pick up the blocking task
+    THRIFT_SLEEP_USEC(100000);
+    for (size_t ix = 0; ix < count; ix++) {
+      threadManager->add(shared_ptr<Runnable>(new BlockTask(monitor, bmonitor, runCount)), 0, 1);
+    }
+    THRIFT_SLEEP_USEC(50000);
+
+    {
+      Synchronized s(bmonitor);
+      bmonitor.notifyAll();
+    }
+    {
+      Synchronized s(monitor);
+      while (blockCount != 0) {
+        monitor.wait();
+      }
+    }
+
+    // expired tasks go when the worker looks for its next task
+    for (int ix = 0; ix < 100 && threadManager->totalTaskCount() > 0; ix++) {
+      THRIFT_SLEEP_USEC(10000);
+    }
+
+    bool success = runCount == count && expiredCount == count
+                   && threadManager->expiredTaskCount() == count
+                   && threadManager->pendingTaskCount() == 0
+                   && threadManager->totalTaskCount() == 0;
+
+    std::cout << "\t\t\t" << (success ? "Success" : "Failure") << "! expired: " << expiredCount
+              << " run: " << count - runCount << std::endl;
+    return success;
+  }
+
+  /**
+   * Stats test.  Run count tasks of timeout milliseconds each on two workers.
+   * Verify that every task was timed, that they ran about as long as they
+   * slept, and that the later ones waited for a worker.
+   */
+  bool statsTest(size_t count = 20, int64_t timeout = 10LL) {
+    Monitor monitor;
+    size_t activeCount = count;
+
+    shared_ptr<ThreadManager> threadManager = newThreadManager(2);
+    threadManager->threadFactory(shared_ptr<PlatformThreadFactory>(new PlatformThreadFactory()));
+    threadManager->start();
+
+    for (size_t ix = 0; ix < count; ix++) {
+      threadManager->add(shared_ptr<Runnable>(new Task(monitor, activeCount, timeout)));
+    }
+
+    {
+      Synchronized s(monitor);
+      while (activeCount != 0) {
+        monitor.wait();
+      }
+    }
+
+    // a task is timed once its run() has returned
+    ThreadManager::TaskStats stats = threadManager->taskStats();
+    for (int ix = 0; ix < 100 && stats.runTime.count() < count; ix++) {
+      THRIFT_SLEEP_USEC(10000);
+      stats = threadManager->taskStats();
+    }
+
+    // timed waits have millisecond resolution and may end up to one early
+    bool success = stats.queueWait.count() == count && stats.runTime.count() == count
+                   && stats.runTime.mean() >= (timeout - 1) * 1000
+                   && stats.runTime.percentile(50) >= (timeout - 1) * 1000
+                   && stats.runTime.maximum() < 1000 * 1000
+                   && stats.queueWait.percentile(100) >= timeout * 1000;
+
+    std::cout << "\t\t\t" << (success ? "Success" : "Failure")
+              << "! run time mean: " << stats.runTime.mean()
+              << "us p50: " << stats.runTime.percentile(50)
+              << "us queue wait p50: " << stats.queueWait.percentile(50)
+              << "us p100: " << stats.queueWait.percentile(100) << "us" << std::endl;
+    return success;
+  }
+
+  class OrderTask : public Runnable {
+
+  public:
+    OrderTask(Monitor& monitor, std::vector<size_t>& order, size_t priority, int64_t delay = 0)
+      : _monitor(monitor), _order(order), _priority(priority), _delay(delay) {}
+
+    void run() {
+      if (_delay > 0) {
+        THRIFT_SLEEP_USEC(_delay * 1000);
+      }
+
+      Synchronized s(_monitor);
+
+      _order.push_back(_priority);
+
+      _monitor.notify();
+    }
+
+    Monitor& _monitor;
+    std::vector<size_t>& _order;
+    size_t _priority;
+    int64_t _delay;
+  };
+
+  /**
+   * Priority test.  Keep the only worker busy while four tasks of priority 1
+   * and then four of priority 0 queue up.  Verify that strict priority runs
+   * all of priority 0 first, and that weights of 3 and 1 interleave them.
+   */
+  bool priorityTest(bool weighted) {
+    Monitor monitor;
+    std::vector<size_t> order;
+
+    std::vector<size_t> weights;
+    weights.push_back(3);
+    weights.push_back(1);
+
+    shared_ptr<ThreadManager> threadManager
+        = weighted ? ThreadManager::newWeightedPriorityThreadManager(1, weights)
+                   : ThreadManager::newPriorityThreadManager(1, 2);
+    threadManager->threadFactory(shared_ptr<PlatformThreadFactory>(new PlatformThreadFactory()));
+    threadManager->start();
+
+    threadManager->add(shared_ptr<Runnable>(new OrderTask(monitor, order, 0, 100)), 0, 0, 0);
+    THRIFT_SLEEP_USEC(20000);
+    for (size_t priority = 2; priority > 0; priority--) {
+      for (size_t ix = 0; ix < 4; ix++) {
+        threadManager->add(shared_ptr<Runnable>(new OrderTask(monitor, order, priority - 1)),
+                           0,
+                           0,
+                           priority - 1);
+      }
+    }
+
+    {
+      Synchronized s(monitor);
+      try {
+        while (order.size() < 9) {
+          monitor.wait(1000);
+        }
+      } catch (TimedOutException&) {
+        // reported as a failure below
+      }
+    }
+
+    size_t strictOrder[] = {0, 0, 0, 0, 0, 1, 1, 1, 1};
+    size_t weightedOrder[] = {0, 0, 0, 1, 0, 0, 1, 1, 1};
+    size_t* expected = weighted ? weightedOrder : strictOrder;
+
+    bool success = threadManager->priorityCount() == 2 && order.size() == 9
+                   && std::equal(order.begin(), order.end(), expected);
+
+    std::cout << "\t\t\t" << (success ? "Success" : "Failure") << "! order:";
+    for (size_t ix = 0; ix < order.size(); ix++) {
+      std::cout << " " << order[ix];
+    }
+    std::cout << std::endl;
+    return success;
+  }
+
+  /**
+   * Batch test.  Keep the only worker busy while batches of tasks are added
+   * against a max pending task count of 4.  Verify that a batch is queued
+   * whole or not at all, and that every task queued runs.
+   */
+  bool batchTest() {
+    Monitor monitor;
+    std::vector<size_t> order;
+
+    shared_ptr<ThreadManager> threadManager = newThreadManager(1, 4);
+    threadManager->threadFactory(shared_ptr<PlatformThreadFactory>(new PlatformThreadFactory()));
+    threadManager->start();
+
+    threadManager->add(shared_ptr<Runnable>(new OrderTask(monitor, order, 0, 100)));
+    THRIFT_SLEEP_USEC(20000);
+
+    std::vector<shared_ptr<Runnable> > batch;
+    for (size_t ix = 1; ix <= 5; ix++) {
+      batch.push_back(shared_ptr<Runnable>(new OrderTask(monitor, order, ix)));
+    }
+
+    bool success = true;
+    try {
+      threadManager->add(batch, -1);
+      success = false;
+    } catch (TooManyPendingTasksException&) {
+      // can never fit
+    }
+
+    std::vector<shared_ptr<Runnable> > head(batch.begin(), batch.begin() + 3);
+    threadManager->add(head, -1);
+    success = success && threadManager->pendingTaskCount() == 3;
+
+    std::vector<shared_ptr<Runnable> > tail(batch.begin() + 3, batch.end());
+    try {
+      threadManager->add(tail, -1);
+      success = false;
+    } catch (TooManyPendingTasksException&) {
+      // does not fit next to the first batch
+    }
+    success = success && threadManager->pendingTaskCount() == 3;
+
+    tail.pop_back();
+    threadManager->add(tail, -1);
+    success = success && threadManager->pendingTaskCount() == 4;
+
+    {
+      Synchronized s(monitor);
+      try {
+        while (order.size() < 5) {
+          monitor.wait(1000);
+        }
+      } catch (TimedOutException&) {
+        // reported as a failure below
+      }
+    }
+
+    std::sort(order.begin(), order.end());
+    size_t expected[] = {0, 1, 2, 3, 4};
+    success = success && order.size() == 5 && std::equal(order.begin(), order.end(), expected);
+
+    std::cout << "\t\t\t" << (success ? "Success" : "Failure") << "! ran: " << order.size()
+              << std::endl;
+    return success;
+  }
+
+  class AddTask : public Runnable {
+
+  public:
+    AddTask(shared_ptr<ThreadManager> threadManager,
+            const std::vector<shared_ptr<Runnable> >& tasks,
+            Monitor& monitor,
+            std::vector<size_t>& order,
+            std::vector<size_t>& ranWhenAdded)
+      : _threadManager(threadManager),
+        _tasks(tasks),
+        _monitor(monitor),
+        _order(order),
+        _ranWhenAdded(ranWhenAdded) {}
+
+    void run() {
+      if (_tasks.size() == 1) {
+        _threadManager->add(_tasks[0]);
+      } else {
+        _threadManager->add(_tasks);
+      }
+
+      Synchronized s(_monitor);
+
+      _ranWhenAdded.push_back(_order.size());
+
+      _monitor.notify();
+    }
+
+    shared_ptr<ThreadManager> _threadManager;
+    std::vector<shared_ptr<Runnable> > _tasks;
+    Monitor& _monitor;
+    std::vector<size_t>& _order;
+    std::vector<size_t>& _ranWhenAdded;
+  };
+
+  /**
+   * Batch wait test.  With the only worker busy and a max pending task count
+   * of 2 reached, block a batch of 2 tasks and then a single task in add().
+   * The worker then takes a long task off the queue, which frees one slot.
+   * Verify that the single task is added while the long task runs, rather
+   * than after it, when the batch fits too.
+   */
+  bool batchWaitTest() {
+    Monitor monitor;
+    std::vector<size_t> order;
+    std::vector<size_t> ranWhenAdded;
+
+    shared_ptr<ThreadManager> threadManager = newThreadManager(1, 2);
+    shared_ptr<PlatformThreadFactory> threadFactory(new PlatformThreadFactory());
+    threadManager->threadFactory(threadFactory);
+    threadManager->start();
+
+    threadManager->add(shared_ptr<Runnable>(new OrderTask(monitor, order, 0, 200)));
+    THRIFT_SLEEP_USEC(20000);
+    threadManager->add(shared_ptr<Runnable>(new OrderTask(monitor, order, 1, 1000)));
+    threadManager->add(shared_ptr<Runnable>(new OrderTask(monitor, order, 2)));
+
+    std::vector<shared_ptr<Runnable> > batch;
+    batch.push_back(shared_ptr<Runnable>(new OrderTask(monitor, order, 3)));
+    batch.push_back(shared_ptr<Runnable>(new OrderTask(monitor, order, 4)));
+    shared_ptr<Thread> batchAdder = threadFactory->newThread(
+        shared_ptr<Runnable>(new AddTask(threadManager, batch, monitor, order, ranWhenAdded)));
+    batchAdder->start();
+    THRIFT_SLEEP_USEC(50000);
+
+    std::vector<shared_ptr<Runnable> > single(
+        1, shared_ptr<Runnable>(new OrderTask(monitor, order, 5)));
+    shared_ptr<Thread> singleAdder = threadFactory->newThread(
+        shared_ptr<Runnable>(new AddTask(threadManager, single, monitor, order, ranWhenAdded)));
+    singleAdder->start();
+
+    {
+      Synchronized s(monitor);
+      try {
+        while (order.size() < 6 || ranWhenAdded.size() < 2) {
+          monitor.wait(3000);
+        }
+      } catch (TimedOutException&) {
+        // reported as a failure below
+      }
+    }
+
+    // the single task was added first, before the long task finished
+    bool success = order.size() == 6 && ranWhenAdded.size() == 2 && ranWhenAdded[0] == 1;
+
+    std::cout << "\t\t\t" << (success ? "Success" : "Failure") << "! tasks run when added:";
+    for (size_t ix = 0; ix < ranWhenAdded.size(); ix++) {
+      std::cout << " " << ranWhenAdded[ix];
+    }
+    std::cout << std::endl;
+    return success;
+  }
+
+  class ResizeRecorder {
+
+  public:
+    ResizeRecorder(Monitor& monitor, std::vector<size_t>& sizes)
+      : _monitor(monitor), _sizes(sizes) {}
+
+    void operator()(const ThreadManager::PoolResize& resize) {
+      Synchronized s(_monitor);
+      _sizes.push_back(resize.newWorkerCount);
+      _monitor.notify();
+    }
+
+    Monitor& _monitor;
+    std::vector<size_t>& _sizes;
+  };
+
+  /**
+   * Pool size test.  Let a pool of one worker resize itself between 1 and 4
+   * workers while 16 tasks of 50 milliseconds queue up, then go idle.  Verify
+   * that it grew to 4 workers and shrank back to 1.  The work stealing
+   * thread manager has a fixed size and must refuse the policy.
+   */
+  bool poolSizeTest() {
+    Monitor monitor;
+    size_t activeCount = 16;
+    Monitor resizeMonitor;
+    std::vector<size_t> sizes;
+
+    shared_ptr<ThreadManager> threadManager = newThreadManager(1);
+    threadManager->threadFactory(shared_ptr<PlatformThreadFactory>(new PlatformThreadFactory()));
+    threadManager->start();
+
+    ThreadManager::PoolSizePolicy policy(1, 4, 10LL, 200LL, 20LL);
+    if (_workStealing) {
+      bool success = false;
+      try {
+        threadManager->setPoolSizePolicy(policy);
+      } catch (IllegalStateException&) {
+        success = true;
+      }
+      std::cout << "\t\t\t" << (success ? "Success" : "Failure") << std::endl;
+      return success;
+    }
+
+    threadManager->setPoolSizePolicy(policy, ResizeRecorder(resizeMonitor, sizes));
+    for (size_t ix = 0; ix < 16; ix++) {
+      threadManager->add(shared_ptr<Runnable>(new Task(monitor, activeCount, 50)));
+    }
+
+    {
+      Synchronized s(monitor);
+      while (activeCount != 0) {
+        monitor.wait();
+      }
+    }
+
+    size_t peak = 0;
+    {
+      Synchronized s(resizeMonitor);
+      try {
+        while (sizes.empty() || sizes.back() != 1) {
+          resizeMonitor.wait(2000);
+        }
+      } catch (TimedOutException&) {
+        // reported as a failure below
+      }
+      for (size_t ix = 0; ix < sizes.size(); ix++) {
+        peak = std::max(peak, sizes[ix]);
+      }
+    }
+
+    bool success = peak == 4 && sizes.back() == 1 && threadManager->workerCount() == 1;
+
+    std::cout << "\t\t\t" << (success ? "Success" : "Failure") << "! sizes:";
+    for (size_t ix = 0; ix < sizes.size(); ix++) {
+      std::cout << " " << sizes[ix];
+    }
+    std::cout << std::endl;
+    return success;
+  }
+
+  /**
+   * Pool shrink test.  Let a pool of 2 to 8 workers grow under bursts of
+   * short tasks and shrink while they run and in the idle time between them.
+   * Verify that the worker count never drops below 2 and that the pool still
+   * stops.  The work stealing thread manager has a fixed size.
+   */
+  bool poolShrinkTest(size_t bursts = 20) {
+    Monitor monitor;
+    size_t activeCount = 0;
+
+    shared_ptr<ThreadManager> threadManager = newThreadManager(2);
+    threadManager->threadFactory(shared_ptr<PlatformThreadFactory>(new PlatformThreadFactory()));
+    threadManager->start();
+    threadManager->setPoolSizePolicy(ThreadManager::PoolSizePolicy(2, 8, 1LL, 5LL, 2LL));
+
+    size_t fewest = threadManager->workerCount();
+    for (size_t burst = 0; burst < bursts; burst++) {
+      {
+        Synchronized s(monitor);
+        activeCount = 16;
+      }
+      for (size_t ix = 0; ix < 16; ix++) {
+        threadManager->add(shared_ptr<Runnable>(new Task(monitor, activeCount, 5)));
+      }
+
+      // watch the workers leave while the tasks finish and the pool goes idle
+      int64_t end = Util::currentTime() + 60;
+      while (true) {
+        fewest = std::min(fewest, threadManager->workerCount());
+        Synchronized s(monitor);
+        if (activeCount == 0 && Util::currentTime() >= end) {
+          break;
+        }
+        try {
+          monitor.wait(1);
+        } catch (TimedOutException&) {
+          // look again
+        }
+      }
+    }
+
+    threadManager->stop();
+
+    bool success = fewest >= 2;
+    std::cout << "\t\t\t" << (success ? "Success" : "Failure") << "! fewest workers: " << fewest
+              << std::endl;
+    return success;
+  }
+
+private:
+  bool _workStealing;
 };
 
 const double ThreadManagerTests::TEST_TOLERANCE = .20;
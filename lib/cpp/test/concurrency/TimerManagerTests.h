@@ -22,8 +22,10 @@
 #include <thrift/concurrency/Monitor.h>
 #include <thrift/concurrency/Util.h>
 
+#include <algorithm>
 #include <assert.h>
 #include <iostream>
+#include <vector>
 
 namespace apache {
 namespace thrift {
@@ -141,6 +143,174 @@ public:
     return true;
   }
 
+  class OrderTask : public Runnable {
+  public:
+    OrderTask(Monitor& monitor, std::vector<int64_t>& order, int64_t timeout)
+      : _monitor(monitor),
+        _order(order),
+        _timeout(timeout),
+        _dueTime(Util::currentTime() + timeout),
+        _early(false) {}
+
+    void run() {
+      _early = Util::currentTime() < _dueTime;
+
+      Synchronized s(_monitor);
+      _order.push_back(_timeout);
+      _monitor.notifyAll();
+    }
+
+    Monitor& _monitor;
+    std::vector<int64_t>& _order;
+    int64_t _timeout;
+    int64_t _dueTime;
+    bool _early;
+  };
+
+  /**
+   * This test adds two tasks and removes the first through its handle before
+   * it falls due.  It verifies that only the second one runs, and that
+   * neither the removed task nor the one that ran can be removed again.
+   */
+  bool test01(int64_t timeout = 100LL) {
+    std::vector<int64_t> order;
+
+    TimerManager timerManager;
+    timerManager.threadFactory(shared_ptr<PlatformThreadFactory>(new PlatformThreadFactory()));
+    timerManager.start();
+
+    TimerManager::Timer removed = timerManager.addTimer(
+        shared_ptr<Runnable>(new OrderTask(_monitor, order, timeout)), timeout);
+    TimerManager::Timer kept = timerManager.addTimer(
+        shared_ptr<Runnable>(new OrderTask(_monitor, order, 2 * timeout)), 2 * timeout);
+    assert(timerManager.taskCount() == 2);
+
+    timerManager.removeTimer(removed);
+    assert(timerManager.taskCount() == 1);
+
+    {
+      Synchronized s(_monitor);
+      while (order.empty()) {
+        _monitor.wait();
+      }
+    }
+    THRIFT_SLEEP_USEC(timeout * 1000);
+
+    bool success = order.size() == 1 && order[0] == 2 * timeout && timerManager.taskCount() == 0;
+
+    try {
+      timerManager.removeTimer(removed);
+      success = false;
+    } catch (NoSuchTaskException&) {
+    }
+    try {
+      timerManager.removeTimer(kept);
+      success = false;
+    } catch (NoSuchTaskException&) {
+    }
+
+    std::cout << "\t\t\t" << (success ? "Success" : "Failure") << "!" << std::endl;
+    return success;
+  }
+
+  /**
+   * This test adds tasks due in a few milliseconds to a few seconds, so that
+   * they start out on different levels of the timing wheel, and verifies that
+   * they run in order and none of them early.
+   */
+  bool test02() {
+    int64_t timeouts[] = {1300, 5, 600, 256, 1, 513, 70, 2048};
+    size_t count = sizeof(timeouts) / sizeof(timeouts[0]);
+    std::vector<int64_t> order;
+    std::vector<shared_ptr<OrderTask> > tasks;
+
+    TimerManager timerManager;
+    timerManager.threadFactory(shared_ptr<PlatformThreadFactory>(new PlatformThreadFactory()));
+    timerManager.start();
+
+    for (size_t ix = 0; ix < count; ix++) {
+      tasks.push_back(shared_ptr<OrderTask>(new OrderTask(_monitor, order, timeouts[ix])));
+      timerManager.add(tasks.back(), timeouts[ix]);
+    }
+
+    {
+      Synchronized s(_monitor);
+      while (order.size() < count) {
+        _monitor.wait();
+      }
+    }
+
+    bool success = timerManager.taskCount() == 0;
+    std::sort(timeouts, timeouts + count);
+    for (size_t ix = 0; ix < count; ix++) {
+      success = success && order[ix] == timeouts[ix] && !tasks[ix]->_early;
+    }
+
+    std::cout << "\t\t\t" << (success ? "Success" : "Failure") << "!" << std::endl;
+    return success;
+  }
+
+  /**
+   * Benchmark of adding and removing count tasks, none of which falls due in
+   * the meantime: adds them all, replaces each with a new one, and removes
+   * them all.
+   */
+  bool churnBenchmark(size_t count = 1000000) {
+    size_t runCount = 0;
+    shared_ptr<Runnable> task(new CountTask(_monitor, runCount));
+    std::vector<TimerManager::Timer> timers(count);
+    uint32_t random = 1;
+
+    TimerManager timerManager;
+    timerManager.threadFactory(shared_ptr<PlatformThreadFactory>(new PlatformThreadFactory()));
+    timerManager.start();
+
+    int64_t time00 = Util::currentTimeUsec();
+    for (size_t ix = 0; ix < count; ix++) {
+      timers[ix] = timerManager.addTimer(task, nextTimeout(random));
+    }
+    int64_t time01 = Util::currentTimeUsec();
+    for (size_t ix = 0; ix < count; ix++) {
+      timerManager.removeTimer(timers[ix]);
+      timers[ix] = timerManager.addTimer(task, nextTimeout(random));
+    }
+    int64_t time02 = Util::currentTimeUsec();
+    for (size_t ix = 0; ix < count; ix++) {
+      timerManager.removeTimer(timers[ix]);
+    }
+    int64_t time03 = Util::currentTimeUsec();
+
+    bool success = timerManager.taskCount() == 0 && runCount == 0;
+
+    std::cout << "\t\t\t" << (success ? "Success" : "Failure")
+              << "! add: " << (time01 - time00) * 1000 / static_cast<int64_t>(count)
+              << "ns replace: " << (time02 - time01) * 1000 / static_cast<int64_t>(count)
+              << "ns remove: " << (time03 - time02) * 1000 / static_cast<int64_t>(count) << "ns"
+              << std::endl;
+    return success;
+  }
+
+  class CountTask : public Runnable {
+  public:
+    CountTask(Monitor& monitor, size_t& count) : _monitor(monitor), _count(count) {}
+
+    void run() {
+      Synchronized s(_monitor);
+      _count++;
+    }
+
+    Monitor& _monitor;
+    size_t& _count;
+  };
+
+  /// A timeout of one minute to one hour, from an xorshift generator
+  static int64_t nextTimeout(uint32_t& random) {
+    random ^= random << 13;
+    random ^= random >> 17;
+    random ^= random << 5;
+    return 60 * 1000LL + random % (60 * 60 * 1000LL);
+  }
+
   friend class TestTask;
 
   Monitor _monitor;
@@ -376,3 +376,24 @@ struct TupleProtocolTestStruct {
 struct ListDoublePerf {
   1: list<double> field;
 }
+
+struct BlobViews {
+  1: binary (cpp.view = "true") blob;
+  2: string (cpp.view = "true") name = "unnamed";
+  3: list<binary (cpp.view = "true")> chunks;
+}
+
+struct LazyHolder {
+  1: i32 id;
+  2: OneOfEach payload (cpp.lazy = "true");
+  3: optional Bonk note (cpp.lazy = "true");
+  4: string tail;
+}
+
+struct UnorderedLookups {
+  1: map<string, i32> (cpp.unordered = "true") counts;
+  2: set<Bonk> (cpp.unordered = "true") bonks;
+  3: map<SomeEnum, list<string>> (cpp.unordered = "true") names;
+  4: optional map<i64, Bonk> (cpp.unordered = "true") by_id;
+  5: set<i32> ordered;
+}
@@ -0,0 +1,73 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+# Structs for StructTableTest.  With cpp:tables every struct except the
+# Expanded ones is read and written from tables; their unused cpp_type field
+# keeps the Expanded twins on the generated code, which the tests compare the
+# tables against.  Left unset, the unused field writes nothing.
+
+namespace cpp thrift.test.tables
+
+enum Color {
+  RED = 1,
+  GREEN = 2,
+  BLUE = 3,
+}
+
+struct Inner {
+  1: i32 value;
+  2: optional string name;
+}
+
+struct ExpandedInner {
+  1: i32 value;
+  2: optional string name;
+  99: optional list<i32> cpp_type "std::vector<int32_t>" unused;
+}
+
+struct Fields {
+  1: required i32 id;
+  2: optional string label;
+  3: i64 count;
+  4: list<Inner> inners;
+  5: map<string, i32> counts;
+  6: set<i16> tags;
+  7: Color color;
+  8: binary data;
+  9: double ratio;
+  10: bool flag;
+  11: i8 small;
+  12: optional Inner extra;
+}
+
+struct ExpandedFields {
+  1: required i32 id;
+  2: optional string label;
+  3: i64 count;
+  4: list<ExpandedInner> inners;
+  5: map<string, i32> counts;
+  6: set<i16> tags;
+  7: Color color;
+  8: binary data;
+  9: double ratio;
+  10: bool flag;
+  11: i8 small;
+  12: optional ExpandedInner extra;
+  99: optional list<i32> cpp_type "std::vector<int32_t>" unused;
+}